@@ -26,6 +26,14 @@
 #include <stasis/logger/logHandle.h>
 #include <stasis/logger/filePool.h>
 #include "mergeStats.h"
+#include "tracePoints.h"
+
+#include <algorithm>
+#include <vector>
+
+// Fire find_component once a lookup is done with a component.
+#define TRACE_COMPONENT(trace, comp) \
+    BLSM_TRACE3(find_component, (int)(comp), (trace).c[comp].hits, (trace).c[comp].datapages_read)
 
 // Backpressure reads to avoid merge starvation?  Experimental/short-term hack
 //#define BACKPRESSURE_READS
@@ -40,7 +48,7 @@ static inline double tv_to_double(struct timeval tv)
 // LOG TABLE IMPLEMENTATION
 /////////////////////////////////////////////////////////////////
 
-bLSM::bLSM(int log_mode, pageid_t max_c0_size, pageid_t internal_region_size, pageid_t datapage_region_size, pageid_t datapage_size)
+bLSM::bLSM(int log_mode, pageid_t max_c0_size, pageid_t internal_region_size, pageid_t datapage_region_size, pageid_t datapage_size, pageid_t row_cache_size)
 {
     recovering = true;
     this->max_c0_size = max_c0_size;
@@ -62,11 +70,18 @@ bLSM::bLSM(int log_mode, pageid_t max_c0_size, pageid_t internal_region_size, pa
     c1_flushing = false;
     current_timestamp = 0;
     expiry = 0;
+    range_filters = false;
     this->merge_mgr = 0;
     tmerger = new tupleMerger(&replace_merger);
+    row_cache = row_cache_size ? new rowCache(row_cache_size) : NULL;
+    prefix_extractor = NULL;
+    op_trace = NULL;
 
     header_mut = rwlc_initlock();
     pthread_mutex_init(&rb_mut, 0);
+    for(int i = 0; i < NUM_INSERT_STRIPES; i++) {
+      pthread_mutex_init(&insert_stripes[i], 0);
+    }
     pthread_cond_init(&c0_needed, 0);
     pthread_cond_init(&c0_ready, 0);
     pthread_cond_init(&c1_needed, 0);
@@ -102,12 +117,17 @@ bLSM::~bLSM()
     log_file->close(log_file);
 
     pthread_mutex_destroy(&rb_mut);
+    for(int i = 0; i < NUM_INSERT_STRIPES; i++) {
+      pthread_mutex_destroy(&insert_stripes[i]);
+    }
     rwlc_deletelock(header_mut);
     pthread_cond_destroy(&c0_needed);
     pthread_cond_destroy(&c0_ready);
     pthread_cond_destroy(&c1_needed);
     pthread_cond_destroy(&c1_ready);
     delete tmerger;
+    if(row_cache) delete row_cache;
+    if(prefix_extractor) delete prefix_extractor;
 }
 
 void bLSM::init_stasis() {
@@ -125,10 +145,10 @@ recordid bLSM::allocTable(int xid)
     table_rec = Talloc(xid, sizeof(tbl_header));
     mergeStats * stats = 0;
     //create the big tree
-    tree_c2 = new diskTreeComponent(xid, internal_region_size, datapage_region_size, datapage_size, stats, 10);
+    tree_c2 = new diskTreeComponent(xid, internal_region_size, datapage_region_size, datapage_size, stats, 10, prefix_extractor, range_filters);
 
     //create the small tree
-    tree_c1 = new diskTreeComponent(xid, internal_region_size, datapage_region_size, datapage_size, stats, 10);
+    tree_c1 = new diskTreeComponent(xid, internal_region_size, datapage_region_size, datapage_size, stats, 10, prefix_extractor, range_filters);
 
     merge_mgr = new mergeManager(this);
     merge_mgr->set_c0_size(max_c0_size);
@@ -156,9 +176,35 @@ void bLSM::openTable(int xid, recordid rid) {
 
 }
 
+// Operation codes for our log entries.  LOG_TUPLE entries hold one tuple;
+// LOG_TUPLE_BATCH entries hold an int32_t tuple count, followed by the tuples.
+static const int LOG_TUPLE = 0;
+static const int LOG_TUPLE_BATCH = 1;
+
 void bLSM::logUpdate(dataTuple * tup) {
   byte * buf = tup->to_bytes();
-  LogEntry * e = stasis_log_write_update(log_file, 0, INVALID_PAGE, 0/*Page**/, 0/*op*/, buf, tup->byte_length());
+  LogEntry * e = stasis_log_write_update(log_file, 0, INVALID_PAGE, 0/*Page**/, LOG_TUPLE, buf, tup->byte_length());
+  log_file->write_entry_done(log_file,e);
+  free(buf);
+}
+
+void bLSM::logUpdates(dataTuple ** tups, int tuple_count) {
+  if(tuple_count == 1) { logUpdate(tups[0]); return; }
+  int32_t count = tuple_count;
+  size_t len = sizeof(count);
+  for(int i = 0; i < tuple_count; i++) {
+    len += tups[i]->byte_length();
+  }
+  byte * buf = (byte*)malloc(len);
+  memcpy(buf, &count, sizeof(count));
+  size_t off = sizeof(count);
+  for(int i = 0; i < tuple_count; i++) {
+    byte * tbuf = tups[i]->to_bytes();
+    memcpy(buf + off, tbuf, tups[i]->byte_length());
+    off += tups[i]->byte_length();
+    free(tbuf);
+  }
+  LogEntry * e = stasis_log_write_update(log_file, 0, INVALID_PAGE, 0/*Page**/, LOG_TUPLE_BATCH, buf, len);
   log_file->write_entry_done(log_file,e);
   free(buf);
 }
@@ -170,9 +216,27 @@ void bLSM::replayLog() {
   while((e = nextInLog(lh))) {
     switch(e->type) {
     case UPDATELOG: {
-      dataTuple * tup = dataTuple::from_bytes((byte*)stasis_log_entry_update_args_cptr(e));
-      insertTuple(tup);
-      dataTuple::freetuple(tup);
+      const byte * buf = (const byte*)stasis_log_entry_update_args_cptr(e);
+      if(e->update.funcID == LOG_TUPLE_BATCH) {
+        int32_t count;
+        memcpy(&count, buf, sizeof(count));
+        buf += sizeof(count);
+        dataTuple ** tups = (dataTuple**)malloc(sizeof(tups[0]) * count);
+        for(int32_t i = 0; i < count; i++) {
+          tups[i] = dataTuple::from_bytes((byte*)buf);
+          buf += tups[i]->byte_length();
+        }
+        insertManyTuples(tups, count);
+        for(int32_t i = 0; i < count; i++) {
+          dataTuple::freetuple(tups[i]);
+        }
+        free(tups);
+      } else {
+        assert(e->update.funcID == LOG_TUPLE);
+        dataTuple * tup = dataTuple::from_bytes((byte*)buf);
+        insertTuple(tup);
+        dataTuple::freetuple(tup);
+      }
     } break;
     case INTERNALLOG: { } break;
     default: assert(e->type == UPDATELOG); abort();
@@ -219,6 +283,67 @@ void bLSM::update_persistent_header(int xid, lsn_t trunc_lsn) {
     Tset(xid, table_rec, &tbl_header);    
 }
 
+void bLSM::get_space_usage(uint64_t * treesize, uint64_t * filesize)
+{
+    int xid = Tbegin();
+
+    rwlc_readlock(header_mut);
+
+    pageid_t internal_c1_region_length, internal_c1_mergeable_region_length = 0, internal_c2_region_length;
+    pageid_t internal_c1_region_count,  internal_c1_mergeable_region_count = 0, internal_c2_region_count;
+    pageid_t *internal_c1_regions, *internal_c1_mergeable_regions = NULL, *internal_c2_regions;
+
+    pageid_t datapage_c1_region_length, datapage_c1_mergeable_region_length = 0, datapage_c2_region_length;
+    pageid_t datapage_c1_region_count,  datapage_c1_mergeable_region_count = 0, datapage_c2_region_count;
+    pageid_t *datapage_c1_regions, *datapage_c1_mergeable_regions = NULL, *datapage_c2_regions;
+
+    get_tree_c1()->list_regions(xid,
+                          &internal_c1_region_length, &internal_c1_region_count, &internal_c1_regions,
+                          &datapage_c1_region_length, &datapage_c1_region_count, &datapage_c1_regions);
+    if(get_tree_c1_mergeable()) {
+      get_tree_c1_mergeable()->list_regions(xid,
+                            &internal_c1_mergeable_region_length, &internal_c1_mergeable_region_count, &internal_c1_mergeable_regions,
+                            &datapage_c1_mergeable_region_length, &datapage_c1_mergeable_region_count, &datapage_c1_mergeable_regions);
+
+    }
+    get_tree_c2()->list_regions(xid,
+                          &internal_c2_region_length, &internal_c2_region_count, &internal_c2_regions,
+                          &datapage_c2_region_length, &datapage_c2_region_count, &datapage_c2_regions);
+
+
+    free(datapage_c1_regions);
+    free(datapage_c1_mergeable_regions);
+    free(datapage_c2_regions);
+
+    free(internal_c1_regions);
+    free(internal_c1_mergeable_regions);
+    free(internal_c2_regions);
+
+
+    *treesize = PAGE_SIZE *
+                ( ( datapage_c1_region_count           * datapage_c1_region_length )
+                + ( datapage_c1_mergeable_region_count * datapage_c1_mergeable_region_length )
+                + ( datapage_c2_region_count           * datapage_c2_region_length)
+                + ( internal_c1_region_count           * internal_c1_region_length )
+                + ( internal_c1_mergeable_region_count * internal_c1_mergeable_region_length )
+                + ( internal_c2_region_count           * internal_c2_region_length) );
+
+    boundary_tag tag;
+    pageid_t pid = ROOT_RECORD.page;
+    TregionReadBoundaryTag(xid, pid, &tag);
+    uint64_t max_off = 0;
+    do {
+        max_off = pid + tag.size;
+        ;
+    } while(TregionNextBoundaryTag(xid, &pid, &tag, 0/*all allocation managers*/));
+
+    rwlc_unlock(header_mut);
+
+    Tcommit(xid);
+
+    *filesize = max_off * PAGE_SIZE;
+}
+
 void bLSM::flushTable()
 {
     struct timeval start_tv, stop_tv;
@@ -248,7 +373,7 @@ void bLSM::flushTable()
     }
     set_c0_is_merging(true);
 
-    merge_mgr->get_merge_stats(0)->handed_off_tree();
+    merge_mgr->handed_off_tree(0);
     merge_mgr->new_merge(0);
 
     gettimeofday(&stop_tv,0);
@@ -277,6 +402,28 @@ void bLSM::flushTable()
     c0_flushing = false;
 }
 
+void bLSM::flushTableAndWait()
+{
+    // flushTable() only tells the C0-C1 merger not to wait for C0 to fill up
+    // before it finishes its current pass, and that pass may have started
+    // after some of C0's keys, so keep flushing until C0 is empty.
+    rwlc_writelock(header_mut);
+    while(is_still_running()) {
+      pthread_mutex_lock(&rb_mut);
+      bool empty = get_tree_c0()->empty();
+      pthread_mutex_unlock(&rb_mut);
+      if(empty) { break; }
+      flushTable();
+      // flushTable() clears c0_flushing before the merge is done.
+      c0_flushing = true;
+      while(get_c0_is_merging() && is_still_running()) {
+        rwlc_cond_wait(&c0_needed, header_mut);
+      }
+      if(is_still_running()) { c0_flushing = false; }
+    }
+    rwlc_unlock(header_mut);
+}
+
 dataTuple * bLSM::findTuple(int xid, const dataTuple::key_t key, size_t keySize)
 {
     // Apply proportional backpressure to reads as well as writes.  This prevents
@@ -285,6 +432,15 @@ dataTuple * bLSM::findTuple(int xid, const dataTuple::key_t key, size_t keySize)
   merge_mgr->tick(merge_mgr->get_merge_stats(0));
 #endif
 
+    uint64_t cache_version = 0;
+    dataTuple *cached_tuple;
+    if(row_cache && row_cache->lookup(key, keySize, &cached_tuple, &cache_version)) {
+        read_stats.record_row_cache_hit();
+        return cached_tuple;
+    }
+    readStats::lookup_t trace;
+    BLSM_TRACE2(find_start, key, keySize);
+
   //prepare a search tuple
     dataTuple *search_tuple = dataTuple::create(key, keySize);
 
@@ -294,12 +450,15 @@ dataTuple * bLSM::findTuple(int xid, const dataTuple::key_t key, size_t keySize)
     dataTuple *ret_tuple=0; 
 
     //step 1: look in tree_c0
+    trace.c[readStats::C0].probes++;
     memTreeComponent::rbtree_t::iterator rbitr = get_tree_c0()->find(search_tuple);
     if(rbitr != get_tree_c0()->end())
     {
         DEBUG("tree_c0 size %d\n", get_tree_c0()->size());
+        trace.c[readStats::C0].hits++;
         ret_tuple = (*rbitr)->create_copy();
     }
+    TRACE_COMPONENT(trace, readStats::C0);
 
     pthread_mutex_unlock(&rb_mut);
     rwlc_readlock(header_mut);  // XXX: FIXME with optimisitic concurrency control.  Has to be before rb_mut, or we could merge the tuple with itself due to an intervening merge
@@ -309,7 +468,10 @@ dataTuple * bLSM::findTuple(int xid, const dataTuple::key_t key, size_t keySize)
     if(get_tree_c0_mergeable() != 0)
     {
         DEBUG("old mem tree not null %d\n", (*(mergedata->old_c0))->size());
+        trace.c[readStats::C0_MERGEABLE].probes++;
         rbitr = get_tree_c0_mergeable()->find(search_tuple);
+        trace.c[readStats::C0_MERGEABLE].hits += (rbitr != get_tree_c0_mergeable()->end());
+        TRACE_COMPONENT(trace, readStats::C0_MERGEABLE);
         if(rbitr != get_tree_c0_mergeable()->end())
         {
             dataTuple *tuple = *rbitr;
@@ -334,7 +496,8 @@ dataTuple * bLSM::findTuple(int xid, const dataTuple::key_t key, size_t keySize)
     if(!done && get_tree_c1_prime() != 0)
     {
         DEBUG("old c1 tree not null\n");
-        dataTuple *tuple_oc1 = get_tree_c1_prime()->findTuple(xid, key, keySize);
+        dataTuple *tuple_oc1 = get_tree_c1_prime()->findTuple(xid, key, keySize, &trace.c[readStats::C1_PRIME]);
+        TRACE_COMPONENT(trace, readStats::C1_PRIME);
 
         if(tuple_oc1 != NULL)
         {
@@ -363,7 +526,8 @@ dataTuple * bLSM::findTuple(int xid, const dataTuple::key_t key, size_t keySize)
     //step 3: check c1
     if(!done)
     {
-        dataTuple *tuple_c1 = get_tree_c1()->findTuple(xid, key, keySize);
+        dataTuple *tuple_c1 = get_tree_c1()->findTuple(xid, key, keySize, &trace.c[readStats::C1]);
+        TRACE_COMPONENT(trace, readStats::C1);
         if(tuple_c1 != NULL)
         {
             bool use_copy = false;
@@ -392,7 +556,8 @@ dataTuple * bLSM::findTuple(int xid, const dataTuple::key_t key, size_t keySize)
     if(!done && get_tree_c1_mergeable() != 0)
     {
         DEBUG("old c1 tree not null\n");
-        dataTuple *tuple_oc1 = get_tree_c1_mergeable()->findTuple(xid, key, keySize);
+        dataTuple *tuple_oc1 = get_tree_c1_mergeable()->findTuple(xid, key, keySize, &trace.c[readStats::C1_MERGEABLE]);
+        TRACE_COMPONENT(trace, readStats::C1_MERGEABLE);
         
         if(tuple_oc1 != NULL)
         {
@@ -422,7 +587,8 @@ dataTuple * bLSM::findTuple(int xid, const dataTuple::key_t key, size_t keySize)
     if(!done)
     {
         DEBUG("Not in old first disk tree\n");        
-        dataTuple *tuple_c2 = get_tree_c2()->findTuple(xid, key, keySize);
+        dataTuple *tuple_c2 = get_tree_c2()->findTuple(xid, key, keySize, &trace.c[readStats::C2]);
+        TRACE_COMPONENT(trace, readStats::C2);
 
         if(tuple_c2 != NULL)
         {
@@ -449,7 +615,10 @@ dataTuple * bLSM::findTuple(int xid, const dataTuple::key_t key, size_t keySize)
     }     
 
     rwlc_unlock(header_mut);
+    read_stats.record(&trace);
+    BLSM_TRACE1(find_done, ret_tuple != NULL && !ret_tuple->isDelete());
     dataTuple::freetuple(search_tuple);
+    if(row_cache) row_cache->fill(key, keySize, ret_tuple, cache_version);
     if (ret_tuple != NULL && ret_tuple->isDelete()) {
         // this is a tombstone. don't return it
         dataTuple::freetuple(ret_tuple);
@@ -471,6 +640,15 @@ dataTuple * bLSM::findTuple_first(int xid, dataTuple::key_t key, size_t keySize)
     merge_mgr->tick(merge_mgr->get_merge_stats(0));
 #endif
 
+    uint64_t cache_version = 0;
+    dataTuple *cached_tuple;
+    if(row_cache && row_cache->lookup(key, keySize, &cached_tuple, &cache_version)) {
+        read_stats.record_row_cache_hit();
+        return cached_tuple;
+    }
+    readStats::lookup_t trace;
+    BLSM_TRACE2(find_start, key, keySize);
+
     //prepare a search tuple
     dataTuple * search_tuple = dataTuple::create(key, keySize);
 
@@ -479,11 +657,14 @@ dataTuple * bLSM::findTuple_first(int xid, dataTuple::key_t key, size_t keySize)
 
     pthread_mutex_lock(&rb_mut);
 
+    trace.c[readStats::C0].probes++;
     memTreeComponent::rbtree_t::iterator rbitr = get_tree_c0()->find(search_tuple);
     if(rbitr != get_tree_c0()->end())
     {
         DEBUG("tree_c0 size %d\n", tree_c0->size());
+        trace.c[readStats::C0].hits++;
         ret_tuple = (*rbitr)->create_copy();
+        TRACE_COMPONENT(trace, readStats::C0);
 
         pthread_mutex_unlock(&rb_mut);
         
@@ -491,6 +672,7 @@ dataTuple * bLSM::findTuple_first(int xid, dataTuple::key_t key, size_t keySize)
     else
     {
         DEBUG("Not in mem tree %d\n", tree_c0->size());
+        TRACE_COMPONENT(trace, readStats::C0);
 
         pthread_mutex_unlock(&rb_mut);
 
@@ -500,11 +682,14 @@ dataTuple * bLSM::findTuple_first(int xid, dataTuple::key_t key, size_t keySize)
         if(get_tree_c0_mergeable() != NULL)
         {
             DEBUG("old mem tree not null %d\n", (*(mergedata->old_c0))->size());
+            trace.c[readStats::C0_MERGEABLE].probes++;
             rbitr = get_tree_c0_mergeable()->find(search_tuple);
             if(rbitr != get_tree_c0_mergeable()->end())
             {
+                trace.c[readStats::C0_MERGEABLE].hits++;
                 ret_tuple = (*rbitr)->create_copy();
             }            
+            TRACE_COMPONENT(trace, readStats::C0_MERGEABLE);
         }
 
         if(ret_tuple == 0)
@@ -515,7 +700,8 @@ dataTuple * bLSM::findTuple_first(int xid, dataTuple::key_t key, size_t keySize)
             if( get_tree_c1_prime() != 0)
             {
               DEBUG("old c1 tree not null\n");
-              ret_tuple = get_tree_c1_prime()->findTuple(xid, key, keySize);
+              ret_tuple = get_tree_c1_prime()->findTuple(xid, key, keySize, &trace.c[readStats::C1_PRIME]);
+              TRACE_COMPONENT(trace, readStats::C1_PRIME);
             }
 
         }
@@ -525,7 +711,8 @@ dataTuple * bLSM::findTuple_first(int xid, dataTuple::key_t key, size_t keySize)
             DEBUG("Not in old mem tree\n");
 
             //step 3: check c1
-            ret_tuple = get_tree_c1()->findTuple(xid, key, keySize);
+            ret_tuple = get_tree_c1()->findTuple(xid, key, keySize, &trace.c[readStats::C1]);
+            TRACE_COMPONENT(trace, readStats::C1);
         }
 
         if(ret_tuple == 0)
@@ -536,7 +723,8 @@ dataTuple * bLSM::findTuple_first(int xid, dataTuple::key_t key, size_t keySize)
             if( get_tree_c1_mergeable() != 0)
             {
               DEBUG("old c1 tree not null\n");
-              ret_tuple = get_tree_c1_mergeable()->findTuple(xid, key, keySize);
+              ret_tuple = get_tree_c1_mergeable()->findTuple(xid, key, keySize, &trace.c[readStats::C1_MERGEABLE]);
+              TRACE_COMPONENT(trace, readStats::C1_MERGEABLE);
             }
                 
         }
@@ -546,12 +734,16 @@ dataTuple * bLSM::findTuple_first(int xid, dataTuple::key_t key, size_t keySize)
             DEBUG("Not in old first disk tree\n");
 
             //step 5: check c2
-            ret_tuple = get_tree_c2()->findTuple(xid, key, keySize);
+            ret_tuple = get_tree_c2()->findTuple(xid, key, keySize, &trace.c[readStats::C2]);
+            TRACE_COMPONENT(trace, readStats::C2);
         }
         rwlc_unlock(header_mut);
     }
 
+    read_stats.record(&trace);
+    BLSM_TRACE1(find_done, ret_tuple != NULL && !ret_tuple->isDelete());
     dataTuple::freetuple(search_tuple);
+    if(row_cache) row_cache->fill(key, keySize, ret_tuple, cache_version);
 
     if (ret_tuple != NULL && ret_tuple->isDelete()) {
         // this is a tombstone. don't return it
@@ -563,8 +755,43 @@ dataTuple * bLSM::findTuple_first(int xid, dataTuple::key_t key, size_t keySize)
 
 }
 
+bool bLSM::findTuple_inMemory(dataTuple::key_t key, size_t keySize, dataTuple ** ret)
+{
+    uint64_t cache_version = 0;
+    if(row_cache && row_cache->lookup(key, keySize, ret, &cache_version)) {
+        read_stats.record_row_cache_hit();
+        return true;
+    }
+
+    dataTuple * search_tuple = dataTuple::create(key, keySize);
+    dataTuple * ret_tuple = 0;
+
+    pthread_mutex_lock(&rb_mut);
+    memTreeComponent::rbtree_t::iterator rbitr = get_tree_c0()->find(search_tuple);
+    if(rbitr != get_tree_c0()->end()) {
+        ret_tuple = (*rbitr)->create_copy();
+    }
+    pthread_mutex_unlock(&rb_mut);
+
+    dataTuple::freetuple(search_tuple);
+    // Misses are accounted for by the findTuple() call that follows.
+    if(ret_tuple == 0) { return false; }
+    readStats::lookup_t trace;
+    trace.c[readStats::C0].probes++;
+    trace.c[readStats::C0].hits++;
+    read_stats.record(&trace);
+
+    if(ret_tuple->isDelete()) {
+        dataTuple::freetuple(ret_tuple);
+        ret_tuple = 0;
+    }
+    *ret = ret_tuple;
+    return true;
+}
+
 dataTuple * bLSM::insertTupleHelper(dataTuple *tuple)
 {
+  dataTuple * user_tuple = tuple;
   bool need_free = false;
   if(!tuple->isDelete() && expiry != 0) {
     // XXX hack for paper experiment
@@ -608,25 +835,118 @@ dataTuple * bLSM::insertTupleHelper(dataTuple *tuple)
   }
   pthread_mutex_unlock(&rb_mut);
 
+  // Must happen after the c0 insertion; see rowCache::fill().
+  if(row_cache) { row_cache->invalidate(user_tuple->strippedkey(), user_tuple->strippedkeylen()); }
+
   if(need_free) { dataTuple::freetuple(tuple); }
 
   return pre_t;
 }
 
-void bLSM::insertManyTuples(dataTuple ** tuples, int tuple_count) {
-  for(int i = 0; i < tuple_count; i++) {
-    merge_mgr->read_tuple_from_small_component(0, tuples[i]);
+namespace {
+struct probe_key_lt {
+  dataTuple ** keys;
+  bool operator() (int a, int b) const { return dataTuple::compare_obj(keys[a], keys[b]) < 0; }
+};
+// Resolve the pending keys that find() has a version of, and remove them from pending.
+template<class FIND>
+void probe_component(FIND find, dataTuple ** keys, bool * exists, std::vector<int> * pending) {
+  unsigned int j = 0;
+  for(unsigned int i = 0; i < pending->size(); i++) {
+    int k = (*pending)[i];
+    dataTuple * t = find(keys[k]);
+    if(t) {
+      exists[k] = !t->isDelete();
+    } else {
+      (*pending)[j++] = k;
+    }
   }
+  pending->resize(j);
+}
+struct find_mem {
+  memTreeComponent::rbtree_ptr_t tree;
+  // Returns a pointer into the tree; only used while the tree is locked.
+  dataTuple * operator() (dataTuple * key) const {
+    memTreeComponent::rbtree_t::iterator it = tree->find(key);
+    return it == tree->end() ? NULL : *it;
+  }
+};
+struct find_disk {
+  diskTreeComponent * tree;
+  std::vector<dataTuple*> * found;
+  // Consults the component's bloom filter before touching its pages.
+  dataTuple * operator() (dataTuple * key) const {
+    dataTuple * t = tree->findTuple(-1, key->strippedkey(), key->strippedkeylen());
+    if(t) { found->push_back(t); }
+    return t;
+  }
+};
+}
+
+void bLSM::probeTuples(dataTuple ** keys, int key_count, bool * exists) {
+  std::vector<int> pending;
+  for(int i = 0; i < key_count; i++) {
+    exists[i] = false;
+    uint64_t cache_version;
+    dataTuple * cached;
+    if(row_cache && row_cache->lookup(keys[i]->strippedkey(), keys[i]->strippedkeylen(), &cached, &cache_version)) {
+      if(cached) {
+        exists[i] = !cached->isDelete();
+        dataTuple::freetuple(cached);
+      }
+    } else {
+      pending.push_back(i);
+    }
+  }
+  if(pending.empty()) { return; }
+  // Probe the disk components in key order.
+  probe_key_lt lt = { keys };
+  std::sort(pending.begin(), pending.end(), lt);
+
+  // Newest component first; the first version we find wins.
+  find_mem mem;
+  pthread_mutex_lock(&rb_mut);
+  mem.tree = get_tree_c0();
+  probe_component(mem, keys, exists, &pending);
+  pthread_mutex_unlock(&rb_mut);
+  if(pending.empty()) { return; }
+
+  std::vector<dataTuple*> found;
+  rwlc_readlock(header_mut);
+  if(get_tree_c0_mergeable()) {
+    mem.tree = get_tree_c0_mergeable();
+    probe_component(mem, keys, exists, &pending);
+  }
+  diskTreeComponent * disk[] = { get_tree_c1_prime(), get_tree_c1(), get_tree_c1_mergeable(), get_tree_c2() };
+  for(unsigned int i = 0; i < sizeof(disk)/sizeof(disk[0]) && !pending.empty(); i++) {
+    if(!disk[i]) { continue; }
+    find_disk d = { disk[i], &found };
+    probe_component(d, keys, exists, &pending);
+  }
+  rwlc_unlock(header_mut);
+  for(unsigned int i = 0; i < found.size(); i++) {
+    dataTuple::freetuple(found[i]);
+  }
+}
+
+void bLSM::insertManyTuples(dataTuple ** tuples, int tuple_count) {
+  BLSM_TRACE1(insert_many_start, tuple_count);
   if(log_mode && !recovering) {
-	  for(int i = 0; i < tuple_count; i++) {
-	    logUpdate(tuples[i]);
-	  }
+	  logUpdates(tuples, tuple_count);
 	  batch_size ++;
 	  if(batch_size >= log_mode) {
+		  BLSM_TRACE0(log_force_start);
 		  log_file->force_tail(log_file, LOG_FORCE_COMMIT);
+		  BLSM_TRACE0(log_force_done);
 		  batch_size = 0;
 	  }
   }
+  // One backpressure tick for the whole batch.  Do this without holding any locks!
+  pageid_t bytes = 0;
+  for(int i = 0; i < tuple_count; i++) {
+    bytes += tuples[i]->byte_length();
+  }
+  merge_mgr->read_tuple_from_small_component(0, tuple_count, bytes);
 
   int num_old_tups = 0;
   pageid_t sum_old_tup_lens = 0;
@@ -640,15 +960,19 @@ void bLSM::insertManyTuples(dataTuple ** tuples, int tuple_count) {
   }
 
   merge_mgr->read_tuple_from_large_component(0, num_old_tups, sum_old_tup_lens);
+  BLSM_TRACE1(insert_many_done, tuple_count);
 }
 
 void bLSM::insertTuple(dataTuple *tuple)
 {
+    BLSM_TRACE2(insert_start, tuple->strippedkey(), tuple->strippedkeylen());
     if(log_mode && !recovering) {
         logUpdate(tuple);
         batch_size++;
         if(batch_size >= log_mode) {
+        	BLSM_TRACE0(log_force_start);
         	log_file->force_tail(log_file, LOG_FORCE_COMMIT);
+        	BLSM_TRACE0(log_force_done);
         	batch_size = 0;
         }
     }
@@ -667,6 +991,7 @@ void bLSM::insertTuple(dataTuple *tuple)
     }
 
     DEBUG("tree size %d tuples %lld bytes.\n", tsize, tree_bytes);
+    BLSM_TRACE2(insert_done, tuple->strippedkey(), tuple->strippedkeylen());
 }
 
 bool bLSM::testAndSetTuple(dataTuple *tuple, dataTuple *tuple2)
@@ -697,6 +1022,53 @@ bool bLSM::testAndSetTuple(dataTuple *tuple, dataTuple *tuple2)
     return succ;
 }
 
+bool bLSM::insertTupleIfAbsent(dataTuple *tuple)
+{
+    // Block for backpressure before taking the stripe lock, so that we don't
+    // sleep while holding it.  (insertTuple() ticks again, but C0 won't have
+    // grown much in the mean time.)
+    merge_mgr->tick(merge_mgr->get_merge_stats(0));
+
+    pthread_mutex_t * stripe = &insert_stripes[insert_stripe(tuple)];
+    pthread_mutex_lock(stripe);
+    bool exists;
+    probeTuples(&tuple, 1, &exists);
+    if(!exists) insertTuple(tuple);
+    pthread_mutex_unlock(stripe);
+    return !exists;
+}
+
+bool bLSM::insertManyTuplesIfAbsent(dataTuple **tuples, int tuple_count)
+{
+    // As in insertTupleIfAbsent(), apply backpressure before locking.
+    merge_mgr->tick(merge_mgr->get_merge_stats(0));
+
+    // Lock each stripe once, in increasing order, so that concurrent batches can't deadlock.
+    std::vector<int> stripes(tuple_count);
+    for(int i = 0; i < tuple_count; i++) {
+      stripes[i] = insert_stripe(tuples[i]);
+    }
+    std::sort(stripes.begin(), stripes.end());
+    stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+    for(unsigned int i = 0; i < stripes.size(); i++) {
+      pthread_mutex_lock(&insert_stripes[stripes[i]]);
+    }
+
+    bool * exists = new bool[tuple_count];
+    probeTuples(tuples, tuple_count, exists);
+    bool succ = true;
+    for(int i = 0; i < tuple_count && succ; i++) {
+      succ = !exists[i];
+    }
+    delete [] exists;
+    if(succ) insertManyTuples(tuples, tuple_count);
+
+    for(unsigned int i = 0; i < stripes.size(); i++) {
+      pthread_mutex_unlock(&insert_stripes[stripes[i]]);
+    }
+    return succ;
+}
+
 void bLSM::registerIterator(iterator * it) {
   its.push_back(it);
 }
@@ -28,6 +28,11 @@
 #include "tupleMerger.h"
 #include "mergeManager.h"
 #include "mergeStats.h"
+#include "rowCache.h"
+#include "latencyStats.h"
+#include "readStats.h"
+#include "opTrace.h"
+#include "prefixExtractor.h"
 
 class bLSM {
 public:
@@ -45,7 +50,9 @@ public:
   //  6GB ~= 100B * 500 GB / (datapage_size * 4KB)
   //  (100B * 500GB) / (6GB * 4KB) = 2.035
   // RCS: Set this to 1 so that we do (on average) one seek per b-tree read.
-  bLSM(int log_mode = 0, pageid_t max_c0_size = 100 * 1024 * 1024, pageid_t internal_region_size = 16384, pageid_t datapage_region_size = 256000, pageid_t datapage_size = 1);
+  //
+  // row_cache_size is the memory budget (in bytes) of the cache in front of findTuple.  Zero (the default) disables it.
+  bLSM(int log_mode = 0, pageid_t max_c0_size = 100 * 1024 * 1024, pageid_t internal_region_size = 16384, pageid_t datapage_region_size = 256000, pageid_t datapage_size = 1, pageid_t row_cache_size = 0);
 
     ~bLSM();
 
@@ -55,6 +62,15 @@ public:
     dataTuple * findTuple(int xid, const dataTuple::key_t key, size_t keySize);
 
     dataTuple * findTuple_first(int xid, dataTuple::key_t key, size_t keySize);
+    /**
+     * Like findTuple_first, but only consults the row cache and C0, so it
+     * never blocks on disk, merges or backpressure.
+     *
+     * @return false if the answer is not in memory; the caller should fall
+     * back to findTuple_first.  Otherwise, *ret is set to a copy of the
+     * tuple (which the caller must free), or NULL if the key does not exist.
+     */
+    bool findTuple_inMemory(dataTuple::key_t key, size_t keySize, dataTuple ** ret);
 
 private:
     dataTuple * insertTupleHelper(dataTuple *tuple);
@@ -67,14 +83,61 @@ public:
      * 2) If tuple2 is not null, it looks at tuple2's key instead of tuple's key.  This means you can atomically set the value of one key based on the value of another (if you want to...)
      */
     bool testAndSetTuple(struct dataTuple *tuple, struct dataTuple *tuple2);
+    /**
+     * Insert tuple unless its key already exists (a tombstone does not count).
+     * Most keys miss C0 and every bloom filter, so this usually costs no disk
+     * reads.  Like testAndSetTuple, this is atomic with respect to other
+     * insertTupleIfAbsent (and insertManyTuplesIfAbsent) calls, but not plain
+     * inserts.  Calls on different
+     * keys rarely contend; they only share one of NUM_INSERT_STRIPES locks.
+     *
+     * @return true if the tuple was inserted.
+     */
+    bool insertTupleIfAbsent(struct dataTuple *tuple);
+    /**
+     * Insert a batch of tuples unless any of their keys already exists.  This
+     * takes the batch's stripe locks (in order) across the check and the
+     * insert, so it is atomic with respect to insertTupleIfAbsent and other
+     * insertManyTuplesIfAbsent calls.  The caller must make sure that the
+     * batch doesn't contain the same key twice.
+     *
+     * @return true if the batch was inserted.
+     */
+    bool insertManyTuplesIfAbsent(struct dataTuple **tuples, int tuple_count);
 
     //other class functions
     recordid allocTable(int xid);
     void openTable(int xid, recordid rid);
     void flushTable();    
+    /**
+     * Merge everything in C0 into C1, and wait until it is there.  Unlike
+     * flushTable(), the caller must not hold header_mut.
+     *
+     * Returns early if the table shuts down.
+     */
+    void flushTableAndWait();
+    /**
+     * @param treesize is set to the bytes allocated to the disk components
+     *                 (C1, C1 mergeable and C2, including internal nodes).
+     * @param filesize is set to the size of the page file, up to the last
+     *                 allocated region.
+     */
+    void get_space_usage(uint64_t * treesize, uint64_t * filesize);
 
     void replayLog();
     void logUpdate(dataTuple * tup);
+    /** Write a batch of tuples to the log as a single entry. */
+    void logUpdates(dataTuple ** tups, int tuple_count);
+    /**
+     * Check whether each of a batch of keys currently exists (i.e., its most
+     * recent version is not a tombstone).  This amortizes locking across the
+     * batch, and only reads disk components whose bloom filter contains the
+     * key.
+     *
+     * @param keys are only used for their keys.
+     * @param exists is set to true for each key that exists.
+     */
+    void probeTuples(dataTuple ** keys, int key_count, bool * exists);
 
     static void init_stasis();
     static void deinit_stasis();
@@ -112,6 +175,24 @@ public:
     void update_persistent_header(int xid, lsn_t log_trunc = INVALID_LSN);
 
     inline tupleMerger * gettuplemerger(){return tmerger;}
+    inline rowCache * get_row_cache(){return row_cache;}
+    /** Latency histograms for client operations, which the server fills in. */
+    inline latencyStats * get_latency_stats(){return &latency_stats;}
+    /** Per-component read amplification and bloom filter counters for point lookups. */
+    inline readStats * get_read_stats(){return &read_stats;}
+    /** The servers record client operations here, if it is not NULL. */
+    inline opTrace * get_op_trace(){return op_trace;}
+    /** The caller retains ownership of t, and must clear it before deleting it. */
+    void set_op_trace(opTrace * t){op_trace = t;}
+    inline const prefixExtractor * get_prefix_extractor(){return prefix_extractor;}
+    /**
+     * Build prefix bloom filters for new disk components, so that prefix
+     * bounded iterators can skip components that do not contain the prefix.
+     * Call before allocTable() or openTable(); the table takes ownership of
+     * p.  Components written before the extractor was set have no prefix
+     * filter, and are never skipped.
+     */
+    void set_prefix_extractor(prefixExtractor * p){assert(!prefix_extractor); prefix_extractor = p;}
     
 public:
 
@@ -128,6 +209,11 @@ public:
     rwlc * header_mut;
     pthread_mutex_t tick_mut;
     pthread_mutex_t rb_mut;
+    static const int NUM_INSERT_STRIPES = 64;
+    pthread_mutex_t insert_stripes[NUM_INSERT_STRIPES]; // serialize insertTupleIfAbsent() by key
+    int insert_stripe(dataTuple * tuple) {
+      return stasis_crc32(tuple->strippedkey(), tuple->strippedkeylen(), 0) % NUM_INSERT_STRIPES;
+    }
     int64_t max_c0_size;
     // these track the effectiveness of snowshoveling
     int64_t mean_c0_run_length;
@@ -173,6 +259,7 @@ public:
 
     lsn_t current_timestamp;
     lsn_t expiry;
+    bool range_filters; // build a rangeFilter for each new disk component, so bounded scans can skip it
 
     //DATA PAGE SETTINGS
     pageid_t internal_region_size; // in number of pages
@@ -180,6 +267,11 @@ public:
     pageid_t datapage_size;        // "
 private:
     tupleMerger *tmerger;
+    rowCache *row_cache; // may be null
+    prefixExtractor *prefix_extractor; // may be null
+    opTrace *op_trace; // may be null
+    latencyStats latency_stats;
+    readStats read_stats;
 
     std::vector<iterator *> its;
 
@@ -318,37 +410,70 @@ public:
 
     class iterator {
   public:
-      explicit iterator(bLSM* ltable)
-      : ltable(ltable),
-        epoch(ltable->get_epoch()),
-        merge_it_(NULL),
-        last_returned(NULL),
-        key(NULL),
-        valid(false),
-        reval_count(0) {
-        rwlc_readlock(ltable->header_mut);
-        pthread_mutex_lock(&ltable->rb_mut);
-        ltable->registerIterator(this);
-        pthread_mutex_unlock(&ltable->rb_mut);
-        validate();
-        //        rwlc_unlock(ltable->header_mut);
+      enum direction_t {
+        FORWARD,
+        /**
+         * Return tuples in descending key order, starting with the last
+         * tuple <= key (or the last tuple in the table, if key is NULL).
+         * Each component is walked backwards in place, so this does not
+         * buffer the range.
+         */
+        REVERSE
+      };
+
+      /** Return tuples >= key (or all tuples, if key is NULL). */
+      explicit iterator(bLSM* ltable, dataTuple *key = NULL, direction_t direction = FORWARD)
+      {
+        init(ltable, key, direction);
+        start();
       }
 
-      explicit iterator(bLSM* ltable,dataTuple *key)
-      : ltable(ltable),
-        epoch(ltable->get_epoch()),
-        merge_it_(NULL),
-        last_returned(NULL),
-        key(key),
-        valid(false),
-        reval_count(0)
+      /**
+       * Return tuples in [key, upper_bound).  If key and upper_bound share a
+       * prefix (according to the table's prefixExtractor), disk components
+       * whose prefix bloom filter rules that prefix out are not read at all.
+       */
+      explicit iterator(bLSM* ltable,dataTuple *key, dataTuple *upper_bound)
       {
-        rwlc_readlock(ltable->header_mut);
-        pthread_mutex_lock(&ltable->rb_mut);
-        ltable->registerIterator(this);
-        pthread_mutex_unlock(&ltable->rb_mut);
-        validate();
-        //        rwlc_unlock(ltable->header_mut);
+        init(ltable, key, FORWARD);
+        this->upper_bound = upper_bound ? upper_bound->create_copy() : NULL;
+        const prefixExtractor * ext = ltable->get_prefix_extractor();
+        if(ext && key && upper_bound) {
+          size_t len = ext->prefix_len(key->strippedkey(), key->strippedkeylen());
+          if(len && len == ext->prefix_len(upper_bound->strippedkey(), upper_bound->strippedkeylen())
+             && !memcmp(key->strippedkey(), upper_bound->strippedkey(), len)) {
+            set_filter_prefix(key->strippedkey(), len);
+          }
+        }
+        start();
+      }
+
+      /**
+       * Return tuples >= key (or all tuples, if key is NULL) that start with
+       * prefix.  Disk components whose prefix bloom filter rules prefix out
+       * are not read at all; this requires prefix to be a complete prefix
+       * according to the table's prefixExtractor.
+       */
+      explicit iterator(bLSM* ltable,dataTuple *key, const byte *prefix, size_t prefixlen)
+      {
+        init(ltable, key, FORWARD);
+        this->prefix = (byte*)malloc(prefixlen);
+        prefix_len = prefixlen;
+        memcpy(this->prefix, prefix, prefixlen);
+        if(!key || dataTuple::compare(key->strippedkey(), key->strippedkeylen(), prefix, prefixlen) < 0) {
+          // Start at the first possible key with this prefix.
+          owned_key = dataTuple::create(prefix, prefixlen);
+          this->key = owned_key;
+        }
+        // The first key past the prefix bounds the range for the components' range filters.
+        size_t succ_len = prefixlen;
+        while(succ_len && prefix[succ_len-1] == 0xff) { succ_len--; }
+        if(succ_len) {
+          upper_bound = dataTuple::create(prefix, succ_len);
+          upper_bound->strippedkey()[succ_len-1]++;
+        }
+        set_filter_prefix(prefix, prefixlen);
+        start();
       }
 
       ~iterator() {
@@ -359,14 +484,26 @@ public:
         pthread_mutex_unlock(&ltable->rb_mut);
         if(last_returned) dataTuple::freetuple(last_returned);
         rwlc_unlock(ltable->header_mut);
+        if(upper_bound) dataTuple::freetuple(upper_bound);
+        if(owned_key) dataTuple::freetuple(owned_key);
+        free(prefix);
+        free(filter_prefix);
       }
   private:
       dataTuple * getnextHelper() {
         //          rwlc_readlock(ltable->header_mut);
+          if(done) { return NULL; }
           revalidate();
           dataTuple * tmp = merge_it_->next_callerFrees();
+          if(tmp && !in_range(tmp)) {
+            // Past the end of the range; don't look any further.
+            dataTuple::freetuple(tmp);
+            tmp = NULL;
+            done = true;
+          }
           if(last_returned && tmp) {
               int res = dataTuple::compare(last_returned->strippedkey(), last_returned->strippedkeylen(), tmp->strippedkey(), tmp->strippedkeylen());
+              if(reverse) { res = -res; }
               if(res >= 0) {
 		  int al = last_returned->strippedkeylen();
                   char * a =(char*)malloc(al + 1);
@@ -403,6 +540,18 @@ public:
           return ret;
       }
 
+      /**
+       * Like getnext(), but return the iterator's own copy of the tuple,
+       * which is only valid until the next call, or until the iterator is
+       * deleted.  This saves a heap copy per tuple for callers that just
+       * serialize the tuples.
+       */
+      const dataTuple * getnextNoCopy() {
+          dataTuple * ret;
+          while((ret = getnextHelper()) && ret->isDelete()) { }
+          return ret;
+      }
+
       void invalidate() {
 //        assert(!trywritelock(ltable->header_lock,0));
         if(valid) {
@@ -414,6 +563,31 @@ public:
 
   private:
       inline void init_helper();
+      /** Set every field to its default; the constructors then fill in their options. */
+      void init(bLSM * ltable, dataTuple * key, direction_t direction) {
+        this->ltable = ltable;
+        epoch = ltable->get_epoch();
+        merge_it_ = NULL;
+        last_returned = NULL;
+        this->key = key;
+        valid = false;
+        reval_count = 0;
+        reverse = (direction == REVERSE);
+        upper_bound = NULL;
+        prefix = NULL;
+        prefix_len = 0;
+        filter_prefix = NULL;
+        filter_prefix_len = 0;
+        owned_key = NULL;
+        done = false;
+      }
+      void start() {
+        rwlc_readlock(ltable->header_mut);
+        pthread_mutex_lock(&ltable->rb_mut);
+        ltable->registerIterator(this);
+        pthread_mutex_unlock(&ltable->rb_mut);
+        validate();
+      }
 
     explicit iterator() { abort(); }
     void operator=(iterator & t) { abort(); }
@@ -438,7 +612,26 @@ public:
       dataTuple * key;
       bool valid;
       int reval_count;
+      bool reverse;
+      dataTuple * upper_bound;
+      byte * prefix;
+      size_t prefix_len;
+      byte * filter_prefix;         // if non-null, skip disk components that don't contain this prefix
+      size_t filter_prefix_len;
+      dataTuple * owned_key;
+      bool done;
       static const int reval_period = 100;
+
+      void set_filter_prefix(const byte * p, size_t len) {
+        filter_prefix = (byte*)malloc(len);
+        memcpy(filter_prefix, p, len);
+        filter_prefix_len = len;
+      }
+      bool in_range(dataTuple * t) {
+        if(upper_bound && dataTuple::compare_obj(t, upper_bound) >= 0) { return false; }
+        if(prefix && (t->strippedkeylen() < prefix_len || memcmp(t->strippedkey(), prefix, prefix_len))) { return false; }
+        return true;
+      }
       void revalidate() {
         if(reval_count == reval_period) {
           rwlc_unlock(ltable->header_mut);
@@ -455,6 +648,16 @@ public:
       }
 
 
+      diskTreeComponent::iterator * open_disk_iterator(diskTreeComponent * c, dataTuple * t) {
+        if(filter_prefix && !c->may_contain_prefix(filter_prefix, filter_prefix_len)) {
+          return NULL;
+        }
+        if(!reverse && upper_bound && !c->may_contain_range(t, upper_bound)) {
+          return NULL;
+        }
+        return reverse ? c->open_reverse_iterator(t) : c->open_iterator(t);
+      }
+
       void validate() {
          memTreeComponent::batchedRevalidatingIterator * c0_it;
          memTreeComponent::iterator *c0_mergeable_it[1];
@@ -470,24 +673,25 @@ public:
           t = NULL;
         }
 
-        c0_it              = new  memTreeComponent::batchedRevalidatingIterator(ltable->get_tree_c0(), 100, &ltable->rb_mut,  t);
-        c0_mergeable_it[0] = new  memTreeComponent::iterator            (ltable->get_tree_c0_mergeable(),                            t);
+        c0_it              = new  memTreeComponent::batchedRevalidatingIterator(ltable->get_tree_c0(), 100, &ltable->rb_mut,  t, reverse);
+        c0_mergeable_it[0] = new  memTreeComponent::iterator            (ltable->get_tree_c0_mergeable(),                            t, reverse);
         if(ltable->get_tree_c1_prime()) {
-          disk_it[0] = ltable->get_tree_c1_prime()->open_iterator(t);
+          disk_it[0] = open_disk_iterator(ltable->get_tree_c1_prime(), t);
         } else {
           disk_it[0] = NULL;
         }
-        disk_it[1]         = ltable->get_tree_c1()->open_iterator(t);
+        disk_it[1]         = open_disk_iterator(ltable->get_tree_c1(), t);
         if(ltable->get_tree_c1_mergeable()) {
-          disk_it[2]         = ltable->get_tree_c1_mergeable()->open_iterator(t);
+          disk_it[2]         = open_disk_iterator(ltable->get_tree_c1_mergeable(), t);
         } else {
           disk_it[2] = NULL;
         }
-        disk_it[3]         = ltable->get_tree_c2()->open_iterator(t);
+        disk_it[3]         = open_disk_iterator(ltable->get_tree_c2(), t);
 
+        int (*cmp)(const dataTuple*,const dataTuple*) = reverse ? dataTuple::compare_obj_desc : dataTuple::compare_obj;
         inner_merge_it_t * inner_merge_it =
-               new inner_merge_it_t(c0_it, c0_mergeable_it, 1, NULL, dataTuple::compare_obj);
-        merge_it_ = new merge_it_t(inner_merge_it, disk_it, 4, NULL, dataTuple::compare_obj); // XXX Hardcodes comparator, and does not handle merges
+               new inner_merge_it_t(c0_it, c0_mergeable_it, 1, NULL, cmp);
+        merge_it_ = new merge_it_t(inner_merge_it, disk_it, 4, NULL, cmp); // XXX does not handle merges
         if(last_returned) {
           dataTuple * junk = merge_it_->peek();
           if(junk && !dataTuple::compare(junk->strippedkey(), junk->strippedkeylen(), last_returned->strippedkey(), last_returned->strippedkeylen())) {
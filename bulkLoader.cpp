@@ -0,0 +1,314 @@
+/*
+ * bulkLoader.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <errno.h>
+#include <math.h>
+#include <algorithm>
+#include "bulkLoader.h"
+#include "componentFile.h"
+
+#include <stasis/transactional.h>
+
+static bool tuple_lt(const dataTuple * a, const dataTuple * b) {
+  return dataTuple::compare_obj(a, b) < 0;
+}
+
+void * bulk_loader_run_thread(void * arg) {
+  return ((bulkLoader*)arg)->run_thread();
+}
+
+bulkLoader::bulkLoader(bLSM * ltable, pageid_t expected_bytes)
+  : ltable_(ltable),
+    stats_(new mergeStats(2, 0)),
+    xid_(Tbegin()),
+    expected_bytes_(expected_bytes ? expected_bytes
+                    : (pageid_t)((double)ltable->max_c0_size * *ltable->R() * *ltable->R())),
+    finished_(false),
+    tuple_count_(0),
+    byte_count_(0),
+    sorted_(new_component(xid_, expected_bytes_)),
+    pending_(NULL),
+    buf_(NULL),
+    buf_bytes_(0),
+    run_buf_(NULL),
+    run_active_(false) { }
+
+bulkLoader::~bulkLoader() {
+  if(!finished_) {
+    // The load was abandoned; give the space back.
+    wait_for_run();
+    if(pending_) dataTuple::freetuple(pending_);
+    if(buf_) {
+      for(unsigned int i = 0; i < buf_->size(); i++) { dataTuple::freetuple((*buf_)[i]); }
+    }
+    sorted_->writes_done();
+    sorted_->dealloc(xid_);
+    delete sorted_;
+    for(unsigned int i = 0; i < runs_.size(); i++) {
+      runs_[i]->dealloc(xid_);
+      delete runs_[i];
+    }
+    Tcommit(xid_);
+  }
+  delete buf_;
+  delete run_buf_;
+  delete stats_;
+}
+
+diskTreeComponent * bulkLoader::new_component(int xid, pageid_t expected_bytes) {
+  // Same bloom filter sizing heuristic as the merge threads; intermediate runs don't need one.
+  return new diskTreeComponent(xid, ltable_->internal_region_size, ltable_->datapage_region_size, ltable_->datapage_size, stats_, expected_bytes / 100, ltable_->get_prefix_extractor(), ltable_->range_filters);
+}
+
+pageid_t bulkLoader::run_size() {
+  // Two buffers are live at once; together they use as much memory as C0.
+  return ltable_->max_c0_size / 2;
+}
+
+void bulkLoader::insertTuple(dataTuple * t) {
+  assert(!finished_);
+  tuple_count_++;
+  byte_count_ += t->byte_length();
+  if(!buf_) {
+    if(!pending_ || dataTuple::compare_obj(pending_, t) <= 0) {
+      append_sorted(t);
+      return;
+    }
+    // Out of order; the prefix we have so far becomes the oldest sorted run.
+    DEBUG("bulk load input is not sorted; switching to external sort\n");
+    sorted_->insertTuple(xid_, pending_);
+    dataTuple::freetuple(pending_);
+    pending_ = NULL;
+    sorted_->writes_done();
+    buf_ = new std::vector<dataTuple*>;
+    run_buf_ = new std::vector<dataTuple*>;
+  }
+  buf_->push_back(t->create_copy());
+  buf_bytes_ += t->byte_length() + sizeof(dataTuple*);
+  if(buf_bytes_ >= run_size()) {
+    start_run();
+  }
+}
+
+void bulkLoader::insertManyTuples(dataTuple ** tuples, int tuple_count) {
+  for(int i = 0; i < tuple_count; i++) {
+    insertTuple(tuples[i]);
+  }
+}
+
+void bulkLoader::append_sorted(dataTuple * t) {
+  if(pending_) {
+    if(dataTuple::compare_obj(pending_, t) < 0) {
+      sorted_->insertTuple(xid_, pending_);
+    } // else it's a duplicate, and t replaces it.
+    dataTuple::freetuple(pending_);
+  }
+  pending_ = t->create_copy();
+}
+
+void bulkLoader::start_run() {
+  wait_for_run();
+  std::swap(buf_, run_buf_);
+  buf_bytes_ = 0;
+  run_active_ = true;
+  pthread_create(&run_pthread_, 0, bulk_loader_run_thread, this);
+}
+
+void bulkLoader::wait_for_run() {
+  if(run_active_) {
+    pthread_join(run_pthread_, 0);
+    run_active_ = false;
+  }
+}
+
+void * bulkLoader::run_thread() {
+  std::vector<dataTuple*> &buf = *run_buf_;
+  // stable, so that the last copy of a duplicate key is the one we keep.
+  std::stable_sort(buf.begin(), buf.end(), tuple_lt);
+
+  int xid = Tbegin();
+  diskTreeComponent * run = new_component(xid, 0);
+  for(unsigned int i = 0; i < buf.size(); i++) {
+    if(i+1 == buf.size() || dataTuple::compare_obj(buf[i], buf[i+1])) {
+      run->insertTuple(xid, buf[i]);
+    }
+    dataTuple::freetuple(buf[i]);
+  }
+  buf.clear();
+  run->writes_done();
+  run->force(xid);
+  Tcommit(xid);
+
+  runs_.push_back(run);
+  return 0;
+}
+
+bool bulkLoader::component_is_empty(diskTreeComponent * c) {
+  if(!c) { return true; }
+  diskTreeComponent::iterator * it = c->open_iterator();
+  dataTuple * t = it->next_callerFrees();
+  delete it;
+  if(t) { dataTuple::freetuple(t); return false; }
+  return true;
+}
+
+bool bulkLoader::table_is_empty_helper(bLSM * ltable) {
+  pthread_mutex_lock(&ltable->rb_mut);
+  bool c0_empty = ltable->get_tree_c0()->empty();
+  pthread_mutex_unlock(&ltable->rb_mut);
+
+  return c0_empty
+      && ltable->get_tree_c0_mergeable() == NULL
+      && ltable->get_tree_c1_prime() == NULL
+      && ltable->get_tree_c1_mergeable() == NULL
+      && component_is_empty(ltable->get_tree_c1())
+      && component_is_empty(ltable->get_tree_c2());
+}
+
+bool bulkLoader::table_is_empty(bLSM * ltable) {
+  rwlc_readlock(ltable->header_mut);
+  bool ret = table_is_empty_helper(ltable);
+  rwlc_unlock(ltable->header_mut);
+  return ret;
+}
+
+int bulkLoader::ingest(bLSM * ltable, const char * path, bool * installed_as_c2) {
+  componentFileReader * r = componentFileReader::open(path);
+  if(!r) { return errno; }
+  bulkLoader * loader = new bulkLoader(ltable, r->get_byte_count());
+  dataTuple * t;
+  while((t = r->next_callerFrees())) {
+    loader->insertTuple(t);
+    dataTuple::freetuple(t);
+  }
+  int err = r->error();
+  delete r;
+  if(err) {
+    delete loader; // abandons the load
+    return err;
+  }
+  err = loader->finish(installed_as_c2);
+  delete loader;
+  return err;
+}
+
+int bulkLoader::finish(bool * installed_as_c2_ret) {
+  assert(!finished_);
+  finished_ = true;
+
+  diskTreeComponent * c;
+  if(!buf_) {
+    if(pending_) {
+      sorted_->insertTuple(xid_, pending_);
+      dataTuple::freetuple(pending_);
+      pending_ = NULL;
+    }
+    sorted_->writes_done();
+    c = sorted_;
+  } else {
+    if(buf_->size()) { start_run(); }
+    wait_for_run();
+
+    c = new_component(xid_, byte_count_);
+    {
+    // Merge the runs, newest first, so that mergeManyIterator prefers the
+    // most recent copy of each key.
+    int num_iters = runs_.size();
+    diskTreeComponent::iterator ** iters = (diskTreeComponent::iterator**)malloc(sizeof(iters[0]) * num_iters);
+    for(int i = 0; i < num_iters - 1; i++) {
+      iters[i] = runs_[num_iters - 2 - i]->open_iterator();
+    }
+    iters[num_iters - 1] = sorted_->open_iterator();
+    bLSM::mergeManyIterator<diskTreeComponent::iterator, diskTreeComponent::iterator> merge_it(
+        runs_[num_iters - 1]->open_iterator(), iters, num_iters, NULL, dataTuple::compare_obj);
+    free(iters);
+
+    dataTuple * t;
+    while((t = merge_it.next_callerFrees())) {
+      c->insertTuple(xid_, t);
+      dataTuple::freetuple(t);
+    }
+    c->writes_done();
+    } // close the iterators before freeing the runs.
+
+    sorted_->dealloc(xid_);
+    delete sorted_;
+    for(unsigned int i = 0; i < runs_.size(); i++) {
+      runs_[i]->dealloc(xid_);
+      delete runs_[i];
+    }
+    runs_.clear();
+  }
+  sorted_ = NULL;
+  c->force(xid_);
+
+  DEBUG("bulk load wrote %lld tuples (%lld bytes)\n", (long long)tuple_count_, (long long)byte_count_);
+
+  rwlc_writelock(ltable_->header_mut);
+  bool installed_as_c2 = table_is_empty_helper(ltable_);
+  if(installed_as_c2) {
+    ltable_->get_tree_c2()->dealloc(xid_);
+    delete ltable_->get_tree_c2();
+    ltable_->set_tree_c2(c);
+    // Pick R as though C2 had been built by the C1-C2 merger. (3.0 is mergeScheduler's MIN_R.)
+    *(ltable_->R()) = std::max(3.0, sqrt(((double)byte_count_) / ((double)ltable_->mean_c0_run_length)));
+    if(ltable_->get_row_cache()) { ltable_->get_row_cache()->clear(); }
+    ltable_->update_persistent_header(xid_);
+    Tcommit(xid_);
+  } else if(!tuple_count_) {
+    c->dealloc(xid_);
+    delete c;
+    Tcommit(xid_);
+  } else {
+    // If the table shuts down, the C1-C2 merger won't take (or finish) the
+    // load, and nothing else would wake us up.
+    while(ltable_->get_tree_c1_mergeable() && ltable_->is_still_running()) {
+      ltable_->c1_flushing = true;
+      rwlc_cond_wait(&ltable_->c1_needed, ltable_->header_mut);
+    }
+    if(!ltable_->is_still_running()) {
+      c->dealloc(xid_);
+      delete c;
+      Tcommit(xid_);
+      rwlc_unlock(ltable_->header_mut);
+      return ESHUTDOWN;
+    }
+    ltable_->set_tree_c1_mergeable(c);
+    ltable_->merge_mgr->handed_off_tree(1, byte_count_);
+    if(ltable_->get_row_cache()) { ltable_->get_row_cache()->clear(); }
+    Tcommit(xid_);
+    pthread_cond_signal(&ltable_->c1_ready);
+
+    // c1_flushing keeps the C1-C2 merger from pacing itself against C1, which
+    // has nothing to do with this merge.
+    while(ltable_->get_tree_c1_mergeable() == c && ltable_->is_still_running()) {
+      ltable_->c1_flushing = true;
+      rwlc_cond_wait(&ltable_->c1_needed, ltable_->header_mut);
+    }
+    if(!ltable_->is_still_running()) {
+      // c belongs to the table now, but the merge into C2 never finished.
+      rwlc_unlock(ltable_->header_mut);
+      return ESHUTDOWN;
+    }
+    ltable_->c1_flushing = false;
+  }
+  rwlc_unlock(ltable_->header_mut);
+
+  if(installed_as_c2_ret) { *installed_as_c2_ret = installed_as_c2; }
+  return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * bulkLoader.h
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef BULKLOADER_H_
+#define BULKLOADER_H_
+
+#include <stasis/common.h>
+#include <pthread.h>
+#include <vector>
+
+#include "bLSM.h"
+
+/**
+ * Builds a disk tree component directly from a stream of tuples, bypassing
+ * C0, the log and the C0-C1 merger.
+ *
+ * As long as the input arrives in key order, tuples are appended straight
+ * into datapages of a new component, so each byte is written once.  The
+ * first out of order tuple switches the loader into external sort mode:
+ * the input is buffered in memory, and each full buffer is sorted and
+ * written out as a sorted run by a helper thread while the caller fills the
+ * next buffer.  finish() then merges the runs (and the sorted prefix, if any)
+ * into the final component.
+ *
+ * If a key appears more than once, the last copy wins.
+ *
+ * finish() installs the component atomically.  If the table is empty, the
+ * component replaces C2.  Otherwise, it is handed to the C1-C2 merger as
+ * C1_mergeable, and finish() blocks until that merge completes.  In the
+ * latter case, the load is ordered before any tuples that are still in C0 or
+ * C1, so callers that need the load to overwrite existing keys should use
+ * insertManyTuples() instead.
+ *
+ * Bulk loaded tuples are not written to the log; they are durable once
+ * finish() returns.
+ */
+class bulkLoader {
+public:
+  /**
+   * @param expected_bytes An estimate of the size of the input, used to
+   * size the bloom filter.  If zero, assume the load will be about as big as
+   * C2 would be at steady state.
+   */
+  bulkLoader(bLSM * ltable, pageid_t expected_bytes = 0);
+  ~bulkLoader();
+
+  /** Add a tuple to the load.  The caller retains ownership of t. */
+  void insertTuple(dataTuple * t);
+  void insertManyTuples(dataTuple ** tuples, int tuple_count);
+
+  /**
+   * Install the loaded data.
+   *
+   * @param installed_as_c2 If non-NULL, set to true if the load was
+   * installed directly as C2, or false if it was merged into the existing
+   * data.
+   * @return 0 on success, or ESHUTDOWN if the table shut down before the
+   * C1-C2 merger finished merging the load.  In that case, the load may not
+   * have been applied, and is not durable.
+   */
+  int finish(bool * installed_as_c2 = NULL);
+
+  /**
+   * Load a file written by componentFileWriter.  The tuples are copied into
+   * a new component the same way a sorted bulk load is, and installed by
+   * finish().
+   *
+   * @param installed_as_c2 Passed to finish().
+   * @return 0 on success, an errno if the file could not be opened or is
+   * corrupt (nothing is installed), or finish()'s error.
+   */
+  static int ingest(bLSM * ltable, const char * path, bool * installed_as_c2 = NULL);
+
+  /** @return true if the table has no tuples in any component. */
+  static bool table_is_empty(bLSM * ltable);
+
+  pageid_t get_tuple_count() { return tuple_count_; }
+  pageid_t get_byte_count() { return byte_count_; }
+
+private:
+  /** Size of each in-memory sort buffer in external sort mode. */
+  pageid_t run_size();
+  void append_sorted(dataTuple * t);
+  void start_run();
+  void wait_for_run();
+  void * run_thread();
+  friend void * bulk_loader_run_thread(void * arg);
+
+  diskTreeComponent * new_component(int xid, pageid_t expected_bytes);
+  static bool component_is_empty(diskTreeComponent * c);
+  static bool table_is_empty_helper(bLSM * ltable);
+
+  bLSM * ltable_;
+  mergeStats * stats_;
+  int xid_;
+  pageid_t expected_bytes_;
+  bool finished_;
+
+  pageid_t tuple_count_;
+  pageid_t byte_count_;
+
+  // Sorted mode.
+  diskTreeComponent * sorted_;
+  dataTuple * pending_;           // held back until we see a larger key, so duplicates can be collapsed
+
+  // External sort mode.
+  std::vector<dataTuple*> * buf_;
+  pageid_t buf_bytes_;
+  std::vector<dataTuple*> * run_buf_; // being sorted and written by run_pthread_
+  std::vector<diskTreeComponent*> runs_; // oldest first
+  bool run_active_;
+  pthread_t run_pthread_;
+};
+
+#endif /* BULKLOADER_H_ */
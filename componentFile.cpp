@@ -0,0 +1,236 @@
+/*
+ * componentFile.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <errno.h>
+#include <stddef.h>
+#include <unistd.h>
+#include "componentFile.h"
+
+const char componentFile::MAGIC[8] = { 'b', 'L', 'S', 'M', 'c', 'o', 'm', 'p' };
+
+// Plain table-driven CRC32 (IEEE polynomial), so that writers don't need Stasis.
+uint32_t componentFile::crc32(const void * buf, size_t len, uint32_t crc) {
+  static uint32_t table[256];
+  static bool init = false;
+  if(!init) {
+    for(uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for(int j = 0; j < 8; j++) {
+        c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+      }
+      table[i] = c;
+    }
+    init = true;
+  }
+  const byte * p = (const byte*)buf;
+  crc = ~crc;
+  for(size_t i = 0; i < len; i++) {
+    crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+/////////////////////////////////////////////////////////////////
+// WRITER
+/////////////////////////////////////////////////////////////////
+
+componentFileWriter * componentFileWriter::open(const char * path, size_t block_size) {
+  FILE * f = fopen(path, "w");
+  if(!f) { return NULL; }
+  componentFileWriter * ret = new componentFileWriter(f, block_size);
+  if(ret->err_) {
+    int err = ret->err_;
+    delete ret;
+    errno = err;
+    return NULL;
+  }
+  return ret;
+}
+
+componentFileWriter::componentFileWriter(FILE * f, size_t block_size)
+  : f_(f),
+    block_((byte*)malloc(block_size)),
+    block_len_(0),
+    block_tuples_(0),
+    last_(NULL),
+    err_(0) {
+  memset(&hdr_, 0, sizeof(hdr_));
+  memcpy(hdr_.magic, componentFile::MAGIC, sizeof(hdr_.magic));
+  hdr_.version = componentFile::VERSION;
+  hdr_.block_size = block_size;
+  // Reserve space for the header; close() fills it in.
+  byte zero[componentFile::HEADER_SIZE];
+  memset(zero, 0, sizeof(zero));
+  if(fwrite(zero, sizeof(zero), 1, f_) != 1) { err_ = errno; }
+}
+
+componentFileWriter::~componentFileWriter() {
+  if(f_) { fclose(f_); }
+  if(last_) { dataTuple::freetuple(last_); }
+  free(block_);
+}
+
+int componentFileWriter::flush_block() {
+  if(!block_tuples_) { return 0; }
+  componentFile::block_header bh;
+  bh.payload_len = block_len_;
+  bh.tuple_count = block_tuples_;
+  bh.payload_crc = componentFile::crc32(block_, block_len_);
+  if(fwrite(&bh, sizeof(bh), 1, f_) != 1 || fwrite(block_, block_len_, 1, f_) != 1) {
+    return errno ? errno : EIO;
+  }
+  hdr_.block_count++;
+  block_len_ = 0;
+  block_tuples_ = 0;
+  return 0;
+}
+
+int componentFileWriter::append(const dataTuple * t) {
+  if(err_) { return err_; }
+  if(last_ && dataTuple::compare_obj(last_, t) >= 0) { return EINVAL; }
+
+  len_t len = t->byte_length();
+  if(block_len_ && block_len_ + len > hdr_.block_size) {
+    if((err_ = flush_block())) { return err_; }
+  }
+  if(!block_tuples_) {
+    // First tuple of the block; remember where it starts for the index.
+    uint64_t off = ftello(f_);
+    len_t keylen = t->strippedkeylen();
+    index_.append((const char*)&off, sizeof(off));
+    index_.append((const char*)&keylen, sizeof(keylen));
+    index_.append((const char*)t->strippedkey(), keylen);
+  }
+  if(len > hdr_.block_size) {
+    block_ = (byte*)realloc(block_, len);
+    hdr_.block_size = len;
+  }
+  byte * buf = t->to_bytes();
+  memcpy(block_ + block_len_, buf, len);
+  free(buf);
+  block_len_ += len;
+  block_tuples_++;
+
+  hdr_.tuple_count++;
+  hdr_.byte_count += len;
+  if(last_) { dataTuple::freetuple(last_); }
+  last_ = t->create_copy();
+  return 0;
+}
+
+int componentFileWriter::close() {
+  if(err_) { return err_; }
+  if((err_ = flush_block())) { return err_; }
+  hdr_.index_offset = ftello(f_);
+  hdr_.index_length = index_.size();
+  if(index_.size() && fwrite(index_.data(), index_.size(), 1, f_) != 1) { return err_ = errno ? errno : EIO; }
+  hdr_.header_crc = componentFile::crc32(&hdr_, offsetof(componentFile::header, header_crc));
+  if(fseeko(f_, 0, SEEK_SET) || fwrite(&hdr_, sizeof(hdr_), 1, f_) != 1) { return err_ = errno ? errno : EIO; }
+  if(fflush(f_) || fsync(fileno(f_))) { return err_ = errno; }
+  int ret = fclose(f_);
+  f_ = NULL;
+  return ret ? (err_ = errno) : 0;
+}
+
+/////////////////////////////////////////////////////////////////
+// READER
+/////////////////////////////////////////////////////////////////
+
+componentFileReader * componentFileReader::open(const char * path) {
+  FILE * f = fopen(path, "r");
+  if(!f) { return NULL; }
+  componentFile::header hdr;
+  if(fread(&hdr, sizeof(hdr), 1, f) != 1) {
+    fclose(f);
+    errno = EINVAL;
+    return NULL;
+  }
+  if(memcmp(hdr.magic, componentFile::MAGIC, sizeof(hdr.magic))
+     || hdr.version != componentFile::VERSION
+     || hdr.header_crc != componentFile::crc32(&hdr, offsetof(componentFile::header, header_crc))) {
+    fclose(f);
+    errno = EINVAL;
+    return NULL;
+  }
+  if(fseeko(f, componentFile::HEADER_SIZE, SEEK_SET)) {
+    int err = errno;
+    fclose(f);
+    errno = err;
+    return NULL;
+  }
+  return new componentFileReader(f, hdr);
+}
+
+componentFileReader::componentFileReader(FILE * f, const componentFile::header &hdr)
+  : f_(f),
+    hdr_(hdr),
+    block_((byte*)malloc(hdr.block_size)),
+    block_cap_(hdr.block_size),
+    block_len_(0),
+    block_off_(0),
+    blocks_read_(0),
+    tuples_read_(0),
+    last_(NULL),
+    err_(0) { }
+
+componentFileReader::~componentFileReader() {
+  fclose(f_);
+  if(last_) { dataTuple::freetuple(last_); }
+  free(block_);
+}
+
+int componentFileReader::read_block() {
+  componentFile::block_header bh;
+  if(fread(&bh, sizeof(bh), 1, f_) != 1) { return ferror(f_) ? errno : EIO; }
+  if(bh.payload_len > block_cap_) {
+    block_ = (byte*)realloc(block_, bh.payload_len);
+    block_cap_ = bh.payload_len;
+  }
+  if(fread(block_, bh.payload_len, 1, f_) != 1) { return ferror(f_) ? errno : EIO; }
+  if(bh.payload_crc != componentFile::crc32(block_, bh.payload_len)) { return EIO; }
+  block_len_ = bh.payload_len;
+  block_off_ = 0;
+  blocks_read_++;
+  return 0;
+}
+
+dataTuple * componentFileReader::next_callerFrees() {
+  if(err_ || tuples_read_ == hdr_.tuple_count) { return NULL; }
+  if(block_off_ == block_len_) {
+    if(blocks_read_ == hdr_.block_count) { err_ = EIO; return NULL; } // truncated
+    if((err_ = read_block())) { return NULL; }
+  }
+  if(block_off_ + 2 * sizeof(len_t) > block_len_) { err_ = EIO; return NULL; }
+  len_t keylen, datalen;
+  memcpy(&keylen, block_ + block_off_, sizeof(keylen));
+  memcpy(&datalen, block_ + block_off_ + sizeof(keylen), sizeof(datalen));
+  size_t len = 2 * sizeof(len_t) + dataTuple::length_from_header(keylen, datalen);
+  if(block_off_ + len > block_len_) { err_ = EIO; return NULL; }
+  dataTuple * ret = dataTuple::from_bytes(keylen, datalen, block_ + block_off_ + 2 * sizeof(len_t));
+  block_off_ += len;
+
+  if(last_ && dataTuple::compare_obj(last_, ret) >= 0) {
+    dataTuple::freetuple(ret);
+    err_ = EINVAL;
+    return NULL;
+  }
+  if(last_) { dataTuple::freetuple(last_); }
+  last_ = ret->create_copy();
+  tuples_read_++;
+  return ret;
+}
@@ -0,0 +1,145 @@
+/*
+ * componentFile.h
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef COMPONENTFILE_H_
+#define COMPONENTFILE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "dataTuple.h"
+
+/**
+ * Sorted component files.
+ *
+ * These let offline jobs build a sorted run of tuples without linking
+ * against Stasis, and ship it to a server, which splices it into the tree
+ * with bulkLoader::ingest().  This file has no dependencies beyond
+ * dataTuple.h; it is safe to use in the client library.
+ *
+ * File layout (all integers are in host byte order, like the rest of the
+ * on-disk and wire formats):
+ *
+ * <pre>
+ *   header    componentFile::header, padded to HEADER_SIZE bytes
+ *   block 0   componentFile::block_header, followed by payload_len bytes of tuples
+ *   ...
+ *   block n-1
+ *   index     for each block: uint64_t file offset, len_t keylen, first key of block
+ * </pre>
+ *
+ * Tuples are encoded as dataTuple::to_bytes() does (keylen, datalen, key,
+ * data), which is also how they are stored in datapages.  Keys are strictly
+ * increasing across the whole file.  Each block and the header carry a CRC32.
+ */
+class componentFile {
+public:
+  static const char     MAGIC[8];
+  static const uint32_t VERSION = 1;
+  static const size_t   HEADER_SIZE = 4096;
+  static const size_t   DEFAULT_BLOCK_SIZE = 1024 * 1024;
+
+  struct header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t block_size;    /// Largest block payload; the writer grows it to fit oversized tuples.
+    uint64_t tuple_count;
+    uint64_t byte_count;    /// Sum of dataTuple::byte_length() over all tuples.
+    uint64_t block_count;
+    uint64_t index_offset;
+    uint64_t index_length;
+    uint32_t header_crc;    /// CRC of the preceding fields.
+  };
+  struct block_header {
+    uint32_t payload_len;
+    uint32_t tuple_count;
+    uint32_t payload_crc;
+  };
+
+  static uint32_t crc32(const void * buf, size_t len, uint32_t crc = 0);
+};
+
+class componentFileWriter {
+public:
+  /** @return a new writer, or NULL (with errno set) if path can't be created. */
+  static componentFileWriter * open(const char * path, size_t block_size = componentFile::DEFAULT_BLOCK_SIZE);
+  ~componentFileWriter();
+
+  /**
+   * Append a tuple.  Keys must be strictly increasing.
+   *
+   * @return 0 on success, EINVAL if t is out of order, or an errno from the
+   * underlying write.
+   */
+  int append(const dataTuple * t);
+  /** Write the index and header.  @return 0 on success, or an errno. */
+  int close();
+
+  uint64_t get_tuple_count() { return hdr_.tuple_count; }
+
+private:
+  componentFileWriter(FILE * f, size_t block_size);
+  int flush_block();
+
+  FILE * f_;
+  componentFile::header hdr_;
+  byte * block_;
+  size_t block_len_;
+  uint32_t block_tuples_;
+  dataTuple * last_;
+  std::string index_;
+  int err_;
+};
+
+class componentFileReader {
+public:
+  /**
+   * @return a new reader, or NULL (with errno set) if the file can't be
+   * opened, or its header is invalid.
+   */
+  static componentFileReader * open(const char * path);
+  ~componentFileReader();
+
+  /**
+   * @return the next tuple, or NULL at the end of the file or on error.  Use
+   * error() to tell the two apart.
+   */
+  dataTuple * next_callerFrees();
+  /** @return 0, or the errno (EIO for a bad checksum, EINVAL for out of order keys) that stopped the scan. */
+  int error() { return err_; }
+
+  uint64_t get_tuple_count() { return hdr_.tuple_count; }
+  uint64_t get_byte_count() { return hdr_.byte_count; }
+
+private:
+  componentFileReader(FILE * f, const componentFile::header &hdr);
+  int read_block();
+
+  FILE * f_;
+  componentFile::header hdr_;
+  byte * block_;
+  size_t block_cap_;
+  size_t block_len_;
+  size_t block_off_;
+  uint64_t blocks_read_;
+  uint64_t tuples_read_;
+  dataTuple * last_;
+  int err_;
+};
+
+#endif /* COMPONENTFILE_H_ */
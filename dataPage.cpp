@@ -20,6 +20,7 @@
 #include "bLSM.h"
 #include "dataPage.h"
 #include "regionAllocator.h"
+#include "tracePoints.h"
 
 #include <stasis/page.h>
 
@@ -275,6 +276,16 @@ bool dataPage::read_data(byte * buf, off_t offset, size_t len) {
   }
 }
 
+bool dataPage::read_len(off_t offset, len_t * len) {
+  // Same latching hack as iterator::getnext().
+  Page * p = loadPage(xid_, calc_chunk_from_offset(offset).page);
+  readlock(p->rwlatch, 0);
+  bool succ = read_data((byte*)len, offset, sizeof(*len));
+  unlock(p->rwlatch);
+  releasePage(p);
+  return succ && *len != 0;
+}
+
 bool dataPage::append(dataTuple const * dat)
 {
   // First, decide if we should append to this datapage, based on whether
@@ -344,12 +355,13 @@ bool dataPage::append(dataTuple const * dat)
   return succ;
 }
 
-bool dataPage::recordRead(const dataTuple::key_t key, size_t keySize,  dataTuple ** buf)
+bool dataPage::recordRead(const dataTuple::key_t key, size_t keySize,  dataTuple ** buf, uint64_t * decoded)
 {
   iterator itr(this, NULL);
 
   int match = -1;
   while((*buf=itr.getnext()) != 0) {
+    if(decoded) { (*decoded)++; }
     match = dataTuple::compare((*buf)->strippedkey(), (*buf)->strippedkeylen(), key, keySize);
 
     if(match<0) { //keep searching
@@ -375,9 +387,15 @@ dataTuple* dataPage::iterator::getnext() {
   len_t len;
   bool succ;
   if(dp == NULL) { return NULL; }
+  if(reverse_) {
+    if(offsets_.empty()) { return NULL; }
+    read_offset_ = offsets_.back();
+    offsets_.pop_back();
+  }
   // XXX hack: read latch the page that the record will live on.
   // This should be handled by a read_data_in_latch function, or something...
   Page * p = loadPage(dp->xid_, dp->calc_chunk_from_offset(read_offset_).page);
+  BLSM_TRACE1(datapage_load, p->id);
   readlock(p->rwlatch, 0);
   succ = dp->read_data((byte*)&len, read_offset_, sizeof(len));
   if((!succ) || (len == 0)) {
@@ -21,6 +21,7 @@
 #define DATA_PAGE_H_
 
 #include <limits.h>
+#include <vector>
 
 #include <stasis/page.h>
 #include <stasis/constants.h>
@@ -54,14 +55,54 @@ public:
         }
       }
     }
+    // Datapages have no slot directory, so to walk one backwards we first
+    // find the offset of each record.  Datapages are small, so this is cheap.
+    void scan_offsets() {
+      off_t off = 0;
+      len_t len;
+      while(dp->read_len(off, &len)) {
+        offsets_.push_back(off);
+        off += sizeof(len) + len;
+      }
+    }
+    void scan_back_to_key(dataTuple * key) {
+      if(key) {
+        while(!offsets_.empty()) {
+          off_t off = offsets_.back();
+          dataTuple * t = getnext();
+          if(!t) { break; }
+          int cmp = dataTuple::compare(key->strippedkey(), key->strippedkeylen(), t->strippedkey(), t->strippedkeylen());
+          dataTuple::freetuple(t);
+          if(cmp >= 0) {
+            offsets_.push_back(off);
+            break;
+          }
+        }
+      }
+    }
   public:
-    iterator(dataPage *dp, dataTuple * key=NULL) : read_offset_(0), dp(dp) {
+    iterator(dataPage *dp, dataTuple * key=NULL) : read_offset_(0), dp(dp), reverse_(false) {
       scan_to_key(key);
     }
+    /**
+     * If reverse is true, getnext() returns tuples in descending order,
+     * starting with the last tuple <= key (or the last tuple on the page, if
+     * key is NULL).
+     */
+    iterator(dataPage *dp, dataTuple * key, bool reverse) : read_offset_(0), dp(dp), reverse_(reverse) {
+      if(reverse_) {
+        scan_offsets();
+        scan_back_to_key(key);
+      } else {
+        scan_to_key(key);
+      }
+    }
 
     void operator=(const iterator &rhs) {
       this->read_offset_ = rhs.read_offset_;
       this->dp = rhs.dp;
+      this->reverse_ = rhs.reverse_;
+      this->offsets_ = rhs.offsets_;
     }
 
     //returns the next tuple and also advances the iterator
@@ -70,6 +111,8 @@ public:
   private:
     off_t read_offset_;
     dataPage *dp;
+    bool reverse_;
+    std::vector<off_t> offsets_; // reverse only; records that have not been returned yet
   };
 
 public:
@@ -100,7 +143,8 @@ public:
   }
 
   bool append(dataTuple const * dat);
-  bool recordRead(const  dataTuple::key_t key, size_t keySize,  dataTuple ** buf);
+  /** @param decoded, if not NULL, is incremented once per tuple examined. */
+  bool recordRead(const  dataTuple::key_t key, size_t keySize,  dataTuple ** buf, uint64_t * decoded = NULL);
 
   inline uint16_t recordCount();
 
@@ -143,6 +187,7 @@ private:
   Page * write_data_and_latch(const byte * buf, size_t len, bool init_next = true, bool latch = true);
   bool write_data(const byte * buf, size_t len, bool init_next = true);
   bool read_data(byte * buf, off_t offset, size_t len);
+  bool read_len(off_t offset, len_t * len);
   bool initialize_next_page();
   void initialize_page(pageid_t pageid);
 
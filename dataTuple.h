@@ -139,6 +139,10 @@ public:
     static int compare_obj(const dataTuple * a, const dataTuple* b) {
       return compare(a->strippedkey(), a->strippedkeylen(), b->strippedkey(), b->strippedkeylen());
     }
+    // for merging iterators that run in descending key order
+    static int compare_obj_desc(const dataTuple * a, const dataTuple* b) {
+      return compare_obj(b, a);
+    }
 
     inline void setDelete() {
 		datalen_ = DELETE;
@@ -213,6 +217,36 @@ public:
     	return dt->sanity_check();
     }
 
+    //framed format: the in-memory image of the tuple, with the key length
+    //in place of the data pointer, padded to a multiple of 8 bytes.  This
+    //lets the receiver use tuples without copying them.
+    size_t framed_length() const {
+      return (sizeof(dataTuple) + (size_t)length_from_header(rawkeylen(), datalen_) + 7) & ~(size_t)7;
+    }
+    void to_frame(byte* buf) const {
+      dataTuple *dt = (dataTuple*)buf;
+      size_t len = length_from_header(rawkeylen(), datalen_);
+      dt->datalen_ = datalen_;
+      dt->data_ = (byte*)(uintptr_t)rawkeylen();
+      memcpy(dt->rawkey(), rawkey(), len);
+      memset(dt->rawkey() + len, 0, framed_length() - sizeof(dataTuple) - len);
+    }
+    //parse a tuple written by to_frame in place.  buf must be 8-byte
+    //aligned, and must outlive the tuple, which must not be freed.
+    //returns NULL if buf does not hold a whole tuple.
+    static dataTuple* from_frame(byte* buf, size_t avail, size_t* used) {
+      if(avail < sizeof(dataTuple)) { return NULL; }
+      dataTuple *dt = (dataTuple*)buf;
+      size_t keylen = (uintptr_t)dt->data_;
+      size_t datalen = (dt->datalen_ == DELETE) ? 0 : dt->datalen_;
+      if(keylen > avail || datalen > avail) { return NULL; }
+      size_t len = (sizeof(dataTuple) + keylen + datalen + 7) & ~(size_t)7;
+      if(len > avail) { return NULL; }
+      dt->data_ = dt->rawkey() + keylen;
+      *used = len;
+      return dt->sanity_check();
+    }
+
     static inline void freetuple(dataTuple* dt) {
         free(dt);
     }
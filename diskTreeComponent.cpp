@@ -68,6 +68,7 @@ void diskTreeComponent::list_regions(int xid, pageid_t *internal_node_region_len
 
 
 void diskTreeComponent::writes_done() {
+  if(range_filter) { range_filter->done(); }
   if(dp) {
     ((mergeStats*)stats)->wrote_datapage(dp);
     dp->writes_done();
@@ -81,6 +82,15 @@ int diskTreeComponent::insertTuple(int xid, dataTuple *t)
   if(bloom_filter) {
     stasis_bloom_filter_insert(bloom_filter, (const char*)t->strippedkey(), t->strippedkeylen());
   }
+  if(prefix_bloom_filter) {
+    size_t prefixlen = prefix_extractor->prefix_len(t->strippedkey(), t->strippedkeylen());
+    if(prefixlen) {
+      stasis_bloom_filter_insert(prefix_bloom_filter, (const char*)t->strippedkey(), prefixlen);
+    }
+  }
+  if(range_filter) {
+    range_filter->insert(t->strippedkey(), t->strippedkeylen());
+  }
   int ret = 0; // no error.
   if(dp==0) {
     dp = insertDataPage(xid, t);
@@ -130,12 +140,16 @@ dataPage* diskTreeComponent::insertDataPage(int xid, dataTuple *tuple) {
     return dp;
 }
 
-dataTuple * diskTreeComponent::findTuple(int xid, dataTuple::key_t key, size_t keySize)
+dataTuple * diskTreeComponent::findTuple(int xid, dataTuple::key_t key, size_t keySize, readStats::counters_t * stats)
 {
     dataTuple * tup=0;
+    readStats::counters_t ignored = readStats::counters_t();
+    if(!stats) { stats = &ignored; }
+    stats->probes++;
 
     if(bloom_filter) {
       if(!stasis_bloom_filter_lookup(bloom_filter, (const char*)key, keySize)) {
+        stats->bloom_negatives++;
         return NULL;
       }
     }
@@ -146,9 +160,15 @@ dataTuple * diskTreeComponent::findTuple(int xid, dataTuple::key_t key, size_t k
     if(pid!=-1)
     {
         dataPage * dp = new dataPage(xid, 0, pid);
-        dp->recordRead(key, keySize, &tup);
+        stats->datapages_read++;
+        dp->recordRead(key, keySize, &tup, &stats->tuples_decoded);
         delete dp;
     }
+    if(tup) {
+        stats->hits++;
+    } else if(bloom_filter) {
+        stats->bloom_false_positives++;
+    }
     return tup;
 }
 
@@ -799,6 +819,14 @@ diskTreeComponent::internalNodes::iterator::iterator(int xid, regionAllocator* r
 }
 
 diskTreeComponent::internalNodes::iterator::iterator(int xid, regionAllocator* ro_alloc, recordid root, const byte* key, len_t keylen) {
+  init(xid, ro_alloc, root, key, keylen, false);
+}
+
+diskTreeComponent::internalNodes::iterator::iterator(int xid, regionAllocator* ro_alloc, recordid root, const byte* key, len_t keylen, bool reverse) {
+  init(xid, ro_alloc, root, key, keylen, reverse);
+}
+
+void diskTreeComponent::internalNodes::iterator::init(int xid, regionAllocator* ro_alloc, recordid root, const byte* key, len_t keylen, bool reverse) {
   if(root.page == NULLRID.page && root.slot == NULLRID.slot) abort();
   ro_alloc_ = ro_alloc;
   p = ro_alloc_->load_page(xid,root.page);
@@ -812,6 +840,29 @@ diskTreeComponent::internalNodes::iterator::iterator(int xid, regionAllocator* r
   justOnePage = (depth==0);
   stasis_record_read_done(xid,p,rid,(const byte*)nr);
 
+  xid_ = xid;
+  t = 0; // must be zero so free() doesn't croak.
+
+  if(!key) {
+    // Only meaningful for reverse iterators; position just past the last entry of the last leaf.
+    assert(reverse);
+    pageid_t leafid = root.page;
+    if(!justOnePage) {
+      // findLastLeaf latches the root itself; latching it twice could
+      // deadlock against a writer that queues up in between.
+      unlock(p->rwlatch);
+      leafid = diskTreeComponent::internalNodes::findLastLeaf(xid, p, depth);
+      releasePage(p);
+      p = ro_alloc_->load_page(xid,leafid);
+      readlock(p->rwlatch,0);
+    }
+    done = false;
+    current.page = leafid;
+    current.slot = stasis_record_last(xid, p).slot + 1;
+    current.size = 0;
+    return;
+  }
+
   recordid lsm_entry_rid = diskTreeComponent::internalNodes::lookup(xid,p,depth,key,keylen);
 
   if(lsm_entry_rid.page == NULLRID.page && lsm_entry_rid.slot == NULLRID.slot) {
@@ -836,17 +887,15 @@ diskTreeComponent::internalNodes::iterator::iterator(int xid, regionAllocator* r
 
     done = false;
     current.page = lsm_entry_rid.page;
-    current.slot = lsm_entry_rid.slot-1;  // this is current rid, which is one less than the first thing next will return (so subtract 1)
+    // this is current rid, which is one away from the first thing next() (or prev()) will return
+    current.slot = reverse ? lsm_entry_rid.slot+1 : lsm_entry_rid.slot-1;
     current.size = lsm_entry_rid.size;
 
-    xid_ = xid;
-
     DEBUG("diskTreeComponentIterator: index root %lld index page %lld data page %lld key %s\n", root.page, current.page, rec->ptr, key);
     DEBUG("entry = %s key = %s\n", (char*)(rec+1), (char*)key);
 
     if(!justOnePage) readlock(p->rwlatch,0);
   }
-  t = 0; // must be zero so free() doesn't croak.
 }
 
 /**
@@ -899,6 +948,53 @@ int diskTreeComponent::internalNodes::iterator::next()
   }
 }
 
+/**
+ * move to the previous page
+ **/
+int diskTreeComponent::internalNodes::iterator::prev()
+{
+  if(done) return 0;
+
+  current.slot--;
+
+  if(current.slot < diskTreeComponent::internalNodes::FIRST_SLOT) {
+    // In single page trees, the root's reserved slots hold the depth and comparator, not leaf links.
+    pageid_t prev_rec = -1;
+    if(!justOnePage) {
+      recordid prev_leaf_rid = {p->id, diskTreeComponent::internalNodes::PREV_LEAF,0};
+      const indexnode_rec *nr = (const indexnode_rec*)stasis_record_read_begin(xid_, p, prev_leaf_rid);
+      prev_rec = nr->ptr;
+      stasis_record_read_done(xid_,p,prev_leaf_rid,(const byte*)nr);
+    }
+
+    unlock(p->rwlatch);
+    releasePage(p);
+
+    if(prev_rec != -1) {
+      p = ro_alloc_->load_page(xid_, prev_rec);
+      readlock(p->rwlatch,0);
+      current.page = prev_rec;
+      current.slot = stasis_record_last(xid_, p).slot;
+    } else {
+      p = 0;
+      done = true;
+    }
+  }
+  return read_current();
+}
+
+int diskTreeComponent::internalNodes::iterator::read_current() {
+  if(t != NULL) { free(t); t = NULL; }
+  if(!p) { return 0; }
+
+  current.size = stasis_record_length_read(xid_, p, current);
+  t = (indexnode_rec*)malloc(current.size);
+  const byte * buf = stasis_record_read_begin(xid_, p, current);
+  memcpy(t, buf, current.size);
+  stasis_record_read_done(xid_, p, current, buf);
+  return 1;
+}
+
 void diskTreeComponent::internalNodes::iterator::close() {
 
   if(p) {
@@ -922,7 +1018,10 @@ void diskTreeComponent::iterator::init_iterators(dataTuple * key1, dataTuple * k
     if(tree_.size == INVALID_SIZE) {
         lsmIterator_ = NULL;
     } else {
-        if(key1) {
+        if(reverse_) {
+            lsmIterator_ = new diskTreeComponent::internalNodes::iterator(-1, ro_alloc_, tree_,
+                    key1 ? key1->strippedkey() : NULL, key1 ? key1->strippedkeylen() : 0, true);
+        } else if(key1) {
             lsmIterator_ = new diskTreeComponent::internalNodes::iterator(-1, ro_alloc_, tree_, key1->strippedkey(), key1->strippedkeylen());
         } else {
             lsmIterator_ = new diskTreeComponent::internalNodes::iterator(-1, ro_alloc_, tree_);
@@ -935,7 +1034,8 @@ diskTreeComponent::iterator::iterator(diskTreeComponent::internalNodes *tree, me
     tree_(tree ? tree->get_root_rec() : NULLRID),
     mgr_(mgr),
     target_progress_delta_(target_progress_delta),
-    flushing_(flushing)
+    flushing_(flushing),
+    reverse_(false)
 {
     init_iterators(NULL, NULL);
     init_helper(NULL);
@@ -946,13 +1046,26 @@ diskTreeComponent::iterator::iterator(diskTreeComponent::internalNodes *tree, da
     tree_(tree ? tree->get_root_rec() : NULLRID),
     mgr_(NULL),
     target_progress_delta_(0.0),
-    flushing_(NULL)
+    flushing_(NULL),
+    reverse_(false)
 {
     init_iterators(key,NULL);
     init_helper(key);
 
 }
 
+diskTreeComponent::iterator::iterator(diskTreeComponent::internalNodes *tree, dataTuple* key, bool reverse) :
+    ro_alloc_(new regionAllocator()),
+    tree_(tree ? tree->get_root_rec() : NULLRID),
+    mgr_(NULL),
+    target_progress_delta_(0.0),
+    flushing_(NULL),
+    reverse_(reverse)
+{
+    init_iterators(key,NULL);
+    init_helper(key);
+}
+
 diskTreeComponent::iterator::~iterator() {
   if(lsmIterator_) {
       lsmIterator_->close();
@@ -975,7 +1088,7 @@ void diskTreeComponent::iterator::init_helper(dataTuple* key1)
     }
     else
     {
-        if(lsmIterator_->next() == 0)
+        if((reverse_ ? lsmIterator_->prev() : lsmIterator_->next()) == 0)
         {
             DEBUG("diskTreeIterator:\t__error__ init_helper():\tlogtreeIteratr::next returned 0." );
             curr_page = 0;
@@ -991,7 +1104,7 @@ void diskTreeComponent::iterator::init_helper(dataTuple* key1)
             curr_page = new dataPage(-1, ro_alloc_, curr_pageid);
 
             DEBUG("opening datapage iterator %lld at key %s\n.", curr_pageid, key1 ? (char*)key1->key() : "NULL");
-            dp_itr = new DPITR_T(curr_page, key1);
+            dp_itr = new DPITR_T(curr_page, key1, reverse_);
         }
 
     }
@@ -1014,7 +1127,7 @@ dataTuple * diskTreeComponent::iterator::next_callerFrees()
         delete curr_page;
         curr_page = 0;
 
-        if(lsmIterator_->next())
+        if(reverse_ ? lsmIterator_->prev() : lsmIterator_->next())
         {
             pageid_t *pid_tmp;
 
@@ -1024,7 +1137,7 @@ dataTuple * diskTreeComponent::iterator::next_callerFrees()
             curr_pageid = *pid_tmp;
             curr_page = new dataPage(-1, ro_alloc_, curr_pageid);
             DEBUG("opening datapage iterator %lld at beginning\n.", curr_pageid);
-            dp_itr = new DPITR_T(curr_page->begin());
+            dp_itr = reverse_ ? new DPITR_T(curr_page, NULL, true) : new DPITR_T(curr_page->begin());
 
 
             readTuple = dp_itr->getnext();
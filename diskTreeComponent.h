@@ -25,6 +25,9 @@
 #include "dataPage.h"
 #include "dataTuple.h"
 #include "mergeStats.h"
+#include "prefixExtractor.h"
+#include "rangeFilter.h"
+#include "readStats.h"
 #include <stasis/util/bloomFilter.h>
 #include <stasis/util/crc32.h>
 
@@ -43,7 +46,8 @@ class diskTreeComponent {
   class iterator;
 
   diskTreeComponent(int xid, pageid_t internal_region_size, pageid_t datapage_region_size, pageid_t datapage_size,
-                    mergeStats* stats, uint64_t bloom_filter_size = 0) :
+                    mergeStats* stats, uint64_t bloom_filter_size = 0, const prefixExtractor * prefix_extractor = NULL,
+                    bool range_filter = false) :
     ltree(new diskTreeComponent::internalNodes(xid, internal_region_size, datapage_region_size, datapage_size)),
     dp(0),
     datapage_size(datapage_size),
@@ -52,7 +56,18 @@ class diskTreeComponent {
                 ? 0
                 : stasis_bloom_filter_create(diskTreeComponent_hash_func_a,
                                       diskTreeComponent_hash_func_b,
-                                      bloom_filter_size, 0.01))  {
+                                      bloom_filter_size, 0.01)),
+    // There are usually far fewer prefixes than keys.  If not, the filter is merely less selective.
+    prefix_bloom_filter((bloom_filter_size == 0 || prefix_extractor == NULL)
+                ? 0
+                : stasis_bloom_filter_create(diskTreeComponent_hash_func_a,
+                                      diskTreeComponent_hash_func_b,
+                                      bloom_filter_size / 8 + 1, 0.01)),
+    prefix_extractor(prefix_extractor),
+    // Budget about as much memory as the bloom filter.
+    range_filter(range_filter
+                ? new rangeFilter(bloom_filter_size < 4096 ? 4096 : bloom_filter_size)
+                : 0) {
     if(bloom_filter) stasis_bloom_filter_print_stats(bloom_filter);
   }
 
@@ -62,10 +77,15 @@ class diskTreeComponent {
     dp(0),
     datapage_size(-1),
     stats(stats),
-    bloom_filter(0) {}
+    bloom_filter(0),
+    prefix_bloom_filter(0),
+    prefix_extractor(0),
+    range_filter(0) {}
 
   ~diskTreeComponent() {
     if(bloom_filter) stasis_bloom_filter_destroy(bloom_filter);
+    if(prefix_bloom_filter) stasis_bloom_filter_destroy(prefix_bloom_filter);
+    delete range_filter;
     delete dp;
     delete ltree;
   }
@@ -74,7 +94,8 @@ class diskTreeComponent {
   recordid get_datapage_allocator_rid();
   recordid get_internal_node_allocator_rid();
   internalNodes * get_internal_nodes() { return ltree; }
-  dataTuple* findTuple(int xid, dataTuple::key_t key, size_t keySize);
+  /** @param stats, if not NULL, accumulates this component's read amplification counters. */
+  dataTuple* findTuple(int xid, dataTuple::key_t key, size_t keySize, readStats::counters_t * stats = NULL);
   int insertTuple(int xid, dataTuple *t);
   void writes_done();
 
@@ -89,6 +110,10 @@ class diskTreeComponent {
       return new iterator(ltree);
     }
   }
+  /** Iterate in descending order, starting with the last tuple <= key (or the last tuple, if key is NULL). */
+  iterator * open_reverse_iterator(dataTuple * key) {
+    return new iterator(ltree, key, true);
+  }
 
   void force(int xid);
   void dealloc(int xid);
@@ -180,7 +205,15 @@ class diskTreeComponent {
     public:
       iterator(int xid, regionAllocator *ro_alloc, recordid root);
       iterator(int xid, regionAllocator *ro_alloc, recordid root, const byte* key, len_t keylen);
+      /**
+       * Open an iterator for use with prev().  The first call to prev()
+       * returns the entry for the datapage that could contain key, or the
+       * last entry in the tree if key is NULL.
+       */
+      iterator(int xid, regionAllocator *ro_alloc, recordid root, const byte* key, len_t keylen, bool reverse);
       int next();
+      /** Like next(), but moves towards the start of the tree, following PREV_LEAF links. */
+      int prev();
       void close();
 
       inline size_t key (byte **key) {
@@ -197,6 +230,9 @@ class diskTreeComponent {
       inline void releaseLock() { }
 
     private:
+      void init(int xid, regionAllocator *ro_alloc, recordid root, const byte* key, len_t keylen, bool reverse);
+      int read_current();
+
       regionAllocator * ro_alloc_;
       Page * p;
       int xid_;
@@ -209,6 +245,25 @@ class diskTreeComponent {
   };
 
   stasis_bloom_filter_t * bloom_filter;
+  stasis_bloom_filter_t * prefix_bloom_filter;
+  const prefixExtractor * prefix_extractor;
+  rangeFilter * range_filter; // null unless enabled; not persisted
+
+  /**
+   * @return false if no key in this component starts with prefix.  Always
+   * true if the component has no prefix filter, or if prefix is not a
+   * complete prefix according to the component's extractor.
+   */
+  bool may_contain_prefix(const byte * prefix, size_t prefixlen) {
+    if(!prefix_bloom_filter || !prefix_extractor->is_prefix(prefix, prefixlen)) { return true; }
+    return stasis_bloom_filter_lookup(prefix_bloom_filter, (const char*)prefix, prefixlen);
+  }
+  /** @return false if no key in [lo, hi) is in this component.  lo and hi may be NULL. */
+  bool may_contain_range(dataTuple * lo, dataTuple * hi) {
+    if(!range_filter) { return true; }
+    return range_filter->may_contain(lo ? lo->strippedkey() : NULL, lo ? lo->strippedkeylen() : 0,
+                                     hi ? hi->strippedkey() : NULL, hi ? hi->strippedkeylen() : 0);
+  }
 
   class iterator
   {
@@ -218,6 +273,8 @@ class diskTreeComponent {
 
       explicit iterator(diskTreeComponent::internalNodes *tree,dataTuple *key);
 
+      explicit iterator(diskTreeComponent::internalNodes *tree,dataTuple *key, bool reverse);
+
       ~iterator();
 
       dataTuple * next_callerFrees();
@@ -235,6 +292,7 @@ class diskTreeComponent {
     mergeManager * mgr_;
     double   target_progress_delta_;
     bool * flushing_;
+    bool reverse_;
 
     diskTreeComponent::internalNodes::iterator* lsmIterator_;
 
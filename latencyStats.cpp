@@ -0,0 +1,146 @@
+/*
+ * latencyStats.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "latencyStats.h"
+
+#include <string.h>
+#include <time.h>
+
+void latencyHistogram::clear() {
+  for(int i = 0; i < BUCKETS; i++) { counts_[i] = 0; }
+  count_ = 0;
+  sum_ = 0;
+  max_ = 0;
+}
+
+void latencyHistogram::merge(const latencyHistogram * h) {
+  uint64_t n = 0;
+  for(int i = 0; i < BUCKETS; i++) {
+    uint64_t c = h->counts_[i];
+    counts_[i] += c;
+    n += c;
+  }
+  // Use the buckets' total, so that percentile() is consistent even if h is being written to.
+  count_ += n;
+  sum_ += h->sum_;
+  if(h->max_ > max_) { max_ = h->max_; }
+}
+
+uint64_t latencyHistogram::bucket_max(int b) {
+  if(b < SUB_BUCKETS) { return b; }
+  int shift = b / SUB_BUCKETS - 1;
+  uint64_t lo = (uint64_t)(SUB_BUCKETS + b % SUB_BUCKETS) << shift;
+  return lo + (((uint64_t)1 << shift) - 1);
+}
+
+uint64_t latencyHistogram::percentile(double p) const {
+  if(!count_) { return 0; }
+  uint64_t rank = (uint64_t)((p / 100.0) * count_ + 0.5);
+  if(rank < 1) { rank = 1; }
+  if(rank > count_) { rank = count_; }
+  uint64_t seen = 0;
+  for(int i = 0; i < BUCKETS; i++) {
+    seen += counts_[i];
+    if(seen >= rank) {
+      uint64_t v = bucket_max(i);
+      return v < max_ ? v : max_;
+    }
+  }
+  return max_;
+}
+
+latencyStats::latencyStats() : threads_(this, retire_thread), start_(now()) {
+}
+
+const char * latencyStats::op_name(op_t op) {
+  switch(op) {
+  case INSERT:       return "insert";
+  case FIND:         return "find";
+  case TEST_AND_SET: return "test_and_set";
+  case SCAN:         return "scan";
+  case BULK_INSERT:  return "bulk_insert";
+  case BACKPRESSURE: return "backpressure";
+  default:           return "unknown";
+  }
+}
+
+uint64_t latencyStats::now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void latencyStats::retire_thread(void * arg, per_thread * t) {
+  latencyStats * s = (latencyStats*)arg;
+  for(int i = 0; i < NUM_OPS; i++) {
+    s->retired_[i].merge(&t->h[i]);
+  }
+}
+
+void latencyStats::merge(latencyHistogram * out) {
+  threads_.lock();
+  for(int i = 0; i < NUM_OPS; i++) {
+    out[i].clear();
+    out[i].merge(&retired_[i]);
+    for(size_t j = 0; j < threads_.size(); j++) {
+      out[i].merge(&threads_[j]->h[i]);
+    }
+  }
+  threads_.unlock();
+}
+
+void latencyStats::summarize(summary_t * out) {
+  latencyHistogram * h = new latencyHistogram[NUM_OPS];
+  merge(h);
+  double elapsed = (double)(now() - start_) / 1000000000.0;
+  for(int i = 0; i < NUM_OPS; i++) {
+    out[i].count = h[i].count();
+    out[i].mean = h[i].count() ? h[i].sum() / h[i].count() : 0;
+    out[i].p50 = h[i].percentile(50.0);
+    out[i].p99 = h[i].percentile(99.0);
+    out[i].p999 = h[i].percentile(99.9);
+    out[i].max = h[i].max();
+    out[i].throughput = elapsed > 0 ? (double)h[i].count() / elapsed : 0;
+  }
+  delete[] h;
+}
+
+void latencyStats::pretty_print(FILE * out) {
+  summary_t s[NUM_OPS];
+  summarize(s);
+  fprintf(out, "%-14s %12s %10s %10s %10s %10s %10s %12s\n", "op", "count", "mean(us)", "p50(us)", "p99(us)", "p99.9(us)", "max(us)", "ops/sec");
+  for(int i = 0; i < NUM_OPS; i++) {
+    fprintf(out, "%-14s %12llu %10.1f %10.1f %10.1f %10.1f %10.1f %12.1f\n", op_name((op_t)i),
+            (unsigned long long)s[i].count, s[i].mean / 1000.0, s[i].p50 / 1000.0, s[i].p99 / 1000.0,
+            s[i].p999 / 1000.0, s[i].max / 1000.0, s[i].throughput);
+  }
+}
+
+void latencyStats::print_metrics(FILE * out) {
+  summary_t s[NUM_OPS];
+  summarize(s);
+  for(int i = 0; i < NUM_OPS; i++) {
+    const char * name = op_name((op_t)i);
+    fprintf(out, "blsm_op_latency_seconds{op=\"%s\",quantile=\"0.5\"} %.9f\n", name, s[i].p50 / 1e9);
+    fprintf(out, "blsm_op_latency_seconds{op=\"%s\",quantile=\"0.99\"} %.9f\n", name, s[i].p99 / 1e9);
+    fprintf(out, "blsm_op_latency_seconds{op=\"%s\",quantile=\"0.999\"} %.9f\n", name, s[i].p999 / 1e9);
+    fprintf(out, "blsm_op_latency_seconds{op=\"%s\",quantile=\"1\"} %.9f\n", name, s[i].max / 1e9);
+    fprintf(out, "blsm_op_latency_seconds_sum{op=\"%s\"} %.9f\n", name, (double)s[i].mean * s[i].count / 1e9);
+    fprintf(out, "blsm_op_latency_seconds_count{op=\"%s\"} %llu\n", name, (unsigned long long)s[i].count);
+  }
+}
@@ -0,0 +1,135 @@
+/*
+ * latencyStats.h
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef LATENCYSTATS_H_
+#define LATENCYSTATS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "threadSlots.h"
+
+/**
+ * A log-linear (HDR style) histogram of nanosecond latencies.  Each power of
+ * two is split into SUB_BUCKETS buckets, so a reported value is within
+ * 1/SUB_BUCKETS of the true one, whatever its magnitude.
+ *
+ * record() is meant to be called by a single thread; other threads may read
+ * the histogram (e.g., to merge it) at any time, and will see a slightly
+ * stale, but otherwise sane, copy.
+ */
+class latencyHistogram {
+public:
+  static const int SUB_BUCKET_BITS = 4;
+  static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  static const int BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  latencyHistogram() { clear(); }
+
+  void clear();
+  inline void record(uint64_t ns) {
+    counts_[bucket(ns)]++;
+    count_++;
+    sum_ += ns;
+    if(ns > max_) { max_ = ns; }
+  }
+  void merge(const latencyHistogram * h);
+
+  uint64_t count() const { return count_; }
+  uint64_t sum() const { return sum_; }
+  uint64_t max() const { return max_; }
+  /** @return an upper bound on the p'th percentile (0 <= p <= 100), or zero if the histogram is empty. */
+  uint64_t percentile(double p) const;
+
+  static inline int bucket(uint64_t ns) {
+    if(ns < (uint64_t)SUB_BUCKETS) { return (int)ns; }
+    int shift = (63 - __builtin_clzll(ns)) - SUB_BUCKET_BITS;
+    return (shift + 1) * SUB_BUCKETS + (int)((ns >> shift) - SUB_BUCKETS);
+  }
+  /** @return the largest value that falls in bucket b. */
+  static uint64_t bucket_max(int b);
+
+private:
+  volatile uint64_t counts_[BUCKETS];
+  volatile uint64_t count_;
+  volatile uint64_t sum_;
+  volatile uint64_t max_;
+};
+
+/**
+ * Per-operation latency histograms for a bLSM instance.
+ *
+ * Each thread records into its own set of histograms, so recording never
+ * takes a lock (after a thread's first call) or bounces cache lines between
+ * threads.  Readers merge every thread's histograms on demand.  When a
+ * thread exits, its histograms are folded into a shared set.
+ */
+class latencyStats {
+public:
+  enum op_t {
+    INSERT,
+    FIND,
+    TEST_AND_SET,
+    SCAN,
+    BULK_INSERT,
+    BACKPRESSURE,   ///< time writers spent sleeping to let merges catch up
+    NUM_OPS
+  };
+
+  /** A summary of one operation, as returned by OP_STAT_PERF_REPORT.  Latencies are in nanoseconds. */
+  struct summary_t {
+    uint64_t count;
+    uint64_t mean;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+    double throughput;   ///< operations per second since the stats were created
+  };
+
+  latencyStats();
+
+  static const char * op_name(op_t op);
+  /** @return a monotonic timestamp, in nanoseconds. */
+  static uint64_t now();
+
+  inline void record(op_t op, uint64_t ns) { get_thread()->h[op].record(ns); }
+  inline void record_since(op_t op, uint64_t start) { record(op, now() - start); }
+
+  /** @param out must have room for NUM_OPS histograms, which are overwritten. */
+  void merge(latencyHistogram * out);
+  /** @param out must have room for NUM_OPS summaries. */
+  void summarize(summary_t * out);
+  void pretty_print(FILE * out);
+  /** Print the summaries in the Prometheus text exposition format; latencies are in seconds. */
+  void print_metrics(FILE * out);
+
+private:
+  struct per_thread {
+    latencyHistogram h[NUM_OPS];
+  };
+
+  per_thread * get_thread() { return threads_.get(); }
+  static void retire_thread(void * arg, per_thread * t);
+
+  threadSlots<per_thread> threads_;     // its lock also protects retired_.
+  latencyHistogram retired_[NUM_OPS];   // from threads that have exited.
+  uint64_t start_;
+};
+
+#endif /* LATENCYSTATS_H_ */
@@ -43,15 +43,26 @@ public:
   public:
     iterator( rbtree_t *s )
       : first_(true),
-	done_(s == NULL) {
+	done_(s == NULL),
+	reverse_(false) {
       init_iterators(s, NULL, NULL);
     }
 
     iterator( rbtree_t *s, dataTuple *&key )
-      : first_(true), done_(s == NULL) {
+      : first_(true), done_(s == NULL), reverse_(false) {
       init_iterators(s, key, NULL);
     }
 
+    /** If reverse is true, return tuples <= key (or all tuples, if key is NULL) in descending order. */
+    iterator( rbtree_t *s, dataTuple *&key, bool reverse )
+      : first_(true), done_(s == NULL), reverse_(reverse) {
+      if(reverse_) {
+        init_reverse_iterators(s, key);
+      } else {
+        init_iterators(s, key, NULL);
+      }
+    }
+
     ~iterator() {
       delete it_;
       delete itend_;
@@ -59,6 +70,12 @@ public:
 
     dataTuple* next_callerFrees() {
       if(done_) { return NULL; }
+      if(reverse_) {
+        // it_ points just past the next tuple to return; itend_ is begin().
+        if(*it_ == *itend_) { done_ = true; return NULL; }
+        (*it_)--;
+        return (*(*it_))->create_copy();
+      }
       if(first_) { first_ = 0;} else { (*it_)++; }
       if(*it_==*itend_) { done_= true; return NULL; }
 
@@ -84,12 +101,22 @@ public:
         itend_ = NULL;
       }
     }
+    void init_reverse_iterators(rbtree_t * s, dataTuple * key) {
+      if(s) {
+        it_    = key ? new MTITER(s->upper_bound(key)) : new MTITER(s->end());
+        itend_ = new MTITER(s->begin());
+      } else {
+        it_ = NULL;
+        itend_ = NULL;
+      }
+    }
     explicit iterator() { abort(); }
     void operator=(iterator & t) { abort(); }
     int operator-(iterator & t) { abort(); }
   private:
     bool first_;
     bool done_;
+    bool reverse_;
     MTITER *it_;
     MTITER *itend_;
   };
@@ -183,6 +210,15 @@ public:
         it++;
       }
     }
+    void populate_prev_ret_impl(MTITER it) {
+      num_batched_ = 0;
+      cur_off_ = 0;
+      while(it != s_->begin() && num_batched_ < batch_size_) {
+        it--;
+        next_ret_[num_batched_] = (*it)->create_copy();
+        num_batched_++;
+      }
+    }
     void populate_next_ret(dataTuple *key=NULL, bool include_key=false) {
       if(cur_off_ == num_batched_) {
         if(mut_) pthread_mutex_lock(mut_);
@@ -195,7 +231,10 @@ public:
             pthread_mutex_lock(mut_);
           }
         }
-        if(key) {
+        if(reverse_) {
+          // the batch ends just before the first tuple > key (or >= key, if !include_key)
+          populate_prev_ret_impl(key ? (include_key ? s_->upper_bound(key) : s_->lower_bound(key)) : s_->end());
+        } else if(key) {
           populate_next_ret_impl(include_key ? s_->lower_bound(key) : s_->upper_bound(key));
         } else {
           populate_next_ret_impl(s_->begin());
@@ -205,11 +244,12 @@ public:
     }
 
   public:
-    batchedRevalidatingIterator( rbtree_t *s, mergeManager * mgr, int64_t target_size, bool * flushing, int batch_size, pthread_mutex_t * rb_mut ) : s_(s), mgr_(mgr), target_size_(target_size), flushing_(flushing), batch_size_(batch_size), num_batched_(batch_size), cur_off_(batch_size), mut_(rb_mut) {
+    batchedRevalidatingIterator( rbtree_t *s, mergeManager * mgr, int64_t target_size, bool * flushing, int batch_size, pthread_mutex_t * rb_mut ) : s_(s), mgr_(mgr), target_size_(target_size), flushing_(flushing), batch_size_(batch_size), num_batched_(batch_size), cur_off_(batch_size), mut_(rb_mut), reverse_(false) {
       next_ret_ = (dataTuple**)malloc(sizeof(next_ret_[0]) * batch_size_);
       populate_next_ret();
     }
-      batchedRevalidatingIterator( rbtree_t *s, int batch_size, pthread_mutex_t * rb_mut, dataTuple *&key ) : s_(s), mgr_(NULL), target_size_(0), flushing_(0), batch_size_(batch_size), num_batched_(batch_size), cur_off_(batch_size), mut_(rb_mut) {
+      // If reverse is true, return tuples <= key (or all tuples, if key is NULL) in descending order.
+      batchedRevalidatingIterator( rbtree_t *s, int batch_size, pthread_mutex_t * rb_mut, dataTuple *&key, bool reverse = false ) : s_(s), mgr_(NULL), target_size_(0), flushing_(0), batch_size_(batch_size), num_batched_(batch_size), cur_off_(batch_size), mut_(rb_mut), reverse_(reverse) {
       next_ret_ = (dataTuple**)malloc(sizeof(next_ret_[0]) * batch_size_);
       populate_next_ret(key, true);
     }
@@ -243,6 +283,7 @@ public:
     int num_batched_;
     int cur_off_;
     pthread_mutex_t * mut_;
+    bool reverse_;
   };
 
 };
@@ -24,7 +24,10 @@
 #include "bLSM.h"
 #include "math.h"
 #include "time.h"
+#include "tracePoints.h"
 #include <stasis/transactional.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define LEGACY_BACKPRESSURE
 
@@ -46,6 +49,8 @@ mergeManager::~mergeManager() {
   pthread_join(pp_thread, 0);
   pthread_join(update_progress_pthread, 0);
   pthread_cond_destroy(&pp_cond);
+  free(metrics_path);
+  pthread_mutex_destroy(&metrics_mut);
   delete c0;
   delete c1;
   delete c2;
@@ -71,7 +76,9 @@ void mergeManager::new_merge(int mergeLevel) {
   (s->stats_elapsed) = elapsed;
   (s->stats_active)  = 0;
 
+  events.record(mergeLevel, mergeEvent::START, (uint64_t)(elapsed * 1000000000.0), 0);
 #endif
+  BLSM_TRACE1(merge_start, mergeLevel);
 }
 void mergeManager::set_c0_size(int64_t size) {
   assert(size);
@@ -382,7 +389,10 @@ void mergeManager::tick(mergeStats * s) {
           struct timespec sleeptime;
           DEBUG("\ndisk sleeping %0.6f tree_megabytes %0.3f\n", slp, ((double)ltable->tree_bytes)/(1024.0*1024.0));
           double_to_ts(&sleeptime,slp);
+          BLSM_TRACE1(backpressure_start, 1);
           nanosleep(&sleeptime, 0);
+          BLSM_TRACE2(backpressure_done, 1, (uint64_t)(slp * 1000000000.0));
+          events.record(1, mergeEvent::SLEEP, (uint64_t)(slp * 1000000000.0), 0);
           update_progress(s, 0);
           s->need_tick = 1;
         } else {
@@ -396,12 +406,14 @@ void mergeManager::tick(mergeStats * s) {
     // Simple backpressure algorithm based on how full C0 is.
 
     pageid_t cur_c0_sz;
+    uint64_t stall_start = 0;
     if(s) {
       // Is C0 bigger than is allowed?
       while((cur_c0_sz = s->get_current_size()) > ltable->max_c0_size) {  // can't use s->current_size, since this is the thread that maintains that number...
 	printf("\nMEMORY OVERRUN!!!! SLEEP!!!!\n");
 	struct timespec ts;
 	double_to_ts(&ts, 0.1);
+	if(!stall_start) { stall_start = latencyStats::now(); BLSM_TRACE1(backpressure_start, 0); }
 	nanosleep(&ts, 0);
       }
       // Linear backpressure model
@@ -420,24 +432,31 @@ void mergeManager::tick(mergeStats * s) {
       struct timespec sleeptime;
       double_to_ts(&sleeptime, slp);
       DEBUG("%d Sleep C %f\n", s->merge_level, slp);
+      if(!stall_start) { stall_start = latencyStats::now(); BLSM_TRACE1(backpressure_start, 0); }
       nanosleep(&sleeptime, 0);
     }
+    if(stall_start) {
+      uint64_t stall = latencyStats::now() - stall_start;
+      BLSM_TRACE2(backpressure_done, 0, stall);
+      ltable->get_latency_stats()->record(latencyStats::BACKPRESSURE, stall);
+      events.record(0, mergeEvent::SLEEP, stall, cur_c0_sz);
+    }
   }
 }
 
-void mergeManager::read_tuple_from_small_component(int merge_level, dataTuple * tup) {
-  if(tup) {
+void mergeManager::read_tuple_from_small_component(int merge_level, int tuple_count, pageid_t byte_len) {
+  if(tuple_count) {
     mergeStats * s = get_merge_stats(merge_level);
-    __sync_fetch_and_add(&s->num_tuples_in_small, 1);
+    __sync_fetch_and_add(&s->num_tuples_in_small, tuple_count);
     //    (s->num_tuples_in_small)++;
 #if EXTENDED_STATS
     //    (s->stats_bytes_in_small_delta) += tup->byte_length();
-    __sync_fetch_and_add(&s->stats_bytes_in_small_delta, tup->byte_length());
+    __sync_fetch_and_add(&s->stats_bytes_in_small_delta, byte_len);
 #endif
     //    (s->bytes_in_small) += tup->byte_length();
-    __sync_fetch_and_add(&s->bytes_in_small, tup->byte_length());
+    __sync_fetch_and_add(&s->bytes_in_small, byte_len);
     if(merge_level != 0) {
-      update_progress(s, tup->byte_length());
+      update_progress(s, byte_len);
     }
     tick(s);
   }
@@ -459,6 +478,24 @@ void mergeManager::wrote_tuple(int merge_level, dataTuple * tup) {
   (s->bytes_out) += tup->byte_length();
 }
 
+void mergeManager::handed_off_tree(int merge_level) {
+  mergeStats * s = get_merge_stats(merge_level);
+  s->handed_off_tree();
+  events.record(merge_level, mergeEvent::HANDOFF, 0, s->get_current_size());
+  BLSM_TRACE2(merge_handoff, merge_level, s->get_current_size());
+}
+
+void mergeManager::handed_off_tree(int merge_level, pageid_t size) {
+  mergeStats * s = get_merge_stats(merge_level);
+  s->handed_off_tree(size);
+  events.record(merge_level, mergeEvent::HANDOFF, 0, size);
+  BLSM_TRACE2(merge_handoff, merge_level, size);
+}
+
+void mergeManager::blocked_on_downstream(uint64_t ns) {
+  events.record(1, mergeEvent::BLOCKED, ns, c1->mergeable_size);
+}
+
 void mergeManager::finished_merge(int merge_level) {
   mergeStats *s = get_merge_stats(merge_level);
   update_progress(s, 0);
@@ -475,6 +512,8 @@ void mergeManager::finished_merge(int merge_level) {
   (s->stats_elapsed) += elapsed;
   (s->stats_active) += elapsed;
   memcpy(&s->stats_sleep, &s->stats_done, sizeof(s->stats_sleep));
+  events.record(merge_level, mergeEvent::FINISH, (uint64_t)(s->stats_active * 1000000000.0), s->stats_bytes_out_with_overhead);
+  BLSM_TRACE2(merge_done, merge_level, s->stats_bytes_out_with_overhead);
 #define VERBOSE
 #ifdef VERBOSE
   fprintf(stdout, "\n");
@@ -512,6 +551,7 @@ void * mergeManager::pretty_print_thread() {
       rwlc_readlock(ltable->header_mut);
       pretty_print(stdout);
       rwlc_unlock(ltable->header_mut);
+      write_metrics_file();
     }
   }
   printf("\n");
@@ -540,6 +580,8 @@ void mergeManager::init_helper(void) {
   double_to_ts(&c1->stats_last_tick, tv_to_double(&tv));
   double_to_ts(&c2->stats_last_tick, tv_to_double(&tv));
 #endif
+  metrics_path = NULL;
+  pthread_mutex_init(&metrics_mut, 0);
   still_running = true;
   pthread_cond_init(&pp_cond, 0);
   pthread_create(&pp_thread, 0, merge_manager_pretty_print_thread, (void*)this);
@@ -581,6 +623,92 @@ void mergeManager::marshal(int xid, recordid rid) {
   c2->marshal(xid, h.c2);
 }
 
+void mergeManager::snapshot_level(mergeStats * s, mergeLevelSnapshot * out) {
+  out->merge_level = s->merge_level;
+  out->active = s->active;
+  out->in_progress = s->in_progress;
+  out->out_progress = s->out_progress;
+  out->base_size = s->base_size;
+  out->mergeable_size = s->mergeable_size;
+  out->target_size = s->target_size;
+  out->current_size = s->get_current_size();
+  out->bytes_out = s->bytes_out;
+  out->bytes_in_small = s->bytes_in_small;
+  out->bytes_in_large = s->bytes_in_large;
+  out->num_tuples_out = s->num_tuples_out;
+  out->num_tuples_in_small = s->num_tuples_in_small;
+  out->num_tuples_in_large = s->num_tuples_in_large;
+#if EXTENDED_STATS
+  out->merge_count = s->stats_merge_count;
+  out->datapages_out = s->stats_num_datapages_out;
+  out->bytes_out_with_overhead = s->stats_bytes_out_with_overhead;
+  out->lifetime_bytes_out_with_overhead = s->stats_lifetime_bytes_out_with_overhead;
+  out->bps = s->stats_bps;
+  out->lifetime_consumed = s->stats_lifetime_consumed;
+  out->lifetime_elapsed = s->stats_lifetime_elapsed;
+  out->lifetime_active = s->stats_lifetime_active;
+#endif
+}
+
+void mergeManager::get_snapshot(mergeSnapshot * out) {
+  memset(out, 0, sizeof(*out));
+  out->version = mergeSnapshot::VERSION;
+  out->timestamp_ns = mergeEventLog::now();
+  out->last_event_seq = events.last_seq();
+  if(ltable) { rwlc_readlock(ltable->header_mut); }
+  if(ltable) {
+    if(ltable->get_tree_c0())            { out->components |= mergeSnapshot::HAVE_C0; }
+    if(ltable->get_tree_c0_mergeable())  { out->components |= mergeSnapshot::HAVE_C0M; }
+    if(ltable->get_tree_c1())            { out->components |= mergeSnapshot::HAVE_C1; }
+    if(ltable->get_tree_c1_mergeable())  { out->components |= mergeSnapshot::HAVE_C1M; }
+    if(ltable->get_tree_c2())            { out->components |= mergeSnapshot::HAVE_C2; }
+    out->r = *ltable->R();
+    out->mean_c0_run_length = ltable->mean_c0_run_length;
+    out->max_c0_size = ltable->max_c0_size;
+    out->num_c0_mergers = ltable->num_c0_mergers;
+  }
+  out->c1_c2_delta = c1_c2_delta;
+  snapshot_level(c0, &out->level[0]);
+  snapshot_level(c1, &out->level[1]);
+  snapshot_level(c2, &out->level[2]);
+  if(ltable) { rwlc_unlock(ltable->header_mut); }
+}
+
+void mergeManager::set_metrics_file(const char * path) {
+  pthread_mutex_lock(&metrics_mut);
+  free(metrics_path);
+  metrics_path = path ? strdup(path) : NULL;
+  pthread_mutex_unlock(&metrics_mut);
+}
+
+void mergeManager::write_metrics_file() {
+  pthread_mutex_lock(&metrics_mut);
+  if(metrics_path) {
+    mergeSnapshot snap;
+    get_snapshot(&snap);
+    // Write a temporary file and rename it, so scrapers never see a partial file.
+    size_t len = strlen(metrics_path) + 5;
+    char * tmp = (char*)malloc(len);
+    snprintf(tmp, len, "%s.tmp", metrics_path);
+    FILE * f = fopen(tmp, "w");
+    if(f) {
+      snap.print_metrics(f);
+      if(ltable) {
+        ltable->get_latency_stats()->print_metrics(f);
+        ltable->get_read_stats()->print_metrics(f);
+        if(ltable->get_row_cache()) { ltable->get_row_cache()->print_metrics(f); }
+      }
+      if(!fclose(f)) {
+        rename(tmp, metrics_path);
+      }
+    } else {
+      perror("Couldn't write metrics file");
+    }
+    free(tmp);
+  }
+  pthread_mutex_unlock(&metrics_mut);
+}
+
 void mergeManager::pretty_print(FILE * out) {
 
 #if EXTENDED_STATS
@@ -607,6 +735,9 @@ void mergeManager::pretty_print(FILE * out) {
       have_c1m ? "C1'" : "...",
       c2->active ? "RUN" : "---", 100.0 * c2->in_progress, c2->stats_bps/((double)mb), c2->stats_lifetime_consumed/(((double)mb)*c2->stats_lifetime_elapsed),
       have_c2 ? "C2" : "..");
+  if(lt && lt->get_row_cache()) {
+    lt->get_row_cache()->pretty_print(out);
+  }
 #endif
 //#define PP_SIZES
 #ifdef PP_SIZES
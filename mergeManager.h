@@ -26,6 +26,7 @@
 #include <sys/time.h>
 #include <stdio.h>
 #include <dataTuple.h>
+#include "mergeTelemetry.h"
 
 class bLSM;
 class mergeStats;
@@ -62,7 +63,12 @@ public:
 
   void tick(mergeStats * s);
   mergeStats* get_merge_stats(int mergeLevel);
-  void read_tuple_from_small_component(int merge_level, dataTuple * tup);
+  void read_tuple_from_small_component(int merge_level, dataTuple * tup) {
+    if(tup)
+      read_tuple_from_small_component(merge_level, 1, tup->byte_length());
+  }
+  /** Account for a batch of tuples at once; applies backpressure (at most) once per call. */
+  void read_tuple_from_small_component(int merge_level, int tuple_count, pageid_t byte_len);
   void read_tuple_from_large_component(int merge_level, dataTuple * tup) {
     if(tup)
       read_tuple_from_large_component(merge_level, 1, tup->byte_length());
@@ -70,6 +76,28 @@ public:
   void read_tuple_from_large_component(int merge_level, int tuple_count, pageid_t byte_len);
 
   void wrote_tuple(int merge_level, dataTuple * tup);
+  /** Called when a merger makes its output tree available to the next one. */
+  void handed_off_tree(int merge_level);
+  /**
+   * Called when a tree that wasn't built by a merger (i.e., by bulkLoader) is
+   * installed as c[merge_level]_mergeable.
+   *
+   * @param size is the number of bytes of tuples in the tree.
+   */
+  void handed_off_tree(int merge_level, pageid_t size);
+  /** Record how long the C0-C1 merger waited for the C1-C2 merger to take C1'. */
+  void blocked_on_downstream(uint64_t ns);
+
+  /** Take a consistent copy of the merge statistics.  Must not be called with ltable->header_mut held. */
+  void get_snapshot(mergeSnapshot * out);
+  mergeEventLog * get_event_log() { return &events; }
+  /**
+   * Have the pretty print thread rewrite path with the output of
+   * mergeSnapshot::print_metrics() every second, for local metrics scrapers.
+   * Pass NULL to stop.
+   */
+  void set_metrics_file(const char * path);
+
   void pretty_print(FILE * out);
   void *pretty_print_thread();
   void *update_progress_thread();
@@ -111,6 +139,13 @@ private:
   mergeStats * c1;   /// Per-tree component statistics for c1 and c1_mergeable.
   mergeStats * c2;   /// Per-tree component statistics for c2.
 
+  mergeEventLog events;
+  char * metrics_path; /// Protected by metrics_mut.
+  pthread_mutex_t metrics_mut;
+  void write_metrics_file();
+  /** Copy one level's statistics.  Caller holds ltable->header_mut. */
+  static void snapshot_level(mergeStats * s, mergeLevelSnapshot * out);
+
   // The following fields are used to shut down the pretty print thread.
   bool still_running;
   pthread_cond_t pp_cond;
@@ -106,6 +106,7 @@ void * mergeScheduler::memMergeThread() {
         if(done==1)
         {
             pthread_cond_signal(&ltable_->c1_ready);  // no block is ready.  this allows the other thread to wake up, and see that we're shutting down.
+            pthread_cond_broadcast(&ltable_->c0_needed); // likewise for flushTableAndWait().
             rwlc_unlock(ltable_->header_mut);
             break;
         }
@@ -124,7 +125,7 @@ void * mergeScheduler::memMergeThread() {
         const int64_t min_bloom_target = ltable_->max_c0_size;
 
         //create a new tree
-        diskTreeComponent * c1_prime = new diskTreeComponent(xid,  ltable_->internal_region_size, ltable_->datapage_region_size, ltable_->datapage_size, stats, (stats->target_size < min_bloom_target ? min_bloom_target : stats->target_size) / 100);
+        diskTreeComponent * c1_prime = new diskTreeComponent(xid,  ltable_->internal_region_size, ltable_->datapage_region_size, ltable_->datapage_size, stats, (stats->target_size < min_bloom_target ? min_bloom_target : stats->target_size) / 100, ltable_->get_prefix_extractor(), ltable_->range_filters);
 
         ltable_->set_tree_c1_prime(c1_prime);
 
@@ -166,7 +167,8 @@ void * mergeScheduler::memMergeThread() {
 
         ltable_->set_c0_is_merging(false);
         double new_c1_size = stats->output_size();
-        pthread_cond_signal(&ltable_->c0_needed);
+        // broadcast; writers in flushTable() and callers of flushTableAndWait() may both be waiting.
+        pthread_cond_broadcast(&ltable_->c0_needed);
 
         ltable_->update_persistent_header(xid, merge_start);
         Tcommit(xid);
@@ -200,11 +202,16 @@ void * mergeScheduler::memMergeThread() {
             DEBUG("mmt:\tnew_c1_size %.2f\tMAX_C0_SIZE %lld\ta->max_size %lld\t targetr %.2f \n", new_c1_size,
                    ltable_->max_c0_size, a->max_size, target_R);
 
-            // XXX need to report backpressure here!
+            uint64_t blocked_start = latencyStats::now();
+            bool blocked = false;
             while(ltable_->get_tree_c1_mergeable()) {
                 ltable_->c1_flushing = true;
                 rwlc_cond_wait(&ltable_->c1_needed, ltable_->header_mut);
                 ltable_->c1_flushing = false;
+                blocked = true;
+            }
+            if(blocked) {
+                ltable_->merge_mgr->blocked_on_downstream(latencyStats::now() - blocked_start);
             }
 
             xid = Tbegin();
@@ -213,10 +220,10 @@ void * mergeScheduler::memMergeThread() {
 
           // 7: and perhaps c1_mergeable
           ltable_->set_tree_c1_mergeable(ltable_->get_tree_c1()); // c1_prime == c1.
-          stats->handed_off_tree();
+          ltable_->merge_mgr->handed_off_tree(1);
 
           // 8: c1 = new empty.
-          ltable_->set_tree_c1(new diskTreeComponent(xid, ltable_->internal_region_size, ltable_->datapage_region_size, ltable_->datapage_size, stats, 10));
+          ltable_->set_tree_c1(new diskTreeComponent(xid, ltable_->internal_region_size, ltable_->datapage_region_size, ltable_->datapage_size, stats, 10, ltable_->get_prefix_extractor(), ltable_->range_filters));
 
           pthread_cond_signal(&ltable_->c1_ready);
           ltable_->update_persistent_header(xid);
@@ -260,7 +267,8 @@ void * mergeScheduler::diskMergeThread()
         // get a new input for merge
         while(!ltable_->get_tree_c1_mergeable())
         {
-            pthread_cond_signal(&ltable_->c1_needed);
+            // broadcast; the mem merge thread and bulkLoader::finish() may both be waiting.
+            pthread_cond_broadcast(&ltable_->c1_needed);
 
             if(!ltable_->is_still_running()){
                 done = 1;
@@ -290,7 +298,7 @@ void * mergeScheduler::diskMergeThread()
         diskTreeComponent::iterator *itrB = ltable_->get_tree_c1_mergeable()->open_iterator(ltable_->merge_mgr, 0.05, &ltable_->c1_flushing);
 
         //create a new tree
-        diskTreeComponent * c2_prime = new diskTreeComponent(xid, ltable_->internal_region_size, ltable_->datapage_region_size, ltable_->datapage_size, stats, (uint64_t)(ltable_->max_c0_size * *ltable_->R() + stats->base_size)/ 1000);
+        diskTreeComponent * c2_prime = new diskTreeComponent(xid, ltable_->internal_region_size, ltable_->datapage_region_size, ltable_->datapage_size, stats, (uint64_t)(ltable_->max_c0_size * *ltable_->R() + stats->base_size)/ 1000, ltable_->get_prefix_extractor(), ltable_->range_filters);
 //        diskTreeComponent * c2_prime = new diskTreeComponent(xid, ltable_->internal_region_size, ltable_->datapage_region_size, ltable_->datapage_size, stats);
 
         rwlc_unlock(ltable_->header_mut);
@@ -331,7 +339,7 @@ void * mergeScheduler::diskMergeThread()
         DEBUG("dmt:\tmerge_count %lld\t#written bytes: %lld\n optimal r %.2f", stats.stats_merge_count, stats.output_size(), *(a->r_i));
         // 10: C2 is never too big
         ltable_->set_tree_c2(c2_prime);
-        stats->handed_off_tree();
+        ltable_->merge_mgr->handed_off_tree(2);
 
         DEBUG("dmt:\tUpdated C2's position on disk to %lld\n",(long long)-1);
         // 13
@@ -79,6 +79,7 @@ class mergeStats {
       ,
       stats_merge_count(0),
       stats_bytes_out_with_overhead(0),
+      stats_lifetime_bytes_out_with_overhead(0),
       stats_num_datapages_out(0),
       stats_bytes_in_small_delta(0),
       stats_lifetime_elapsed(0),
@@ -113,6 +114,7 @@ class mergeStats {
 #if EXTENDED_STATS
       stats_merge_count = 0;
       stats_bytes_out_with_overhead = 0;
+      stats_lifetime_bytes_out_with_overhead = 0;
       stats_num_datapages_out = 0;
       stats_bytes_in_small_delta = 0;
       stats_lifetime_elapsed = 0;
@@ -182,12 +184,20 @@ class mergeStats {
         just_handed_off = true;
       }
     }
+    /**
+     * A tree that our merger didn't build was installed as the mergeable
+     * tree.  Our merger's own output wasn't handed off, so its progress stands.
+     */
+    void handed_off_tree(pageid_t size) {
+      mergeable_size = size;
+    }
     void merged_tuples(dataTuple * merged, dataTuple * small, dataTuple * large) {
     }
     void wrote_datapage(dataPage *dp) {
 #if EXTENDED_STATS
       stats_num_datapages_out++;
       stats_bytes_out_with_overhead += (PAGE_SIZE * dp->get_page_count());
+      stats_lifetime_bytes_out_with_overhead += (PAGE_SIZE * dp->get_page_count());
 #endif
     }
     pageid_t output_size() {
@@ -244,6 +254,7 @@ class mergeStats {
     struct timeval stats_done;           /// When did we finish merging?
     struct timespec stats_last_tick;
     pageid_t stats_bytes_out_with_overhead;/// How many bytes did we write (including internal tree nodes)?
+    pageid_t stats_lifetime_bytes_out_with_overhead;/// Ditto, over every merge since startup; never reset.
     pageid_t stats_num_datapages_out;    /// How many datapages?
     pageid_t stats_bytes_in_small_delta; /// How many bytes from the small input tree during this tick (for C0, we ignore tree overheads)?
     double stats_lifetime_elapsed;       /// How long has this tree existed, in seconds?
@@ -0,0 +1,134 @@
+/*
+ * mergeTelemetry.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "mergeTelemetry.h"
+
+#include <time.h>
+
+const char * mergeEvent::type_name(int type) {
+  switch(type) {
+  case START:   return "start";
+  case HANDOFF: return "handoff";
+  case FINISH:  return "finish";
+  case SLEEP:   return "sleep";
+  case BLOCKED: return "blocked";
+  default:      return "unknown";
+  }
+}
+
+mergeEventLog::mergeEventLog(size_t capacity) :
+  events_(new mergeEvent[capacity]),
+  capacity_(capacity),
+  next_seq_(1),
+  seen_seq_(0) {
+  pthread_mutex_init(&mut_, 0);
+}
+
+mergeEventLog::~mergeEventLog() {
+  pthread_mutex_destroy(&mut_);
+  delete[] events_;
+}
+
+uint64_t mergeEventLog::now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void mergeEventLog::record(int merge_level, mergeEvent::type_t type, uint64_t duration_ns, int64_t bytes) {
+  uint64_t ts = now();
+  pthread_mutex_lock(&mut_);
+  uint64_t newest = next_seq_ - 1;
+  mergeEvent * e = &events_[newest % capacity_];
+  if(type == mergeEvent::SLEEP && newest > seen_seq_
+     && e->type == mergeEvent::SLEEP && e->merge_level == merge_level) {
+    e->timestamp_ns = ts;
+    e->duration_ns += duration_ns;
+    e->bytes = bytes;
+    e->count++;
+  } else {
+    e = &events_[next_seq_ % capacity_];
+    e->seq = next_seq_++;
+    e->timestamp_ns = ts;
+    e->merge_level = merge_level;
+    e->type = type;
+    e->duration_ns = duration_ns;
+    e->bytes = bytes;
+    e->count = 1;
+  }
+  pthread_mutex_unlock(&mut_);
+}
+
+size_t mergeEventLog::read(uint64_t after_seq, mergeEvent * out, size_t max) {
+  pthread_mutex_lock(&mut_);
+  uint64_t first = next_seq_ > capacity_ ? next_seq_ - capacity_ : 1;
+  if(after_seq + 1 > first) { first = after_seq + 1; }
+  size_t n = 0;
+  for(uint64_t seq = first; seq < next_seq_ && n < max; seq++) {
+    out[n++] = events_[seq % capacity_];
+  }
+  if(n && out[n-1].seq > seen_seq_) { seen_seq_ = out[n-1].seq; }
+  pthread_mutex_unlock(&mut_);
+  return n;
+}
+
+uint64_t mergeEventLog::last_seq() {
+  pthread_mutex_lock(&mut_);
+  uint64_t ret = next_seq_ - 1;
+  seen_seq_ = ret;
+  pthread_mutex_unlock(&mut_);
+  return ret;
+}
+
+void mergeSnapshot::print_metrics(FILE * out) const {
+  fprintf(out, "blsm_merge_r %f\n", r);
+  fprintf(out, "blsm_merge_c1_c2_delta %f\n", c1_c2_delta);
+  fprintf(out, "blsm_merge_mean_c0_run_length_bytes %lld\n", (long long)mean_c0_run_length);
+  fprintf(out, "blsm_merge_max_c0_size_bytes %lld\n", (long long)max_c0_size);
+  fprintf(out, "blsm_merge_c0_mergers_total %lld\n", (long long)num_c0_mergers);
+  fprintf(out, "blsm_merge_last_event_seq %llu\n", (unsigned long long)last_event_seq);
+  static const char * component_names[] = { "c0", "c0_mergeable", "c1", "c1_mergeable", "c2" };
+  for(int i = 0; i < 5; i++) {
+    fprintf(out, "blsm_tree_component_present{component=\"%s\"} %d\n", component_names[i], (components >> i) & 1);
+  }
+  for(int i = 0; i < 3; i++) {
+    const mergeLevelSnapshot * l = &level[i];
+    int m = l->merge_level;
+    fprintf(out, "blsm_merge_active{level=\"%d\"} %d\n", m, l->active);
+    fprintf(out, "blsm_merge_in_progress{level=\"%d\"} %f\n", m, l->in_progress);
+    fprintf(out, "blsm_merge_out_progress{level=\"%d\"} %f\n", m, l->out_progress);
+    fprintf(out, "blsm_merge_base_size_bytes{level=\"%d\"} %lld\n", m, (long long)l->base_size);
+    fprintf(out, "blsm_merge_mergeable_size_bytes{level=\"%d\"} %lld\n", m, (long long)l->mergeable_size);
+    fprintf(out, "blsm_merge_target_size_bytes{level=\"%d\"} %lld\n", m, (long long)l->target_size);
+    fprintf(out, "blsm_merge_current_size_bytes{level=\"%d\"} %lld\n", m, (long long)l->current_size);
+    fprintf(out, "blsm_merge_bytes_out{level=\"%d\"} %lld\n", m, (long long)l->bytes_out);
+    fprintf(out, "blsm_merge_bytes_in{level=\"%d\",input=\"small\"} %lld\n", m, (long long)l->bytes_in_small);
+    fprintf(out, "blsm_merge_bytes_in{level=\"%d\",input=\"large\"} %lld\n", m, (long long)l->bytes_in_large);
+    fprintf(out, "blsm_merge_tuples_out{level=\"%d\"} %lld\n", m, (long long)l->num_tuples_out);
+    fprintf(out, "blsm_merge_tuples_in{level=\"%d\",input=\"small\"} %lld\n", m, (long long)l->num_tuples_in_small);
+    fprintf(out, "blsm_merge_tuples_in{level=\"%d\",input=\"large\"} %lld\n", m, (long long)l->num_tuples_in_large);
+    fprintf(out, "blsm_merges_total{level=\"%d\"} %lld\n", m, (long long)l->merge_count);
+    fprintf(out, "blsm_merge_datapages_out{level=\"%d\"} %lld\n", m, (long long)l->datapages_out);
+    fprintf(out, "blsm_merge_bytes_out_with_overhead{level=\"%d\"} %lld\n", m, (long long)l->bytes_out_with_overhead);
+    fprintf(out, "blsm_merge_written_bytes_total{level=\"%d\"} %lld\n", m, (long long)l->lifetime_bytes_out_with_overhead);
+    fprintf(out, "blsm_merge_input_bytes_per_second{level=\"%d\"} %f\n", m, l->bps);
+    fprintf(out, "blsm_merge_consumed_bytes_total{level=\"%d\"} %f\n", m, l->lifetime_consumed);
+    fprintf(out, "blsm_merge_elapsed_seconds_total{level=\"%d\"} %f\n", m, l->lifetime_elapsed);
+    fprintf(out, "blsm_merge_active_seconds_total{level=\"%d\"} %f\n", m, l->lifetime_active);
+  }
+}
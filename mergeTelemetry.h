@@ -0,0 +1,147 @@
+/*
+ * mergeTelemetry.h
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef MERGETELEMETRY_H_
+#define MERGETELEMETRY_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+/**
+ * The state of one merge level (0 => application to C0, 1 => C0 to C1,
+ * 2 => C1 to C2), as kept by mergeStats.  Sizes are in bytes, and times are
+ * in seconds.
+ */
+struct mergeLevelSnapshot {
+  int32_t merge_level;
+  int32_t active;
+  double in_progress;
+  double out_progress;
+  int64_t base_size;
+  int64_t mergeable_size;
+  int64_t target_size;
+  int64_t current_size;
+  int64_t bytes_out;
+  int64_t bytes_in_small;
+  int64_t bytes_in_large;
+  int64_t num_tuples_out;
+  int64_t num_tuples_in_small;
+  int64_t num_tuples_in_large;
+  int64_t merge_count;
+  int64_t datapages_out;
+  int64_t bytes_out_with_overhead;
+  int64_t lifetime_bytes_out_with_overhead;  ///< bytes_out_with_overhead, summed over every merge since startup.
+  double bps;                ///< decaying average of the input rate, while active.
+  double lifetime_consumed;  ///< bytes consumed from the upstream merger.
+  double lifetime_elapsed;
+  double lifetime_active;
+};
+
+/**
+ * A consistent copy of mergeManager's spring-and-gear state, as returned by
+ * mergeManager::get_snapshot() and OP_STAT_MERGE_TELEMETRY.  It is plain
+ * data, so both ends of a connection must share the same architecture.
+ */
+struct mergeSnapshot {
+  static const uint32_t VERSION = 2;
+  static const uint32_t HAVE_C0  = 1;
+  static const uint32_t HAVE_C0M = 2;
+  static const uint32_t HAVE_C1  = 4;
+  static const uint32_t HAVE_C1M = 8;
+  static const uint32_t HAVE_C2  = 16;
+
+  uint32_t version;
+  uint32_t components;       ///< which tree components exist; HAVE_* bits.
+  uint64_t timestamp_ns;     ///< wall clock time of the snapshot.
+  double r;
+  double c1_c2_delta;
+  int64_t mean_c0_run_length;
+  int64_t max_c0_size;
+  int64_t num_c0_mergers;
+  uint64_t last_event_seq;   ///< the newest event in the merge event log, or zero.
+  mergeLevelSnapshot level[3];
+
+  /** Print the snapshot in the Prometheus text exposition format. */
+  void print_metrics(FILE * out) const;
+};
+
+/** Something that happened to a merger; see mergeEventLog. */
+struct mergeEvent {
+  enum type_t {
+    START,     ///< a merge started; duration is how long the merger waited for input.
+    HANDOFF,   ///< a merger handed its output tree to the next one; bytes is its size.
+    FINISH,    ///< a merge finished; duration is how long it ran, and bytes is how much it wrote.
+    SLEEP,     ///< a writer (level 0) or merger slept for backpressure; see count.
+    BLOCKED,   ///< the C0-C1 merger waited for the C1-C2 merger to take C1'.
+    NUM_TYPES
+  };
+  uint64_t seq;            ///< starts at one, and increases by one per event.
+  uint64_t timestamp_ns;   ///< wall clock time at the end of the event.
+  int32_t merge_level;
+  int32_t type;
+  uint64_t duration_ns;
+  int64_t bytes;
+  uint64_t count;          ///< for SLEEP, how many sleeps duration_ns adds up; otherwise one.
+
+  static const char * type_name(int type);
+};
+
+/**
+ * A fixed size, time ordered ring of the most recent merge events, so that
+ * write stalls can be lined up against what the mergers were doing.  Events
+ * are rare (at most a few per merge), so a mutex is cheap enough.
+ *
+ * Backpressure sleeps are not rare; a stalled merger sleeps on every tick.
+ * So a SLEEP is folded into the newest event instead, if that is a SLEEP at
+ * the same level that no reader has seen yet.  Runs of sleeps then take up
+ * one slot per poll, rather than pushing everything else out of the ring.
+ */
+class mergeEventLog {
+public:
+  static const size_t DEFAULT_CAPACITY = 4096;
+
+  mergeEventLog(size_t capacity = DEFAULT_CAPACITY);
+  ~mergeEventLog();
+
+  void record(int merge_level, mergeEvent::type_t type, uint64_t duration_ns, int64_t bytes);
+  /**
+   * Copy out the oldest retained events whose seq is greater than after_seq.
+   * Pass the seq of the last event seen to poll for new ones; events that
+   * were overwritten in the meantime are skipped.  Events that have been
+   * read are never folded into again.
+   *
+   * @param out must have room for max events.
+   * @return the number of events copied.
+   */
+  size_t read(uint64_t after_seq, mergeEvent * out, size_t max);
+  /** @return the seq of the newest event, or zero if there have been none. */
+  uint64_t last_seq();
+
+  /** @return the current wall clock time, in nanoseconds. */
+  static uint64_t now();
+
+private:
+  mergeEvent * events_;
+  size_t capacity_;
+  uint64_t next_seq_;
+  uint64_t seen_seq_;  ///< the newest event that read() or last_seq() has reported.
+  pthread_mutex_t mut_;
+};
+
+#endif /* MERGETELEMETRY_H_ */
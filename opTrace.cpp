@@ -0,0 +1,290 @@
+/*
+ * opTrace.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "opTrace.h"
+#include "latencyStats.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+const char opTrace::MAGIC[8] = { 'b', 'L', 'S', 'M', 't', 'r', 'c', '1' };
+
+opTrace * opTrace::open(const char * path) {
+  FILE * f = fopen(path, "w");
+  if(!f) { return NULL; }
+  header hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, MAGIC, sizeof(hdr.magic));
+  hdr.version = VERSION;
+  hdr.record_size = sizeof(record);
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  hdr.start_time_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+  if(fwrite(&hdr, sizeof(hdr), 1, f) != 1 || fflush(f)) {
+    int err = errno;
+    fclose(f);
+    errno = err;
+    return NULL;
+  }
+  return new opTrace(f);
+}
+
+opTrace::opTrace(FILE * f) :
+  f_(f),
+  start_(latencyStats::now()),
+  threads_(this, retire_thread, register_thread),
+  queued_bytes_(0),
+  next_thread_(0),
+  dropped_(0),
+  shutting_down_(false) {
+  pthread_cond_init(&cond_, 0);
+  pthread_create(&writer_, 0, writer_thread, this);
+}
+
+opTrace::~opTrace() {
+  threads_.lock();
+  shutting_down_ = true;
+  pthread_cond_signal(&cond_);
+  threads_.unlock();
+  pthread_join(writer_, 0);
+  fclose(f_);
+
+  for(size_t i = 0; i < queue_.size(); i++) {
+    free(queue_[i].buf);
+  }
+  pthread_cond_destroy(&cond_);
+}
+
+const char * opTrace::op_name(op_t op) {
+  switch(op) {
+  case INSERT:           return "insert";
+  case INSERT_IF_ABSENT: return "insert_if_absent";
+  case FIND:             return "find";
+  case TEST_AND_SET:     return "test_and_set";
+  case SCAN:             return "scan";
+  default:               return "unknown";
+  }
+}
+
+void opTrace::register_thread(void * arg, per_thread * t) {
+  t->id = ((opTrace*)arg)->next_thread_++;
+}
+
+void opTrace::retire_thread(void * arg, per_thread * t) {
+  pthread_mutex_lock(&t->mut);
+  if(t->b.len) {
+    ((opTrace*)arg)->enqueue(t->b);
+    t->b.buf = NULL;
+  }
+  pthread_mutex_unlock(&t->mut);
+}
+
+static byte * append_tuple(byte * p, const dataTuple * t) {
+  len_t keylen, datalen;
+  const byte * bytes = t->get_bytes(&keylen, &datalen);
+  memcpy(p, &keylen, sizeof(keylen));
+  p += sizeof(keylen);
+  memcpy(p, &datalen, sizeof(datalen));
+  p += sizeof(datalen);
+  size_t len = dataTuple::length_from_header(keylen, datalen);
+  memcpy(p, bytes, len);
+  return p + len;
+}
+
+void opTrace::record_op(op_t op, uint64_t start, bool result, const dataTuple * t, const dataTuple * t2, uint64_t count) {
+  assert(t || !t2);
+  record r;
+  r.start_ns = start > start_ ? start - start_ : 0;
+  r.duration_ns = latencyStats::now() - start;
+  r.count = count;
+  r.op = op;
+  r.tuples = t2 ? 2 : (t ? 1 : 0);
+  r.result = result;
+  r.pad = 0;
+  size_t len = sizeof(r) + (t ? t->byte_length() : 0) + (t2 ? t2->byte_length() : 0);
+
+  per_thread * th = get_thread();
+  buffer full;
+  full.buf = NULL;
+  pthread_mutex_lock(&th->mut);
+  if(th->b.len + len > th->cap) {
+    if(th->b.len) {
+      full = th->b;
+    } else {
+      free(th->b.buf);
+    }
+    th->cap = len > BUFFER_SIZE ? len : BUFFER_SIZE;
+    th->b.buf = (byte*)malloc(th->cap);
+    th->b.len = 0;
+    th->b.records = 0;
+  }
+  r.thread = th->id;
+  r.seq = th->seq++;
+  byte * p = th->b.buf + th->b.len;
+  memcpy(p, &r, sizeof(r));
+  p += sizeof(r);
+  if(t)  { p = append_tuple(p, t); }
+  if(t2) { p = append_tuple(p, t2); }
+  th->b.len += len;
+  th->b.records++;
+  pthread_mutex_unlock(&th->mut);
+
+  if(full.buf) {
+    threads_.lock();
+    enqueue(full);
+    pthread_cond_signal(&cond_);
+    threads_.unlock();
+  }
+}
+
+uint64_t opTrace::get_dropped() {
+  threads_.lock();
+  uint64_t ret = dropped_;
+  threads_.unlock();
+  return ret;
+}
+
+void opTrace::enqueue(buffer b) {
+  if(queued_bytes_ + b.len > MAX_QUEUED_BYTES) {
+    dropped_ += b.records;
+    free(b.buf);
+    return;
+  }
+  queued_bytes_ += b.len;
+  queue_.push_back(b);
+}
+
+void opTrace::collect_partial_buffers() {
+  for(size_t i = 0; i < threads_.size(); i++) {
+    per_thread * t = threads_[i];
+    pthread_mutex_lock(&t->mut);
+    if(t->b.len) {
+      enqueue(t->b);
+      t->b.buf = NULL;
+      t->b.len = 0;
+      t->b.records = 0;
+      t->cap = 0;
+    }
+    pthread_mutex_unlock(&t->mut);
+  }
+}
+
+void * opTrace::writer_thread(void * arg) {
+  ((opTrace*)arg)->writer();
+  return 0;
+}
+
+void opTrace::writer() {
+  threads_.lock();
+  while(true) {
+    if(queue_.empty() && !shutting_down_) {
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_sec++;
+      if(pthread_cond_timedwait(&cond_, threads_.mutex(), &ts) == ETIMEDOUT) {
+        collect_partial_buffers();
+      }
+    }
+    bool done = shutting_down_;
+    if(done) { collect_partial_buffers(); }
+    std::vector<buffer> work;
+    work.swap(queue_);
+    queued_bytes_ = 0;
+    threads_.unlock();
+
+    uint64_t lost = 0;
+    for(size_t i = 0; i < work.size(); i++) {
+      if(fwrite(work[i].buf, work[i].len, 1, f_) != 1) {
+        lost += work[i].records;
+      }
+      free(work[i].buf);
+    }
+    if(!work.empty()) { fflush(f_); }
+
+    threads_.lock();
+    if(lost) {
+      if(!dropped_) { perror("Couldn't write op trace"); }
+      dropped_ += lost;
+    }
+    if(done) { break; }
+  }
+  threads_.unlock();
+}
+
+opTraceReader * opTraceReader::open(const char * path) {
+  FILE * f = fopen(path, "r");
+  if(!f) { return NULL; }
+  opTrace::header hdr;
+  if(fread(&hdr, sizeof(hdr), 1, f) != 1
+     || memcmp(hdr.magic, opTrace::MAGIC, sizeof(hdr.magic))
+     || hdr.version != opTrace::VERSION
+     || hdr.record_size != sizeof(opTrace::record)) {
+    fclose(f);
+    errno = EINVAL;
+    return NULL;
+  }
+  return new opTraceReader(f, hdr);
+}
+
+opTraceReader::opTraceReader(FILE * f, const opTrace::header &hdr) :
+  f_(f),
+  hdr_(hdr),
+  err_(0) {
+}
+
+opTraceReader::~opTraceReader() {
+  fclose(f_);
+}
+
+dataTuple * opTraceReader::read_tuple() {
+  len_t lens[2];
+  if(fread(lens, sizeof(lens), 1, f_) != 1) { return NULL; }
+  size_t len = dataTuple::length_from_header(lens[0], lens[1]);
+  byte * buf = (byte*)malloc(len);
+  dataTuple * ret = NULL;
+  if(fread(buf, len, 1, f_) == 1) {
+    ret = dataTuple::from_bytes(lens[0], lens[1], buf);
+  }
+  free(buf);
+  return ret;
+}
+
+bool opTraceReader::next(opTrace::record * r, dataTuple ** t, dataTuple ** t2) {
+  *t = NULL;
+  *t2 = NULL;
+  if(err_) { return false; }
+  size_t n = fread(r, 1, sizeof(*r), f_);
+  if(n == 0) { return false; }
+  if(n != sizeof(*r) || r->op >= opTrace::NUM_OPS || r->tuples > 2) {
+    err_ = EIO;
+    return false;
+  }
+  if(r->tuples > 0 && !(*t = read_tuple())) {
+    err_ = EIO;
+    return false;
+  }
+  if(r->tuples > 1 && !(*t2 = read_tuple())) {
+    dataTuple::freetuple(*t);
+    *t = NULL;
+    err_ = EIO;
+    return false;
+  }
+  return true;
+}
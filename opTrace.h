@@ -0,0 +1,191 @@
+/*
+ * opTrace.h
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef OPTRACE_H_
+#define OPTRACE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <vector>
+
+#include "dataTuple.h"
+#include "threadSlots.h"
+
+/**
+ * A binary trace of the operations a server performs against its bLSM
+ * instance, for replay on another machine (see benchmarks/trace_replay).
+ *
+ * Each thread appends records to a private buffer.  Full buffers are handed
+ * to a writer thread, which also collects partially filled buffers once a
+ * second, so that an idle server's trace stays current.  Recording never
+ * waits for the disk; if the writer falls more than MAX_QUEUED_BYTES behind,
+ * buffers are dropped, and counted in get_dropped().
+ *
+ * File layout (integers are in host byte order, like componentFile):
+ *
+ * <pre>
+ *   header    opTrace::header
+ *   record    opTrace::record, followed by record::tuples encoded tuples
+ *   ...
+ * </pre>
+ *
+ * Tuples are encoded as dataTuple::to_bytes() does (keylen, datalen, key,
+ * data).  Records are in order within each thread, but threads' records are
+ * interleaved a buffer at a time; sort by (start_ns, thread, seq) to recover
+ * the order in which operations started.
+ *
+ * Batched inserts (OP_BULK_INSERT, and mapkeeper's insertMany) are applied
+ * all at once, so they have no per-tuple latency.  Each tuple is recorded as
+ * an INSERT whose start_ns and duration_ns are the whole batch's, and whose
+ * count is the number of tuples in the batch; single inserts have a count
+ * of (uint64_t)-1.  Leave out the batched records (or divide their
+ * durations by count) when comparing insert latencies.
+ */
+class opTrace {
+public:
+  static const char     MAGIC[8];
+  static const uint32_t VERSION = 1;
+  static const size_t   BUFFER_SIZE = 256 * 1024;
+  static const size_t   MAX_QUEUED_BYTES = 64 * 1024 * 1024;
+
+  enum op_t {
+    INSERT,            ///< tuple; tombstones are deletes.  count is the batch size for batched inserts.
+    INSERT_IF_ABSENT,  ///< tuple; result is 1 if it was inserted.
+    FIND,              ///< key tuple; result is 1 if the key was found.
+    TEST_AND_SET,      ///< new tuple, expected tuple; result is 1 if the tuple was set.
+    SCAN,              ///< start tuple, and end tuple unless the scan was unbounded; count is the limit.
+    NUM_OPS
+  };
+
+  struct header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t record_size;      /// sizeof(record), so readers can reject files from other builds.
+    uint64_t start_time_ns;    /// Wall clock time at which the trace started.
+  };
+  struct record {
+    uint64_t start_ns;         /// When the operation started, relative to the start of the trace.
+    uint64_t duration_ns;
+    uint64_t count;
+    uint64_t seq;              /// Per-thread sequence number.
+    uint32_t thread;
+    uint8_t  op;
+    uint8_t  tuples;
+    uint8_t  result;
+    uint8_t  pad;
+  };
+
+  /** @return a new trace, or NULL (with errno set) if path can't be created. */
+  static opTrace * open(const char * path);
+  /** Waits for the writer to drain everything recorded so far. */
+  ~opTrace();
+
+  static const char * op_name(op_t op);
+
+  /**
+   * Record an operation that started at start (a latencyStats::now()
+   * timestamp) and just finished.
+   *
+   * @param t2 may be NULL.
+   */
+  void record_op(op_t op, uint64_t start, bool result, const dataTuple * t, const dataTuple * t2 = NULL, uint64_t count = (uint64_t)-1);
+
+  /** @return the number of records that were lost because the writer fell behind. */
+  uint64_t get_dropped();
+
+private:
+  struct buffer {
+    byte * buf;
+    size_t len;
+    uint64_t records;
+  };
+  struct per_thread {
+    pthread_mutex_t mut;     // held while appending; the writer takes it to collect partial buffers.
+    buffer b;
+    size_t cap;
+    uint32_t id;
+    uint64_t seq;
+    per_thread() : cap(0), id(0), seq(0) {
+      pthread_mutex_init(&mut, 0);
+      b.buf = NULL;
+      b.len = 0;
+      b.records = 0;
+    }
+    ~per_thread() {
+      free(b.buf);
+      pthread_mutex_destroy(&mut);
+    }
+  };
+
+  opTrace(FILE * f);
+
+  per_thread * get_thread() { return threads_.get(); }
+  static void register_thread(void * arg, per_thread * t);
+  static void retire_thread(void * arg, per_thread * t);
+  /** Queue b for the writer, or drop it.  Caller holds threads_'s lock. */
+  void enqueue(buffer b);
+  void collect_partial_buffers();
+  static void * writer_thread(void * arg);
+  void writer();
+
+  FILE * f_;
+  uint64_t start_;
+  pthread_t writer_;
+  threadSlots<per_thread> threads_;   // its lock also protects the fields below.
+  pthread_cond_t cond_;
+  std::vector<buffer> queue_;
+  size_t queued_bytes_;
+  uint32_t next_thread_;
+  uint64_t dropped_;
+  bool shutting_down_;
+};
+
+class opTraceReader {
+public:
+  /**
+   * @return a new reader, or NULL (with errno set) if the file can't be
+   * opened, or its header is invalid.
+   */
+  static opTraceReader * open(const char * path);
+  ~opTraceReader();
+
+  /**
+   * Read the next record.  Unused tuples are set to NULL; the caller frees
+   * the others.
+   *
+   * @return false at the end of the file or on error.  Use error() to tell
+   * the two apart.
+   */
+  bool next(opTrace::record * r, dataTuple ** t, dataTuple ** t2);
+  /** @return 0, or EIO if the file ends in the middle of a record (e.g., the server crashed) or is corrupt. */
+  int error() { return err_; }
+
+  const opTrace::header & get_header() { return hdr_; }
+
+private:
+  opTraceReader(FILE * f, const opTrace::header &hdr);
+  dataTuple * read_tuple();
+
+  FILE * f_;
+  opTrace::header hdr_;
+  int err_;
+};
+
+#endif /* OPTRACE_H_ */
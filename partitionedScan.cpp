@@ -0,0 +1,173 @@
+/*
+ * partitionedScan.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <algorithm>
+#include "partitionedScan.h"
+
+#include <stasis/transactional.h>
+
+static bool sample_lt(const partitionedScan::sample_t &a, const partitionedScan::sample_t &b) {
+  return dataTuple::compare_obj(a.key, b.key) < 0;
+}
+
+// Walk an in-memory tree, copying only the first key of each chunk.  If
+// rb_mut is set, it is dropped every BATCH tuples so that writers are not
+// blocked for the whole walk.
+static void sample_mem(memTreeComponent::rbtree_ptr_t tree, pthread_mutex_t * rb_mut, pageid_t chunk, std::vector<partitionedScan::sample_t> * samples) {
+  static const int BATCH = 1000;
+  if(!tree) { return; }
+  partitionedScan::sample_t s = { NULL, 0 };
+  dataTuple * resume = NULL;  // the last key we saw
+  bool done = false;
+  while(!done) {
+    if(rb_mut) { pthread_mutex_lock(rb_mut); }
+    memTreeComponent::rbtree_t::const_iterator it = resume ? tree->upper_bound(resume) : tree->begin();
+    for(int i = 0; i < BATCH && it != tree->end(); i++, ++it) {
+      s.bytes += (*it)->byte_length();
+      if(!s.key) {
+        s.key = dataTuple::create((*it)->rawkey(), (*it)->rawkeylen());
+      }
+      if(s.bytes >= chunk) {
+        samples->push_back(s);
+        s.key = NULL;
+        s.bytes = 0;
+      }
+    }
+    done = (it == tree->end());
+    if(!done) {
+      if(resume) { dataTuple::freetuple(resume); }
+      --it;
+      resume = dataTuple::create((*it)->rawkey(), (*it)->rawkeylen());
+    }
+    if(rb_mut) { pthread_mutex_unlock(rb_mut); }
+  }
+  if(resume) { dataTuple::freetuple(resume); }
+  if(s.key) { samples->push_back(s); }
+}
+
+static void sample_disk(int xid, diskTreeComponent * c, pageid_t chunk, std::vector<partitionedScan::sample_t> * samples) {
+  if(!c) { return; }
+  regionAllocator * ro_alloc = new regionAllocator();
+  diskTreeComponent::internalNodes::iterator * it = new diskTreeComponent::internalNodes::iterator(xid, ro_alloc, c->get_root_rid());
+  while(it->next()) {
+    byte * key;
+    size_t keylen = it->key(&key);
+    partitionedScan::sample_t s = { dataTuple::create(key, keylen), chunk };
+    samples->push_back(s);
+  }
+  it->close();
+  delete it;
+  delete ro_alloc;
+}
+
+void partitionedScan::sample_keys(bLSM * ltable, std::vector<sample_t> * samples) {
+  // Disk trees have one internal node entry per datapage; sample C0 at the same granularity.
+  pageid_t chunk = ltable->datapage_size * PAGE_SIZE;
+
+  int xid = Tbegin();
+  rwlc_readlock(ltable->header_mut);
+
+  // C0_mergeable doesn't change until the C0-C1 merger is done with it,
+  // which can't happen while we hold header_mut.
+  sample_mem(ltable->get_tree_c0(), &ltable->rb_mut, chunk, samples);
+  sample_mem(ltable->get_tree_c0_mergeable(), NULL, chunk, samples);
+
+  sample_disk(xid, ltable->get_tree_c1_prime(), chunk, samples);
+  sample_disk(xid, ltable->get_tree_c1(), chunk, samples);
+  sample_disk(xid, ltable->get_tree_c1_mergeable(), chunk, samples);
+  sample_disk(xid, ltable->get_tree_c2(), chunk, samples);
+
+  rwlc_unlock(ltable->header_mut);
+  Tcommit(xid);
+
+  std::sort(samples->begin(), samples->end(), sample_lt);
+}
+
+void partitionedScan::free_samples(std::vector<sample_t> * samples) {
+  for(unsigned int i = 0; i < samples->size(); i++) {
+    dataTuple::freetuple((*samples)[i].key);
+  }
+  samples->clear();
+}
+
+void partitionedScan::split_points(const std::vector<sample_t> &samples, int n, std::vector<dataTuple*> * keys) {
+  double total = 0;
+  for(unsigned int i = 0; i < samples.size(); i++) {
+    total += samples[i].bytes;
+  }
+  double cum = 0;
+  int k = 1;
+  for(unsigned int i = 0; i < samples.size() && k < n; i++) {
+    // Split before the first sample that would push the current range past its share.
+    dataTuple * prev = keys->empty() ? samples[0].key : keys->back();
+    if(cum >= (total * k) / n && dataTuple::compare_obj(prev, samples[i].key) < 0) {
+      keys->push_back(samples[i].key->create_copy());
+      k++;
+    }
+    cum += samples[i].bytes;
+  }
+}
+
+partitionedScan::partitionedScan(bLSM * ltable, int n) : ltable_(ltable) {
+  std::vector<sample_t> samples;
+  sample_keys(ltable, &samples);
+  split_points(samples, n, &splits_);
+  free_samples(&samples);
+  DEBUG("partitioned scan: %d partitions requested, %d chosen\n", n, get_partition_count());
+}
+
+partitionedScan::~partitionedScan() {
+  for(unsigned int i = 0; i < splits_.size(); i++) {
+    dataTuple::freetuple(splits_[i]);
+  }
+}
+
+void * partitionedScan::worker_thread(void * arg) {
+  worker_t * w = (worker_t*)arg;
+  iterator * it = w->scan->open_iterator(w->partition);
+  dataTuple * t;
+  while((t = it->getnext())) {
+    w->ret = w->cb(w->arg, w->partition, t);
+    dataTuple::freetuple(t);
+    if(w->ret) { break; }
+  }
+  delete it;
+  return 0;
+}
+
+int partitionedScan::run(callback_t cb, void * arg) {
+  int n = get_partition_count();
+  worker_t * workers = new worker_t[n];
+  pthread_t * threads = new pthread_t[n];
+  for(int i = 0; i < n; i++) {
+    workers[i].scan = this;
+    workers[i].partition = i;
+    workers[i].cb = cb;
+    workers[i].arg = arg;
+    workers[i].ret = 0;
+    pthread_create(&threads[i], 0, worker_thread, &workers[i]);
+  }
+  int ret = 0;
+  for(int i = 0; i < n; i++) {
+    pthread_join(threads[i], 0);
+    if(!ret) { ret = workers[i].ret; }
+  }
+  delete [] threads;
+  delete [] workers;
+  return ret;
+}
@@ -0,0 +1,124 @@
+/*
+ * partitionedScan.h
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef PARTITIONEDSCAN_H_
+#define PARTITIONEDSCAN_H_
+
+#include <stasis/common.h>
+#include <vector>
+
+#include "bLSM.h"
+
+/**
+ * Splits the key space into ranges that hold roughly the same number of
+ * bytes, and scans them in parallel.
+ *
+ * The split points are chosen from a sample of every component: one key
+ * per datapage of each disk tree (read from the bottom level of its internal
+ * nodes), and one key per datapage worth of tuples in C0 and C0_mergeable.
+ * Each sample is weighted by the number of bytes it stands for, so a
+ * recently written burst of keys that is still in C0 or C1 gets its own
+ * partitions instead of landing in whichever C2 range happens to cover it.
+ *
+ * The partitions are computed once, when the partitionedScan is created.
+ * They are only a hint; each partition is scanned with its own
+ * bLSM::iterator, so the union of the partitions is always exactly the
+ * table, however much it changes in the meantime.
+ */
+class partitionedScan {
+public:
+  struct sample_t {
+    dataTuple * key;
+    pageid_t bytes;   /// approximate number of bytes between key and the next sample of the same component
+  };
+  /** Sample every component of ltable.  The result is sorted by key; free it with free_samples(). */
+  static void sample_keys(bLSM * ltable, std::vector<sample_t> * samples);
+  static void free_samples(std::vector<sample_t> * samples);
+  /**
+   * Choose up to n-1 distinct keys that split the samples into n ranges of
+   * about the same size.  The keys are copies; the caller frees them.
+   */
+  static void split_points(const std::vector<sample_t> &samples, int n, std::vector<dataTuple*> * keys);
+
+  /** Partition ltable into (at most) n ranges.  Small tables get fewer partitions. */
+  partitionedScan(bLSM * ltable, int n);
+  ~partitionedScan();
+
+  int get_partition_count() { return splits_.size() + 1; }
+  /** @return the smallest key in partition i, or NULL if it is the first partition. */
+  dataTuple * get_start_key(int i) { return i ? splits_[i-1] : NULL; }
+  /** @return the smallest key past partition i, or NULL if it is the last partition. */
+  dataTuple * get_end_key(int i) { return i < (int)splits_.size() ? splits_[i] : NULL; }
+
+  /** A bLSM::iterator that stops at the end of a range. */
+  class iterator {
+  public:
+    iterator(bLSM * ltable, dataTuple * start, dataTuple * end)
+      : it_(new bLSM::iterator(ltable, start)), end_(end) { }
+    ~iterator() { delete it_; }
+    /** @return the next live tuple in the range, or NULL.  The caller frees it. */
+    dataTuple * getnext() {
+      if(!it_) { return NULL; }
+      dataTuple * t = it_->getnext();
+      if(t && end_ && dataTuple::compare_obj(t, end_) >= 0) {
+        dataTuple::freetuple(t);
+        t = NULL;
+      }
+      if(!t) {
+        // Drop our read lock on the tree header as soon as possible.
+        delete it_;
+        it_ = NULL;
+      }
+      return t;
+    }
+  private:
+    bLSM::iterator * it_;
+    dataTuple * end_;
+  };
+  iterator * open_iterator(int i) { return new iterator(ltable_, get_start_key(i), get_end_key(i)); }
+
+  /**
+   * Called once for each tuple of partition i, from that partition's thread.
+   * Calls for a given partition are in key order.  t belongs to the caller
+   * of the callback.
+   *
+   * @return zero to continue, or nonzero to stop scanning this partition.
+   */
+  typedef int (*callback_t)(void * arg, int partition, dataTuple * t);
+  /**
+   * Scan every partition concurrently, with one thread per partition.
+   *
+   * @return zero, or the first nonzero value returned by cb.
+   */
+  int run(callback_t cb, void * arg);
+
+private:
+  struct worker_t {
+    partitionedScan * scan;
+    int partition;
+    callback_t cb;
+    void * arg;
+    int ret;
+  };
+  static void * worker_thread(void * arg);
+
+  bLSM * ltable_;
+  std::vector<dataTuple*> splits_;
+};
+
+#endif /* PARTITIONEDSCAN_H_ */
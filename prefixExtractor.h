@@ -0,0 +1,58 @@
+/*
+ * prefixExtractor.h
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _PREFIX_EXTRACTOR_H_
+#define _PREFIX_EXTRACTOR_H_
+
+#include <stasis/common.h>
+
+/**
+ * @return the length of key's prefix, or zero if key has no prefix (and
+ * should not be entered into prefix bloom filters).
+ */
+typedef size_t (*prefix_fn_t) (const byte * key, size_t keylen);
+
+/**
+ * Maps keys to prefixes for the per-component prefix bloom filters.  Keys
+ * that share a prefix must be contiguous in key order, so the prefix has to
+ * be a leading substring of the key.
+ *
+ * Either wrap an arbitrary function, or use a fixed length prefix (which is
+ * what the mapkeeper server does with its 4 byte database ids).
+ */
+class prefixExtractor
+{
+public:
+    prefixExtractor(prefix_fn_t prefix_fp) : prefix_fp(prefix_fp), fixed_len(0) { }
+    explicit prefixExtractor(size_t fixed_len) : prefix_fp(0), fixed_len(fixed_len) { }
+
+    size_t prefix_len(const byte * key, size_t keylen) const {
+        if(prefix_fp) { return prefix_fp(key, keylen); }
+        return keylen >= fixed_len ? fixed_len : 0;
+    }
+    /** @return true if prefix is exactly what this extractor returns for keys that start with it. */
+    bool is_prefix(const byte * prefix, size_t prefixlen) const {
+        return prefixlen && prefix_len(prefix, prefixlen) == prefixlen;
+    }
+
+private:
+    prefix_fn_t prefix_fp;
+    size_t fixed_len;
+};
+
+#endif
@@ -0,0 +1,83 @@
+/*
+ * rangeFilter.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "rangeFilter.h"
+#include "dataTuple.h"
+
+rangeFilter::rangeFilter(size_t max_bytes)
+  : max_bytes_(max_bytes),
+    trunc_len_(MAX_TRUNC_LEN),
+    sealed_(false) { }
+
+void rangeFilter::insert(const byte * key, size_t keylen) {
+  if(offsets_.empty()) { min_.assign((const char*)key, keylen); }
+  max_.assign((const char*)key, keylen);
+
+  size_t len = keylen < trunc_len_ ? keylen : trunc_len_;
+  size_t n = offsets_.size();
+  if(n && !dataTuple::compare(entry(n-1), entry_len(n-1), key, len)) { return; }
+  offsets_.push_back(data_.size());
+  data_.append((const char*)key, len);
+  while(memory_usage() > max_bytes_ && trunc_len_ > 1) {
+    coarsen();
+  }
+}
+
+void rangeFilter::coarsen() {
+  trunc_len_ = trunc_len_ * 3 / 4;
+  std::string data;
+  std::vector<uint32_t> offsets;
+  for(size_t i = 0; i < offsets_.size(); i++) {
+    size_t len = entry_len(i);
+    if(len > trunc_len_) { len = trunc_len_; }
+    size_t n = offsets.size();
+    if(n) {
+      size_t last_len = data.size() - offsets[n-1];
+      if(!dataTuple::compare((const byte*)data.data() + offsets[n-1], last_len, entry(i), len)) { continue; }
+    }
+    offsets.push_back(data.size());
+    data.append((const char*)entry(i), len);
+  }
+  data_.swap(data);
+  offsets_.swap(offsets);
+  DEBUG("range filter: truncated to %lld bytes; %lld prefixes\n", (long long)trunc_len_, (long long)offsets_.size());
+}
+
+bool rangeFilter::may_contain(const byte * lo, size_t lolen, const byte * hi, size_t hilen) const {
+  if(!sealed_) { return true; }
+  if(offsets_.empty()) { return false; }
+  if(lo && dataTuple::compare(lo, lolen, (const byte*)max_.data(), max_.size()) > 0) { return false; }
+  if(hi && dataTuple::compare(hi, hilen, (const byte*)min_.data(), min_.size()) <= 0) { return false; }
+  if(!lo) { return true; }  // the smallest key is in range
+
+  // Find the first prefix >= trunc(lo).
+  size_t lo_trunc = lolen < trunc_len_ ? lolen : trunc_len_;
+  size_t begin = 0, end = offsets_.size();
+  while(begin < end) {
+    size_t mid = begin + (end - begin) / 2;
+    if(dataTuple::compare(entry(mid), entry_len(mid), lo, lo_trunc) < 0) {
+      begin = mid + 1;
+    } else {
+      end = mid;
+    }
+  }
+  if(begin == offsets_.size()) { return false; }
+  if(!hi) { return true; }
+  size_t hi_trunc = hilen < trunc_len_ ? hilen : trunc_len_;
+  return dataTuple::compare(entry(begin), entry_len(begin), hi, hi_trunc) <= 0;
+}
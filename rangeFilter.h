@@ -0,0 +1,80 @@
+/*
+ * rangeFilter.h
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef RANGEFILTER_H_
+#define RANGEFILTER_H_
+
+#include <stasis/common.h>
+#include <string>
+#include <vector>
+
+/**
+ * Answers "might this component contain a key in [lo, hi)?" for the keys
+ * of one disk tree component.
+ *
+ * The filter stores the exact smallest and largest keys, and the sorted,
+ * distinct set of key prefixes truncated to trunc_len bytes (the same
+ * truncation idea as SuRF-Base, but stored as a flat sorted array instead of
+ * a succinct trie).  Truncation preserves key order, so any key in [lo, hi)
+ * has a truncated prefix in [trunc(lo), trunc(hi)], and there are no false
+ * negatives.  When the prefixes outgrow the space budget, trunc_len shrinks
+ * and the stored prefixes are coarsened in place; the filter gets less
+ * selective, but never bigger than the budget.
+ *
+ * Keys must be inserted in order, by a single writer.  Readers must not
+ * call may_contain() until done() has been called; until then it returns
+ * true.
+ */
+class rangeFilter {
+public:
+  static const size_t MAX_TRUNC_LEN = 32;
+
+  rangeFilter(size_t max_bytes);
+
+  void insert(const byte * key, size_t keylen);
+  /** No more keys will be inserted. */
+  void done() { sealed_ = true; }
+
+  /**
+   * @param lo the smallest key of interest, or NULL for the start of the key space.
+   * @param hi the first key past the range of interest, or NULL for the end of the key space.
+   * @return false if no key in [lo, hi) was inserted.
+   */
+  bool may_contain(const byte * lo, size_t lolen, const byte * hi, size_t hilen) const;
+
+  size_t get_trunc_len() const { return trunc_len_; }
+  size_t get_entry_count() const { return offsets_.size(); }
+  size_t memory_usage() const { return data_.size() + offsets_.size() * sizeof(offsets_[0]) + min_.size() + max_.size(); }
+
+private:
+  size_t entry_len(size_t i) const {
+    return (i + 1 < offsets_.size() ? offsets_[i+1] : data_.size()) - offsets_[i];
+  }
+  const byte * entry(size_t i) const { return (const byte*)data_.data() + offsets_[i]; }
+  void coarsen();
+
+  size_t max_bytes_;
+  size_t trunc_len_;
+  bool sealed_;
+  std::string min_;
+  std::string max_;
+  std::string data_;               /// concatenated truncated prefixes, in order
+  std::vector<uint32_t> offsets_;  /// where each prefix starts in data_
+};
+
+#endif /* RANGEFILTER_H_ */
@@ -0,0 +1,122 @@
+/*
+ * readStats.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "readStats.h"
+
+readStats::readStats() : threads_(this, retire_thread) {
+  memset(&retired_, 0, sizeof(retired_));
+}
+
+const char * readStats::component_name(component_t c) {
+  switch(c) {
+  case C0:           return "c0";
+  case C0_MERGEABLE: return "c0_mergeable";
+  case C1_PRIME:     return "c1_prime";
+  case C1:           return "c1";
+  case C1_MERGEABLE: return "c1_mergeable";
+  case C2:           return "c2";
+  default:           return "unknown";
+  }
+}
+
+void readStats::retire_thread(void * arg, per_thread * t) {
+  add(&((readStats*)arg)->retired_, &t->s);
+}
+
+void readStats::add(summary_t * to, const summary_t * from) {
+  // summary_t is nothing but uint64_t's.
+  uint64_t * dst = (uint64_t*)to;
+  const uint64_t * src = (const uint64_t*)from;
+  for(size_t i = 0; i < sizeof(summary_t) / sizeof(uint64_t); i++) {
+    dst[i] += src[i];
+  }
+}
+
+void readStats::record(const lookup_t * l) {
+  summary_t * s = &get_thread()->s;
+  int components = 0;
+  uint64_t datapages = 0;
+  for(int i = 0; i < NUM_COMPONENTS; i++) {
+    const counters_t * c = &l->c[i];
+    s->c[i].probes += c->probes;
+    s->c[i].hits += c->hits;
+    s->c[i].bloom_negatives += c->bloom_negatives;
+    s->c[i].bloom_false_positives += c->bloom_false_positives;
+    s->c[i].datapages_read += c->datapages_read;
+    s->c[i].tuples_decoded += c->tuples_decoded;
+    if(c->probes) { components++; }
+    datapages += c->datapages_read;
+  }
+  s->lookups++;
+  s->components_per_lookup[components]++;
+  s->datapages_per_lookup[datapages > MAX_DATAPAGES ? MAX_DATAPAGES : datapages]++;
+}
+
+void readStats::summarize(summary_t * out) {
+  memset(out, 0, sizeof(*out));
+  threads_.lock();
+  add(out, &retired_);
+  for(size_t i = 0; i < threads_.size(); i++) {
+    add(out, &threads_[i]->s);
+  }
+  threads_.unlock();
+}
+
+void readStats::pretty_print(FILE * out, const summary_t * s) {
+  fprintf(out, "lookups %llu row cache hits %llu\n", (unsigned long long)s->lookups, (unsigned long long)s->row_cache_hits);
+  fprintf(out, "%-14s %12s %12s %12s %12s %12s %12s %8s\n", "component", "probes", "hits", "bloom_neg", "bloom_fp", "datapages", "tuples", "fp rate");
+  for(int i = 0; i < NUM_COMPONENTS; i++) {
+    const counters_t * c = &s->c[i];
+    // Of the probes for keys the component didn't have, how many got past the filter?
+    uint64_t absent = c->bloom_false_positives + c->bloom_negatives;
+    fprintf(out, "%-14s %12llu %12llu %12llu %12llu %12llu %12llu %7.2f%%\n", component_name((component_t)i),
+            (unsigned long long)c->probes, (unsigned long long)c->hits, (unsigned long long)c->bloom_negatives,
+            (unsigned long long)c->bloom_false_positives, (unsigned long long)c->datapages_read,
+            (unsigned long long)c->tuples_decoded,
+            absent ? 100.0 * (double)c->bloom_false_positives / (double)absent : 0.0);
+  }
+  fprintf(out, "components probed per lookup:");
+  for(int i = 0; i <= NUM_COMPONENTS; i++) {
+    fprintf(out, " %d: %llu", i, (unsigned long long)s->components_per_lookup[i]);
+  }
+  fprintf(out, "\ndatapages read per lookup:");
+  for(int i = 0; i <= MAX_DATAPAGES; i++) {
+    fprintf(out, " %d: %llu", i, (unsigned long long)s->datapages_per_lookup[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void readStats::print_metrics(FILE * out) {
+  summary_t s;
+  summarize(&s);
+  fprintf(out, "blsm_read_lookups_total %llu\n", (unsigned long long)s.lookups);
+  fprintf(out, "blsm_read_row_cache_hits_total %llu\n", (unsigned long long)s.row_cache_hits);
+  for(int i = 0; i < NUM_COMPONENTS; i++) {
+    const char * name = component_name((component_t)i);
+    const counters_t * c = &s.c[i];
+    fprintf(out, "blsm_read_probes_total{component=\"%s\"} %llu\n", name, (unsigned long long)c->probes);
+    fprintf(out, "blsm_read_hits_total{component=\"%s\"} %llu\n", name, (unsigned long long)c->hits);
+    fprintf(out, "blsm_read_bloom_negatives_total{component=\"%s\"} %llu\n", name, (unsigned long long)c->bloom_negatives);
+    fprintf(out, "blsm_read_bloom_false_positives_total{component=\"%s\"} %llu\n", name, (unsigned long long)c->bloom_false_positives);
+    fprintf(out, "blsm_read_datapages_total{component=\"%s\"} %llu\n", name, (unsigned long long)c->datapages_read);
+    fprintf(out, "blsm_read_tuples_decoded_total{component=\"%s\"} %llu\n", name, (unsigned long long)c->tuples_decoded);
+  }
+  for(int i = 0; i <= MAX_DATAPAGES; i++) {
+    fprintf(out, "blsm_read_lookups_by_datapages{datapages=\"%d\"} %llu\n", i, (unsigned long long)s.datapages_per_lookup[i]);
+  }
+}
@@ -0,0 +1,100 @@
+/*
+ * readStats.h
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef READSTATS_H_
+#define READSTATS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "threadSlots.h"
+
+/**
+ * Read amplification accounting for point lookups.
+ *
+ * A lookup fills in a lookup_t on its stack as it probes each tree
+ * component, and hands it to record() once it is done.  Like latencyStats,
+ * the totals are kept per thread, and merged when someone asks for them.
+ */
+class readStats {
+public:
+  enum component_t {
+    C0,
+    C0_MERGEABLE,
+    C1_PRIME,
+    C1,
+    C1_MERGEABLE,
+    C2,
+    NUM_COMPONENTS
+  };
+  /** The largest number of datapages a lookup can read: one per disk component. */
+  static const int MAX_DATAPAGES = 4;
+
+  struct counters_t {
+    uint64_t probes;                 ///< times the component was consulted.
+    uint64_t hits;                   ///< probes that found a version of the key (including tombstones).
+    uint64_t bloom_negatives;        ///< probes that the bloom filter answered without reading a datapage.
+    uint64_t bloom_false_positives;  ///< probes that passed the bloom filter, but didn't find the key.
+    uint64_t datapages_read;
+    uint64_t tuples_decoded;         ///< tuples dataPage::recordRead() looked at.
+  };
+
+  /** What one lookup did. */
+  struct lookup_t {
+    counters_t c[NUM_COMPONENTS];
+    lookup_t() { memset(c, 0, sizeof(c)); }
+  };
+
+  /** Totals, as returned by OP_STAT_READ_AMPLIFICATION. */
+  struct summary_t {
+    uint64_t lookups;               ///< lookups that missed the row cache.
+    uint64_t row_cache_hits;
+    counters_t c[NUM_COMPONENTS];
+    uint64_t components_per_lookup[NUM_COMPONENTS + 1];   ///< lookups by how many components they probed.
+    uint64_t datapages_per_lookup[MAX_DATAPAGES + 1];     ///< lookups by how many datapages they read.
+  };
+
+  readStats();
+
+  static const char * component_name(component_t c);
+
+  void record(const lookup_t * l);
+  void record_row_cache_hit() { get_thread()->s.row_cache_hits++; }
+
+  /** @param out is overwritten. */
+  void summarize(summary_t * out);
+  static void pretty_print(FILE * out, const summary_t * s);
+  /** Print the totals in the Prometheus text exposition format. */
+  void print_metrics(FILE * out);
+
+private:
+  struct per_thread {
+    summary_t s;
+    per_thread() { memset(&s, 0, sizeof(s)); }
+  };
+
+  per_thread * get_thread() { return threads_.get(); }
+  static void retire_thread(void * arg, per_thread * t);
+  static void add(summary_t * to, const summary_t * from);
+
+  threadSlots<per_thread> threads_;     // its lock also protects retired_.
+  summary_t retired_;                   // from threads that have exited.
+};
+
+#endif /* READSTATS_H_ */
@@ -0,0 +1,258 @@
+/*
+ * rowCache.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "rowCache.h"
+
+rowCache::rowCache(pageid_t capacity)
+  : shard_capacity_(capacity / NUM_SHARDS),
+    shards_(new shard_t[NUM_SHARDS]) {
+  for(int i = 0; i < NUM_SHARDS; i++) {
+    shard_t * s = &shards_[i];
+    pthread_mutex_init(&s->mut, 0);
+    s->version = 0;
+    s->hand = 0;
+    s->bytes = 0;
+    memset(s->sketch, 0, sizeof(s->sketch));
+    s->sketch_samples = 0;
+    memset(&s->stats, 0, sizeof(s->stats));
+  }
+}
+
+rowCache::~rowCache() {
+  for(int i = 0; i < NUM_SHARDS; i++) {
+    shard_t * s = &shards_[i];
+    for(size_t j = 0; j < s->slots.size(); j++) {
+      if(s->slots[j].tup) { dataTuple::freetuple(s->slots[j].tup); }
+    }
+    pthread_mutex_destroy(&s->mut);
+  }
+  delete[] shards_;
+}
+
+// FNV-1a.  The shard is picked with the low bits, the sketch rows use the rest.
+uint64_t rowCache::hash(const byte * key, len_t keylen) {
+  uint64_t h = 14695981039346656037ULL;
+  for(len_t i = 0; i < keylen; i++) {
+    h ^= key[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+void rowCache::sketch_increment(shard_t * s, uint64_t h) {
+  uint64_t hh = h / NUM_SHARDS;
+  for(int i = 0; i < SKETCH_DEPTH; i++) {
+    uint8_t * c = &s->sketch[i][(hh >> (i * 12)) & (SKETCH_WIDTH - 1)];
+    if(*c < SKETCH_MAX) { (*c)++; }
+  }
+  s->sketch_samples++;
+  if(s->sketch_samples == 10 * SKETCH_WIDTH) {
+    // Age the counts so that yesterday's hot keys don't stay hot forever.
+    for(int i = 0; i < SKETCH_DEPTH; i++) {
+      for(int j = 0; j < SKETCH_WIDTH; j++) {
+        s->sketch[i][j] >>= 1;
+      }
+    }
+    s->sketch_samples = 0;
+  }
+}
+
+uint8_t rowCache::sketch_estimate(shard_t * s, uint64_t h) {
+  uint64_t hh = h / NUM_SHARDS;
+  uint8_t ret = SKETCH_MAX;
+  for(int i = 0; i < SKETCH_DEPTH; i++) {
+    uint8_t c = s->sketch[i][(hh >> (i * 12)) & (SKETCH_WIDTH - 1)];
+    if(c < ret) { ret = c; }
+  }
+  return ret;
+}
+
+size_t rowCache::pick_victim(shard_t * s) {
+  // Caller guarantees that at least one slot is occupied, so this terminates
+  // after at most two sweeps.
+  while(true) {
+    if(s->hand >= s->slots.size()) { s->hand = 0; }
+    slot_t * slot = &s->slots[s->hand];
+    if(slot->tup) {
+      if(!slot->referenced) { return s->hand; }
+      slot->referenced = false;
+    }
+    s->hand++;
+  }
+}
+
+void rowCache::evict(shard_t * s, size_t slot) {
+  dataTuple * t = s->slots[slot].tup;
+  s->index.erase(t);
+  s->bytes -= entry_size(t);
+  dataTuple::freetuple(t);
+  s->slots[slot].tup = NULL;
+  s->slots[slot].referenced = false;
+  s->free_slots.push_back(slot);
+}
+
+bool rowCache::lookup(const byte * key, len_t keylen, dataTuple ** ret, uint64_t * version) {
+  uint64_t h = hash(key, keylen);
+  shard_t * s = shard_for(h);
+  dataTuple * search_tuple = dataTuple::create(key, keylen);
+
+  pthread_mutex_lock(&s->mut);
+  sketch_increment(s, h);
+  index_t::iterator it = s->index.find(search_tuple);
+  bool hit = (it != s->index.end());
+  if(hit) {
+    slot_t * slot = &s->slots[it->second];
+    slot->referenced = true;
+    *ret = slot->tup->isDelete() ? NULL : slot->tup->create_copy();
+    s->stats.hits++;
+  } else {
+    *ret = NULL;
+    *version = s->version;
+    s->stats.misses++;
+  }
+  pthread_mutex_unlock(&s->mut);
+
+  dataTuple::freetuple(search_tuple);
+  return hit;
+}
+
+void rowCache::fill(const byte * key, len_t keylen, const dataTuple * t, uint64_t version) {
+  uint64_t h = hash(key, keylen);
+  shard_t * s = shard_for(h);
+  dataTuple * tup = (t && !t->isDelete()) ? t->create_copy() : dataTuple::create(key, keylen);
+  pageid_t sz = entry_size(tup);
+
+  pthread_mutex_lock(&s->mut);
+  if(s->version != version || sz > shard_capacity_ || s->index.find(tup) != s->index.end()) {
+    // Raced with a writer (or another reader got here first); don't cache.
+    pthread_mutex_unlock(&s->mut);
+    dataTuple::freetuple(tup);
+    return;
+  }
+  if(s->bytes + sz > shard_capacity_) {
+    // TinyLFU admission: only displace the CLOCK victim if the new key has
+    // been asked for more often.
+    size_t victim = pick_victim(s);
+    if(sketch_estimate(s, h) <= sketch_estimate(s, hash(s->slots[victim].tup->strippedkey(), s->slots[victim].tup->strippedkeylen()))) {
+      s->stats.rejections++;
+      pthread_mutex_unlock(&s->mut);
+      dataTuple::freetuple(tup);
+      return;
+    }
+    evict(s, victim);
+    s->stats.evictions++;
+    while(s->bytes + sz > shard_capacity_) {
+      evict(s, pick_victim(s));
+      s->stats.evictions++;
+    }
+  }
+  size_t slot;
+  if(s->free_slots.empty()) {
+    slot = s->slots.size();
+    slot_t empty = { NULL, false };
+    s->slots.push_back(empty);
+  } else {
+    slot = s->free_slots.back();
+    s->free_slots.pop_back();
+  }
+  s->slots[slot].tup = tup;
+  s->slots[slot].referenced = false;
+  s->index.insert(std::pair<dataTuple*, size_t>(tup, slot));
+  s->bytes += sz;
+  s->stats.fills++;
+  pthread_mutex_unlock(&s->mut);
+}
+
+void rowCache::invalidate(const byte * key, len_t keylen) {
+  uint64_t h = hash(key, keylen);
+  shard_t * s = shard_for(h);
+  dataTuple * search_tuple = dataTuple::create(key, keylen);
+
+  pthread_mutex_lock(&s->mut);
+  s->version++;
+  index_t::iterator it = s->index.find(search_tuple);
+  if(it != s->index.end()) {
+    evict(s, it->second);
+    s->stats.invalidations++;
+  }
+  pthread_mutex_unlock(&s->mut);
+
+  dataTuple::freetuple(search_tuple);
+}
+
+void rowCache::clear() {
+  for(int i = 0; i < NUM_SHARDS; i++) {
+    shard_t * s = &shards_[i];
+    pthread_mutex_lock(&s->mut);
+    s->version++;
+    for(size_t j = 0; j < s->slots.size(); j++) {
+      if(s->slots[j].tup) {
+        evict(s, j);
+        s->stats.invalidations++;
+      }
+    }
+    pthread_mutex_unlock(&s->mut);
+  }
+}
+
+void rowCache::get_stats(stats_t * ret) {
+  memset(ret, 0, sizeof(*ret));
+  for(int i = 0; i < NUM_SHARDS; i++) {
+    shard_t * s = &shards_[i];
+    pthread_mutex_lock(&s->mut);
+    ret->hits          += s->stats.hits;
+    ret->misses        += s->stats.misses;
+    ret->fills         += s->stats.fills;
+    ret->rejections    += s->stats.rejections;
+    ret->evictions     += s->stats.evictions;
+    ret->invalidations += s->stats.invalidations;
+    ret->entries       += s->index.size();
+    ret->bytes         += s->bytes;
+    pthread_mutex_unlock(&s->mut);
+  }
+  ret->capacity = shard_capacity_ * NUM_SHARDS;
+}
+
+void rowCache::pretty_print(FILE * out) {
+  stats_t s;
+  get_stats(&s);
+  pretty_print(out, &s);
+}
+
+void rowCache::pretty_print(FILE * out, const stats_t * s) {
+  pageid_t mb = 1024 * 1024;
+  uint64_t lookups = s->hits + s->misses;
+  fprintf(out, "[row cache] %5.1f%% hit %lld/%lldMB %lld entries %lld evicted %lld rejected ",
+          lookups ? 100.0 * (double)s->hits / (double)lookups : 0.0,
+          (long long)(s->bytes / mb), (long long)(s->capacity / mb),
+          (long long)s->entries, (long long)s->evictions, (long long)s->rejections);
+}
+
+void rowCache::print_metrics(FILE * out) {
+  stats_t s;
+  get_stats(&s);
+  fprintf(out, "blsm_row_cache_hits_total %llu\n", (unsigned long long)s.hits);
+  fprintf(out, "blsm_row_cache_misses_total %llu\n", (unsigned long long)s.misses);
+  fprintf(out, "blsm_row_cache_fills_total %llu\n", (unsigned long long)s.fills);
+  fprintf(out, "blsm_row_cache_rejections_total %llu\n", (unsigned long long)s.rejections);
+  fprintf(out, "blsm_row_cache_evictions_total %llu\n", (unsigned long long)s.evictions);
+  fprintf(out, "blsm_row_cache_invalidations_total %llu\n", (unsigned long long)s.invalidations);
+  fprintf(out, "blsm_row_cache_entries %lld\n", (long long)s.entries);
+  fprintf(out, "blsm_row_cache_bytes %lld\n", (long long)s.bytes);
+  fprintf(out, "blsm_row_cache_capacity_bytes %lld\n", (long long)s.capacity);
+}
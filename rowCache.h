@@ -0,0 +1,131 @@
+/*
+ * rowCache.h
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef ROWCACHE_H_
+#define ROWCACHE_H_
+
+#include <stasis/common.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <map>
+#include <vector>
+
+#include "dataTuple.h"
+
+/**
+ * A sharded cache of point lookup results that sits in front of
+ * bLSM::findTuple().
+ *
+ * Each shard maps keys to the fully merged tuple that findTuple() returned
+ * for them.  Keys that were not found are cached as tombstones, so repeated
+ * misses on hot keys don't probe the bloom filters and tree components
+ * either.  Replacement is CLOCK; a small count-min sketch per shard
+ * (TinyLFU) decides whether a new key is popular enough to displace the
+ * CLOCK victim, which keeps scans of cold keys from flushing the cache.
+ *
+ * Merges never change the logical value of a key, so the cache only needs to
+ * hear about writes.  bLSM calls invalidate() after each c0 insertion.  To
+ * avoid caching a value that was read before a concurrent write, lookup()
+ * hands out the shard's version number on a miss, and fill() drops the tuple
+ * if any key in the shard was invalidated in the mean time.
+ */
+class rowCache {
+public:
+  struct stats_t {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t fills;
+    uint64_t rejections;    /// fills refused by the admission filter
+    uint64_t evictions;
+    uint64_t invalidations;
+    pageid_t entries;
+    pageid_t bytes;
+    pageid_t capacity;
+  };
+
+  static const int NUM_SHARDS = 64;
+
+  rowCache(pageid_t capacity);
+  ~rowCache();
+
+  /**
+   * Look up a key.
+   *
+   * @return true on a cache hit.  *ret is then set to a copy of the cached
+   * tuple that the caller must free, or NULL if the key is known not to exist.
+   * On a miss, *version should be passed to fill() along with the tuple that
+   * the caller eventually found.
+   */
+  bool lookup(const byte * key, len_t keylen, dataTuple ** ret, uint64_t * version);
+  /**
+   * Offer the result of a lookup that missed.  t may be NULL (or a tombstone)
+   * to record that the key does not exist.  The cache makes its own copy.
+   */
+  void fill(const byte * key, len_t keylen, const dataTuple * t, uint64_t version);
+  /** Drop any cached state for key.  Called by writers. */
+  void invalidate(const byte * key, len_t keylen);
+  /** Drop everything.  Called when a whole component is spliced into the tree. */
+  void clear();
+
+  void get_stats(stats_t * s);
+  void pretty_print(FILE * out);
+  static void pretty_print(FILE * out, const stats_t * s);
+  /** Print the stats in the Prometheus text exposition format. */
+  void print_metrics(FILE * out);
+
+private:
+  struct slot_t {
+    dataTuple * tup;
+    bool referenced;
+  };
+  typedef std::map<dataTuple*, size_t, dataTuple> index_t;
+
+  static const int SKETCH_WIDTH = 4096;   // counters per row; must be a power of two
+  static const int SKETCH_DEPTH = 4;
+  static const uint8_t SKETCH_MAX = 15;
+  static const int ENTRY_OVERHEAD = 96;   // rough cost of the map node and slot
+
+  struct shard_t {
+    pthread_mutex_t mut;
+    uint64_t version;
+    index_t index;
+    std::vector<slot_t> slots;
+    std::vector<size_t> free_slots;
+    size_t hand;
+    pageid_t bytes;
+    uint8_t sketch[SKETCH_DEPTH][SKETCH_WIDTH];
+    uint64_t sketch_samples;
+    stats_t stats;
+  };
+
+  static uint64_t hash(const byte * key, len_t keylen);
+  static pageid_t entry_size(const dataTuple * t) {
+    return sizeof(dataTuple) + t->byte_length() + ENTRY_OVERHEAD;
+  }
+  inline shard_t * shard_for(uint64_t h) { return &shards_[h % NUM_SHARDS]; }
+
+  void sketch_increment(shard_t * s, uint64_t h);
+  uint8_t sketch_estimate(shard_t * s, uint64_t h);
+  size_t pick_victim(shard_t * s);
+  void evict(shard_t * s, size_t slot);
+
+  pageid_t shard_capacity_;
+  shard_t * shards_;
+};
+
+#endif /* ROWCACHE_H_ */
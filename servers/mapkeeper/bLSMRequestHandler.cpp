@@ -21,6 +21,7 @@
 #include <stasis/logger/safeWrites.h>
 
 #include <iostream>
+#include <set>
 #include <signal.h>
 #include "mergeScheduler.h"
 #include "bLSM.h"
@@ -28,7 +29,18 @@
 
 int blind_update = 0; // updates check preimage by default.
 
-FILE* trace = 0;
+opTrace* trace = 0;
+// Held for reading while recording to trace, so that shutdown() can wait
+// for requests that are still running before it deletes the trace.
+pthread_rwlock_t trace_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static void trace_op(opTrace::op_t op, uint64_t start, bool result, const dataTuple * t,
+                     const dataTuple * t2 = NULL, uint64_t count = (uint64_t)-1) {
+    if(!trace) { return; }
+    pthread_rwlock_rdlock(&trace_lock);
+    if(trace) { trace->record_op(op, start, result, t, t2, count); }
+    pthread_rwlock_unlock(&trace_lock);
+}
 
 LSMServerHandler::
 LSMServerHandler(int argc, char **argv)
@@ -37,6 +49,8 @@ LSMServerHandler(int argc, char **argv)
 
     // how big the in-memory tree should be (512MB).
     int64_t c0_size = 1024 * 1024 * 512 * 1;
+    // memory budget of the cache in front of point lookups (none by default).
+    int64_t row_cache_size = 0;
     // write-ahead log
     // 1 -> sync on each commit
     // 2 -> sync on each 2 commits
@@ -44,6 +58,9 @@ LSMServerHandler(int argc, char **argv)
     int log_mode = 0; // do not log by default.
     int64_t expiry_delta = 0;  // do not gc by default
     port = 9090;
+    nonblocking = true;
+    worker_threads = 32;
+    io_threads = 1;
     char * tracefile = 0;
     stasis_buffer_manager_size = 1 * 1024 * 1024 * 1024 / PAGE_SIZE;  // 1.5GB total
 
@@ -70,9 +87,28 @@ LSMServerHandler(int argc, char **argv)
         } else if(!strcmp(argv[i], "--port")) {
             i++;
             port = atoi(argv[i]);
+        } else if(!strcmp(argv[i], "--server")) {
+            i++;
+            if(!strcmp(argv[i], "nonblocking")) {
+                nonblocking = true;
+            } else if(!strcmp(argv[i], "threaded")) {
+                nonblocking = false;
+            } else {
+                fprintf(stderr, "Unknown server type %s; expected nonblocking or threaded\n", argv[i]);
+                abort();
+            }
+        } else if(!strcmp(argv[i], "--worker-threads")) {
+            i++;
+            worker_threads = atoi(argv[i]);
+        } else if(!strcmp(argv[i], "--io-threads")) {
+            i++;
+            io_threads = atoi(argv[i]);
         } else if(!strcmp(argv[i], "--trace")) {
             i++;
             tracefile = argv[i];
+        } else if(!strcmp(argv[i], "--row-cache")) {
+            i++;
+            row_cache_size = atoll(argv[i]) * 1024 * 1024;
         } else if(!strcmp(argv[i], "--blind-update")) {
             blind_update = 1;
         } else if(!strcmp(argv[i], "--expiry-delta")) {
@@ -99,13 +135,13 @@ LSMServerHandler(int argc, char **argv)
           stasis_handle_raid0_filenames = tok;
           stasis_handle_factory = stasis_handle_raid0_factory;
         } else {
-            fprintf(stderr, "Usage: %s [--test|--benchmark|--benchmark-small|--benchmark-big] [--log-mode <int>] [--expiry-delta <int>] [--raid0 file1,file2,...]", argv[0]);
+            fprintf(stderr, "Usage: %s [--test|--benchmark|--benchmark-small|--benchmark-big] [--log-mode <int>] [--expiry-delta <int>] [--raid0 file1,file2,...] [--server nonblocking|threaded] [--worker-threads <int>] [--io-threads <int>] [--trace <file>] [--blind-update] [--row-cache <MB>]", argv[0]);
             abort();
         }
     }
 
     if(tracefile) {
-      trace = fopen(tracefile, "w");
+      trace = opTrace::open(tracefile);
       if(trace == 0) {
         perror("Couldn't open trace file!");
         abort();
@@ -113,6 +149,7 @@ LSMServerHandler(int argc, char **argv)
     }
 
     pthread_mutex_init(&mutex_, 0);
+    pthread_rwlock_init(&catalog_lock_, 0);
     bLSM::init_stasis();
 
     int xid = Tbegin();
@@ -120,7 +157,10 @@ LSMServerHandler(int argc, char **argv)
 
     recordid table_root = ROOT_RECORD;
     {
-        ltable_ = new bLSM(log_mode, c0_size);
+        ltable_ = new bLSM(log_mode, c0_size, 16384, 256000, 1, row_cache_size);
+        // Every key starts with its map's 4 byte id; let scans skip components that don't contain the map.
+        ltable_->set_prefix_extractor(new prefixExtractor(sizeof(uint32_t)));
+        ltable_->range_filters = true;
         ltable_->expiry = expiry_delta;
 
         if(TrecordType(xid, ROOT_RECORD) == INVALID_SLOT) {
@@ -157,22 +197,21 @@ initNextDatabaseId()
 {
     nextDatabaseId_ = 1;
     uint32_t id = 0;
-    dataTuple* start = buildTuple(id, "");
-    dataTuple* end = buildTuple(id + 1, "");
-    bLSM::iterator* itr = new bLSM::iterator(ltable_, start);
+    // The catalog is the set of map id 0 records; load all of them.
+    bLSM::iterator* itr = new bLSM::iterator(ltable_, NULL, (byte*)&id, sizeof(id));
     dataTuple* current;
+    pthread_rwlock_wrlock(&catalog_lock_);
+    catalog_.clear();
     while ((current = itr->getnext())) {
-        // are we at the end of range?
-        if (dataTuple::compare_obj(current, end) >= 0) {
-            dataTuple::freetuple(current);
-            break;
-        }
         uint32_t currentId = *((uint32_t*)(current->data()));
         if (currentId > nextDatabaseId_) {
             nextDatabaseId_ = currentId;
         }
+        catalog_[std::string((char*)(current->strippedkey()) + sizeof(id),
+                             current->strippedkeylen() - sizeof(id))] = currentId;
         dataTuple::freetuple(current);
     }
+    pthread_rwlock_unlock(&catalog_lock_);
     nextDatabaseId_++;
     delete itr;
 }
@@ -191,14 +230,21 @@ nextDatabaseId()
 ResponseCode::type LSMServerHandler::
 ping() 
 {
-  if(trace) { fprintf(trace, "Success = ping()\n"); fflush(trace); }
     return mapkeeper::ResponseCode::Success;
 }
 
 ResponseCode::type LSMServerHandler::
 shutdown()
 {
-  if(trace) { fprintf(trace, "Success = shutdown()\n"); fflush(trace); }
+  if(trace) {
+    // exit() doesn't run destructors; drain the trace by hand, once no
+    // other request is still recording to it.
+    pthread_rwlock_wrlock(&trace_lock);
+    opTrace * t = trace;
+    trace = 0;
+    pthread_rwlock_unlock(&trace_lock);
+    delete t;
+  }
   exit(0); // xxx hack
   return mapkeeper::ResponseCode::Success;
 }
@@ -209,7 +255,9 @@ std::string pp_tuple(dataTuple * tuple) {
 ResponseCode::type LSMServerHandler::
 insert(dataTuple* tuple)
 {
+    uint64_t start = latencyStats::now();
     ltable_->insertTuple(tuple);
+    trace_op(opTrace::INSERT, start, true, tuple);
     dataTuple::freetuple(tuple);
     return mapkeeper::ResponseCode::Success;
 }
@@ -217,79 +265,68 @@ insert(dataTuple* tuple)
 ResponseCode::type LSMServerHandler::
 addMap(const std::string& databaseName) 
 {
+    pthread_rwlock_wrlock(&catalog_lock_);
+    if (catalog_.count(databaseName) || dropping_.count(databaseName)
+        || adding_.count(databaseName)) {
+        pthread_rwlock_unlock(&catalog_lock_);
+        return mapkeeper::ResponseCode::MapExists;
+    }
+    adding_.insert(databaseName);
+    // Like dropMap, don't hold the lock while insert() blocks on backpressure.
+    pthread_rwlock_unlock(&catalog_lock_);
+
     uint32_t id = nextDatabaseId();
     dataTuple* tup = buildTuple(0, databaseName, (void*)&id, (uint32_t)(sizeof(id)));
-    dataTuple* ret = get(tup);
-    if (ret) {
-        dataTuple::freetuple(ret);
-        if(trace) { fprintf(trace, "MapExists = addMap(%s)\n", databaseName.c_str()); fflush(trace); }
-        return mapkeeper::ResponseCode::MapExists;
+    ResponseCode::type ret = insert(tup);
+    pthread_rwlock_wrlock(&catalog_lock_);
+    adding_.erase(databaseName);
+    if (ret == mapkeeper::ResponseCode::Success) {
+        catalog_[databaseName] = id;
     }
-    if(trace) { fprintf(trace, "Success = addMap(%s)\n", databaseName.c_str()); fflush(trace); }
-    return insert(tup);
+    pthread_rwlock_unlock(&catalog_lock_);
+    return ret;
 }
 
 ResponseCode::type LSMServerHandler::
 dropMap(const std::string& databaseName) 
 {
-  uint32_t id = getDatabaseId(databaseName);
-  if(id == 0) {
-    if(trace) { fprintf(trace, "MapNotFound = dropMap(%s)\n", databaseName.c_str()); fflush(trace); }
+  pthread_rwlock_wrlock(&catalog_lock_);
+  std::map<std::string, uint32_t>::iterator entry = catalog_.find(databaseName);
+  if(entry == catalog_.end()) {
+    pthread_rwlock_unlock(&catalog_lock_);
     return mapkeeper::ResponseCode::MapNotFound;
   }
-  dataTuple * tup = buildTuple(0, databaseName);
-  dataTuple * exists = get(tup);
-
-  if(exists) {
-    dataTuple::freetuple(exists);
-
-    dataTuple * startKey = buildTuple(id, "");
-    bLSM::iterator * itr = new bLSM::iterator(ltable_, startKey);
-    dataTuple::freetuple(startKey);
-    dataTuple * current;
-
-    // insert tombstone; deletes metadata entry for map; frees tup
-    insert(tup);
-
-    while(NULL != (current = itr->getnext())) {
-      if(*((uint32_t*)current->strippedkey()) != id) {
-        dataTuple::freetuple(current);
-        break;
-      }
-      dataTuple * del = dataTuple::create(current->strippedkey(), current->strippedkeylen());
-      ltable_->insertTuple(del);
-      dataTuple::freetuple(del);
-      dataTuple::freetuple(current);
-    }
-    delete itr;
-    if(trace) { fprintf(trace, "Success = dropMap(%s)\n", databaseName.c_str()); fflush(trace); }
-    return mapkeeper::ResponseCode::Success;
-  } else {
-    dataTuple::freetuple(tup);
-    if(trace) { fprintf(trace, "MapNotFound = dropMap(%s)\n", databaseName.c_str()); fflush(trace); }
-    return mapkeeper::ResponseCode::MapNotFound;
+  uint32_t id = entry->second;
+  catalog_.erase(entry);
+  dropping_.insert(databaseName);
+  // insert() can block on merge backpressure; don't stall every other
+  // catalog lookup while it does.
+  pthread_rwlock_unlock(&catalog_lock_);
+
+  // insert tombstone; deletes metadata entry for map
+  insert(buildTuple(0, databaseName));
+  pthread_rwlock_wrlock(&catalog_lock_);
+  dropping_.erase(databaseName);
+  pthread_rwlock_unlock(&catalog_lock_);
+
+  bLSM::iterator * itr = new bLSM::iterator(ltable_, NULL, (byte*)&id, sizeof(id));
+  dataTuple * current;
+  while(NULL != (current = itr->getnext())) {
+    insert(dataTuple::create(current->strippedkey(), current->strippedkeylen()));
+    dataTuple::freetuple(current);
   }
+  delete itr;
+  return mapkeeper::ResponseCode::Success;
 }
 
 void LSMServerHandler::
 listMaps(StringListResponse& _return) 
 {
-  dataTuple * startKey = buildTuple(0, "");
-  bLSM::iterator * itr = new bLSM::iterator(ltable_, startKey);
-  dataTuple::freetuple(startKey);
-  dataTuple * current;
-  while(NULL != (current = itr->getnext())) {
-    if(*((uint32_t*)current->strippedkey()) != 0) {
-      dataTuple::freetuple(current);
-      break;
-    }
-    _return.values.push_back(
-        std::string((char*)(current->strippedkey()) + sizeof(uint32_t),
-                    current->strippedkeylen() - sizeof(uint32_t)));
-    dataTuple::freetuple(current);
+  pthread_rwlock_rdlock(&catalog_lock_);
+  for(std::map<std::string, uint32_t>::const_iterator it = catalog_.begin(); it != catalog_.end(); ++it) {
+    _return.values.push_back(it->first);
   }
-  delete itr;
-  if(trace) { fprintf(trace, "... = listMaps()\n"); fflush(trace); }
+  pthread_rwlock_unlock(&catalog_lock_);
     _return.responseCode = mapkeeper::ResponseCode::Success;
 }
 
@@ -302,11 +339,11 @@ scan(RecordListResponse& _return, const std::string& databaseName, const ScanOrd
     uint32_t id = getDatabaseId(databaseName);
     if (id == 0) {
         // database not found
-        if(trace) { fprintf(trace, "MapNotFound = scan(...)\n"); fflush(trace); }
         _return.responseCode = mapkeeper::ResponseCode::MapNotFound;
         return;
     }
  
+    uint64_t scanStart = latencyStats::now();
     dataTuple* start = buildTuple(id, startKey);
     dataTuple* end;
     if (endKey.empty()) {
@@ -314,7 +351,19 @@ scan(RecordListResponse& _return, const std::string& databaseName, const ScanOrd
     } else {
         end = buildTuple(id, endKey);
     }
-    bLSM::iterator* itr = new bLSM::iterator(ltable_, start);
+    bool descending = (order == ScanOrder::Descending);
+    // Descending scans start at the end of the range and walk backwards.
+    bLSM::iterator* itr;
+    if (descending) {
+        itr = new bLSM::iterator(ltable_, end, bLSM::iterator::REVERSE);
+    } else if (endKey.empty()) {
+        itr = new bLSM::iterator(ltable_, start, (byte*)&id, sizeof(id));
+    } else {
+        // The iterator's bound is exclusive; an included end key needs the key just past it.
+        dataTuple* upper = endKeyIncluded ? buildTuple(id, endKey + std::string(1, '\0')) : end->create_copy();
+        itr = new bLSM::iterator(ltable_, start, upper);
+        dataTuple::freetuple(upper);
+    }
 
     int32_t resultSize = 0;
 
@@ -323,25 +372,41 @@ scan(RecordListResponse& _return, const std::string& databaseName, const ScanOrd
         dataTuple* current = itr->getnext();
         if (current == NULL) {
             _return.responseCode = mapkeeper::ResponseCode::ScanEnded;
-            if(trace) { fprintf(trace, "ScanEnded = scan(...)\n"); fflush(trace); }
             break;
         }
 
-        int cmp = dataTuple::compare_obj(current, start);
-        if ((!startKeyIncluded) && cmp == 0) {
-            dataTuple::freetuple(current);
-            continue;
-        } 
-
-        // are we at the end of range?
-        cmp = dataTuple::compare_obj(current, end);
-        if ((!endKeyIncluded && cmp >= 0) ||
-                (endKeyIncluded && cmp > 0)) {
-            dataTuple::freetuple(current);
-            _return.responseCode = mapkeeper::ResponseCode::ScanEnded;
-            if(trace) { fprintf(trace, "ScanEnded = scan(...)\n"); fflush(trace); }
-            break;
-        } 
+        if (descending) {
+            // an empty end key means "end of the map"; the end tuple belongs to the next map.
+            int cmp = dataTuple::compare_obj(current, end);
+            if ((!endKeyIncluded || endKey.empty()) && cmp == 0) {
+                dataTuple::freetuple(current);
+                continue;
+            }
+
+            // are we at the start of range?
+            cmp = dataTuple::compare_obj(current, start);
+            if ((!startKeyIncluded && cmp <= 0) ||
+                    (startKeyIncluded && cmp < 0)) {
+                dataTuple::freetuple(current);
+                _return.responseCode = mapkeeper::ResponseCode::ScanEnded;
+                break;
+            }
+        } else {
+            int cmp = dataTuple::compare_obj(current, start);
+            if ((!startKeyIncluded) && cmp == 0) {
+                dataTuple::freetuple(current);
+                continue;
+            }
+
+            // are we at the end of range?
+            cmp = dataTuple::compare_obj(current, end);
+            if ((!endKeyIncluded && cmp >= 0) ||
+                    (endKeyIncluded && cmp > 0)) {
+                dataTuple::freetuple(current);
+                _return.responseCode = mapkeeper::ResponseCode::ScanEnded;
+                break;
+            }
+        }
 
         Record rec;
         int32_t keySize =  current->strippedkeylen() - sizeof(id);
@@ -354,13 +419,17 @@ scan(RecordListResponse& _return, const std::string& databaseName, const ScanOrd
         dataTuple::freetuple(current);
     }
     delete itr;
+    // Replays as an ascending scan of the whole range.
+    trace_op(opTrace::SCAN, scanStart, true, start, end, maxRecords ? (uint64_t)maxRecords : (uint64_t)-1);
 }
 
 dataTuple* LSMServerHandler::
 get(dataTuple* tuple)
 {
+    uint64_t start = latencyStats::now();
     // -1 is invalid txn id
     dataTuple* tup = ltable_->findTuple_first(-1, tuple->rawkey(), tuple->rawkeylen());
+    trace_op(opTrace::FIND, start, tup != NULL, tuple);
     return tup;
 }
 
@@ -370,7 +439,6 @@ get(BinaryResponse& _return, const std::string& databaseName, const std::string&
     uint32_t id = getDatabaseId(databaseName);
     if (id == 0) {
         // database not found
-        if(trace) { fprintf(trace, "MapNotFound = get(%s, %s)\n", databaseName.c_str(), recordName.c_str()); fflush(trace); }
         _return.responseCode = mapkeeper::ResponseCode::MapNotFound;
         return;
     }
@@ -378,11 +446,9 @@ get(BinaryResponse& _return, const std::string& databaseName, const std::string&
     dataTuple* recordBody = get(id, recordName);
     if (recordBody == NULL) {
         // record not found
-        if(trace) { fprintf(trace, "RecordNotFound = get(%s, %s)\n", databaseName.c_str(), recordName.c_str()); fflush(trace); }
         _return.responseCode = mapkeeper::ResponseCode::RecordNotFound;
         return;
     }
-    if(trace) { fprintf(trace, "Success = get(%s, %s)\n", databaseName.c_str(), recordName.c_str()); fflush(trace); }
     _return.responseCode = mapkeeper::ResponseCode::Success;
     _return.value.assign((const char*)(recordBody->data()), recordBody->datalen());
     dataTuple::freetuple(recordBody);
@@ -391,16 +457,17 @@ get(BinaryResponse& _return, const std::string& databaseName, const std::string&
 uint32_t LSMServerHandler::
 getDatabaseId(const std::string& databaseName)
 {
-    dataTuple* tup = buildTuple(0, databaseName);
-    dataTuple* databaseId = get(tup);
-    dataTuple::freetuple(tup);
-    if (databaseId == NULL) {
+    uint32_t id = 0;
+    pthread_rwlock_rdlock(&catalog_lock_);
+    std::map<std::string, uint32_t>::const_iterator entry = catalog_.find(databaseName);
+    if (entry != catalog_.end()) {
+        id = entry->second;
+    }
+    pthread_rwlock_unlock(&catalog_lock_);
+    if (id == 0) {
         // database not found
         std::cout << "db not found" << std::endl;
-        return 0;
     }
-    uint32_t id = *((uint32_t*)(databaseId->data()));
-    dataTuple::freetuple(databaseId);
     return id;
 }
 
@@ -421,11 +488,9 @@ put(const std::string& databaseName,
 {
   uint32_t id = getDatabaseId(databaseName);
   if (id == 0) {
-      if(trace) { fprintf(trace, "MapNotFound = put(%s, %s)\n", databaseName.c_str(), recordName.c_str()); fflush(trace); }
       return mapkeeper::ResponseCode::MapNotFound;
   }
   dataTuple* tup = buildTuple(id, recordName, recordBody);
-  if(trace) { fprintf(trace, "Success = put(%s, %s)\n", databaseName.c_str(), recordName.c_str()); fflush(trace); }
   return insert(tup);
 }
 
@@ -436,32 +501,65 @@ insert(const std::string& databaseName,
 {
     uint32_t id = getDatabaseId(databaseName);
     if (id == 0) {
-        if(trace) { fprintf(trace, "MapNotFound = insert(%s, %s)\n", databaseName.c_str(), recordName.c_str()); fflush(trace); }
         return mapkeeper::ResponseCode::MapNotFound;
     }
+    dataTuple* tup = buildTuple(id, recordName, recordBody);
     if(!blind_update) {
-      dataTuple* oldRecordBody = get(id, recordName);
-      if (oldRecordBody != NULL) {
-        if(oldRecordBody->isDelete()) {
-          dataTuple::freetuple(oldRecordBody);
-        } else {
-          dataTuple::freetuple(oldRecordBody);
-          if(trace) { fprintf(trace, "RecordExists = insert(%s, %s)\n", databaseName.c_str(), recordName.c_str()); fflush(trace); }
-          return mapkeeper::ResponseCode::RecordExists;
-        }
+      uint64_t start = latencyStats::now();
+      bool inserted = ltable_->insertTupleIfAbsent(tup);
+      trace_op(opTrace::INSERT_IF_ABSENT, start, inserted, tup);
+      dataTuple::freetuple(tup);
+      if(!inserted) {
+        return mapkeeper::ResponseCode::RecordExists;
       }
+      return mapkeeper::ResponseCode::Success;
     }
-
-    dataTuple* tup = buildTuple(id, recordName, recordBody);
-    if(trace) { fprintf(trace, "Success = insert(%s, %s)\n", databaseName.c_str(), recordName.c_str()); fflush(trace); }
     return insert(tup);
 }
 
 ResponseCode::type LSMServerHandler::
 insertMany(const std::string& databaseName, const std::vector<Record> & records)
 {
-    if(trace) { fprintf(trace, "Error = insertMany(%s, ...) (not supported)\n", databaseName.c_str()); fflush(trace); }
-    return mapkeeper::ResponseCode::Error;
+    uint32_t id = getDatabaseId(databaseName);
+    if (id == 0) {
+        return mapkeeper::ResponseCode::MapNotFound;
+    }
+    if (records.empty()) {
+        return mapkeeper::ResponseCode::Success;
+    }
+    int count = records.size();
+    dataTuple** tups = (dataTuple**)malloc(sizeof(tups[0]) * count);
+    for (int i = 0; i < count; i++) {
+        tups[i] = buildTuple(id, records[i].key, records[i].value);
+    }
+    ResponseCode::type ret = mapkeeper::ResponseCode::Success;
+    uint64_t start = latencyStats::now();
+    if (!blind_update) {
+        // Like insert(), refuse the whole batch if any of the records exist,
+        // or if the batch contains the same record twice.
+        std::set<std::string> seen;
+        for (int i = 0; i < count && ret == mapkeeper::ResponseCode::Success; i++) {
+            if (!seen.insert(records[i].key).second) {
+                ret = mapkeeper::ResponseCode::RecordExists;
+            }
+        }
+        if (ret == mapkeeper::ResponseCode::Success && !ltable_->insertManyTuplesIfAbsent(tups, count)) {
+            ret = mapkeeper::ResponseCode::RecordExists;
+        }
+    } else {
+        ltable_->insertManyTuples(tups, count);
+    }
+    if (ret == mapkeeper::ResponseCode::Success) {
+        // One INSERT per record; see opTrace.h for how batches are timed.
+        for (int i = 0; trace && i < count; i++) {
+            trace_op(opTrace::INSERT, start, true, tups[i], NULL, count);
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        dataTuple::freetuple(tups[i]);
+    }
+    free(tups);
+    return ret;
 }
 
 ResponseCode::type LSMServerHandler::
@@ -471,19 +569,16 @@ update(const std::string& databaseName,
 {
     uint32_t id = getDatabaseId(databaseName);
     if (id == 0) {
-        if(trace) { fprintf(trace, "MapNotFound = update(%s, %s)\n", databaseName.c_str(), recordName.c_str()); fflush(trace); }
         return mapkeeper::ResponseCode::MapNotFound;
     }
     if(!blind_update) {
       dataTuple* oldRecordBody = get(id, recordName);
       if (oldRecordBody == NULL) {
-        if(trace) { fprintf(trace, "RecordNotFound = update(%s, %s)\n", databaseName.c_str(), recordName.c_str()); fflush(trace); }
         return mapkeeper::ResponseCode::RecordNotFound;
       }
       dataTuple::freetuple(oldRecordBody);
     }
     dataTuple* tup = buildTuple(id, recordName, recordBody);
-    if(trace) { fprintf(trace, "Success = update(%s, %s)\n", databaseName.c_str(), recordName.c_str()); fflush(trace); }
     return insert(tup);
 }
 
@@ -492,17 +587,14 @@ remove(const std::string& databaseName, const std::string& recordName)
 {
     uint32_t id = getDatabaseId(databaseName);
     if (id == 0) {
-        if(trace) { fprintf(trace, "MapNotFound = remove(%s, %s)\n", databaseName.c_str(), recordName.c_str()); fflush(trace); }
         return mapkeeper::ResponseCode::MapNotFound;
     }
     dataTuple* oldRecordBody = get(id, recordName);
     if (oldRecordBody == NULL) {
-        if(trace) { fprintf(trace, "RecordNotFound = remove(%s, %s)\n", databaseName.c_str(), recordName.c_str()); fflush(trace); }
         return mapkeeper::ResponseCode::RecordNotFound;
     }
     dataTuple::freetuple(oldRecordBody);
     dataTuple* tup = buildTuple(id, recordName);
-    if(trace) { fprintf(trace, "Success = remove(%s, %s)\n", databaseName.c_str(), recordName.c_str()); fflush(trace); }
     return insert(tup);
 }
 
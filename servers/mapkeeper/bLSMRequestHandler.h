@@ -16,6 +16,9 @@
  * limitations under the License.
  */
 #include "MapKeeper.h"
+#include <map>
+#include <set>
+#include <pthread.h>
 #include <protocol/TBinaryProtocol.h>
 #include <transport/TServerSocket.h>
 #include <transport/TBufferTransports.h>
@@ -46,6 +49,10 @@ public:
     ResponseCode::type update(const std::string& databaseName, const std::string& recordName, const std::string& recordBody);
     ResponseCode::type remove(const std::string& databaseName, const std::string& recordName);
     short port;
+    // front end settings; see blsm_server.cpp
+    bool nonblocking;      /// serve with TNonblockingServer instead of one thread per connection
+    int worker_threads;    /// size of the pool that runs requests in nonblocking mode
+    int io_threads;        /// threads that read and write sockets in nonblocking mode
 
 private:
     ResponseCode::type insert(dataTuple* tuple);
@@ -60,4 +67,22 @@ private:
     bLSM* ltable_;
     uint32_t nextDatabaseId_;
     pthread_mutex_t mutex_;
+    /**
+     * name -> id for every map.  Loaded from the id 0 records at startup, and
+     * kept up to date by addMap (see adding_) and dropMap (see dropping_).
+     * Neither holds catalog_lock_ while it writes the id 0 record.
+     */
+    std::map<std::string, uint32_t> catalog_;
+    /**
+     * Maps that dropMap has removed from catalog_, but whose id 0 record it
+     * hasn't deleted yet.  addMap can't reuse these names until it has.
+     */
+    std::set<std::string> dropping_;
+    /**
+     * Maps whose id 0 record addMap is writing.  They are added to catalog_
+     * once it has been written; until then, other addMaps of the same name
+     * fail with MapExists.
+     */
+    std::set<std::string> adding_;
+    pthread_rwlock_t catalog_lock_;
 };
@@ -21,6 +21,7 @@
 #include <server/TSimpleServer.h>
 #include <server/TThreadPoolServer.h>
 #include <server/TThreadedServer.h>
+#include <server/TNonblockingServer.h>
 #include <transport/TServerSocket.h>
 #include <transport/TBufferTransports.h>
 #include <concurrency/ThreadManager.h>
@@ -41,15 +42,25 @@ using namespace mapkeeper;
 int main(int argc, char **argv) {
     shared_ptr<LSMServerHandler> handler(new LSMServerHandler(argc, argv));
     shared_ptr<TProcessor> processor(new MapKeeperProcessor(handler));
-    shared_ptr<TServerTransport> serverTransport(new TServerSocket(handler->port));
-    shared_ptr<TTransportFactory> transportFactory(new TFramedTransportFactory());
     shared_ptr<TProtocolFactory> protocolFactory(new TBinaryProtocolFactory());
-    shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(32);
-    shared_ptr<ThreadFactory> threadFactory(new PosixThreadFactory());
-    //threadManager->threadFactory(threadFactory);
-    //threadManager->start();
-    TThreadedServer server(processor, serverTransport, transportFactory, protocolFactory);
-    printf("I'm using tthreaded server!");
-    server.serve();
+    if (handler->nonblocking) {
+        // A few I/O threads multiplex every connection; requests run on a
+        // bounded pool, so a writer that is sleeping for backpressure only
+        // ties up a worker, and idle connections cost no threads at all.
+        shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(handler->worker_threads);
+        shared_ptr<ThreadFactory> threadFactory(new PosixThreadFactory());
+        threadManager->threadFactory(threadFactory);
+        threadManager->start();
+        TNonblockingServer server(processor, protocolFactory, handler->port, threadManager);
+        server.setNumIOThreads(handler->io_threads);
+        printf("Serving with nonblocking server: %d io threads, %d workers\n", handler->io_threads, handler->worker_threads);
+        server.serve();
+    } else {
+        shared_ptr<TServerTransport> serverTransport(new TServerSocket(handler->port));
+        shared_ptr<TTransportFactory> transportFactory(new TFramedTransportFactory());
+        TThreadedServer server(processor, serverTransport, transportFactory, protocolFactory);
+        printf("Serving with threaded server (one thread per connection)\n");
+        server.serve();
+    }
     return 0;
 }
@@ -0,0 +1,400 @@
+/*
+ * asyncclient.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <map>
+
+#include "asyncclient.h"
+
+struct asyncClient::connection {
+  asyncClient * client;
+  int sockd;
+  FILE * in;                 // buffered reads; only the receiver thread uses it.
+  pthread_t receiver;
+  bool started;
+  pthread_mutex_t mut;       // protects the fields below, and serializes writes to sockd.
+  std::map<uint64_t, pending_op> pending;
+  uint64_t next_id;
+  bool dead;
+};
+
+/** Open a connection, and switch it to pipelined mode.  @return the socket, or -1. */
+static int open_pipelined(const char * host, int port) {
+  char portstr[16];
+  snprintf(portstr, sizeof(portstr), "%d", port ? port : 32432);
+  struct addrinfo hints, *res;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if(getaddrinfo(host, portstr, &hints, &res)) {
+    fprintf(stderr, "ERROR, no such host as %s\n", host);
+    return -1;
+  }
+  int sockd = socket(AF_INET, SOCK_STREAM, 0);
+  if(sockd == -1) {
+    perror("ERROR opening socket");
+    freeaddrinfo(res);
+    return -1;
+  }
+#ifdef LOGSTORE_NODELAY
+  int flag = 1;
+  if(setsockopt(sockd, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(flag)) == -1) {
+    perror("ERROR on setting socket option TCP_NODELAY");
+  }
+#endif
+  if(connect(sockd, res->ai_addr, res->ai_addrlen) == -1) {
+    perror("ERROR connecting");
+    freeaddrinfo(res);
+    close(sockd);
+    return -1;
+  }
+  freeaddrinfo(res);
+
+  int err = writeoptosocket(sockd, OP_PIPELINE);
+  if(!err) { err = writeendofiteratortosocket(sockd); }
+  if(!err) { err = writeendofiteratortosocket(sockd); }
+  if(err || readopfromsocket(sockd, LOGSTORE_SERVER_RESPONSE) != LOGSTORE_RESPONSE_SUCCESS) {
+    fprintf(stderr, "Server at %s:%d does not support pipelined requests\n", host, port);
+    close(sockd);
+    return -1;
+  }
+  return sockd;
+}
+
+/** FNV-1a, so that the client doesn't need stasis' hash functions. */
+static uint32_t key_hash(const dataTuple * t) {
+  const byte * k = t->strippedkey();
+  uint32_t h = 2166136261u;
+  for(len_t i = 0; i < t->strippedkeylen(); i++) {
+    h = (h ^ k[i]) * 16777619u;
+  }
+  return h;
+}
+
+asyncClient::future::future() : done_(false), rcode_(LOGSTORE_CONN_CLOSED_ERROR), tuples_(NULL), tuple_count_(0) {
+  pthread_mutex_init(&mut_, 0);
+  pthread_cond_init(&cond_, 0);
+}
+asyncClient::future::~future() {
+  for(size_t i = 0; i < tuple_count_; i++) {
+    dataTuple::freetuple(tuples_[i]);
+  }
+  free(tuples_);
+  pthread_cond_destroy(&cond_);
+  pthread_mutex_destroy(&mut_);
+}
+network_op_t asyncClient::future::wait() {
+  pthread_mutex_lock(&mut_);
+  while(!done_) { pthread_cond_wait(&cond_, &mut_); }
+  pthread_mutex_unlock(&mut_);
+  return rcode_;
+}
+void asyncClient::future::callback(void * arg, network_op_t rcode, dataTuple ** tuples, size_t tuple_count) {
+  future * f = (future*)arg;
+  pthread_mutex_lock(&f->mut_);
+  f->rcode_ = rcode;
+  f->tuples_ = tuples;
+  f->tuple_count_ = tuple_count;
+  f->done_ = true;
+  pthread_cond_broadcast(&f->cond_);
+  pthread_mutex_unlock(&f->mut_);
+}
+
+asyncClient::asyncClient(const char * host, int port, int connections, size_t max_batch, size_t max_outstanding) :
+  ok_(true),
+  max_batch_(max_batch),
+  max_outstanding_(max_outstanding),
+  next_conn_(0),
+  outstanding_(0),
+  shutting_down_(false) {
+  pthread_mutex_init(&mut_, 0);
+  pthread_cond_init(&outstanding_cond_, 0);
+
+  for(int i = 0; i < connections; i++) {
+    connection * c = new connection;
+    c->client = this;
+    c->sockd = open_pipelined(host, port);
+    c->in = NULL;
+    c->started = false;
+    c->next_id = 1;
+    c->dead = (c->sockd == -1);
+    pthread_mutex_init(&c->mut, 0);
+    if(!c->dead) {
+      c->in = fdopen(dup(c->sockd), "r");
+      c->started = true;
+      pthread_create(&c->receiver, 0, receiver_wrap, c);
+    } else {
+      ok_ = false;
+    }
+    conns_.push_back(c);
+
+    // Each bulk insert connection has its own queue of puts, and a thread
+    // that sends them.
+    logstore_handle_t * l = logstore_client_open(host, port, 100);
+    if(!l) { ok_ = false; continue; }
+    put_queue * q = new put_queue;
+    q->client = this;
+    q->l = l;
+    pthread_cond_init(&q->cond, 0);
+    put_queues_.push_back(q);
+    pthread_create(&q->batcher, 0, batcher_wrap, q);
+  }
+}
+
+asyncClient::~asyncClient() {
+  flush();
+
+  pthread_mutex_lock(&mut_);
+  shutting_down_ = true;
+  for(size_t i = 0; i < put_queues_.size(); i++) {
+    pthread_cond_broadcast(&put_queues_[i]->cond);
+  }
+  pthread_mutex_unlock(&mut_);
+  for(size_t i = 0; i < put_queues_.size(); i++) {
+    put_queue * q = put_queues_[i];
+    pthread_join(q->batcher, 0);
+    logstore_client_close(q->l);
+    pthread_cond_destroy(&q->cond);
+    delete q;
+  }
+
+  for(size_t i = 0; i < conns_.size(); i++) {
+    connection * c = conns_[i];
+    pthread_mutex_lock(&c->mut);
+    if(!c->dead) {
+      // The server answers everything that is outstanding, then closes the
+      // connection, which ends the receiver thread.
+      uint64_t reqid = 0;
+      if(!writetosocket(c->sockd, &reqid, sizeof(reqid))) {
+        writeoptosocket(c->sockd, OP_DONE);
+      }
+    }
+    pthread_mutex_unlock(&c->mut);
+    if(c->started) {
+      pthread_join(c->receiver, 0);
+      fclose(c->in);
+    }
+    if(c->sockd != -1) { close(c->sockd); }
+    pthread_mutex_destroy(&c->mut);
+    delete c;
+  }
+
+  pthread_cond_destroy(&outstanding_cond_);
+  pthread_mutex_destroy(&mut_);
+}
+
+void asyncClient::begin_op() {
+  pthread_mutex_lock(&mut_);
+  while(outstanding_ >= max_outstanding_) {
+    pthread_cond_wait(&outstanding_cond_, &mut_);
+  }
+  outstanding_++;
+  pthread_mutex_unlock(&mut_);
+}
+
+void asyncClient::complete(callback_t cb, void * arg, network_op_t rcode, dataTuple ** tuples, size_t tuple_count) {
+  if(cb) {
+    cb(arg, rcode, tuples, tuple_count);
+  } else {
+    for(size_t i = 0; i < tuple_count; i++) {
+      dataTuple::freetuple(tuples[i]);
+    }
+    free(tuples);
+  }
+  pthread_mutex_lock(&mut_);
+  outstanding_--;
+  pthread_cond_broadcast(&outstanding_cond_);
+  pthread_mutex_unlock(&mut_);
+}
+
+void asyncClient::put(dataTuple * tup, callback_t cb, void * arg) {
+  begin_op();
+  if(put_queues_.empty()) {
+    complete(cb, arg, LOGSTORE_CONN_CLOSED_ERROR, NULL, 0);
+    return;
+  }
+  // Batchers run independently, so send each key through the same one.
+  put_queue * q = put_queues_[key_hash(tup) % put_queues_.size()];
+  pending_put p;
+  p.tup = tup->create_copy();
+  p.cb = cb;
+  p.arg = arg;
+  pthread_mutex_lock(&mut_);
+  q->puts.push_back(p);
+  pthread_cond_signal(&q->cond);
+  pthread_mutex_unlock(&mut_);
+}
+
+void asyncClient::submit(network_op_t opcode, dataTuple * tuple, dataTuple * tuple2, uint64_t count, callback_t cb, void * arg) {
+  begin_op();
+  if(opcode == OP_BULK_INSERT || conns_.empty()) {
+    complete(cb, arg, LOGSTORE_UNIMPLEMENTED_ERROR, NULL, 0);
+    return;
+  }
+  pthread_mutex_lock(&mut_);
+  connection * c = conns_[next_conn_++ % conns_.size()];
+  pthread_mutex_unlock(&mut_);
+
+  pending_op op;
+  op.cb = cb;
+  op.arg = arg;
+
+  pthread_mutex_lock(&c->mut);
+  if(c->dead) {
+    pthread_mutex_unlock(&c->mut);
+    complete(cb, arg, LOGSTORE_CONN_CLOSED_ERROR, NULL, 0);
+    return;
+  }
+  uint64_t reqid = c->next_id++;
+  c->pending[reqid] = op;
+
+  // Serialize the whole request, so that it goes out in a single write.
+  char * buf = NULL;
+  size_t len = 0;
+  FILE * mf = open_memstream(&buf, &len);
+  int err = 0;
+  if(!err) { err = writetosocket(mf, &reqid, sizeof(reqid));  }
+  if(!err) { err = writetosocket(mf, &opcode, sizeof(opcode)); }
+  if(!err) { err = writetupletosocket(mf, tuple);             }
+  if(!err) { err = writetupletosocket(mf, tuple2);            }
+  if(!err && opreadscount(opcode)) { err = writecounttosocket(mf, count); }
+  fclose(mf);
+  if(!err) { err = writetosocket(c->sockd, buf, len); }
+  free(buf);
+  if(err) {
+    // The receiver thread sees the broken connection, and fails everything else.
+    c->pending.erase(reqid);
+    pthread_mutex_unlock(&c->mut);
+    complete(cb, arg, LOGSTORE_CONN_CLOSED_ERROR, NULL, 0);
+    return;
+  }
+  pthread_mutex_unlock(&c->mut);
+}
+
+void asyncClient::flush() {
+  pthread_mutex_lock(&mut_);
+  while(outstanding_) {
+    pthread_cond_wait(&outstanding_cond_, &mut_);
+  }
+  pthread_mutex_unlock(&mut_);
+}
+
+void * asyncClient::receiver_wrap(void * arg) {
+  connection * c = (connection*)arg;
+  c->client->receiver(c);
+  return 0;
+}
+
+void asyncClient::receiver(connection * c) {
+  while(true) {
+    uint64_t reqid, len;
+    int err = 0;
+    if( !err) { err = readfromsocket(c->in, &reqid, sizeof(reqid)); }
+    if( !err) { err = readfromsocket(c->in, &len, sizeof(len));     }
+    byte * buf = NULL;
+    if( !err) {
+      buf = (byte*) malloc(len);
+      err = readfromsocket(c->in, buf, len);
+    }
+    if(err) { free(buf); break; }
+
+    dataTuple ** tuples;
+    size_t tuple_count;
+    network_op_t rcode = readresponsefrombuffer(buf, len, &tuples, &tuple_count);
+    free(buf);
+
+    pthread_mutex_lock(&c->mut);
+    std::map<uint64_t, pending_op>::iterator it = c->pending.find(reqid);
+    bool found = (it != c->pending.end());
+    pending_op op;
+    if(found) {
+      op = it->second;
+      c->pending.erase(it);
+    }
+    pthread_mutex_unlock(&c->mut);
+
+    if(!found) {
+      fprintf(stderr, "Server answered unknown request %lld; closing connection\n", (long long)reqid);
+      for(size_t i = 0; i < tuple_count; i++) { dataTuple::freetuple(tuples[i]); }
+      free(tuples);
+      break;
+    }
+    complete(op.cb, op.arg, rcode, tuples, tuple_count);
+  }
+
+  // Fail whatever the server will never answer.
+  pthread_mutex_lock(&c->mut);
+  c->dead = true;
+  std::map<uint64_t, pending_op> orphans;
+  orphans.swap(c->pending);
+  shutdown(c->sockd, SHUT_RDWR);
+  pthread_mutex_unlock(&c->mut);
+  for(std::map<uint64_t, pending_op>::iterator it = orphans.begin(); it != orphans.end(); ++it) {
+    complete(it->second.cb, it->second.arg, LOGSTORE_CONN_CLOSED_ERROR, NULL, 0);
+  }
+}
+
+void * asyncClient::batcher_wrap(void * arg) {
+  put_queue * q = (put_queue*)arg;
+  q->client->batcher(q);
+  return 0;
+}
+
+void asyncClient::batcher(put_queue * q) {
+  logstore_handle_t * l = q->l;
+  std::vector<pending_put> batch;
+  pthread_mutex_lock(&mut_);
+  while(true) {
+    while(q->puts.empty() && !shutting_down_) {
+      pthread_cond_wait(&q->cond, &mut_);
+    }
+    if(q->puts.empty()) { break; }
+    // Take everything that piled up while the last batch was in flight.
+    size_t n = q->puts.size() < max_batch_ ? q->puts.size() : max_batch_;
+    batch.assign(q->puts.begin(), q->puts.begin() + n);
+    q->puts.erase(q->puts.begin(), q->puts.begin() + n);
+    pthread_mutex_unlock(&mut_);
+
+    network_op_t rcode = logstore_client_op_returns_many(l, OP_BULK_INSERT);
+    if(rcode == LOGSTORE_RESPONSE_RECEIVING_TUPLES) {
+      rcode = LOGSTORE_RESPONSE_SUCCESS;
+      for(size_t i = 0; i < n && rcode == LOGSTORE_RESPONSE_SUCCESS; i++) {
+        rcode = logstore_client_send_tuple(l, batch[i].tup);
+      }
+      if(rcode == LOGSTORE_RESPONSE_SUCCESS) {
+        rcode = logstore_client_send_tuple(l, NULL);  // end of stream; waits for the server.
+      }
+    } else if(!opiserror(rcode)) {
+      rcode = LOGSTORE_PROTOCOL_ERROR;
+    }
+    for(size_t i = 0; i < n; i++) {
+      dataTuple::freetuple(batch[i].tup);
+      complete(batch[i].cb, batch[i].arg, rcode, NULL, 0);
+    }
+    batch.clear();
+
+    pthread_mutex_lock(&mut_);
+  }
+  pthread_mutex_unlock(&mut_);
+}
@@ -0,0 +1,154 @@
+/*
+ * asyncclient.h
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ASYNCCLIENT_H_
+#define ASYNCCLIENT_H_
+
+#include <pthread.h>
+#include <deque>
+#include <vector>
+
+#include "datatuple.h"
+#include "tcpclient.h"
+#include "network.h"
+
+/**
+ * A thread-safe, non-blocking client for the native protocol.
+ *
+ * Requests are spread over a pool of pipelined connections (OP_PIPELINE),
+ * and each connection has a thread that completes responses as they
+ * arrive.  Puts go through a separate set of untagged connections: whatever
+ * puts are queued when one of them is idle are sent as a single
+ * OP_BULK_INSERT stream, so concurrent puts are batched without adding any
+ * latency when the client is lightly loaded.  Each key is always sent on
+ * the same connection, so puts to the same key are applied in the order
+ * put() was called, but puts are not ordered with respect to submit().
+ *
+ * Completions run callbacks on the client's threads, so they should be
+ * cheap, and must not block on other requests.
+ */
+class asyncClient {
+public:
+  /**
+   * Called once per request.  The callback owns tuples (and the array that
+   * holds them), which is NULL unless rcode is LOGSTORE_RESPONSE_SENDING_TUPLES.
+   */
+  typedef void (*callback_t)(void * arg, network_op_t rcode, dataTuple ** tuples, size_t tuple_count);
+
+  /** A completion that callers can block on, for code that would rather not use callbacks. */
+  class future {
+  public:
+    future();
+    ~future();
+    /** Wait for the request to complete, and return its response code. */
+    network_op_t wait();
+    /** Valid after wait().  The tuples still belong to the future. */
+    dataTuple ** tuples() { return tuples_; }
+    size_t tuple_count() { return tuple_count_; }
+
+    static void callback(void * arg, network_op_t rcode, dataTuple ** tuples, size_t tuple_count);
+  private:
+    pthread_mutex_t mut_;
+    pthread_cond_t cond_;
+    bool done_;
+    network_op_t rcode_;
+    dataTuple ** tuples_;
+    size_t tuple_count_;
+  };
+
+  static const int DEFAULT_CONNECTIONS = 4;
+  static const size_t DEFAULT_MAX_BATCH = 1000;
+  static const size_t DEFAULT_MAX_OUTSTANDING = 1024;
+
+  /**
+   * @param connections is the number of pipelined connections, and also the
+   *        number of bulk insert connections.
+   * @param max_batch caps the number of puts sent in one OP_BULK_INSERT stream.
+   *        Keep it below requestDispatch's BULK_LOAD_MIN_TUPLES, so that
+   *        batches sent to an empty table go through C0 and the log.
+   * @param max_outstanding caps the number of requests (including queued
+   *        puts) that have not completed; beyond it, put() and submit() block.
+   */
+  asyncClient(const char * host, int port, int connections = DEFAULT_CONNECTIONS,
+              size_t max_batch = DEFAULT_MAX_BATCH, size_t max_outstanding = DEFAULT_MAX_OUTSTANDING);
+  /** Waits for outstanding requests, then closes the connections. */
+  ~asyncClient();
+
+  /** @return false if any of the connections could not be opened. */
+  bool ok() { return ok_; }
+
+  /**
+   * Queue an insert, update or delete.  The tuple is copied.  cb is called
+   * with LOGSTORE_RESPONSE_SUCCESS once the batch containing it is applied.
+   */
+  void put(dataTuple * tup, callback_t cb = NULL, void * arg = NULL);
+
+  /**
+   * Send any other request on one of the pipelined connections.  The tuples
+   * are serialized before this returns.  OP_BULK_INSERT is not supported;
+   * use put() instead.
+   */
+  void submit(network_op_t opcode, dataTuple * tuple = NULL, dataTuple * tuple2 = NULL,
+              uint64_t count = (uint64_t)-1, callback_t cb = NULL, void * arg = NULL);
+
+  /** Wait until every request issued so far has completed. */
+  void flush();
+
+private:
+  struct pending_op {
+    callback_t cb;
+    void * arg;
+  };
+  struct pending_put {
+    dataTuple * tup;
+    callback_t cb;
+    void * arg;
+  };
+  struct connection;
+  /** The puts waiting for one bulk insert connection. */
+  struct put_queue {
+    asyncClient * client;
+    logstore_handle_t * l;
+    pthread_t batcher;
+    std::deque<pending_put> puts;  // protected by asyncClient::mut_.
+    pthread_cond_t cond;           // signalled when puts are queued, or on shutdown.
+  };
+
+  static void * receiver_wrap(void * arg);
+  static void * batcher_wrap(void * arg);
+  void receiver(connection * c);
+  void batcher(put_queue * q);
+
+  void begin_op();
+  void complete(callback_t cb, void * arg, network_op_t rcode, dataTuple ** tuples, size_t tuple_count);
+
+  bool ok_;
+  size_t max_batch_;
+  size_t max_outstanding_;
+
+  std::vector<connection*> conns_;
+  size_t next_conn_;                  // round robin; protected by mut_.
+  std::vector<put_queue*> put_queues_;
+
+  pthread_mutex_t mut_;               // protects everything below, and the put queues.
+  pthread_cond_t outstanding_cond_;   // signalled when requests complete.
+  size_t outstanding_;
+  bool shutting_down_;
+};
+
+#endif /* ASYNCCLIENT_H_ */
@@ -20,12 +20,13 @@
  *      Author: sears
  */
 
-#include "..tcpclient.h"
+#include "../tcpclient.h"
+#include "../asyncclient.h"
 #include "../network.h"
 #include "datatuple.h"
 
 void usage(char * argv[]) {
-    fprintf(stderr, "usage %s numthreads threadopcount [host [port]]\n", argv[0]);
+    fprintf(stderr, "usage %s [--async] numthreads threadopcount [host [port]]\n", argv[0]);
 }
 
 #include "../servers/native/util/util_main.h"
@@ -34,6 +35,21 @@ int threadopcount;
 
 int thrargc;
 char ** thrargv;
+asyncClient * async = NULL;
+int async_errors = 0;
+
+void noop_done(void * arg, network_op_t rcode, dataTuple ** tuples, size_t tuple_count) {
+  if(rcode != LOGSTORE_RESPONSE_SUCCESS) {
+    __sync_fetch_and_add(&async_errors, 1);
+  }
+}
+
+void * async_worker (void * arg) {
+  for(int i = 0; i < threadopcount; i++) {
+    async->submit(OP_DBG_NOOP, NULL, NULL, (uint64_t)-1, noop_done, NULL);
+  }
+  return 0;
+}
 
 void * worker (void * arg) {
   logstore_handle_t * l = util_open_conn(thrargc-2, thrargv+2);
@@ -50,12 +66,24 @@ void * worker (void * arg) {
 }
 
 int main(int argc, char * argv[]) {
+    bool use_async = argc > 1 && !strcmp(argv[1], "--async");
+    if(use_async) {
+      // Drop the flag, so that the rest of the arguments parse as usual.
+      argv[1] = argv[0];
+      argc--;
+      argv++;
+    }
     if(argc < 3) {
       usage(argv);
       return 1;
     }
     thrargc = argc;
     thrargv = argv;
+    if(use_async) {
+      // One client, shared by every thread, instead of a connection per thread.
+      async = new asyncClient(argc > 3 ? argv[3] : "localhost", argc > 4 ? atoi(argv[4]) : 32432);
+      if(!async->ok()) { perror("Couldn't open connection"); return 2; }
+    }
 
     int numthreads = atoi(argv[1]);
     threadopcount = (atoi(argv[2])/numthreads);
@@ -65,7 +93,7 @@ int main(int argc, char * argv[]) {
     struct timeval start, stop;
     gettimeofday(&start, 0);
     for(int i = 0; i < numthreads; i++) {
-      pthread_create(&threads[i], 0, worker, 0);
+      pthread_create(&threads[i], 0, use_async ? async_worker : worker, 0);
     }
     int had_err = 0;
     for(int i = 0; i < numthreads; i++) {
@@ -75,6 +103,13 @@ int main(int argc, char * argv[]) {
         had_err = 1;
       }
     }
+    if(use_async) {
+      async->flush();
+      if(async_errors) {
+        fprintf(stderr, "%d no-ops failed\n", async_errors);
+        had_err = 1;
+      }
+    }
     gettimeofday(&stop,0);
     if(!had_err) {
       double startf = ((double)start.tv_sec) + (double)start.tv_usec / 1000000.0;
@@ -84,6 +119,7 @@ int main(int argc, char * argv[]) {
           numthreads, threadopcount, elapsed, ((double)threadopcount)/elapsed, (((double)numthreads)*(double)threadopcount)/elapsed);
     }
     free(threads);
+    delete async;
     return 0;
 
 }
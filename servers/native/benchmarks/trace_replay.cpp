@@ -0,0 +1,309 @@
+/*
+ * trace_replay.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Replay an op trace (newserver --trace, or the mapkeeper server's --trace)
+ * against a server, or against a bLSM instance in the current directory.
+ *
+ * The replay is open loop: each operation is issued at its recorded start
+ * time, divided by --speed (0 means as fast as possible), whether or not the
+ * ones before it have finished.  Operations from the same traced thread run
+ * in their recorded order on the same replay thread, so the order in which
+ * each client saw its requests complete is preserved; given the same trace
+ * and thread count, each replay thread issues the same sequence of
+ * operations.  Latency is measured from the scheduled start time, so it
+ * includes time spent waiting for a replay thread that fell behind.
+ */
+#include <stasis/transactional.h>
+#include <signal.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+#include "../tcpclient.h"
+#include "../network.h"
+#include "bLSM.h"
+#include "mergeScheduler.h"
+#include "latencyStats.h"
+#include "opTrace.h"
+
+struct replay_op {
+	opTrace::record r;
+	dataTuple * t;
+	dataTuple * t2;
+};
+
+static bool replay_op_before(const replay_op &a, const replay_op &b) {
+	if(a.r.start_ns != b.r.start_ns) { return a.r.start_ns < b.r.start_ns; }
+	if(a.r.thread != b.r.thread) { return a.r.thread < b.r.thread; }
+	return a.r.seq < b.r.seq;
+}
+
+struct replay_thread {
+	pthread_t thread;
+	std::vector<replay_op*> ops;
+	bLSM * ltable;              // either this,
+	logstore_handle_t * conn;   // or this is set.
+	uint64_t start;             // latencyStats::now() at which the trace's time zero is replayed.
+	double speed;
+	uint64_t errors;
+	uint64_t late;              // operations issued more than a millisecond behind schedule.
+	latencyHistogram latency[opTrace::NUM_OPS];   // from the scheduled start.
+	latencyHistogram service[opTrace::NUM_OPS];   // from the time the operation was issued.
+};
+
+static void sleep_until(uint64_t when) {
+	struct timespec ts;
+	ts.tv_sec = when / 1000000000ull;
+	ts.tv_nsec = when % 1000000000ull;
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) { }
+}
+
+/** @return true if the operation didn't fail. */
+static bool run_local(bLSM * ltable, const replay_op * op) {
+	switch(op->r.op) {
+	case opTrace::INSERT:
+		ltable->insertTuple(op->t);
+		return true;
+	case opTrace::INSERT_IF_ABSENT:
+		ltable->insertTupleIfAbsent(op->t);
+		return true;
+	case opTrace::FIND: {
+		dataTuple * dt = ltable->findTuple_first(-1, op->t->strippedkey(), op->t->strippedkeylen());
+		if(dt) { dataTuple::freetuple(dt); }
+		return true;
+	}
+	case opTrace::TEST_AND_SET:
+		ltable->testAndSetTuple(op->t, op->t2);
+		return true;
+	case opTrace::SCAN: {
+		bLSM::iterator * itr = op->t2 ? new bLSM::iterator(ltable, op->t, op->t2)
+		                              : new bLSM::iterator(ltable, op->t);
+		uint64_t count = 0;
+		while(count != op->r.count && itr->getnextNoCopy()) { count++; }
+		delete itr;
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+static bool run_remote(logstore_handle_t * l, const replay_op * op) {
+	network_op_t opcode;
+	dataTuple * t2 = op->t2;
+	uint64_t count = (uint64_t)-1;
+	switch(op->r.op) {
+	case opTrace::INSERT:           opcode = OP_INSERT; break;
+	case opTrace::INSERT_IF_ABSENT: opcode = OP_TEST_AND_SET; t2 = NULL; break;  // set iff there's no tuple.
+	case opTrace::FIND:             opcode = OP_FIND; break;
+	case opTrace::TEST_AND_SET:     opcode = OP_TEST_AND_SET; break;
+	case opTrace::SCAN:             opcode = OP_SCAN; count = op->r.count; break;
+	default:                        return false;
+	}
+	uint8_t rcode = logstore_client_op_returns_many(l, opcode, op->t, t2, count);
+	if(opiserror(rcode)) { return false; }
+	if(rcode == LOGSTORE_RESPONSE_SENDING_TUPLES) {
+		dataTuple * dt;
+		while((dt = logstore_client_next_tuple(l))) {
+			dataTuple::freetuple(dt);
+		}
+	}
+	return true;
+}
+
+static void * replay_worker(void * arg) {
+	replay_thread * w = (replay_thread*)arg;
+	for(size_t i = 0; i < w->ops.size(); i++) {
+		const replay_op * op = w->ops[i];
+		uint64_t scheduled = w->start;
+		if(w->speed > 0) {
+			scheduled += (uint64_t)((double)op->r.start_ns / w->speed);
+			sleep_until(scheduled);
+		}
+		uint64_t issued = latencyStats::now();
+		if(w->speed > 0 && issued > scheduled + 1000000) { w->late++; }
+		bool ok = w->ltable ? run_local(w->ltable, op) : run_remote(w->conn, op);
+		uint64_t done = latencyStats::now();
+		if(!ok) {
+			w->errors++;
+			if(!w->ltable) {
+				fprintf(stderr, "Lost connection to server\n");
+				break;
+			}
+			continue;
+		}
+		w->latency[op->r.op].record(done - (w->speed > 0 ? scheduled : issued));
+		w->service[op->r.op].record(done - issued);
+	}
+	return 0;
+}
+
+static void print_histograms(const char * title, const latencyHistogram * h, double seconds) {
+	printf("\n%s\n", title);
+	printf("%-18s %12s %10s %10s %10s %10s %10s %12s\n", "op", "count", "mean(us)", "p50(us)", "p99(us)", "p99.9(us)", "max(us)", "ops/sec");
+	for(int i = 0; i < opTrace::NUM_OPS; i++) {
+		if(!h[i].count()) { continue; }
+		printf("%-18s %12llu %10.1f %10.1f %10.1f %10.1f %10.1f %12.1f\n", opTrace::op_name((opTrace::op_t)i),
+		       (unsigned long long)h[i].count(), h[i].sum() / (1000.0 * h[i].count()),
+		       h[i].percentile(50) / 1000.0, h[i].percentile(99) / 1000.0, h[i].percentile(99.9) / 1000.0,
+		       h[i].max() / 1000.0, seconds > 0 ? h[i].count() / seconds : 0.0);
+	}
+}
+
+static void usage(char * argv[]) {
+	fprintf(stderr, "usage: %s [--speed <x>] [--threads <n>] [--max-ops <n>] [--server <host> <port> | --local] <trace file>\n", argv[0]);
+	fprintf(stderr, "  --speed 1 replays at the recorded rate, 2 at twice the rate, and 0 as fast as possible.\n");
+	fprintf(stderr, "  --local replays against a new or existing table in the current directory.\n");
+	exit(1);
+}
+
+int main(int argc, char * argv[]) {
+	signal(SIGPIPE, SIG_IGN);
+	double speed = 1.0;
+	int threads = 16;
+	uint64_t max_ops = (uint64_t)-1;
+	const char * host = "localhost";
+	int port = 32432;
+	bool local = false;
+	const char * path = NULL;
+
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "--speed") && i + 1 < argc) {
+			speed = atof(argv[++i]);
+		} else if(!strcmp(argv[i], "--threads") && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		} else if(!strcmp(argv[i], "--max-ops") && i + 1 < argc) {
+			max_ops = strtoull(argv[++i], NULL, 10);
+		} else if(!strcmp(argv[i], "--server") && i + 2 < argc) {
+			host = argv[++i];
+			port = atoi(argv[++i]);
+		} else if(!strcmp(argv[i], "--local")) {
+			local = true;
+		} else if(argv[i][0] != '-' && !path) {
+			path = argv[i];
+		} else {
+			usage(argv);
+		}
+	}
+	if(!path || threads < 1 || speed < 0) { usage(argv); }
+
+	opTraceReader * reader = opTraceReader::open(path);
+	if(!reader) { perror("Couldn't open trace"); return 2; }
+	std::vector<replay_op> ops;
+	latencyHistogram recorded[opTrace::NUM_OPS];
+	replay_op op;
+	while(ops.size() < max_ops && reader->next(&op.r, &op.t, &op.t2)) {
+		recorded[op.r.op].record(op.r.duration_ns);
+		ops.push_back(op);
+	}
+	if(reader->error()) {
+		fprintf(stderr, "Warning: trace is truncated or corrupt after %llu operations\n", (unsigned long long)ops.size());
+	}
+	delete reader;
+	if(ops.empty()) { fprintf(stderr, "Trace is empty\n"); return 0; }
+	std::sort(ops.begin(), ops.end(), replay_op_before);
+	double traced_seconds = (ops.back().r.start_ns - ops.front().r.start_ns) / 1e9;
+	uint64_t first = ops.front().r.start_ns;
+	for(size_t i = 0; i < ops.size(); i++) {
+		ops[i].r.start_ns -= first;
+	}
+
+	bLSM * ltable = NULL;
+	mergeScheduler * mscheduler = NULL;
+	if(local) {
+		bLSM::init_stasis();
+		int xid = Tbegin();
+		ltable = new bLSM(0, 1024 * 1024 * 512);
+		if(TrecordType(xid, ROOT_RECORD) == INVALID_SLOT) {
+			printf("Creating empty logstore\n");
+			ltable->allocTable(xid);
+		} else {
+			printf("Opened existing logstore\n");
+			recordid table_root = ROOT_RECORD;
+			table_root.size = TrecordSize(xid, ROOT_RECORD);
+			ltable->openTable(xid, table_root);
+		}
+		Tcommit(xid);
+		mscheduler = new mergeScheduler(ltable);
+		mscheduler->start();
+		ltable->replayLog();
+	}
+
+	std::vector<replay_thread*> workers;
+	for(int i = 0; i < threads; i++) {
+		replay_thread * w = new replay_thread;
+		w->ltable = ltable;
+		w->conn = NULL;
+		w->speed = speed;
+		w->errors = 0;
+		w->late = 0;
+		if(!local) {
+			w->conn = logstore_client_open(host, port, 100);
+			if(!w->conn) { perror("Couldn't open connection"); return 2; }
+		}
+		workers.push_back(w);
+	}
+	for(size_t i = 0; i < ops.size(); i++) {
+		workers[ops[i].r.thread % threads]->ops.push_back(&ops[i]);
+	}
+
+	printf("Replaying %llu operations (%.1f traced seconds) on %d threads at %s speed\n",
+	       (unsigned long long)ops.size(), traced_seconds, threads, speed > 0 ? "scaled" : "maximum");
+	uint64_t start = latencyStats::now() + 10000000;   // give the threads time to start.
+	for(int i = 0; i < threads; i++) {
+		workers[i]->start = start;
+		pthread_create(&workers[i]->thread, 0, replay_worker, workers[i]);
+	}
+	latencyHistogram latency[opTrace::NUM_OPS];
+	latencyHistogram service[opTrace::NUM_OPS];
+	uint64_t errors = 0;
+	uint64_t late = 0;
+	for(int i = 0; i < threads; i++) {
+		replay_thread * w = workers[i];
+		pthread_join(w->thread, 0);
+		for(int j = 0; j < opTrace::NUM_OPS; j++) {
+			latency[j].merge(&w->latency[j]);
+			service[j].merge(&w->service[j]);
+		}
+		errors += w->errors;
+		late += w->late;
+		if(w->conn) { logstore_client_close(w->conn); }
+		delete w;
+	}
+	double seconds = (latencyStats::now() - start) / 1e9;
+
+	uint64_t total = 0;
+	for(int i = 0; i < opTrace::NUM_OPS; i++) { total += service[i].count(); }
+	printf("\n%llu operations in %.3f seconds: %.1f ops/sec; %llu errors, %llu issued more than 1ms late\n",
+	       (unsigned long long)total, seconds, seconds > 0 ? total / seconds : 0.0,
+	       (unsigned long long)errors, (unsigned long long)late);
+	print_histograms("Recorded latency (as seen by the traced server)", recorded, traced_seconds);
+	print_histograms("Replay latency (from scheduled start)", latency, seconds);
+	print_histograms("Replay service time (from issue)", service, seconds);
+
+	for(size_t i = 0; i < ops.size(); i++) {
+		if(ops[i].t)  { dataTuple::freetuple(ops[i].t); }
+		if(ops[i].t2) { dataTuple::freetuple(ops[i].t2); }
+	}
+	if(local) {
+		mscheduler->shutdown();
+		delete mscheduler;
+		delete ltable;
+		bLSM::deinit_stasis();
+	}
+	return errors ? 3 : 0;
+}
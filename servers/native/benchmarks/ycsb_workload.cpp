@@ -0,0 +1,642 @@
+/*
+ * ycsb_workload.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * A YCSB style workload driver that links directly against bLSM, so that
+ * it measures the engine, and not the network or the client library.
+ *
+ * It loads --records keys, then runs --operations operations, drawn from
+ * the read/update/insert/scan/read-modify-write mix, against a table in the
+ * current directory.  Keys are chosen as YCSB does: uniformly, from a
+ * scrambled zipfian distribution, or favoring recent inserts ("latest").
+ * --workload a through f select YCSB's core workloads; later flags override
+ * their settings.
+ *
+ * For each phase, it reports throughput, per-operation latency
+ * percentiles, and write amplification: bytes the C0-C1 and C1-C2 mergers
+ * wrote (including tree overhead, from the per-level lifetime counters in
+ * mergeTelemetry.h's snapshot) over the bytes of tuples the application
+ * inserted.
+ * At the end, it merges C0 to disk and reports space amplification: bytes
+ * allocated to the disk components over the bytes of live tuples.
+ */
+#include <stasis/transactional.h>
+#include <math.h>
+#include <signal.h>
+#include <unistd.h>
+#include <vector>
+
+#include "bLSM.h"
+#include "mergeScheduler.h"
+#include "latencyStats.h"
+#include "mergeTelemetry.h"
+
+enum op_t {
+	READ,
+	UPDATE,
+	INSERT,
+	SCAN,
+	READ_MODIFY_WRITE,
+	NUM_OPS
+};
+static const char * op_names[NUM_OPS] = { "read", "update", "insert", "scan", "read_modify_write" };
+
+enum distribution_t {
+	UNIFORM,
+	ZIPFIAN,
+	LATEST,
+	CONSTANT
+};
+static const char * distribution_names[] = { "uniform", "zipfian", "latest", "constant" };
+
+struct workload {
+	uint64_t records;
+	uint64_t operations;
+	double proportion[NUM_OPS];
+	distribution_t request_distribution;
+	double zipfian_constant;
+	int key_size;
+	distribution_t value_distribution;   // CONSTANT, UNIFORM or ZIPFIAN between min_value_size and max_value_size.
+	int min_value_size;
+	int max_value_size;
+	int max_scan_length;
+	int threads;
+	int64_t c0_size;
+	int64_t row_cache_size;
+	int log_mode;
+	uint64_t seed;
+	bool load;
+	bool measure_space;
+};
+
+/**
+ * Gray et al.'s zipfian generator ("Quickly generating billion-record
+ * synthetic databases", SIGMOD 1994), as used by YCSB.  Item 0 is the most
+ * popular.
+ */
+class zipfian {
+public:
+	zipfian(uint64_t items, double theta) : items_(items), theta_(theta) {
+		zetan_ = zeta(items, theta);
+		double zeta2 = zeta(2, theta);
+		alpha_ = 1.0 / (1.0 - theta);
+		eta_ = (1 - pow(2.0 / items, 1 - theta)) / (1 - zeta2 / zetan_);
+		half_pow_theta_ = 1.0 + pow(0.5, theta);
+	}
+	/** @param u is uniform on [0, 1). */
+	uint64_t next(double u) const {
+		double uz = u * zetan_;
+		if(uz < 1.0) { return 0; }
+		if(uz < half_pow_theta_) { return 1; }
+		uint64_t ret = (uint64_t)(items_ * pow(eta_ * u - eta_ + 1, alpha_));
+		return ret < items_ ? ret : items_ - 1;
+	}
+private:
+	static double zeta(uint64_t n, double theta) {
+		double sum = 0;
+		for(uint64_t i = 0; i < n; i++) {
+			sum += 1 / pow(i + 1, theta);
+		}
+		return sum;
+	}
+	uint64_t items_;
+	double theta_;
+	double zetan_;
+	double alpha_;
+	double eta_;
+	double half_pow_theta_;
+};
+
+static uint64_t fnv_hash64(uint64_t val) {
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for(int i = 0; i < 8; i++) {
+		hash ^= val & 0xff;
+		hash *= 1099511628211ull;
+		val >>= 8;
+	}
+	return hash;
+}
+
+struct bench {
+	workload w;
+	bLSM * ltable;
+	zipfian * key_zipf;          // over the initial record count.
+	zipfian * value_zipf;
+	byte * random_bytes;         // values are slices of this.
+	size_t random_bytes_len;
+	volatile uint64_t next_insert;  // the next key number to insert.
+};
+
+struct bench_thread {
+	pthread_t thread;
+	bench * b;
+	int id;
+	uint64_t rng;
+	uint64_t first_key;          // load phase: insert [first_key, first_key + count).
+	uint64_t count;
+	bool loading;
+	volatile uint64_t done;      // operations finished so far; read by the progress reporter.
+	uint64_t user_bytes;         // bytes of tuples inserted.
+	uint64_t read_misses;
+	uint64_t scanned;
+	latencyHistogram h[NUM_OPS];
+};
+
+// xorshift64*; each thread has its own, seeded from --seed and its id, so runs are repeatable.
+static inline uint64_t next_random(bench_thread * t) {
+	t->rng ^= t->rng >> 12;
+	t->rng ^= t->rng << 25;
+	t->rng ^= t->rng >> 27;
+	return t->rng * 2685821657736338717ull;
+}
+static inline double next_double(bench_thread * t) {
+	return (next_random(t) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static dataTuple * make_key(bench * b, uint64_t keynum) {
+	// Hash the key number, as YCSB does, so that inserts are spread across the key space.
+	char key[128];
+	int width = b->w.key_size - 5;   // "user", and the NUL.
+	int len = snprintf(key, sizeof(key), "user%0*llu", width > 0 ? width : 1, (unsigned long long)fnv_hash64(keynum));
+	return dataTuple::create(key, len + 1);
+}
+
+static dataTuple * make_tuple(bench_thread * t, uint64_t keynum) {
+	bench * b = t->b;
+	int len = b->w.min_value_size;
+	int range = b->w.max_value_size - b->w.min_value_size + 1;
+	if(b->w.value_distribution == UNIFORM) {
+		len += next_random(t) % range;
+	} else if(b->w.value_distribution == ZIPFIAN) {
+		len += b->value_zipf->next(next_double(t));
+	}
+	dataTuple * key = make_key(b, keynum);
+	size_t off = next_random(t) % (b->random_bytes_len - len + 1);
+	dataTuple * ret = dataTuple::create(key->rawkey(), key->rawkeylen(), b->random_bytes + off, len);
+	dataTuple::freetuple(key);
+	return ret;
+}
+
+static uint64_t choose_key(bench_thread * t) {
+	bench * b = t->b;
+	uint64_t limit = b->next_insert;   // may include in-flight inserts; those reads miss.
+	if(!limit) { return 0; }
+	switch(b->w.request_distribution) {
+	case ZIPFIAN:
+		return fnv_hash64(b->key_zipf->next(next_double(t))) % limit;
+	case LATEST:
+		return limit - 1 - (b->key_zipf->next(next_double(t)) % limit);
+	default:
+		return next_random(t) % limit;
+	}
+}
+
+static void do_insert(bench_thread * t, uint64_t keynum) {
+	dataTuple * tup = make_tuple(t, keynum);
+	t->b->ltable->insertTuple(tup);
+	t->user_bytes += tup->byte_length();
+	dataTuple::freetuple(tup);
+}
+
+static void do_read(bench_thread * t, uint64_t keynum) {
+	dataTuple * key = make_key(t->b, keynum);
+	dataTuple * dt = t->b->ltable->findTuple_first(-1, key->strippedkey(), key->strippedkeylen());
+	if(dt) {
+		dataTuple::freetuple(dt);
+	} else {
+		t->read_misses++;
+	}
+	dataTuple::freetuple(key);
+}
+
+static void do_scan(bench_thread * t, uint64_t keynum) {
+	dataTuple * key = make_key(t->b, keynum);
+	int len = 1 + next_random(t) % t->b->w.max_scan_length;
+	bLSM::iterator * itr = new bLSM::iterator(t->b->ltable, key);
+	for(int i = 0; i < len && itr->getnextNoCopy(); i++) {
+		t->scanned++;
+	}
+	delete itr;
+	dataTuple::freetuple(key);
+}
+
+static op_t choose_op(bench_thread * t) {
+	double u = next_double(t);
+	for(int i = 0; i < NUM_OPS - 1; i++) {
+		if(u < t->b->w.proportion[i]) { return (op_t)i; }
+		u -= t->b->w.proportion[i];
+	}
+	return (op_t)(NUM_OPS - 1);
+}
+
+static void * bench_worker(void * arg) {
+	bench_thread * t = (bench_thread*)arg;
+	bench * b = t->b;
+	for(uint64_t i = 0; i < t->count; i++) {
+		uint64_t start = latencyStats::now();
+		op_t op = t->loading ? INSERT : choose_op(t);
+		switch(op) {
+		case READ:
+			do_read(t, choose_key(t));
+			break;
+		case UPDATE:
+			do_insert(t, choose_key(t));
+			break;
+		case INSERT:
+			do_insert(t, t->loading ? t->first_key + i : __sync_fetch_and_add(&b->next_insert, 1));
+			break;
+		case SCAN:
+			do_scan(t, choose_key(t));
+			break;
+		case READ_MODIFY_WRITE: {
+			uint64_t keynum = choose_key(t);
+			do_read(t, keynum);
+			do_insert(t, keynum);
+			break;
+		}
+		default:
+			abort();
+		}
+		t->h[op].record(latencyStats::now() - start);
+		t->done = i + 1;
+	}
+	return 0;
+}
+
+/**
+ * @return the bytes written by the C0-C1 and C1-C2 mergers since startup,
+ * including by merges that are still running.  Take the difference of two
+ * readings to get the bytes written in between.
+ */
+static int64_t merge_bytes_written(mergeManager * mgr) {
+	mergeSnapshot s;
+	mgr->get_snapshot(&s);
+	return s.level[1].lifetime_bytes_out_with_overhead + s.level[2].lifetime_bytes_out_with_overhead;
+}
+
+struct phase_result {
+	const char * name;
+	uint64_t ops;
+	double seconds;
+	uint64_t user_bytes;
+	int64_t merge_bytes;
+	uint64_t read_misses;
+	uint64_t scanned;
+	latencyHistogram h[NUM_OPS];
+};
+
+static void run_phase(bench * b, const char * name, bool loading, uint64_t ops, phase_result * r) {
+	std::vector<bench_thread*> threads;
+	int64_t merge_start = merge_bytes_written(b->ltable->merge_mgr);
+	for(int i = 0; i < b->w.threads; i++) {
+		bench_thread * t = new bench_thread;
+		t->b = b;
+		t->id = i;
+		t->rng = fnv_hash64(b->w.seed * 1000003 + i + (loading ? 0 : 500009)) | 1;
+		t->count = ops / b->w.threads + ((uint64_t)i < ops % b->w.threads ? 1 : 0);
+		t->first_key = i ? threads[i-1]->first_key + threads[i-1]->count : 0;
+		t->loading = loading;
+		t->done = 0;
+		t->user_bytes = 0;
+		t->read_misses = 0;
+		t->scanned = 0;
+		threads.push_back(t);
+	}
+	uint64_t start = latencyStats::now();
+	for(int i = 0; i < b->w.threads; i++) {
+		pthread_create(&threads[i]->thread, 0, bench_worker, threads[i]);
+	}
+	uint64_t last_done = 0;
+	while(true) {
+		sleep(1);
+		uint64_t done = 0;
+		for(int i = 0; i < b->w.threads; i++) { done += threads[i]->done; }
+		fprintf(stderr, "%s: %llu/%llu operations, %llu ops/sec\n", name, (unsigned long long)done,
+		        (unsigned long long)ops, (unsigned long long)(done - last_done));
+		last_done = done;
+		if(done == ops) { break; }
+	}
+	r->name = name;
+	r->user_bytes = 0;
+	r->read_misses = 0;
+	r->scanned = 0;
+	for(int i = 0; i < b->w.threads; i++) {
+		bench_thread * t = threads[i];
+		pthread_join(t->thread, 0);
+		for(int j = 0; j < NUM_OPS; j++) {
+			r->h[j].merge(&t->h[j]);
+		}
+		r->user_bytes += t->user_bytes;
+		r->read_misses += t->read_misses;
+		r->scanned += t->scanned;
+		delete t;
+	}
+	r->seconds = (latencyStats::now() - start) / 1e9;
+	r->ops = ops;
+	r->merge_bytes = merge_bytes_written(b->ltable->merge_mgr) - merge_start;
+}
+
+static double write_amplification(const phase_result * r) {
+	return r->user_bytes ? (double)r->merge_bytes / (double)r->user_bytes : 0.0;
+}
+
+static void print_phase(const phase_result * r) {
+	printf("\n%s: %llu operations in %.3f seconds: %.1f ops/sec\n", r->name, (unsigned long long)r->ops,
+	       r->seconds, r->seconds > 0 ? r->ops / r->seconds : 0.0);
+	printf("%-18s %12s %10s %10s %10s %10s %10s %10s\n", "op", "count", "mean(us)", "p50(us)", "p95(us)", "p99(us)", "p99.9(us)", "max(us)");
+	for(int i = 0; i < NUM_OPS; i++) {
+		const latencyHistogram * h = &r->h[i];
+		if(!h->count()) { continue; }
+		printf("%-18s %12llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", op_names[i], (unsigned long long)h->count(),
+		       h->sum() / (1000.0 * h->count()), h->percentile(50) / 1000.0, h->percentile(95) / 1000.0,
+		       h->percentile(99) / 1000.0, h->percentile(99.9) / 1000.0, h->max() / 1000.0);
+	}
+	printf("read misses %llu, tuples scanned %llu\n", (unsigned long long)r->read_misses, (unsigned long long)r->scanned);
+	printf("application bytes written %llu, merge bytes written %lld, write amplification %.2f\n",
+	       (unsigned long long)r->user_bytes, (long long)r->merge_bytes, write_amplification(r));
+}
+
+static void print_phase_json(FILE * f, const phase_result * r) {
+	fprintf(f, "    {\n");
+	fprintf(f, "      \"name\": \"%s\",\n", r->name);
+	fprintf(f, "      \"operations\": %llu,\n", (unsigned long long)r->ops);
+	fprintf(f, "      \"seconds\": %.6f,\n", r->seconds);
+	fprintf(f, "      \"throughput\": %.3f,\n", r->seconds > 0 ? r->ops / r->seconds : 0.0);
+	fprintf(f, "      \"read_misses\": %llu,\n", (unsigned long long)r->read_misses);
+	fprintf(f, "      \"tuples_scanned\": %llu,\n", (unsigned long long)r->scanned);
+	fprintf(f, "      \"application_bytes_written\": %llu,\n", (unsigned long long)r->user_bytes);
+	fprintf(f, "      \"merge_bytes_written\": %lld,\n", (long long)r->merge_bytes);
+	fprintf(f, "      \"write_amplification\": %.4f,\n", write_amplification(r));
+	fprintf(f, "      \"latency_us\": {");
+	bool first = true;
+	for(int i = 0; i < NUM_OPS; i++) {
+		const latencyHistogram * h = &r->h[i];
+		if(!h->count()) { continue; }
+		fprintf(f, "%s\n        \"%s\": { \"count\": %llu, \"mean\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f }",
+		        first ? "" : ",", op_names[i], (unsigned long long)h->count(), h->sum() / (1000.0 * h->count()),
+		        h->percentile(50) / 1000.0, h->percentile(95) / 1000.0, h->percentile(99) / 1000.0,
+		        h->percentile(99.9) / 1000.0, h->max() / 1000.0);
+		first = false;
+	}
+	fprintf(f, "\n      }\n");
+	fprintf(f, "    }");
+}
+
+struct space_result {
+	uint64_t tree_bytes;
+	uint64_t file_bytes;
+	uint64_t live_bytes;
+	uint64_t live_tuples;
+	double amplification() const { return live_bytes ? (double)tree_bytes / (double)live_bytes : 0.0; }
+};
+
+/** Merge C0 to disk, then compare the size of the disk components to the size of the live data. */
+static void measure_space(bench * b, space_result * s) {
+	bLSM * ltable = b->ltable;
+	fprintf(stderr, "Waiting for C0 to reach disk...\n");
+	ltable->flushTableAndWait();
+	ltable->get_space_usage(&s->tree_bytes, &s->file_bytes);
+
+	s->live_bytes = 0;
+	s->live_tuples = 0;
+	bLSM::iterator * itr = new bLSM::iterator(ltable);
+	const dataTuple * t;
+	while((t = itr->getnextNoCopy())) {
+		s->live_bytes += t->byte_length();
+		s->live_tuples++;
+	}
+	delete itr;
+}
+
+static void print_json(FILE * f, const workload * w, const std::vector<phase_result*> &phases, const space_result * s) {
+	fprintf(f, "{\n");
+	fprintf(f, "  \"workload\": {\n");
+	fprintf(f, "    \"records\": %llu,\n", (unsigned long long)w->records);
+	fprintf(f, "    \"operations\": %llu,\n", (unsigned long long)w->operations);
+	for(int i = 0; i < NUM_OPS; i++) {
+		fprintf(f, "    \"%s_proportion\": %.4f,\n", op_names[i], w->proportion[i]);
+	}
+	fprintf(f, "    \"request_distribution\": \"%s\",\n", distribution_names[w->request_distribution]);
+	fprintf(f, "    \"zipfian_constant\": %.4f,\n", w->zipfian_constant);
+	fprintf(f, "    \"key_size\": %d,\n", w->key_size);
+	fprintf(f, "    \"value_distribution\": \"%s\",\n", distribution_names[w->value_distribution]);
+	fprintf(f, "    \"min_value_size\": %d,\n", w->min_value_size);
+	fprintf(f, "    \"max_value_size\": %d,\n", w->max_value_size);
+	fprintf(f, "    \"max_scan_length\": %d,\n", w->max_scan_length);
+	fprintf(f, "    \"threads\": %d,\n", w->threads);
+	fprintf(f, "    \"c0_size\": %lld,\n", (long long)w->c0_size);
+	fprintf(f, "    \"row_cache_size\": %lld,\n", (long long)w->row_cache_size);
+	fprintf(f, "    \"log_mode\": %d,\n", w->log_mode);
+	fprintf(f, "    \"seed\": %llu\n", (unsigned long long)w->seed);
+	fprintf(f, "  },\n");
+	fprintf(f, "  \"phases\": [\n");
+	for(size_t i = 0; i < phases.size(); i++) {
+		print_phase_json(f, phases[i]);
+		fprintf(f, "%s\n", i + 1 < phases.size() ? "," : "");
+	}
+	fprintf(f, "  ]");
+	if(s) {
+		fprintf(f, ",\n  \"space\": {\n");
+		fprintf(f, "    \"tree_bytes\": %llu,\n", (unsigned long long)s->tree_bytes);
+		fprintf(f, "    \"file_bytes\": %llu,\n", (unsigned long long)s->file_bytes);
+		fprintf(f, "    \"live_bytes\": %llu,\n", (unsigned long long)s->live_bytes);
+		fprintf(f, "    \"live_tuples\": %llu,\n", (unsigned long long)s->live_tuples);
+		fprintf(f, "    \"space_amplification\": %.4f\n", s->amplification());
+		fprintf(f, "  }");
+	}
+	fprintf(f, "\n}\n");
+}
+
+static void set_mix(workload * w, double read, double update, double insert, double scan, double rmw, distribution_t d) {
+	w->proportion[READ] = read;
+	w->proportion[UPDATE] = update;
+	w->proportion[INSERT] = insert;
+	w->proportion[SCAN] = scan;
+	w->proportion[READ_MODIFY_WRITE] = rmw;
+	w->request_distribution = d;
+}
+
+static bool parse_distribution(const char * s, distribution_t * d) {
+	for(int i = 0; i < 4; i++) {
+		if(!strcmp(s, distribution_names[i])) { *d = (distribution_t)i; return true; }
+	}
+	return false;
+}
+
+static void usage(char * argv[]) {
+	fprintf(stderr,
+	        "usage: %s [--workload a|b|c|d|e|f] [--records <n>] [--operations <n>] [--threads <n>]\n"
+	        "       [--read <p>] [--update <p>] [--insert <p>] [--scan <p>] [--rmw <p>]\n"
+	        "       [--distribution uniform|zipfian|latest] [--zipfian-constant <theta>]\n"
+	        "       [--key-size <bytes>] [--value-size <bytes>|<min>-<max>] [--value-distribution constant|uniform|zipfian]\n"
+	        "       [--max-scan-length <n>] [--c0-size <MB>] [--row-cache <MB>] [--log-mode <int>] [--seed <n>]\n"
+	        "       [--no-load] [--no-space] [--json <file>|-]\n"
+	        "Runs against a new or existing table in the current directory.\n", argv[0]);
+	exit(1);
+}
+
+int main(int argc, char * argv[]) {
+	signal(SIGPIPE, SIG_IGN);
+	workload w;
+	w.records = 100000;
+	w.operations = 1000000;
+	set_mix(&w, 0.5, 0.5, 0, 0, 0, ZIPFIAN);  // workload a
+	w.zipfian_constant = 0.99;
+	w.key_size = 24;
+	w.value_distribution = CONSTANT;
+	w.min_value_size = w.max_value_size = 1000;
+	w.max_scan_length = 100;
+	w.threads = 1;
+	w.c0_size = 1024 * 1024 * 512;
+	w.row_cache_size = 0;
+	w.log_mode = 0;
+	w.seed = 1;
+	w.load = true;
+	w.measure_space = true;
+	const char * json_path = NULL;
+
+	for(int i = 1; i < argc; i++) {
+		const char * arg = argv[i];
+		const char * val = i + 1 < argc ? argv[i+1] : NULL;
+		if(!strcmp(arg, "--no-load")) {
+			w.load = false;
+		} else if(!strcmp(arg, "--no-space")) {
+			w.measure_space = false;
+		} else if(!val) {
+			usage(argv);
+		} else if(!strcmp(arg, "--workload")) {
+			switch(val[0]) {
+			case 'a': set_mix(&w, 0.5,  0.5,  0,    0,    0,   ZIPFIAN); break;
+			case 'b': set_mix(&w, 0.95, 0.05, 0,    0,    0,   ZIPFIAN); break;
+			case 'c': set_mix(&w, 1,    0,    0,    0,    0,   ZIPFIAN); break;
+			case 'd': set_mix(&w, 0.95, 0,    0.05, 0,    0,   LATEST);  break;
+			case 'e': set_mix(&w, 0,    0,    0.05, 0.95, 0,   ZIPFIAN); break;
+			case 'f': set_mix(&w, 0.5,  0,    0,    0,    0.5, ZIPFIAN); break;
+			default: usage(argv);
+			}
+			i++;
+		} else if(!strcmp(arg, "--records"))         { w.records = strtoull(val, NULL, 10); i++;
+		} else if(!strcmp(arg, "--operations"))      { w.operations = strtoull(val, NULL, 10); i++;
+		} else if(!strcmp(arg, "--threads"))         { w.threads = atoi(val); i++;
+		} else if(!strcmp(arg, "--read"))            { w.proportion[READ] = atof(val); i++;
+		} else if(!strcmp(arg, "--update"))          { w.proportion[UPDATE] = atof(val); i++;
+		} else if(!strcmp(arg, "--insert"))          { w.proportion[INSERT] = atof(val); i++;
+		} else if(!strcmp(arg, "--scan"))            { w.proportion[SCAN] = atof(val); i++;
+		} else if(!strcmp(arg, "--rmw"))             { w.proportion[READ_MODIFY_WRITE] = atof(val); i++;
+		} else if(!strcmp(arg, "--zipfian-constant")) { w.zipfian_constant = atof(val); i++;
+		} else if(!strcmp(arg, "--key-size"))        { w.key_size = atoi(val); i++;
+		} else if(!strcmp(arg, "--max-scan-length")) { w.max_scan_length = atoi(val); i++;
+		} else if(!strcmp(arg, "--c0-size"))         { w.c0_size = atoll(val) * 1024 * 1024; i++;
+		} else if(!strcmp(arg, "--row-cache"))       { w.row_cache_size = atoll(val) * 1024 * 1024; i++;
+		} else if(!strcmp(arg, "--log-mode"))        { w.log_mode = atoi(val); i++;
+		} else if(!strcmp(arg, "--seed"))            { w.seed = strtoull(val, NULL, 10); i++;
+		} else if(!strcmp(arg, "--json"))            { json_path = val; i++;
+		} else if(!strcmp(arg, "--distribution")) {
+			if(!parse_distribution(val, &w.request_distribution) || w.request_distribution == CONSTANT) { usage(argv); }
+			i++;
+		} else if(!strcmp(arg, "--value-distribution")) {
+			if(!parse_distribution(val, &w.value_distribution) || w.value_distribution == LATEST) { usage(argv); }
+			i++;
+		} else if(!strcmp(arg, "--value-size")) {
+			if(sscanf(val, "%d-%d", &w.min_value_size, &w.max_value_size) != 2) {
+				w.min_value_size = w.max_value_size = atoi(val);
+			}
+			i++;
+		} else {
+			usage(argv);
+		}
+	}
+	double total = 0;
+	for(int i = 0; i < NUM_OPS; i++) { total += w.proportion[i]; }
+	if(total <= 0 || w.threads < 1 || w.key_size < 1 || w.min_value_size < 0 || w.max_value_size < w.min_value_size
+	   || w.max_scan_length < 1 || w.zipfian_constant <= 0 || w.zipfian_constant >= 1 || (!w.records && !w.proportion[INSERT])) {
+		usage(argv);
+	}
+	for(int i = 0; i < NUM_OPS; i++) { w.proportion[i] /= total; }
+	if(w.min_value_size == w.max_value_size) { w.value_distribution = CONSTANT; }
+
+	bench b;
+	b.w = w;
+	b.key_zipf = new zipfian(w.records ? w.records : 1, w.zipfian_constant);
+	b.value_zipf = new zipfian(w.max_value_size - w.min_value_size + 1, w.zipfian_constant);
+	b.random_bytes_len = 1024 * 1024 + w.max_value_size;
+	b.random_bytes = (byte*)malloc(b.random_bytes_len);
+	uint64_t seed = w.seed | 1;
+	for(size_t i = 0; i < b.random_bytes_len; i++) {
+		seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+		b.random_bytes[i] = (byte)seed;
+	}
+	b.next_insert = w.records;
+
+	stasis_buffer_manager_size = 1 * 1024 * 1024 * 1024 / PAGE_SIZE;
+	bLSM::init_stasis();
+	int xid = Tbegin();
+	b.ltable = new bLSM(w.log_mode, w.c0_size, 16384, 256000, 1, w.row_cache_size);
+	if(TrecordType(xid, ROOT_RECORD) == INVALID_SLOT) {
+		printf("Creating empty logstore\n");
+		b.ltable->allocTable(xid);
+	} else {
+		printf("Opened existing logstore\n");
+		recordid table_root = ROOT_RECORD;
+		table_root.size = TrecordSize(xid, ROOT_RECORD);
+		b.ltable->openTable(xid, table_root);
+	}
+	Tcommit(xid);
+	mergeScheduler * mscheduler = new mergeScheduler(b.ltable);
+	mscheduler->start();
+	b.ltable->replayLog();
+
+	std::vector<phase_result*> phases;
+	if(w.load && w.records) {
+		phase_result * r = new phase_result;
+		run_phase(&b, "load", true, w.records, r);
+		print_phase(r);
+		phases.push_back(r);
+	}
+	if(w.operations) {
+		phase_result * r = new phase_result;
+		run_phase(&b, "run", false, w.operations, r);
+		print_phase(r);
+		phases.push_back(r);
+	}
+	space_result space;
+	if(w.measure_space) {
+		measure_space(&b, &space);
+		printf("\ndisk components %llu bytes, page file %llu bytes, live data %llu bytes in %llu tuples, space amplification %.2f\n",
+		       (unsigned long long)space.tree_bytes, (unsigned long long)space.file_bytes,
+		       (unsigned long long)space.live_bytes, (unsigned long long)space.live_tuples, space.amplification());
+	}
+
+	if(json_path) {
+		FILE * f = strcmp(json_path, "-") ? fopen(json_path, "w") : stdout;
+		if(!f) {
+			perror("Couldn't open JSON output file");
+		} else {
+			print_json(f, &w, phases, w.measure_space ? &space : NULL);
+			if(f != stdout) { fclose(f); }
+		}
+	}
+
+	for(size_t i = 0; i < phases.size(); i++) { delete phases[i]; }
+	mscheduler->shutdown();
+	delete mscheduler;
+	delete b.ltable;
+	bLSM::deinit_stasis();
+	delete b.key_zipf;
+	delete b.value_zipf;
+	free(b.random_bytes);
+	return 0;
+}
@@ -19,7 +19,6 @@
 #ifndef _LOGSERVER_H_
 #define _LOGSERVER_H_
 
-#include <queue>
 #include <vector>
 
 #include "datatuple.h"
@@ -40,18 +39,7 @@
 struct pthread_item;
 
 struct pthread_data {
-    std::queue<pthread_item> *idleth_queue;
-    std::queue<int> *ready_queue;
-    std::queue<int> *work_queue;
-    pthread_mutex_t * qlock;
-
-    pthread_cond_t *selcond;
-    int* self_pipe;
-    
-    pthread_cond_t * th_cond;
-    pthread_mutex_t * th_mut;
-    
-    int *workitem; //id of the socket to work
+    int epoll_fd; // every worker waits on the same epoll set
 
     bLSM *ltable;
     bool *sys_alive;
@@ -75,17 +63,23 @@ struct serverth_data
 {
     int *server_socket;
     int server_port;
-    std::queue<pthread_item> *idleth_queue;
-    std::queue<int> *ready_queue;
-
-    pthread_cond_t *selcond;
-    int * self_pipe;
-
-    pthread_mutex_t *qlock;
+    int epoll_fd;
+    bool *sys_alive;
 };
 
 void * thread_work_fn( void *);
 
+/**
+ * A thread pool that serves requestDispatch over TCP.
+ *
+ * Idle connections are registered with a single epoll set, in one-shot
+ * mode.  Every worker thread waits on the set; the kernel hands each
+ * readable connection to exactly one of them, which processes one request
+ * and then re-arms the connection.  Unlike the old select() loop, there is
+ * no dispatcher thread, no FD_SETSIZE limit, and the cost of a wakeup does
+ * not depend on the number of connections.  (The process still needs a
+ * large enough RLIMIT_NOFILE.)
+ */
 class logserver
 {
 public:
@@ -93,34 +87,27 @@ public:
         this->nthreads = nthreads;
         this->server_port = server_port;
 
-        qlock = new pthread_mutex_t;
-        pthread_mutex_init(qlock,0);
-
         ltable = 0;
-
-        #ifdef STATS_ENABLED        
-        num_selevents = 0;
-        num_selcalls = 0;
-        #endif
-
-
+        epoll_fd = -1;
     }
 
     ~logserver()
         {
-            delete qlock;
         }
     
-    void startserver(bLSM *ltable);
+    /**
+     * Serve until stopserver() is called.
+     *
+     * @return 0 once stopserver() has stopped accepting connections (it
+     * continues to shut down the workers in its own thread), or -1 if the
+     * server socket couldn't be opened.
+     */
+    int startserver(bLSM *ltable);
 
     void stopserver();
     
 private:
 
-    //main loop of server
-    //accept connections, assign jobs to threads
-    void eventLoop();
-
     int server_port;
     
     size_t nthreads;
@@ -128,24 +115,16 @@ private:
     bool sys_alive;
     
     int serversocket; //server socket file descriptor
-
-    std::queue<int> ready_queue; //connections to go inside select
-    std::queue<int> work_queue;  //connections to be processed by worker threads
-    std::queue<pthread_item> idleth_queue;
-    pthread_mutex_t *qlock;
+    int epoll_fd;     //idle connections, waiting for their next request
 
     pthread_t server_thread;
     serverth_data *sdata;
-    pthread_cond_t *selcond; //server loop cond
-    int * self_pipe; // write a byte to self_pipe[1] to wake up select().
     std::vector<pthread_item *> th_list; // list of threads
 
     bLSM *ltable;
 
     #ifdef STATS_ENABLED
     int num_reqs;
-    int num_selevents;
-    int num_selcalls;
     struct timeval start_tv, stop_tv;
     double tot_threadwork_time;
     double tot_time;
@@ -29,6 +29,8 @@
 typedef unsigned char byte;
 #include <cstring>
 #include <assert.h>
+#include <limits.h>
+#include <sys/uio.h>
 
 typedef uint8_t network_op_t;
 
@@ -63,7 +65,12 @@ static const network_op_t OP_DBG_DROP_DATABASE        = 19;
 static const network_op_t OP_DBG_BLOCKMAP             = 20;
 static const network_op_t OP_DBG_NOOP                 = 21;
 static const network_op_t OP_DBG_SET_LOG_MODE         = 22;
-static const network_op_t LOGSTORE_LAST_REQUEST_CODE  = 22;
+
+static const network_op_t OP_PIPELINE                 = 23;  // Switch this connection to tagged requests; see below.
+static const network_op_t OP_FRAMED                   = 24;  // Like OP_PIPELINE, but requests and responses are batched into frames.
+static const network_op_t OP_SCAN_STREAM              = 25;  // Scan in batches, with client-granted credits.  See below.
+static const network_op_t OP_SHM_ATTACH               = 26;  // Move this (Unix socket) connection to shared memory rings; see shmRing.h.
+static const network_op_t LOGSTORE_LAST_REQUEST_CODE  = 26;
 
 //error codes
 static const network_op_t LOGSTORE_FIRST_ERROR  = 27;
@@ -75,6 +82,13 @@ static const network_op_t LOGSTORE_PROTOCOL_ERROR = 31; // The other side respon
 static const network_op_t LOGSTORE_LAST_ERROR   = 31;
 static const network_op_t OP_INVALID = 32;
 
+//more client codes; the first block ran into the error codes.
+static const network_op_t LOGSTORE_FIRST_EXTENDED_REQUEST_CODE = 33;
+static const network_op_t OP_SCAN_FILTERED            = 33;  // OP_SCAN with a filter, projection or aggregate; see scanFilter.h.
+static const network_op_t OP_STAT_MERGE_TELEMETRY     = 34;  // A mergeSnapshot, then the merge events after COUNT; see mergeTelemetry.h.
+static const network_op_t OP_STAT_READ_AMPLIFICATION  = 35;  // A readStats::summary_t of point lookup costs per tree component, then the rowCache::stats_t if the row cache is enabled.
+static const network_op_t LOGSTORE_LAST_EXTENDED_REQUEST_CODE  = 35;
+
 typedef enum {
   LOGSTORE_CLIENT_REQUEST,
   LOGSTORE_SERVER_RESPONSE
@@ -173,7 +187,8 @@ static inline bool opiserror(network_op_t op) {
   return (LOGSTORE_FIRST_ERROR <= op && op <= LOGSTORE_LAST_ERROR);
 }
 static inline bool opisrequest(network_op_t op) {
-  return (LOGSTORE_FIRST_REQUEST_CODE <= op && op <= LOGSTORE_LAST_REQUEST_CODE);
+  return (LOGSTORE_FIRST_REQUEST_CODE <= op && op <= LOGSTORE_LAST_REQUEST_CODE)
+      || (LOGSTORE_FIRST_EXTENDED_REQUEST_CODE <= op && op <= LOGSTORE_LAST_EXTENDED_REQUEST_CODE);
 }
 static inline bool opisresponse(network_op_t op) {
   return (LOGSTORE_FIRST_RESPONSE_CODE <= op && op <= LOGSTORE_LAST_RESPONSE_CODE);
@@ -268,6 +283,73 @@ static inline int writeoptosocket(int sockd, network_op_t op) {
 }
 
 /**
+	Pipelined wire format:
+
+	  After the server acknowledges OP_PIPELINE with LOGSTORE_RESPONSE_SUCCESS,
+	  every request on the connection is prefixed with a client-chosen id:
+
+	    REQUEST_ID (uint64_t)
+	    OPCODE
+	    TUPLE
+	    TUPLE
+	    [COUNT, for OP_SCAN, OP_STAT_HISTOGRAM, OP_SCAN_STREAM, OP_SCAN_FILTERED and OP_STAT_MERGE_TELEMETRY]
+
+	  The server executes outstanding requests concurrently, and answers each
+	  one as soon as it completes, possibly out of order:
+
+	    REQUEST_ID (uint64_t)
+	    LENGTH     (uint64_t)
+	    LENGTH bytes, formatted exactly like an untagged response
+
+	  The client should not issue a request that depends on the outcome of
+	  another one until it has seen that response.  OP_DONE (with any id, and
+	  no tuples) ends the connection after the outstanding requests have been
+	  answered.  OP_BULK_INSERT is not supported on pipelined connections.
+
+	Framed wire format:
+
+	  OP_FRAMED works like OP_PIPELINE, but in both directions, the stream
+	  is a series of frames, each of which holds as many records as the
+	  sender had ready:
+
+	    LENGTH (uint64_t)
+	    LENGTH bytes of records
+
+	  Request records are laid out so that the server can use them in place:
+
+	    REQUEST_ID (uint64_t)
+	    COUNT      (uint64_t, only used by the ops that take one; see opreadscount())
+	    OPCODE     (uint8_t)
+	    FLAGS      (uint8_t; FRAMED_HAS_TUPLE, FRAMED_HAS_TUPLE2)
+	    6 bytes of padding
+	    [TUPLE, in dataTuple::to_frame() format]
+	    [TUPLE]
+
+	  Response records are the same as pipelined responses (REQUEST_ID,
+	  LENGTH, body).  A frame is read with one read() of its length and one
+	  of its body, and the server writes all of the responses that are ready
+	  with a single writev().  Since tuples are sent as their in-memory
+	  image, both ends must share the same architecture.
+
+	Streaming scan wire format:
+
+	  The request is OP_SCAN_STREAM, the first key (or NULL), an exclusive
+	  upper bound (or NULL), and COUNT, the size of the first batch.  The
+	  server responds with LOGSTORE_RESPONSE_SENDING_TUPLES, then batches:
+
+	    N (uint64_t, at most the credit granted)
+	    TUPLE * N
+	    TOKEN, a key-only tuple, or datatuple::DELETE once the scan is complete
+
+	  After each batch with a TOKEN, the client sends a CREDIT (uint64_t):
+	  the size of the next batch, or zero to cancel the scan.  Batches may
+	  also be cut short to bound the server's buffer.  The server does not
+	  keep an iterator open between batches, so a slow client does not
+	  hold up merges.  TOKEN is the first key that the next batch may
+	  return; passing it as the first key of a new OP_SCAN_STREAM resumes
+	  the scan, on any connection.  On pipelined connections, which can't
+	  carry credits, the server sends one batch and ends the request.
+
 	Iterator wire format:
 
 	  LOGSTORE_RESPONSE_SENDING_TUPLES
@@ -374,5 +456,164 @@ static inline int writecounttosocket(FILE* sockf, uint64_t count) {
 static inline int writecounttosocket(int sockd, uint64_t count) {
 	return writetosocket(sockd, &count, sizeof(count));
 }
+/**
+    Write a batch of buffers, with as few system calls as possible.
+
+    @return zero on success, or an errno.  (iov is modified.)
+ */
+static inline int writevtosocket(int sockd, struct iovec * iov, int iovcnt) {
+	while(iovcnt) {
+		ssize_t i = writev(sockd, iov, iovcnt < IOV_MAX ? iovcnt : IOV_MAX);
+		if(i == -1) {
+			if(errno == EINTR) { continue; }
+			perror("writevtosocket failed");
+			return errno;
+		}
+		// skip the buffers that went out, and trim the one that was cut short.
+		while(iovcnt && (size_t)i >= iov->iov_len) {
+			i -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if(iovcnt) {
+			iov->iov_base = ((byte*)iov->iov_base) + i;
+			iov->iov_len -= i;
+		}
+	}
+	return 0;
+}
+
+static const uint64_t FRAMED_MAX_LENGTH = 64 * 1024 * 1024;
+static const size_t FRAMED_REQUEST_HEADER = 24;
+static const uint8_t FRAMED_HAS_TUPLE = 1;
+static const uint8_t FRAMED_HAS_TUPLE2 = 2;
+
+static inline size_t framedrequestlength(const dataTuple * tuple, const dataTuple * tuple2) {
+  return FRAMED_REQUEST_HEADER
+      + (tuple  ? tuple->framed_length()  : 0)
+      + (tuple2 ? tuple2->framed_length() : 0);
+}
+/**
+    Append a request record to a frame.  buf must have framedrequestlength() bytes free.
+ */
+static inline void writeframedrequest(byte * buf, uint64_t id, network_op_t opcode,
+                                      const dataTuple * tuple, const dataTuple * tuple2, uint64_t count) {
+  memcpy(buf, &id, sizeof(id));
+  memcpy(buf + 8, &count, sizeof(count));
+  memset(buf + 16, 0, 8);
+  buf[16] = opcode;
+  buf[17] = (tuple ? FRAMED_HAS_TUPLE : 0) | (tuple2 ? FRAMED_HAS_TUPLE2 : 0);
+  buf += FRAMED_REQUEST_HEADER;
+  if(tuple)  { tuple->to_frame(buf); buf += tuple->framed_length(); }
+  if(tuple2) { tuple2->to_frame(buf); }
+}
+/**
+    Parse a request record in place.  The tuples point into buf.
+
+    @return zero, or LOGSTORE_PROTOCOL_ERROR if the record is truncated.
+ */
+static inline int readframedrequest(byte * buf, size_t avail, uint64_t * id, network_op_t * opcode,
+                                    dataTuple ** tuple, dataTuple ** tuple2, uint64_t * count, size_t * used) {
+  *tuple = *tuple2 = NULL;
+  if(avail < FRAMED_REQUEST_HEADER) { return LOGSTORE_PROTOCOL_ERROR; }
+  memcpy(id, buf, sizeof(*id));
+  memcpy(count, buf + 8, sizeof(*count));
+  *opcode = buf[16];
+  uint8_t flags = buf[17];
+  size_t off = FRAMED_REQUEST_HEADER;
+  size_t n;
+  if(flags & FRAMED_HAS_TUPLE) {
+    if(!(*tuple = dataTuple::from_frame(buf + off, avail - off, &n)))  { return LOGSTORE_PROTOCOL_ERROR; }
+    off += n;
+  }
+  if(flags & FRAMED_HAS_TUPLE2) {
+    if(!(*tuple2 = dataTuple::from_frame(buf + off, avail - off, &n))) { return LOGSTORE_PROTOCOL_ERROR; }
+    off += n;
+  }
+  *used = off;
+  return 0;
+}
+static inline bool opreadscount(network_op_t op) {
+  return op == OP_SCAN || op == OP_STAT_HISTOGRAM || op == OP_SCAN_STREAM || op == OP_SCAN_FILTERED
+      || op == OP_STAT_MERGE_TELEMETRY;
+}
+/** @return true if a successful request of this type ends with the connection being closed. */
+static inline bool opclosesconnection(network_op_t op) {
+  return op == OP_DONE || op == OP_PIPELINE || op == OP_FRAMED || op == OP_SHM_ATTACH;
+}
+/**
+    @return the length of the untagged request (OPCODE, TUPLE, TUPLE and
+    maybe COUNT) at the start of buf, or zero if buf does not hold all of it.
+    Anything that does not start with a request code is one byte long.
+ */
+static inline size_t requestlength(const byte * buf, size_t avail) {
+  if(!avail) { return 0; }
+  size_t off = sizeof(network_op_t);
+  if(!opisrequest(buf[0])) { return off; }
+  for(int i = 0; i < 2; i++) {
+    len_t keylen, datalen;
+    if(avail - off < sizeof(keylen)) { return 0; }
+    memcpy(&keylen, buf + off, sizeof(keylen));
+    off += sizeof(keylen);
+    if(keylen == DELETE) { continue; }
+    if(avail - off < sizeof(datalen)) { return 0; }
+    memcpy(&datalen, buf + off, sizeof(datalen));
+    off += sizeof(datalen);
+    size_t len = (size_t)keylen + (datalen == DELETE ? 0 : (size_t)datalen);
+    if(avail - off < len) { return 0; }
+    off += len;
+  }
+  if(opreadscount(buf[0])) {
+    if(avail - off < sizeof(uint64_t)) { return 0; }
+    off += sizeof(uint64_t);
+  }
+  return off;
+}
+static inline int flushsocket(FILE * sockf) {
+  return MYFFLUSH(sockf);
+}
+static inline int flushsocket(int sockd) {
+  return 0;
+}
+
+/**
+    Parse the body of a pipelined response, which is formatted like an
+    untagged response.
+
+    @param tuples will be set to a malloc()ed array of the returned tuples, or NULL.
+    @param tuple_count will be set to the length of tuples.
+    @return the response code, or LOGSTORE_PROTOCOL_ERROR if the body is truncated.
+ */
+static inline network_op_t readresponsefrombuffer(byte * buf, size_t len, dataTuple *** tuples, size_t * tuple_count) {
+  *tuples = NULL;
+  *tuple_count = 0;
+  if(!len) { return LOGSTORE_PROTOCOL_ERROR; }
+
+  FILE * body = fmemopen(buf, len, "r");
+  network_op_t rcode = readopfromsocket(body, LOGSTORE_SERVER_RESPONSE);
+  if(rcode == LOGSTORE_RESPONSE_SENDING_TUPLES) {
+    size_t size = 0;
+    int err = 0;
+    dataTuple * t;
+    while((t = readtuplefromsocket(body, &err))) {
+      if(*tuple_count == size) {
+        size = size ? 2 * size : 4;
+        *tuples = (dataTuple**) realloc(*tuples, size * sizeof(**tuples));
+      }
+      (*tuples)[(*tuple_count)++] = t;
+    }
+    if(err) {
+      for(size_t i = 0; i < *tuple_count; i++) {
+        dataTuple::freetuple((*tuples)[i]);
+      }
+      free(*tuples);
+      *tuples = NULL;
+      *tuple_count = 0;
+      rcode = LOGSTORE_PROTOCOL_ERROR;
+    }
+  }
+  fclose(body);
+  return rcode;
+}
 
 #endif /* NETWORK_H_ */
@@ -32,9 +32,15 @@ int main(int argc, char *argv[])
 {
     signal(SIGPIPE, SIG_IGN);
     int64_t c0_size = 1024 * 1024 * 512 * 1;
+    int64_t row_cache_size = 0;
     int log_mode = 0; // do not log by default.
     int64_t expiry_delta = 0;  // do not gc by default
+    bool range_filters = false;
     int port = simpleServer::DEFAULT_PORT;
+    int workers = 0; // one per core
+    const char * unix_path = NULL;
+    const char * metrics_path = NULL;
+    const char * trace_path = NULL;
     stasis_buffer_manager_size = 1 * 1024 * 1024 * 1024 / PAGE_SIZE;  // 1.5GB total
 
     for(int i = 1; i < argc; i++) {
@@ -52,11 +58,28 @@ int main(int argc, char *argv[])
         } else if(!strcmp(argv[i], "--expiry-delta")) {
             i++;
             expiry_delta = atoi(argv[i]);
+        } else if(!strcmp(argv[i], "--range-filters")) {
+            range_filters = true;
         } else if(!strcmp(argv[i], "--port")) {
             i++;
             port = atoi(argv[i]);
+        } else if(!strcmp(argv[i], "--workers")) {
+            i++;
+            workers = atoi(argv[i]);
+        } else if(!strcmp(argv[i], "--unix-socket")) {
+            i++;
+            unix_path = argv[i];
+        } else if(!strcmp(argv[i], "--metrics-file")) {
+            i++;
+            metrics_path = argv[i];
+        } else if(!strcmp(argv[i], "--trace")) {
+            i++;
+            trace_path = argv[i];
+        } else if(!strcmp(argv[i], "--row-cache")) {
+            i++;
+            row_cache_size = atoll(argv[i]) * 1024 * 1024;
     	} else {
-    		fprintf(stderr, "Usage: %s [--test|--benchmark] [--log-mode <int>] [--expiry-delta <int>] [--port <int>]", argv[0]);
+    		fprintf(stderr, "Usage: %s [--test|--benchmark] [--log-mode <int>] [--expiry-delta <int>] [--range-filters] [--port <int>] [--workers <int>] [--unix-socket <path>] [--metrics-file <path>] [--trace <path>] [--row-cache <MB>]", argv[0]);
     		abort();
     	}
     }
@@ -68,8 +91,9 @@ int main(int argc, char *argv[])
 
       recordid table_root = ROOT_RECORD;
     {
-		bLSM ltable(log_mode, c0_size);
+		bLSM ltable(log_mode, c0_size, 16384, 256000, 1, row_cache_size);
 		ltable.expiry = expiry_delta;
+		ltable.range_filters = range_filters;
 
 		if(TrecordType(xid, ROOT_RECORD) == INVALID_SLOT) {
 			printf("Creating empty logstore\n");
@@ -83,17 +107,36 @@ int main(int argc, char *argv[])
 		}
 
 		Tcommit(xid);
+		if(metrics_path) {
+			ltable.merge_mgr->set_metrics_file(metrics_path);
+		}
+		opTrace * trace = NULL;
+		if(trace_path) {
+			trace = opTrace::open(trace_path);
+			if(!trace) {
+				perror("Couldn't open trace file");
+				abort();
+			}
+			ltable.set_op_trace(trace);
+		}
 		mergeScheduler * mscheduler = new mergeScheduler(&ltable);
 		mscheduler->start();
 		ltable.replayLog();
 
-		simpleServer *lserver = new simpleServer(&ltable, simpleServer::DEFAULT_THREADS, port);
+		simpleServer *lserver = new simpleServer(&ltable, simpleServer::DEFAULT_THREADS, port, workers, unix_path);
 
 		lserver->acceptLoop();
 
 		printf ("Stopping server...\n");
 		delete lserver;
 
+		if(trace) {
+			ltable.set_op_trace(NULL);
+			uint64_t dropped = trace->get_dropped();
+			delete trace;
+			if(dropped) { printf("Op trace dropped %llu records\n", (unsigned long long)dropped); }
+		}
+
 		printf("Stopping merge threads...\n");
 		mscheduler->shutdown();
 		delete mscheduler;
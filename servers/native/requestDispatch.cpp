@@ -20,50 +20,107 @@
  */
 #include "requestDispatch.h"
 #include "regionAllocator.h"
+#include "bulkLoader.h"
+#include "partitionedScan.h"
+#include "shmRing.h"
+#include "scanFilter.h"
+#include "tracePoints.h"
+
+#include <deque>
+#include <vector>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 
 template<class HANDLE>
 inline int requestDispatch<HANDLE>::op_insert(bLSM * ltable, HANDLE fd, dataTuple * tuple) {
+    uint64_t start = latencyStats::now();
     //insert/update/delete
     ltable->insertTuple(tuple);
+    if(ltable->get_op_trace()) { ltable->get_op_trace()->record_op(opTrace::INSERT, start, true, tuple); }
     //step 4: send response
     return writeoptosocket(fd, LOGSTORE_RESPONSE_SUCCESS);
 }
 template<class HANDLE>
 inline int requestDispatch<HANDLE>::op_test_and_set(bLSM * ltable, HANDLE fd, dataTuple * tuple, dataTuple * tuple2) {
+    uint64_t start = latencyStats::now();
     //insert/update/delete
     bool succ = ltable->testAndSetTuple(tuple, tuple2);
+    if(ltable->get_op_trace()) { ltable->get_op_trace()->record_op(opTrace::TEST_AND_SET, start, succ, tuple, tuple2); }
     //step 4: send response
     return writeoptosocket(fd, succ ? LOGSTORE_RESPONSE_SUCCESS : LOGSTORE_RESPONSE_FAIL);
 }
+/** Add a batch of bulk inserted tuples to the op trace, as individual inserts; see opTrace.h. */
+static void trace_batch(bLSM * ltable, uint64_t start, dataTuple ** tups, int count) {
+  opTrace * trace = ltable->get_op_trace();
+  for(int i = 0; trace && i < count; i++) {
+    trace->record_op(opTrace::INSERT, start, true, tups[i], NULL, count);
+  }
+}
+/** Apply a batch of bulk inserted tuples, then free them. */
+static void bulk_insert_batch(bLSM * ltable, bulkLoader * loader, dataTuple ** tups, int count) {
+  uint64_t start = latencyStats::now();
+  if(loader) {
+    loader->insertManyTuples(tups, count);
+  } else {
+    ltable->insertManyTuples(tups, count);
+  }
+  trace_batch(ltable, start, tups, count);
+  for(int i = 0; i < count; i++) {
+    dataTuple::freetuple(tups[i]);
+  }
+}
 template<class HANDLE>
 inline int requestDispatch<HANDLE>::op_bulk_insert(bLSM *ltable, HANDLE fd) {
   int err = writeoptosocket(fd, LOGSTORE_RESPONSE_RECEIVING_TUPLES);
+  // Initial loads (e.g., from copy_database) bypass c0 and build c2 directly.
+  // Otherwise, the tuples need to overwrite what's there, so go through c0.
+  // Short streams, such as asyncClient's batches of puts, always go through
+  // c0 (and the log), so we hold on to the start of the stream until we
+  // know that it is long enough to be a load.
+  bulkLoader * loader = NULL;
+  bool decided = false;
   dataTuple ** tups = (dataTuple **) malloc(sizeof(tups[0]) * 100);
   int tups_size = 100;
   int cur_tup_count = 0;
   while((tups[cur_tup_count] = readtuplefromsocket(fd, &err))) {
     cur_tup_count++;
     if(cur_tup_count == tups_size) {
-      ltable->insertManyTuples(tups, cur_tup_count);
-      for(int i = 0; i < cur_tup_count; i++) {
-        dataTuple::freetuple(tups[i]);
+      if(!decided && (size_t)tups_size < BULK_LOAD_MIN_TUPLES) {
+        tups_size *= 2;
+        tups = (dataTuple **) realloc(tups, sizeof(tups[0]) * tups_size);
+        continue;
+      }
+      if(!decided) {
+        decided = true;
+        if(bulkLoader::table_is_empty(ltable)) { loader = new bulkLoader(ltable); }
       }
+      bulk_insert_batch(ltable, loader, tups, cur_tup_count);
       cur_tup_count = 0;
     }
   }
-  ltable->insertManyTuples(tups, cur_tup_count);
-  for(int i = 0; i < cur_tup_count; i++) {
-    dataTuple::freetuple(tups[i]);
-  }
+  bulk_insert_batch(ltable, loader, tups, cur_tup_count);
   free(tups);
-  if(!err) err = writeoptosocket(fd, LOGSTORE_RESPONSE_SUCCESS);
+  bool failed = false;
+  if(loader) {
+    if(!err) { failed = loader->finish() != 0; } // otherwise, the client went away, and deleting the loader abandons the load.
+    delete loader;
+  }
+  if(!err) err = writeoptosocket(fd, failed ? LOGSTORE_RESPONSE_FAIL : LOGSTORE_RESPONSE_SUCCESS);
   return err;
 }
 template<class HANDLE>
 inline int requestDispatch<HANDLE>::op_find(bLSM * ltable, HANDLE fd, dataTuple * tuple) {
+    uint64_t start = latencyStats::now();
     //find the tuple
     dataTuple *dt = ltable->findTuple_first(-1, tuple->strippedkey(), tuple->strippedkeylen());
-
+    if(ltable->get_op_trace()) { ltable->get_op_trace()->record_op(opTrace::FIND, start, dt != 0, tuple); }
+    return op_find_respond(fd, tuple, dt);
+}
+template<class HANDLE>
+inline int requestDispatch<HANDLE>::op_find_respond(HANDLE fd, dataTuple * tuple, dataTuple * dt) {
     #ifdef STATS_ENABLED
 
     if(dt == 0) {
@@ -110,17 +167,12 @@ inline int requestDispatch<HANDLE>::op_scan(bLSM * ltable, HANDLE fd, dataTuple
     int err = writeoptosocket(fd, LOGSTORE_RESPONSE_SENDING_TUPLES);
 
     if(!err) {
-        bLSM::iterator * itr = new bLSM::iterator(ltable, tuple);
-        dataTuple * t;
-        while(!err && (t = itr->getnext())) {
-            if(tuple2) {  // are we at the end of range?
-                if(dataTuple::compare_obj(t, tuple2) >= 0) {
-                    dataTuple::freetuple(t);
-                    break;
-                }
-            }
+        // Bounded iterators stop at the end of the range, and skip components that can't overlap it.
+        bLSM::iterator * itr = tuple2 ? new bLSM::iterator(ltable, tuple, tuple2)
+                                      : new bLSM::iterator(ltable, tuple);
+        const dataTuple * t;
+        while(!err && (t = itr->getnextNoCopy())) {
             err = writetupletosocket(fd, t);
-            dataTuple::freetuple(t);
             count ++;
             if(count == limit) { break; }  // did we hit limit?
         }
@@ -129,6 +181,155 @@ inline int requestDispatch<HANDLE>::op_scan(bLSM * ltable, HANDLE fd, dataTuple
     if(!err) { writeendofiteratortosocket(fd); }
     return err;
 }
+/**
+ * Like op_scan, but only return the tuples that match a scan_filter, or an
+ * aggregate over them (see scanFilter.h), so that the client doesn't have
+ * to pull the whole range across the network.
+ */
+template<class HANDLE>
+inline int requestDispatch<HANDLE>::op_scan_filtered(bLSM * ltable, HANDLE fd, dataTuple * tuple, dataTuple * tuple2, size_t limit) {
+    scan_filter f;
+    if(!tuple || tuple->isDelete() || !scan_filter_parse(tuple->data(), tuple->datalen(), &f)) {
+        return writeoptosocket(fd, LOGSTORE_PROTOCOL_ERROR);
+    }
+    // Nothing outside the prefix can match, so don't scan it.
+    dataTuple * start = dataTuple::compare(tuple->strippedkey(), tuple->strippedkeylen(), f.prefix, f.h.prefix_len) < 0
+        ? dataTuple::create(f.prefix, f.h.prefix_len)
+        : dataTuple::create(tuple->rawkey(), tuple->rawkeylen());
+    dataTuple * end = NULL;
+    size_t succ_len = f.h.prefix_len;
+    while(succ_len && f.prefix[succ_len-1] == 0xff) { succ_len--; }
+    if(succ_len) {
+        end = dataTuple::create(f.prefix, succ_len);
+        end->strippedkey()[succ_len-1]++;
+    }
+    if(tuple2 && (!end || dataTuple::compare(tuple2->strippedkey(), tuple2->strippedkeylen(),
+                                             end->strippedkey(), end->strippedkeylen()) < 0)) {
+        if(end) { dataTuple::freetuple(end); }
+        end = dataTuple::create(tuple2->rawkey(), tuple2->rawkeylen());
+    }
+
+    size_t count = 0;
+    scan_aggregate agg;
+    scan_aggregate_init(&agg);
+    int err = writeoptosocket(fd, LOGSTORE_RESPONSE_SENDING_TUPLES);
+
+    if(!err) {
+        bLSM::iterator * itr = end ? new bLSM::iterator(ltable, start, end)
+                                   : new bLSM::iterator(ltable, start);
+        const dataTuple * t;
+        while(!err && (t = itr->getnextNoCopy())) {
+            if(!scan_filter_matches(&f, t)) { continue; }
+            if(f.h.aggregate == SCAN_AGGREGATE) {
+                scan_aggregate_add(&f, &agg, t);
+            } else {
+                dataTuple * projected = scan_filter_project(&f, t);
+                err = writetupletosocket(fd, projected ? projected : t);
+                if(projected) { dataTuple::freetuple(projected); }
+            }
+            count ++;
+            if(count == limit) { break; }  // did we hit limit?
+        }
+        delete itr;
+    }
+    if(!err && f.h.aggregate == SCAN_AGGREGATE) {
+        dataTuple * result = dataTuple::create("", 0, &agg, sizeof(agg));
+        err = writetupletosocket(fd, result);
+        dataTuple::freetuple(result);
+    }
+    if(!err) { writeendofiteratortosocket(fd); }
+    dataTuple::freetuple(start);
+    if(end) { dataTuple::freetuple(end); }
+    return err;
+}
+/** A growable buffer, reused for every batch of a streaming scan. */
+struct scan_buffer {
+  byte * buf;
+  size_t len;
+  size_t size;
+};
+static void scan_buffer_append(scan_buffer * b, const void * p, size_t n) {
+  if(b->len + n > b->size) {
+    b->size = 2 * (b->len + n);
+    b->buf = (byte*) realloc(b->buf, b->size);
+  }
+  memcpy(b->buf + b->len, p, n);
+  b->len += n;
+}
+/** Append a tuple in the same format as writetupletosocket(). */
+static void scan_buffer_append_tuple(scan_buffer * b, const dataTuple * t) {
+  len_t keylen, datalen;
+  const byte * bytes = t->get_bytes(&keylen, &datalen);
+  scan_buffer_append(b, &keylen, sizeof(keylen));
+  scan_buffer_append(b, &datalen, sizeof(datalen));
+  scan_buffer_append(b, bytes, dataTuple::length_from_header(keylen, datalen));
+}
+/** @return the smallest key that sorts after t's key, which is t's key with a zero byte appended. */
+static dataTuple * key_successor(const dataTuple * t) {
+  len_t len = t->strippedkeylen();
+  byte * k = (byte*) malloc(len + 1);
+  memcpy(k, t->strippedkey(), len);
+  k[len] = 0;
+  dataTuple * ret = dataTuple::create(k, len + 1);
+  free(k);
+  return ret;
+}
+
+template<class HANDLE>
+int requestDispatch<HANDLE>::scan_stream(bLSM * ltable, HANDLE fd, dataTuple * start, dataTuple * end, uint64_t credit, bool wait_for_credit) {
+    int err = writeoptosocket(fd, LOGSTORE_RESPONSE_SENDING_TUPLES);
+
+    scan_buffer b;
+    b.buf = NULL;
+    b.len = b.size = 0;
+    dataTuple * resume = start ? start->create_copy() : NULL;
+
+    while(!err) {
+        b.len = 0;
+        uint64_t n = 0;
+        scan_buffer_append(&b, &n, sizeof(n));  // filled in below.
+
+        // The iterator pins the tree components (and holds up merges), so
+        // only keep it open while we fill the batch.
+        bLSM::iterator * itr = end ? new bLSM::iterator(ltable, resume, end)
+                                   : new bLSM::iterator(ltable, resume);
+        bool complete = false;
+        const dataTuple * last = NULL;
+        while(n < credit && b.len < SCAN_BATCH_BYTES) {
+            const dataTuple * t = itr->getnextNoCopy();
+            if(!t) { complete = true; break; }
+            scan_buffer_append_tuple(&b, t);
+            last = t;
+            n++;
+        }
+        if(last) {
+            if(resume) dataTuple::freetuple(resume);
+            resume = key_successor(last);
+        }
+        delete itr;
+
+        memcpy(b.buf, &n, sizeof(n));
+        if(complete) {
+            scan_buffer_append(&b, &DELETE, sizeof(DELETE));
+        } else if(resume) {
+            scan_buffer_append_tuple(&b, resume);
+        } else {
+            // No credit for the first batch; resume from the beginning.
+            dataTuple * first = dataTuple::create("", 0);
+            scan_buffer_append_tuple(&b, first);
+            dataTuple::freetuple(first);
+        }
+        err = writetosocket(fd, b.buf, b.len);
+
+        if(err || complete || !wait_for_credit) { break; }
+        if(!err) { err = flushsocket(fd); }
+        if(!err) { credit = readcountfromsocket(fd, &err); }
+        if(!err && !credit) { break; }  // the client cancelled the scan.
+    }
+    free(b.buf);
+    if(resume) dataTuple::freetuple(resume);
+    return err;
+}
 template<class HANDLE>
 inline int requestDispatch<HANDLE>::op_flush(bLSM * ltable, HANDLE fd) {
     ltable->flushTable();
@@ -141,106 +342,102 @@ inline int requestDispatch<HANDLE>::op_shutdown(bLSM * ltable, HANDLE fd) {
 }
 template<class HANDLE>
 inline int requestDispatch<HANDLE>::op_stat_space_usage(bLSM * ltable, HANDLE fd) {
+    uint64_t treesize, filesize;
+    ltable->get_space_usage(&treesize, &filesize);
+    dataTuple *tup = dataTuple::create(&treesize, sizeof(treesize), &filesize, sizeof(filesize));
 
+    DEBUG("tree size: %lld, filesize %lld\n", treesize, filesize);
 
-    int xid = Tbegin();
+    int err = 0;
+    if(!err){ err = writeoptosocket(fd, LOGSTORE_RESPONSE_SENDING_TUPLES); }
+    if(!err){ err = writetupletosocket(fd, tup);                           }
+    if(!err){ err = writeendofiteratortosocket(fd);                        }
 
-    rwlc_readlock(ltable->header_mut);
 
-    /*  pageid_t datapage_c1_region_length, datapage_c1_mergeable_region_length = 0, datapage_c2_region_length;
-    pageid_t datapage_c1_region_count,  datapage_c1_mergeable_region_count = 0, datapage_c2_region_count;
-    pageid_t tree_c1_region_length, tree_c1_mergeable_region_length = 0, tree_c2_region_length;
-    pageid_t tree_c1_region_count,  tree_c1_mergeable_region_count = 0, tree_c2_region_count;
+    dataTuple::freetuple(tup);
 
-    pageid_t * datapage_c1_regions = ltable->get_tree_c1()->get_datapage_alloc()->list_regions(xid, &datapage_c1_region_length, &datapage_c1_region_count);
+    return err;
+}
+/**
+ * Return one tuple per operation type; its key is the operation's name, and
+ * its value is a latencyStats::summary_t.
+ */
+template<class HANDLE>
+inline int requestDispatch<HANDLE>::op_stat_perf_report(bLSM * ltable, HANDLE fd) {
+    latencyStats::summary_t summaries[latencyStats::NUM_OPS];
+    ltable->get_latency_stats()->summarize(summaries);
 
-    pageid_t * datapage_c1_mergeable_regions = NULL;
-    if(ltable->get_tree_c1_mergeable()) {
-      datapage_c1_mergeable_regions = ltable->get_tree_c1_mergeable()->get_datapage_alloc()->list_regions(xid, &datapage_c1_mergeable_region_length, &datapage_c1_mergeable_region_count);
+    int err = writeoptosocket(fd, LOGSTORE_RESPONSE_SENDING_TUPLES);
+    for(int i = 0; !err && i < latencyStats::NUM_OPS; i++) {
+        const char * name = latencyStats::op_name((latencyStats::op_t)i);
+        dataTuple * tup = dataTuple::create(name, strlen(name)+1, &summaries[i], sizeof(summaries[i]));
+        err = writetupletosocket(fd, tup);
+        dataTuple::freetuple(tup);
     }
-    pageid_t * datapage_c2_regions = ltable->get_tree_c2()->get_datapage_alloc()->list_regions(xid, &datapage_c2_region_length, &datapage_c2_region_count);
-
-    pageid_t * tree_c1_regions = ltable->get_tree_c1()->get_internal_node_alloc()->list_regions(xid, &tree_c1_region_length, &tree_c1_region_count);
+    if(!err) { err = writeendofiteratortosocket(fd); }
+    return err;
+}
+/**
+ * Return a tuple whose key is "snapshot" and whose value is a mergeSnapshot,
+ * then one tuple per retained merge event newer than after_seq; their keys
+ * are "event", and their values are mergeEvents.
+ */
+template<class HANDLE>
+inline int requestDispatch<HANDLE>::op_stat_merge_telemetry(bLSM * ltable, HANDLE fd, uint64_t after_seq) {
+    if(after_seq == (uint64_t)-1) { after_seq = 0; }  // the client didn't say.
+    mergeSnapshot snap;
+    ltable->merge_mgr->get_snapshot(&snap);
 
-    pageid_t * tree_c1_mergeable_regions = NULL;
-    if(ltable->get_tree_c1_mergeable()) {
-      tree_c1_mergeable_regions = ltable->get_tree_c1_mergeable()->get_internal_node_alloc()->list_regions(xid, &tree_c1_mergeable_region_length, &tree_c1_mergeable_region_count);
+    int err = writeoptosocket(fd, LOGSTORE_RESPONSE_SENDING_TUPLES);
+    if(!err) {
+        dataTuple * tup = dataTuple::create("snapshot", strlen("snapshot")+1, &snap, sizeof(snap));
+        err = writetupletosocket(fd, tup);
+        dataTuple::freetuple(tup);
     }
-
-    pageid_t * tree_c2_regions = ltable->get_tree_c2()->get_internal_node_alloc()->list_regions(xid, &tree_c2_region_length, &tree_c2_region_count);
-    */
-
-    pageid_t internal_c1_region_length, internal_c1_mergeable_region_length = 0, internal_c2_region_length;
-    pageid_t internal_c1_region_count,  internal_c1_mergeable_region_count = 0, internal_c2_region_count;
-    pageid_t *internal_c1_regions, *internal_c1_mergeable_regions = NULL, *internal_c2_regions;
-
-    pageid_t datapage_c1_region_length, datapage_c1_mergeable_region_length = 0, datapage_c2_region_length;
-    pageid_t datapage_c1_region_count,  datapage_c1_mergeable_region_count = 0, datapage_c2_region_count;
-    pageid_t *datapage_c1_regions, *datapage_c1_mergeable_regions = NULL, *datapage_c2_regions;
-
-    ltable->get_tree_c1()->list_regions(xid,
-                          &internal_c1_region_length, &internal_c1_region_count, &internal_c1_regions,
-                          &datapage_c1_region_length, &datapage_c1_region_count, &datapage_c1_regions);
-    if(ltable->get_tree_c1_mergeable()) {
-      ltable->get_tree_c1_mergeable()->list_regions(xid,
-                            &internal_c1_mergeable_region_length, &internal_c1_mergeable_region_count, &internal_c1_mergeable_regions,
-                            &datapage_c1_mergeable_region_length, &datapage_c1_mergeable_region_count, &datapage_c1_mergeable_regions);
-
+    static const size_t BATCH = 256;
+    mergeEvent events[BATCH];
+    size_t n;
+    // Stop at the snapshot's newest event, so that a busy server can't keep us here.
+    while(!err && after_seq < snap.last_event_seq
+          && (n = ltable->merge_mgr->get_event_log()->read(after_seq, events, BATCH))) {
+        for(size_t i = 0; !err && i < n && events[i].seq <= snap.last_event_seq; i++) {
+            dataTuple * tup = dataTuple::create("event", strlen("event")+1, &events[i], sizeof(events[i]));
+            err = writetupletosocket(fd, tup);
+            dataTuple::freetuple(tup);
+        }
+        after_seq = events[n-1].seq;
     }
-    ltable->get_tree_c2()->list_regions(xid,
-                          &internal_c2_region_length, &internal_c2_region_count, &internal_c2_regions,
-                          &datapage_c2_region_length, &datapage_c2_region_count, &datapage_c2_regions);
-
-
-    free(datapage_c1_regions);
-    free(datapage_c1_mergeable_regions);
-    free(datapage_c2_regions);
-
-    free(internal_c1_regions);
-    free(internal_c1_mergeable_regions);
-    free(internal_c2_regions);
-
-
-    uint64_t treesize = PAGE_SIZE *
-                ( ( datapage_c1_region_count           * datapage_c1_region_length )
-                + ( datapage_c1_mergeable_region_count * datapage_c1_mergeable_region_length )
-                + ( datapage_c2_region_count           * datapage_c2_region_length)
-                + ( internal_c1_region_count           * internal_c1_region_length )
-                + ( internal_c1_mergeable_region_count * internal_c1_mergeable_region_length )
-                + ( internal_c2_region_count           * internal_c2_region_length) );
-
-    boundary_tag tag;
-    pageid_t pid = ROOT_RECORD.page;
-    TregionReadBoundaryTag(xid, pid, &tag);
-    uint64_t max_off = 0;
-    do {
-        max_off = pid + tag.size;
-        ;
-    } while(TregionNextBoundaryTag(xid, &pid, &tag, 0/*all allocation managers*/));
-
-    rwlc_unlock(ltable->header_mut);
-
-    Tcommit(xid);
-
-    uint64_t filesize = max_off * PAGE_SIZE;
-    dataTuple *tup = dataTuple::create(&treesize, sizeof(treesize), &filesize, sizeof(filesize));
+    if(!err) { err = writeendofiteratortosocket(fd); }
+    return err;
+}
 
-    DEBUG("tree size: %lld, filesize %lld\n", treesize, filesize);
+/**
+ * Return a tuple whose key is "read_stats", and whose value is a
+ * readStats::summary_t.  If the row cache is enabled, it is followed by a
+ * tuple whose key is "row_cache", and whose value is a rowCache::stats_t.
+ */
+template<class HANDLE>
+inline int requestDispatch<HANDLE>::op_stat_read_amplification(bLSM * ltable, HANDLE fd) {
+    readStats::summary_t s;
+    ltable->get_read_stats()->summarize(&s);
+    dataTuple * tup = dataTuple::create("read_stats", strlen("read_stats")+1, &s, sizeof(s));
+    dataTuple * cache_tup = NULL;
+    if(ltable->get_row_cache()) {
+        rowCache::stats_t cs;
+        ltable->get_row_cache()->get_stats(&cs);
+        cache_tup = dataTuple::create("row_cache", strlen("row_cache")+1, &cs, sizeof(cs));
+    }
 
     int err = 0;
     if(!err){ err = writeoptosocket(fd, LOGSTORE_RESPONSE_SENDING_TUPLES); }
     if(!err){ err = writetupletosocket(fd, tup);                           }
+    if(!err && cache_tup){ err = writetupletosocket(fd, cache_tup);        }
     if(!err){ err = writeendofiteratortosocket(fd);                        }
 
-
     dataTuple::freetuple(tup);
-
+    if(cache_tup) dataTuple::freetuple(cache_tup);
     return err;
 }
-template<class HANDLE>
-inline int requestDispatch<HANDLE>::op_stat_perf_report(bLSM * ltable, HANDLE fd) {
-
-}
 
 
 template<class HANDLE>
@@ -250,25 +447,25 @@ inline int requestDispatch<HANDLE>::op_stat_histogram(bLSM * ltable, HANDLE fd,
         return writeoptosocket(fd, LOGSTORE_PROTOCOL_ERROR);
     }
 
-    int xid = Tbegin();
-    regionAllocator * ro_alloc = new regionAllocator();
-    diskTreeComponent::internalNodes::iterator * it = new diskTreeComponent::internalNodes::iterator(xid, ro_alloc, ltable->get_tree_c2()->get_root_rid());
-    size_t count = 0;
+    // Sample every component, not just C2, so that data that has not been
+    // merged down yet is reflected in the partitions.
+    std::vector<partitionedScan::sample_t> samples;
+    partitionedScan::sample_keys(ltable, &samples);
+    size_t count = samples.size();
     int err = 0;
 
-    while(it->next()) { count++; }
-    it->close();
-    delete(it);
-
-    uint64_t stride;
-
-    if(count > limit) {
-        stride = count / (limit-1);
-        stride++;  // this way, we truncate the last bucket instead of occasionally creating a tiny last bucket.
-    } else {
-        stride = 1;
+    // Send the first key, the split points between (up to) limit-1 equally
+    // sized buckets, and the last key.
+    std::vector<dataTuple*> splits;
+    if(count) {
+        partitionedScan::split_points(samples, limit - 1, &splits);
     }
 
+    // The number of samples per bucket that split_points actually produced;
+    // it may return fewer than limit-2 keys.
+    uint64_t stride = (count + splits.size()) / (splits.size() + 1);
+    if(!stride) { stride = 1; }
+
     dataTuple * tup = dataTuple::create(&stride, sizeof(stride));
 
     if(!err) { err = writeoptosocket(fd, LOGSTORE_RESPONSE_SENDING_TUPLES); }
@@ -276,29 +473,17 @@ inline int requestDispatch<HANDLE>::op_stat_histogram(bLSM * ltable, HANDLE fd,
 
     dataTuple::freetuple(tup);
 
-    size_t cur_stride = 0;
-    size_t i = 0;
-    it = new diskTreeComponent::internalNodes::iterator(xid, ro_alloc, ltable->get_tree_c2()->get_root_rid()); // TODO make this method private?
-    while(it->next()) {
-        i++;
-        if(i == count || !cur_stride) {  // do we want to send this key? (this matches the first, last and interior keys)
-            byte * key;
-            size_t keylen= it->key(&key);
-            tup = dataTuple::create(key, keylen);
-
-            if(!err) { err = writetupletosocket(fd, tup);                   }
-
-            dataTuple::freetuple(tup);
-            cur_stride = stride;
+    if(count) {
+        if(!err) { err = writetupletosocket(fd, samples[0].key);            }
+        for(size_t i = 0; i < splits.size(); i++) {
+            if(!err) { err = writetupletosocket(fd, splits[i]);             }
+            dataTuple::freetuple(splits[i]);
         }
-        cur_stride--;
+        if(count > 1 && !err) { err = writetupletosocket(fd, samples[count-1].key); }
     }
+    partitionedScan::free_samples(&samples);
 
-    it->close();
-    delete(it);
-    delete(ro_alloc);
     if(!err){ err = writeendofiteratortosocket(fd);                         }
-    Tcommit(xid);
     return err;
 }
 template<class HANDLE>
@@ -447,6 +632,469 @@ inline int requestDispatch<HANDLE>::op_dbg_set_log_mode(bLSM * ltable, HANDLE fd
 	  return writeoptosocket(fd, LOGSTORE_RESPONSE_SUCCESS);
   }
 }
+
+/** A frame of requests.  Its buffer holds their tuples, so it lives until the last of them is done. */
+struct request_frame {
+  byte * buf;
+  int refs;                 // protected by pipeline_state::mut.
+};
+
+/** A request read from a pipelined connection, waiting for a worker. */
+struct pipelined_request {
+  uint64_t id;
+  network_op_t opcode;
+  dataTuple * tuple;
+  dataTuple * tuple2;
+  uint64_t count;
+  request_frame * frame;    // NULL if the tuples were malloc()ed individually.
+};
+
+/** A response that is waiting to be written. */
+struct pipelined_response {
+  uint64_t id;
+  uint64_t len;
+  char * buf;
+};
+
+struct pipeline_state {
+  bLSM * ltable;
+  int sockd;                      // responses are written here, by one writer task at a time.
+  bool framed;
+  requestExecutor * executor;
+  pthread_mutex_t mut;            // protects outstanding, and the request_frame refcounts.
+  pthread_cond_t cond;            // signalled when outstanding drops.
+  size_t outstanding;             // requests that are queued or running, plus the writer task.
+  pthread_mutex_t write_mut;      // protects the fields below.
+  std::vector<pipelined_response> responses;  // completed, waiting for the writer.
+  bool writing;                   // a writer task is queued or running; it will pick up new responses too.
+  int write_err;
+};
+
+/** A pipelined request, on its way through the executor. */
+struct pipeline_task {
+  pipeline_state * s;
+  pipelined_request req;
+};
+
+static requestExecutor * configured_executor = NULL;
+static requestExecutor * shared_executor = NULL;
+static pthread_once_t shared_executor_once = PTHREAD_ONCE_INIT;
+static void create_shared_executor() { shared_executor = new requestExecutor(); }
+
+template<class HANDLE>
+void requestDispatch<HANDLE>::set_executor(requestExecutor * executor) {
+  configured_executor = executor;
+}
+static requestExecutor * pipeline_executor() {
+  if(configured_executor) { return configured_executor; }
+  pthread_once(&shared_executor_once, create_shared_executor);
+  return shared_executor;
+}
+
+// Responses go straight to the file descriptor, so buffered FILE* output must be flushed first.
+static inline int pipeline_sockd(int fd) { return fd; }
+static inline int pipeline_sockd(FILE * f) { MYFFLUSH(f); return fileno(f); }
+
+static void pipeline_release_frame(pipeline_state * s, request_frame * frame) {
+  pthread_mutex_lock(&s->mut);
+  bool last = !--frame->refs;
+  pthread_mutex_unlock(&s->mut);
+  if(last) {
+    free(frame->buf);
+    free(frame);
+  }
+}
+static void pipeline_release(pipeline_state * s, pipelined_request * req) {
+  if(req->frame) {
+    pipeline_release_frame(s, req->frame);
+  } else {
+    if(req->tuple)  dataTuple::freetuple(req->tuple);
+    if(req->tuple2) dataTuple::freetuple(req->tuple2);
+  }
+}
+static void pipeline_complete(pipeline_state * s) {
+  pthread_mutex_lock(&s->mut);
+  s->outstanding--;
+  pthread_cond_broadcast(&s->cond);
+  pthread_mutex_unlock(&s->mut);
+}
+
+/**
+ * Send everything in s->responses, one writev() per batch, until no more
+ * responses arrive.  This can block on a slow client, so it runs on the
+ * blocking pool.
+ */
+static void pipeline_write(void * arg) {
+  pipeline_state * s = (pipeline_state*)arg;
+  std::vector<pipelined_response> batch;
+  std::vector<uint64_t> hdrs;
+  std::vector<struct iovec> iov;
+  pthread_mutex_lock(&s->write_mut);
+  while(!s->responses.empty()) {
+    batch.swap(s->responses);
+    int err = s->write_err;
+    pthread_mutex_unlock(&s->write_mut);
+
+    hdrs.resize(1 + 2 * batch.size());
+    iov.clear();
+    hdrs[0] = 0;  // the frame length
+    if(s->framed) {
+      struct iovec v = { &hdrs[0], sizeof(hdrs[0]) };
+      iov.push_back(v);
+    }
+    for(size_t i = 0; i < batch.size(); i++) {
+      hdrs[1 + 2*i]     = batch[i].id;
+      hdrs[1 + 2*i + 1] = batch[i].len;
+      struct iovec h = { &hdrs[1 + 2*i], 2 * sizeof(uint64_t) };
+      struct iovec b = { batch[i].buf, batch[i].len };
+      iov.push_back(h);
+      iov.push_back(b);
+      hdrs[0] += 2 * sizeof(uint64_t) + batch[i].len;
+    }
+    if(!err) { err = writevtosocket(s->sockd, &iov[0], iov.size()); }
+    for(size_t i = 0; i < batch.size(); i++) {
+      free(batch[i].buf);
+    }
+    batch.clear();
+
+    pthread_mutex_lock(&s->write_mut);
+    if(err && !s->write_err) {
+      s->write_err = err;
+      // Wake up the reader, so that it stops accepting requests we can't answer.
+      shutdown(s->sockd, SHUT_RDWR);
+    }
+  }
+  s->writing = false;
+  pthread_mutex_unlock(&s->write_mut);
+  pipeline_complete(s);
+}
+
+/** Hand a response to the writer task, starting one if none is queued or running. */
+static void pipeline_respond(pipeline_state * s, pipelined_response r) {
+  pthread_mutex_lock(&s->write_mut);
+  s->responses.push_back(r);
+  bool start_writer = !s->writing;
+  s->writing = true;
+  pthread_mutex_unlock(&s->write_mut);
+  if(start_writer) {
+    pthread_mutex_lock(&s->mut);
+    s->outstanding++;
+    pthread_mutex_unlock(&s->mut);
+    s->executor->submit_blocking(pipeline_write, s);
+  }
+}
+
+/**
+ * Run a request against a memory buffer, so that the whole response can be
+ * written at once, and hand the response to the writer.
+ *
+ * @param nonblocking if true, only run the request if that can be done
+ *        without blocking; see requestDispatch::dispatch_nonblocking().
+ * @return false if nonblocking was set, and the request was not run.
+ */
+static bool pipeline_execute(pipeline_task * t, bool nonblocking) {
+  pipeline_state * s = t->s;
+  pipelined_request * req = &t->req;
+  pipelined_response r;
+  r.id = req->id;
+  r.buf = NULL;
+  size_t len = 0;
+  FILE * mf = open_memstream(&r.buf, &len);
+  int err = 0;
+  bool handled = true;
+  if(opiserror(req->opcode)) {
+    err = writeoptosocket(mf, req->opcode);
+  } else if(nonblocking) {
+    handled = requestDispatch<FILE*>::dispatch_nonblocking(req->opcode, req->tuple, req->tuple2, req->count, s->ltable, mf, &err);
+  } else if(req->opcode == OP_SCAN_STREAM) {
+    // There is no way to send credits on this connection, so send one batch.
+    err = requestDispatch<FILE*>::scan_stream(s->ltable, mf, req->tuple, req->tuple2, req->count, false);
+  } else {
+    err = requestDispatch<FILE*>::dispatch_request(req->opcode, req->tuple, req->tuple2, req->count, s->ltable, mf);
+  }
+  fclose(mf);
+  if(!handled) {
+    free(r.buf);
+    return false;
+  }
+  pipeline_release(s, req);
+  if(err || !len) {
+    r.buf = (char*) realloc(r.buf, 1);
+    r.buf[0] = LOGSTORE_REMOTE_ERROR;
+    len = 1;
+  }
+  r.len = len;
+  pipeline_respond(s, r);
+  delete t;
+  pipeline_complete(s);
+  return true;
+}
+static void pipeline_run_blocking(void * arg) {
+  pipeline_execute((pipeline_task*)arg, false);
+}
+/** Serve the request on this executor worker if it won't block, and on the blocking pool if it might. */
+static void pipeline_run(void * arg) {
+  pipeline_task * t = (pipeline_task*)arg;
+  pipeline_state * s = t->s;
+  if(!pipeline_execute(t, true)) {
+    s->executor->submit_blocking(pipeline_run_blocking, t);
+  }
+}
+
+static void pipeline_start(pipeline_state * s, bLSM * ltable, int sockd, bool framed) {
+  s->ltable = ltable;
+  s->sockd = sockd;
+  s->framed = framed;
+  s->executor = pipeline_executor();
+  s->outstanding = 0;
+  s->writing = false;
+  s->write_err = 0;
+  pthread_mutex_init(&s->mut, 0);
+  pthread_cond_init(&s->cond, 0);
+  pthread_mutex_init(&s->write_mut, 0);
+}
+
+static void pipeline_enqueue(pipeline_state * s, pipelined_request req, size_t max_outstanding) {
+  // These would read from (or take over) the socket, which belongs to the reader now.
+  if(req.opcode == OP_BULK_INSERT || req.opcode == OP_PIPELINE || req.opcode == OP_FRAMED || req.opcode == OP_SHM_ATTACH) {
+    req.opcode = LOGSTORE_UNIMPLEMENTED_ERROR;
+  }
+  pthread_mutex_lock(&s->mut);
+  if(req.frame) { req.frame->refs++; }
+  while(s->outstanding >= max_outstanding) {
+    pthread_cond_wait(&s->cond, &s->mut);
+  }
+  s->outstanding++;
+  pthread_mutex_unlock(&s->mut);
+  pipeline_task * t = new pipeline_task;
+  t->s = s;
+  t->req = req;
+  s->executor->submit(pipeline_run, t);
+}
+
+/** Wait for the outstanding requests to be answered, then clean up. */
+static void pipeline_finish(pipeline_state * s) {
+  pthread_mutex_lock(&s->mut);
+  while(s->outstanding) {
+    pthread_cond_wait(&s->cond, &s->mut);
+  }
+  pthread_mutex_unlock(&s->mut);
+  pthread_mutex_destroy(&s->write_mut);
+  pthread_cond_destroy(&s->cond);
+  pthread_mutex_destroy(&s->mut);
+}
+
+/**
+ * Serve the rest of the connection with tagged requests.  This thread reads
+ * requests and submits them to the shared requestExecutor: requests that
+ * can be served without blocking run on its workers, and the rest on its
+ * blocking pool, so that slow disk reads do not hold up requests that hit
+ * C0.  Each response is written as soon as it is ready.  The connection
+ * keeps its reader thread until the client sends OP_DONE or goes away.
+ *
+ * @return non-zero; the connection is closed afterwards.
+ */
+template<class HANDLE>
+inline int requestDispatch<HANDLE>::op_pipeline(bLSM * ltable, HANDLE fd) {
+  int err = writeoptosocket(fd, LOGSTORE_RESPONSE_SUCCESS);
+  if(err) { return err; }
+
+  pipeline_state s;
+  pipeline_start(&s, ltable, pipeline_sockd(fd), false);
+
+  while(true) {
+    pipelined_request req;
+    req.tuple = req.tuple2 = NULL;
+    req.count = (uint64_t)-1;
+    req.frame = NULL;
+
+    if(( err = readfromsocket(fd, &req.id, sizeof(req.id)) )) { break; }
+    req.opcode = readopfromsocket(fd, LOGSTORE_CLIENT_REQUEST);
+    if(req.opcode == OP_DONE) { break; }
+    if(opiserror(req.opcode)) { err = req.opcode; break; }
+
+    if(!err) { req.tuple  = readtuplefromsocket(fd, &err); }
+    if(!err) { req.tuple2 = readtuplefromsocket(fd, &err); }
+    if(!err && opreadscount(req.opcode)) { req.count = readcountfromsocket(fd, &err); }
+    if(err) {
+      pipeline_release(&s, &req);
+      break;
+    }
+    pipeline_enqueue(&s, req, PIPELINE_MAX_QUEUED);
+  }
+  if(err && err != EOF) {
+    perror("pipelined connection failed");
+  }
+  pipeline_finish(&s);
+
+  return err ? err : EOF;
+}
+
+/**
+ * Like op_pipeline, but requests arrive in frames, which are read with two
+ * calls to read(), and whose tuples are used in place.
+ */
+template<class HANDLE>
+inline int requestDispatch<HANDLE>::op_framed(bLSM * ltable, HANDLE fd) {
+  int err = writeoptosocket(fd, LOGSTORE_RESPONSE_SUCCESS);
+  if(err) { return err; }
+
+  pipeline_state s;
+  pipeline_start(&s, ltable, pipeline_sockd(fd), true);
+
+  bool client_done = false;
+  while(!err && !client_done) {
+    uint64_t len;
+    if(( err = readfromsocket(fd, &len, sizeof(len)) )) { break; }
+    if(len > FRAMED_MAX_LENGTH) { err = LOGSTORE_PROTOCOL_ERROR; break; }
+
+    request_frame * frame = (request_frame*) malloc(sizeof(*frame));
+    frame->buf = (byte*) malloc(len);
+    frame->refs = 1;  // ours, until we are done parsing it.
+    err = readfromsocket(fd, frame->buf, len);
+
+    size_t off = 0;
+    while(!err && off < len) {
+      pipelined_request req;
+      req.frame = frame;
+      size_t used;
+      err = readframedrequest(frame->buf + off, len - off, &req.id, &req.opcode,
+                              &req.tuple, &req.tuple2, &req.count, &used);
+      if(err) { break; }
+      off += used;
+      if(req.opcode == OP_DONE) { client_done = true; break; }
+      if(!opisrequest(req.opcode)) { err = LOGSTORE_PROTOCOL_ERROR; break; }
+      pipeline_enqueue(&s, req, PIPELINE_MAX_QUEUED);
+    }
+    pipeline_release_frame(&s, frame);
+  }
+  if(err && err != EOF) {
+    perror("framed connection failed");
+  }
+  pipeline_finish(&s);
+
+  return err ? err : EOF;
+}
+/**
+ * @return true if the client on sockd may ask the server to map the shared
+ * memory segment called name: it must be a local (Unix socket) peer, and the
+ * name must be one that clients create.  Sets *peer_uid, which the segment's
+ * owner must match.
+ */
+static bool shm_attach_allowed(int sockd, const char * name, uid_t * peer_uid) {
+  struct sockaddr_storage addr;
+  socklen_t addr_len = sizeof(addr);
+  if(getsockname(sockd, (struct sockaddr*)&addr, &addr_len) || addr.ss_family != AF_UNIX) {
+    return false;
+  }
+  struct ucred cred;
+  socklen_t cred_len = sizeof(cred);
+  if(getsockopt(sockd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len)) {
+    return false;
+  }
+  *peer_uid = cred.uid;
+  size_t prefix_len = strlen(SHM_NAME_PREFIX);
+  return !strncmp(name, SHM_NAME_PREFIX, prefix_len) && !strchr(name + prefix_len, '/');
+}
+/**
+ * Serve requests from a client's shared memory rings (see shmRing.h) until
+ * it sends OP_DONE or goes away.  The client can still write to a request
+ * after sending it, so each one is copied out of the ring (and its space
+ * released) before it is parsed.  Each response is written to the ring
+ * with a single copy.  The socket is
+ * only used to notice that the client has exited, and for records that are
+ * too big for the rings.
+ *
+ * @return non-zero; the connection is closed afterwards.
+ */
+template<class HANDLE>
+inline int requestDispatch<HANDLE>::op_shm_attach(bLSM * ltable, HANDLE fd, dataTuple * tuple, uint64_t ring_bytes) {
+  if(!tuple || !tuple->rawkeylen() || tuple->rawkey()[tuple->rawkeylen()-1] != '\0'
+     || !shm_ring_size_ok(ring_bytes)) {
+    return writeoptosocket(fd, LOGSTORE_PROTOCOL_ERROR);
+  }
+  const char * name = (const char*)tuple->rawkey();
+  uid_t peer_uid;
+  if(!shm_attach_allowed(pipeline_sockd(fd), name, &peer_uid)) {
+    return writeoptosocket(fd, LOGSTORE_REMOTE_ERROR);
+  }
+  size_t seg_len = shm_segment_size(ring_bytes);
+  byte * seg = (byte*)MAP_FAILED;
+  int shmfd = shm_open(name, O_RDWR | O_NOFOLLOW, 0);
+  struct stat st;
+  if(shmfd != -1 && !fstat(shmfd, &st) && st.st_uid == peer_uid && (size_t)st.st_size == seg_len) {
+    seg = (byte*)mmap(0, seg_len, PROT_READ | PROT_WRITE, MAP_SHARED, shmfd, 0);
+  }
+  if(shmfd != -1) { close(shmfd); }
+  if(seg == MAP_FAILED) {
+    perror("couldn't attach shared memory segment");
+    return writeoptosocket(fd, LOGSTORE_REMOTE_ERROR);
+  }
+  int err = writeoptosocket(fd, LOGSTORE_RESPONSE_SUCCESS);
+  if(!err) { err = flushsocket(fd); }
+
+  int sockd = pipeline_sockd(fd);
+  shm_ring_view requests, responses;
+  shm_ring_views(seg, ring_bytes, &requests, &responses);
+  byte * body = NULL;  // a private copy of the current request.
+  size_t body_size = 0;
+
+  while(!err) {
+    size_t len;
+    uint64_t flags;
+    byte * rec = shm_ring_peek(&requests, &len, &flags, sockd, &err);
+    if(err) { break; }
+    if(flags & SHM_RECORD_ON_SOCKET) {
+      shm_ring_release(&requests, len);
+      uint64_t n;
+      err = readfromsocket(fd, &n, sizeof(n));
+      if(!err && n > FRAMED_MAX_LENGTH) { err = LOGSTORE_PROTOCOL_ERROR; }
+      len = n;
+    }
+    if(!err && len > body_size) {
+      body_size = len;
+      body = (byte*) realloc(body, body_size);
+    }
+    if(!err && (flags & SHM_RECORD_ON_SOCKET)) {
+      err = readfromsocket(fd, body, len);
+    } else if(!err) {
+      memcpy(body, rec, len);
+      shm_ring_release(&requests, len);
+    }
+
+    uint64_t id, count;
+    network_op_t opcode = OP_DONE;
+    dataTuple *t = NULL, *t2 = NULL;
+    size_t used;
+    if(!err) { err = readframedrequest(body, len, &id, &opcode, &t, &t2, &count, &used); }
+    if(err || opcode == OP_DONE) { break; }
+
+    byte * resp = NULL;
+    size_t resp_len = 0;
+    FILE * mf = open_memstream((char**)&resp, &resp_len);
+    int derr;
+    if(!opisrequest(opcode) || opcode == OP_BULK_INSERT || opcode == OP_PIPELINE || opcode == OP_FRAMED
+       || opcode == OP_SCAN_STREAM || opcode == OP_SHM_ATTACH) {
+      derr = writeoptosocket(mf, LOGSTORE_UNIMPLEMENTED_ERROR);
+    } else {
+      derr = requestDispatch<FILE*>::dispatch_request(opcode, t, t2, count, ltable, mf);
+    }
+    fclose(mf);
+    if(derr || !resp_len) {
+      resp[0] = LOGSTORE_REMOTE_ERROR;
+      resp_len = 1;
+    }
+    err = shm_ring_send(&responses, resp, resp_len, sockd);
+    free(resp);
+  }
+  if(err && err != EOF && err != LOGSTORE_CONN_CLOSED_ERROR) {
+    perror("shared memory connection failed");
+  }
+  free(body);
+  munmap(seg, seg_len);
+
+  return err ? err : EOF;
+}
 template<class HANDLE>
 int requestDispatch<HANDLE>::dispatch_request(HANDLE f, bLSM *ltable) {
   //step 1: read the opcode
@@ -474,7 +1122,7 @@ int requestDispatch<HANDLE>::dispatch_request(HANDLE f, bLSM *ltable) {
   // Deal with old work_queue item by freeing it or putting it back in the queue.
 
   if(err) {
-    if(opcode != OP_DONE) {
+    if(!opclosesconnection(opcode)) {
       perror("network error. conn closed");
     } else {
 //              printf("client done. conn closed. (%d, %d)\n",
@@ -487,6 +1135,27 @@ int requestDispatch<HANDLE>::dispatch_request(HANDLE f, bLSM *ltable) {
 template<class HANDLE>
 int requestDispatch<HANDLE>::dispatch_request(network_op_t opcode, dataTuple * tuple, dataTuple * tuple2, bLSM * ltable, HANDLE fd) {
     int err = 0;
+    uint64_t count = (uint64_t)-1;
+    if(opreadscount(opcode)) {
+        count = readcountfromsocket(fd, &err);
+    }
+    if(!err) { err = dispatch_request(opcode, tuple, tuple2, count, ltable, fd); }
+    return err;
+}
+/** @return the latency histogram for requests with this opcode, or NUM_OPS if they aren't tracked. */
+static latencyStats::op_t latency_op(network_op_t opcode) {
+    if(opcode == OP_INSERT)       { return latencyStats::INSERT; }
+    if(opcode == OP_FIND)         { return latencyStats::FIND; }
+    if(opcode == OP_TEST_AND_SET) { return latencyStats::TEST_AND_SET; }
+    if(opcode == OP_SCAN || opcode == OP_SCAN_STREAM || opcode == OP_SCAN_FILTERED) { return latencyStats::SCAN; }
+    if(opcode == OP_BULK_INSERT)  { return latencyStats::BULK_INSERT; }
+    return latencyStats::NUM_OPS;
+}
+template<class HANDLE>
+int requestDispatch<HANDLE>::dispatch_request(network_op_t opcode, dataTuple * tuple, dataTuple * tuple2, uint64_t count, bLSM * ltable, HANDLE fd) {
+    int err = 0;
+    uint64_t start = latencyStats::now();
+    BLSM_TRACE1(dispatch_start, opcode);
 #if 0
     if(tuple) {
         char * printme = (char*)malloc(tuple->rawkeylen()+1);
@@ -510,8 +1179,7 @@ int requestDispatch<HANDLE>::dispatch_request(network_op_t opcode, dataTuple * t
     }
     else if(opcode == OP_SCAN)
     {
-        size_t limit = readcountfromsocket(fd, &err);
-        if(!err) {  err = op_scan(ltable, fd, tuple, tuple2, limit); }
+        err = op_scan(ltable, fd, tuple, tuple2, count);
     }
     else if(opcode == OP_BULK_INSERT) {
         err = op_bulk_insert(ltable, fd);
@@ -532,10 +1200,17 @@ int requestDispatch<HANDLE>::dispatch_request(network_op_t opcode, dataTuple * t
     {
         err = op_stat_perf_report(ltable, fd);
     }
+    else if(opcode == OP_STAT_MERGE_TELEMETRY)
+    {
+        err = op_stat_merge_telemetry(ltable, fd, count);
+    }
+    else if(opcode == OP_STAT_READ_AMPLIFICATION)
+    {
+        err = op_stat_read_amplification(ltable, fd);
+    }
     else if(opcode == OP_STAT_HISTOGRAM)
     {
-        size_t limit = readcountfromsocket(fd, &err);
-        err = op_stat_histogram(ltable, fd, limit);
+        err = op_stat_histogram(ltable, fd, count);
     }
     else if(opcode == OP_DBG_BLOCKMAP)
     {
@@ -551,8 +1226,52 @@ int requestDispatch<HANDLE>::dispatch_request(network_op_t opcode, dataTuple * t
     else if(opcode == OP_DBG_SET_LOG_MODE) {
       err = op_dbg_set_log_mode(ltable, fd, tuple);
     }
+    else if(opcode == OP_PIPELINE) {
+      err = op_pipeline(ltable, fd);
+    }
+    else if(opcode == OP_FRAMED) {
+      err = op_framed(ltable, fd);
+    }
+    else if(opcode == OP_SCAN_STREAM) {
+      err = scan_stream(ltable, fd, tuple, tuple2, count, true);
+    }
+    else if(opcode == OP_SCAN_FILTERED) {
+      err = op_scan_filtered(ltable, fd, tuple, tuple2, count);
+    }
+    else if(opcode == OP_SHM_ATTACH) {
+      err = op_shm_attach(ltable, fd, tuple, count);
+    }
+    latencyStats::op_t op = latency_op(opcode);
+    if(!err && op != latencyStats::NUM_OPS) {
+      ltable->get_latency_stats()->record_since(op, start);
+    }
+    if(op == latencyStats::SCAN && ltable->get_op_trace()) {
+      // Filters and projections aren't traced; these replay as plain scans.
+      ltable->get_op_trace()->record_op(opTrace::SCAN, start, !err, tuple, tuple2, count);
+    }
+    BLSM_TRACE2(dispatch_done, opcode, err);
     return err;
 }
 
+template<class HANDLE>
+bool requestDispatch<HANDLE>::dispatch_nonblocking(network_op_t opcode, dataTuple * tuple, dataTuple * tuple2, uint64_t count, bLSM * ltable, HANDLE fd, int * err) {
+    if(opcode == OP_DBG_NOOP) {
+        *err = op_dbg_noop(ltable, fd);
+        return true;
+    }
+    if(opcode == OP_FIND) {
+        uint64_t start = latencyStats::now();
+        dataTuple * dt;
+        if(!ltable->findTuple_inMemory(tuple->strippedkey(), tuple->strippedkeylen(), &dt)) {
+            return false;
+        }
+        if(ltable->get_op_trace()) { ltable->get_op_trace()->record_op(opTrace::FIND, start, dt != 0, tuple); }
+        *err = op_find_respond(fd, tuple, dt);
+        if(!*err) { ltable->get_latency_stats()->record_since(latencyStats::FIND, start); }
+        return true;
+    }
+    return false;
+}
+
 template class requestDispatch<int>;
 template class requestDispatch<FILE*>;
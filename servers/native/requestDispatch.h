@@ -24,26 +24,64 @@
 #include "network.h"
 #include "datatuple.h"
 #include "blsm.h"
+#include "requestExecutor.h"
 template<class HANDLE>
 class requestDispatch {
 private:
   static inline int op_insert(bLSM * ltable, HANDLE fd, dataTuple * tuple);
   static inline int op_test_and_set(bLSM * ltable, HANDLE fd, dataTuple * tuple, dataTuple * tuple2);
   static inline int op_find(bLSM * ltable, HANDLE fd, dataTuple * tuple);
+  static inline int op_find_respond(HANDLE fd, dataTuple * tuple, dataTuple * dt);
   static inline int op_scan(bLSM * ltable, HANDLE fd, dataTuple * tuple, dataTuple * tuple2, size_t limit);
+  static inline int op_scan_filtered(bLSM * ltable, HANDLE fd, dataTuple * tuple, dataTuple * tuple2, size_t limit);
   static inline int op_bulk_insert(bLSM * ltable, HANDLE fd);
   static inline int op_flush(bLSM * ltable, HANDLE fd);
   static inline int op_shutdown(bLSM * ltable, HANDLE fd);
   static inline int op_stat_space_usage(bLSM * ltable, HANDLE fd);
   static inline int op_stat_perf_report(bLSM * ltable, HANDLE fd);
+  static inline int op_stat_merge_telemetry(bLSM * ltable, HANDLE fd, uint64_t after_seq);
+  static inline int op_stat_read_amplification(bLSM * ltable, HANDLE fd);
   static inline int op_stat_histogram(bLSM * ltable, HANDLE fd, size_t limit);
   static inline int op_dbg_blockmap(bLSM * ltable, HANDLE fd);
   static inline int op_dbg_drop_database(bLSM * ltable, HANDLE fd);
   static inline int op_dbg_noop(bLSM * ltable, HANDLE fd);
   static inline int op_dbg_set_log_mode(bLSM * ltable, HANDLE fd, dataTuple * tuple);
+  static inline int op_pipeline(bLSM * ltable, HANDLE fd);
+  static inline int op_framed(bLSM * ltable, HANDLE fd);
+  static inline int op_shm_attach(bLSM * ltable, HANDLE fd, dataTuple * tuple, uint64_t ring_bytes);
 
 public:
   static int dispatch_request(HANDLE f, bLSM * ltable);
   static int dispatch_request(network_op_t opcode, dataTuple * tuple, dataTuple * tuple2, bLSM * ltable, HANDLE fd);
+  static int dispatch_request(network_op_t opcode, dataTuple * tuple, dataTuple * tuple2, uint64_t count, bLSM * ltable, HANDLE fd);
+  /**
+   * Serve a request only if that can be done without blocking: no disk
+   * reads, merge backpressure or long-lived connection state.
+   *
+   * @return false if the request was not handled (and nothing was written);
+   * otherwise, *err is set as dispatch_request would have returned it.
+   */
+  static bool dispatch_nonblocking(network_op_t opcode, dataTuple * tuple, dataTuple * tuple2, uint64_t count, bLSM * ltable, HANDLE fd, int * err);
+  /**
+   * Serve OP_SCAN_STREAM.  If wait_for_credit is false, send a single batch;
+   * the client resumes with the continuation token.
+   */
+  static int scan_stream(bLSM * ltable, HANDLE fd, dataTuple * start, dataTuple * end, uint64_t credit, bool wait_for_credit);
+  /** Batches of a streaming scan are cut short once they reach this many bytes. */
+  static const size_t SCAN_BATCH_BYTES = 1024 * 1024;
+  /**
+   * OP_BULK_INSERT streams to an empty table are loaded straight into C2
+   * once they reach this many tuples; shorter streams go through C0.
+   */
+  static const size_t BULK_LOAD_MIN_TUPLES = 10000;
+  /** Requests a pipelined connection may have outstanding before the server stops reading from it. */
+  static const size_t PIPELINE_MAX_QUEUED = 256;
+  /**
+   * Run pipelined requests on executor, which must outlive every pipelined
+   * connection.  Until this is called, they share an executor with one
+   * worker per core, created on first use.  (This is a single setting for
+   * every HANDLE type.)
+   */
+  static void set_executor(requestExecutor * executor);
 };
 #endif /* REQUESTDISPATCH_H_ */
@@ -0,0 +1,197 @@
+/*
+ * requestExecutor.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "requestExecutor.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+requestExecutor::requestExecutor(int workers, int max_blocking_threads) :
+  nworkers_(workers),
+  next_queue_(0),
+  queued_(0),
+  sleeping_(0),
+  shutting_down_(false),
+  blocking_idle_(0),
+  max_blocking_threads_(max_blocking_threads),
+  blocking_shutting_down_(false) {
+  if(nworkers_ <= 0) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    nworkers_ = cores > 0 ? cores : 1;
+  }
+  pthread_key_create(&self_key_, 0);
+  pthread_mutex_init(&idle_mut_, 0);
+  pthread_cond_init(&idle_cond_, 0);
+  pthread_mutex_init(&blocking_mut_, 0);
+  pthread_cond_init(&blocking_cond_, 0);
+
+  queues_ = new worker_queue[nworkers_];
+  for(int i = 0; i < nworkers_; i++) {
+    pthread_mutex_init(&queues_[i].mut, 0);
+  }
+  for(int i = 0; i < nworkers_; i++) {
+    worker_arg * arg = (worker_arg*)malloc(sizeof(worker_arg));
+    arg->obj = this;
+    arg->self = i;
+    pthread_create(&queues_[i].thread, 0, worker_wrap, arg);
+  }
+}
+
+requestExecutor::~requestExecutor() {
+  pthread_mutex_lock(&idle_mut_);
+  shutting_down_ = true;
+  pthread_cond_broadcast(&idle_cond_);
+  pthread_mutex_unlock(&idle_mut_);
+  for(int i = 0; i < nworkers_; i++) {
+    pthread_join(queues_[i].thread, 0);
+  }
+
+  // The workers may have handed off blocking work on their way out, so stop the pool last.
+  pthread_mutex_lock(&blocking_mut_);
+  blocking_shutting_down_ = true;
+  pthread_cond_broadcast(&blocking_cond_);
+  pthread_mutex_unlock(&blocking_mut_);
+  for(size_t i = 0; i < blocking_threads_.size(); i++) {
+    pthread_join(blocking_threads_[i], 0);
+  }
+
+  for(int i = 0; i < nworkers_; i++) {
+    pthread_mutex_destroy(&queues_[i].mut);
+  }
+  delete[] queues_;
+  pthread_cond_destroy(&blocking_cond_);
+  pthread_mutex_destroy(&blocking_mut_);
+  pthread_cond_destroy(&idle_cond_);
+  pthread_mutex_destroy(&idle_mut_);
+  pthread_key_delete(self_key_);
+}
+
+void requestExecutor::submit(task_fn fn, void * arg) {
+  task t;
+  t.fn = fn;
+  t.arg = arg;
+  intptr_t self = (intptr_t)pthread_getspecific(self_key_);
+  int q = self ? self - 1 : __sync_fetch_and_add(&next_queue_, 1) % nworkers_;
+
+  pthread_mutex_lock(&queues_[q].mut);
+  queues_[q].tasks.push_back(t);
+  pthread_mutex_unlock(&queues_[q].mut);
+
+  pthread_mutex_lock(&idle_mut_);
+  queued_++;
+  if(sleeping_) { pthread_cond_signal(&idle_cond_); }
+  pthread_mutex_unlock(&idle_mut_);
+}
+
+void requestExecutor::submit_blocking(task_fn fn, void * arg) {
+  task t;
+  t.fn = fn;
+  t.arg = arg;
+  pthread_mutex_lock(&blocking_mut_);
+  blocking_tasks_.push_back(t);
+  // Blocking tasks can run for as long as a connection lives, so never leave
+  // one waiting behind another if we can help it.  Lazily spawn new threads.
+  if(blocking_tasks_.size() > (size_t)blocking_idle_
+     && (int)blocking_threads_.size() < max_blocking_threads_) {
+    pthread_t th;
+    pthread_create(&th, 0, blocking_wrap, this);
+    blocking_threads_.push_back(th);
+  }
+  pthread_cond_signal(&blocking_cond_);
+  pthread_mutex_unlock(&blocking_mut_);
+}
+
+bool requestExecutor::try_get(int self, task * t) {
+  // Our own work first, newest first, while it is still in cache.
+  pthread_mutex_lock(&queues_[self].mut);
+  if(!queues_[self].tasks.empty()) {
+    *t = queues_[self].tasks.back();
+    queues_[self].tasks.pop_back();
+    pthread_mutex_unlock(&queues_[self].mut);
+    return true;
+  }
+  pthread_mutex_unlock(&queues_[self].mut);
+  // Then steal the oldest task from someone else.
+  for(int i = 1; i < nworkers_; i++) {
+    worker_queue * q = &queues_[(self + i) % nworkers_];
+    pthread_mutex_lock(&q->mut);
+    if(!q->tasks.empty()) {
+      *t = q->tasks.front();
+      q->tasks.pop_front();
+      pthread_mutex_unlock(&q->mut);
+      return true;
+    }
+    pthread_mutex_unlock(&q->mut);
+  }
+  return false;
+}
+
+void * requestExecutor::worker_wrap(void * arg) {
+  worker_arg * a = (worker_arg*)arg;
+  a->obj->worker(a->self);
+  free(a);
+  return 0;
+}
+
+void requestExecutor::worker(int self) {
+  pthread_setspecific(self_key_, (void*)(intptr_t)(self + 1));
+  while(true) {
+    task t;
+    if(try_get(self, &t)) {
+      pthread_mutex_lock(&idle_mut_);
+      queued_--;
+      pthread_mutex_unlock(&idle_mut_);
+      t.fn(t.arg);
+      continue;
+    }
+    pthread_mutex_lock(&idle_mut_);
+    // queued_ can be non-zero while another worker is between taking a task
+    // and decrementing it; in that case, just look again.
+    while(!queued_ && !shutting_down_) {
+      sleeping_++;
+      pthread_cond_wait(&idle_cond_, &idle_mut_);
+      sleeping_--;
+    }
+    bool done = shutting_down_ && !queued_;
+    pthread_mutex_unlock(&idle_mut_);
+    if(done) { break; }
+  }
+}
+
+void * requestExecutor::blocking_wrap(void * arg) {
+  ((requestExecutor*)arg)->blocking_worker();
+  return 0;
+}
+
+void requestExecutor::blocking_worker() {
+  pthread_mutex_lock(&blocking_mut_);
+  while(true) {
+    blocking_idle_++;
+    while(blocking_tasks_.empty() && !blocking_shutting_down_) {
+      pthread_cond_wait(&blocking_cond_, &blocking_mut_);
+    }
+    blocking_idle_--;
+    if(blocking_tasks_.empty()) { break; }
+    task t = blocking_tasks_.front();
+    blocking_tasks_.pop_front();
+    pthread_mutex_unlock(&blocking_mut_);
+    t.fn(t.arg);
+    pthread_mutex_lock(&blocking_mut_);
+  }
+  pthread_mutex_unlock(&blocking_mut_);
+}
@@ -0,0 +1,100 @@
+/*
+ * requestExecutor.h
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef REQUESTEXECUTOR_H_
+#define REQUESTEXECUTOR_H_
+
+#include <pthread.h>
+#include <deque>
+#include <vector>
+
+/**
+ * Runs requests on a fixed set of worker threads, independent of the number
+ * of connections.
+ *
+ * Each worker has its own deque.  Tasks submitted by a worker go on its own
+ * deque, which it drains newest first; idle workers steal the oldest tasks
+ * from the others.  Tasks submitted from other threads are spread round
+ * robin.  Workers must not block, so work that might (disk reads, merge
+ * backpressure, long-lived connections) goes to submit_blocking(), which
+ * runs it on a separate pool that grows on demand.
+ */
+class requestExecutor {
+public:
+  typedef void (*task_fn)(void * arg);
+
+  static const int DEFAULT_MAX_BLOCKING_THREADS = 1000;
+
+  /**
+   * @param workers is the number of non-blocking workers; zero means one per core.
+   * @param max_blocking_threads caps the blocking pool.  Once every thread is
+   *        busy, blocking tasks wait for one to finish.
+   */
+  requestExecutor(int workers = 0, int max_blocking_threads = DEFAULT_MAX_BLOCKING_THREADS);
+  /** Runs the tasks that are already queued, then stops the threads. */
+  ~requestExecutor();
+
+  /** Run a short task that will not block. */
+  void submit(task_fn fn, void * arg);
+  /** Run a task that may block. */
+  void submit_blocking(task_fn fn, void * arg);
+
+  int worker_count() { return nworkers_; }
+
+private:
+  struct task {
+    task_fn fn;
+    void * arg;
+  };
+  struct worker_queue {
+    pthread_mutex_t mut;
+    std::deque<task> tasks;
+    pthread_t thread;
+  };
+  struct worker_arg {
+    requestExecutor * obj;
+    int self;
+  };
+
+  static void * worker_wrap(void * arg);
+  static void * blocking_wrap(void * arg);
+  void worker(int self);
+  void blocking_worker();
+  bool try_get(int self, task * t);
+
+  int nworkers_;
+  worker_queue * queues_;
+  pthread_key_t self_key_;        // the calling thread's worker index + 1, or 0 for other threads.
+  unsigned int next_queue_;       // round robin for tasks from other threads.
+
+  pthread_mutex_t idle_mut_;      // protects the fields below.
+  pthread_cond_t idle_cond_;      // signalled when a task is queued, or on shutdown.
+  size_t queued_;                 // tasks in the worker deques.
+  int sleeping_;
+  bool shutting_down_;
+
+  pthread_mutex_t blocking_mut_;  // protects the fields below.
+  pthread_cond_t blocking_cond_;
+  std::deque<task> blocking_tasks_;
+  std::vector<pthread_t> blocking_threads_;
+  int blocking_idle_;
+  int max_blocking_threads_;
+  bool blocking_shutting_down_;
+};
+
+#endif /* REQUESTEXECUTOR_H_ */
@@ -0,0 +1,209 @@
+/*
+ * scanFilter.h
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SCANFILTER_H_
+#define SCANFILTER_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "datatuple.h"
+
+/*
+	Filtered scan wire format (OP_SCAN_FILTERED):
+
+	  The request is laid out like OP_SCAN (first key, exclusive upper bound
+	  or NULL, COUNT), except that the first tuple is required, and its value
+	  is a scan_filter descriptor:
+
+	    scan_filter_header
+	    PREFIX  (prefix_len bytes)
+	    OPERAND (cmp_len bytes)
+
+	  The server only considers tuples whose key starts with PREFIX, and
+	  whose value bytes [cmp_offset, cmp_offset + cmp_len) compare to OPERAND
+	  (with memcmp()) as value_cmp says.  Values too short to hold the field
+	  don't match.  COUNT bounds the number of matching tuples.
+
+	  Without SCAN_AGGREGATE, the matching tuples are returned like OP_SCAN,
+	  projected as requested.  With it, the response is a single tuple with
+	  an empty key, whose value is a scan_aggregate over the little-endian
+	  integer field [agg_offset, agg_offset + agg_width) of the matching
+	  values.  Tuples that are too short for the field are counted in rows,
+	  but not in values.
+
+	  Both ends must share the same architecture.
+ */
+
+static const uint8_t SCAN_FILTER_VERSION = 1;
+
+static const uint8_t SCAN_CMP_NONE = 0;
+static const uint8_t SCAN_CMP_EQ   = 1;
+static const uint8_t SCAN_CMP_NE   = 2;
+static const uint8_t SCAN_CMP_LT   = 3;
+static const uint8_t SCAN_CMP_LE   = 4;
+static const uint8_t SCAN_CMP_GT   = 5;
+static const uint8_t SCAN_CMP_GE   = 6;
+
+static const uint8_t SCAN_PROJECT_ALL         = 0;
+static const uint8_t SCAN_PROJECT_KEY         = 1;  // keys, with empty values.
+static const uint8_t SCAN_PROJECT_VALUE_RANGE = 2;  // keys, with value bytes [project_offset, project_offset + project_len).
+
+static const uint8_t SCAN_ROWS      = 0;
+static const uint8_t SCAN_AGGREGATE = 1;
+
+struct scan_filter_header {
+  uint8_t  version;
+  uint8_t  value_cmp;
+  uint8_t  projection;
+  uint8_t  aggregate;
+  uint8_t  agg_width;       // 1, 2, 4 or 8.
+  uint8_t  agg_signed;
+  uint16_t pad;
+  uint32_t prefix_len;
+  uint32_t cmp_offset;
+  uint32_t cmp_len;
+  uint32_t project_offset;
+  uint32_t project_len;
+  uint32_t agg_offset;
+};
+
+/** A parsed descriptor.  prefix and operand point into the buffer it was parsed from. */
+struct scan_filter {
+  scan_filter_header h;
+  const byte * prefix;
+  const byte * operand;
+};
+
+/** The result of an SCAN_AGGREGATE scan.  sum wraps; if agg_signed, sum, min and max are two's complement. */
+struct scan_aggregate {
+  uint64_t rows;            // matching tuples.
+  uint64_t values;          // matching tuples that have the field.
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+};
+
+/** A filter that matches everything, and returns whole tuples. */
+static inline void scan_filter_init(scan_filter * f) {
+  memset(&f->h, 0, sizeof(f->h));
+  f->h.version = SCAN_FILTER_VERSION;
+  f->h.agg_width = 8;
+  f->prefix = f->operand = NULL;
+}
+
+static inline size_t scan_filter_length(const scan_filter * f) {
+  return sizeof(f->h) + f->h.prefix_len + f->h.cmp_len;
+}
+
+/**
+    Build the first tuple of an OP_SCAN_FILTERED request.
+
+    @param start is the first key to consider, or NULL.
+ */
+static inline dataTuple * scan_filter_request(const scan_filter * f, const dataTuple * start) {
+  size_t len = scan_filter_length(f);
+  byte * buf = (byte*) malloc(len);
+  memcpy(buf, &f->h, sizeof(f->h));
+  memcpy(buf + sizeof(f->h), f->prefix, f->h.prefix_len);
+  memcpy(buf + sizeof(f->h) + f->h.prefix_len, f->operand, f->h.cmp_len);
+  dataTuple * ret = start ? dataTuple::create(start->rawkey(), start->rawkeylen(), buf, len)
+                          : dataTuple::create("", 0, buf, len);
+  free(buf);
+  return ret;
+}
+
+/** @return false if the descriptor is truncated or malformed. */
+static inline bool scan_filter_parse(const byte * buf, size_t len, scan_filter * f) {
+  if(len < sizeof(f->h)) { return false; }
+  memcpy(&f->h, buf, sizeof(f->h));
+  if(f->h.version != SCAN_FILTER_VERSION
+     || f->h.value_cmp > SCAN_CMP_GE
+     || f->h.projection > SCAN_PROJECT_VALUE_RANGE
+     || f->h.aggregate > SCAN_AGGREGATE
+     || (f->h.agg_width != 1 && f->h.agg_width != 2 && f->h.agg_width != 4 && f->h.agg_width != 8)
+     || (uint64_t)sizeof(f->h) + f->h.prefix_len + f->h.cmp_len != len) {
+    return false;
+  }
+  f->prefix = buf + sizeof(f->h);
+  f->operand = f->prefix + f->h.prefix_len;
+  return true;
+}
+
+static inline bool scan_filter_has_prefix(const scan_filter * f, const dataTuple * t) {
+  return t->strippedkeylen() >= f->h.prefix_len
+      && !memcmp(t->strippedkey(), f->prefix, f->h.prefix_len);
+}
+
+static inline bool scan_filter_matches(const scan_filter * f, const dataTuple * t) {
+  if(!scan_filter_has_prefix(f, t)) { return false; }
+  if(f->h.value_cmp == SCAN_CMP_NONE) { return true; }
+  if((uint64_t)f->h.cmp_offset + f->h.cmp_len > t->datalen()) { return false; }
+  int c = memcmp(t->data() + f->h.cmp_offset, f->operand, f->h.cmp_len);
+  switch(f->h.value_cmp) {
+  case SCAN_CMP_EQ: return c == 0;
+  case SCAN_CMP_NE: return c != 0;
+  case SCAN_CMP_LT: return c <  0;
+  case SCAN_CMP_LE: return c <= 0;
+  case SCAN_CMP_GT: return c >  0;
+  default:          return c >= 0;
+  }
+}
+
+/**
+    @return the tuple to send for t, or NULL if t should be sent as is.  The
+    caller frees the result.
+ */
+static inline dataTuple * scan_filter_project(const scan_filter * f, const dataTuple * t) {
+  if(f->h.projection == SCAN_PROJECT_KEY) {
+    return dataTuple::create(t->rawkey(), t->rawkeylen(), "", 0);
+  } else if(f->h.projection == SCAN_PROJECT_VALUE_RANGE) {
+    size_t off = f->h.project_offset < t->datalen() ? f->h.project_offset : t->datalen();
+    size_t len = t->datalen() - off < f->h.project_len ? t->datalen() - off : f->h.project_len;
+    return dataTuple::create(t->rawkey(), t->rawkeylen(), t->data() + off, len);
+  }
+  return NULL;
+}
+
+static inline void scan_aggregate_init(scan_aggregate * a) {
+  memset(a, 0, sizeof(*a));
+}
+
+static inline void scan_aggregate_add(const scan_filter * f, scan_aggregate * a, const dataTuple * t) {
+  a->rows++;
+  int w = f->h.agg_width;
+  if((uint64_t)f->h.agg_offset + w > t->datalen()) { return; }
+  uint64_t v = 0;
+  const byte * p = t->data() + f->h.agg_offset;
+  for(int i = w - 1; i >= 0; i--) { v = (v << 8) | p[i]; }
+  if(f->h.agg_signed && w < 8 && (v >> (8 * w - 1))) {
+    v |= ~(uint64_t)0 << (8 * w);  // sign extend.
+  }
+  bool first = !a->values++;
+  a->sum += v;
+  if(f->h.agg_signed) {
+    if(first || (int64_t)v < (int64_t)a->min) { a->min = v; }
+    if(first || (int64_t)v > (int64_t)a->max) { a->max = v; }
+  } else {
+    if(first || v < a->min) { a->min = v; }
+    if(first || v > a->max) { a->max = v; }
+  }
+}
+
+#endif /* SCANFILTER_H_ */
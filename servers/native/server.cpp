@@ -105,7 +105,12 @@ int main(int argc, char *argv[])
 
     lserver = new logserver(100, 32432);
 
-    lserver->startserver(&ltable);
+    if(lserver->startserver(&ltable)) {
+        printf("Couldn't start server\n");
+        abort();
+    }
 
-    abort(); // can't get here.
+    // stopserver() returned us here; terminate() is still shutting down in
+    // the thread that took the signal, and it will exit() the process.
+    pthread_exit(0);
 }
@@ -0,0 +1,276 @@
+/*
+ * shmRing.h
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SHMRING_H_
+#define SHMRING_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "network.h"
+
+/*
+	Shared memory wire format (OP_SHM_ATTACH):
+
+	  Clients on the same host as the server may connect over a Unix socket,
+	  create a shared memory segment, and send OP_SHM_ATTACH with the
+	  segment's name as the key of the first tuple, and COUNT set to the size
+	  of each ring.  The server refuses (with LOGSTORE_REMOTE_ERROR) unless
+	  the connection is a Unix socket, the name starts with SHM_NAME_PREFIX,
+	  and the segment belongs to the peer's uid.  Once the server responds with LOGSTORE_RESPONSE_SUCCESS,
+	  requests and responses travel through a pair of single-producer,
+	  single-consumer rings in the segment:
+
+	    shm_ring (requests, client to server)
+	    shm_ring (responses, server to client)
+	    COUNT bytes of request records
+	    COUNT bytes of response records
+
+	  Each record is a header followed by its body, padded to 8 bytes:
+
+	    LENGTH (uint64_t)
+	    FLAGS  (uint64_t; SHM_RECORD_WRAP, SHM_RECORD_ON_SOCKET)
+
+	  Request bodies are framed request records (see network.h).  The client
+	  can write to the segment at any time, so the server checks each
+	  record's length against the ring, and copies the body out before
+	  parsing it.  Response bodies are untagged responses.
+	  Bodies larger than half a ring are sent on the socket instead, as a
+	  LENGTH (uint64_t) and the body, and the record in the ring is an empty
+	  one marked SHM_RECORD_ON_SOCKET.  OP_DONE ends the connection.
+	  Requests that stream over the connection (OP_BULK_INSERT,
+	  OP_PIPELINE, OP_FRAMED and OP_SCAN_STREAM) are not supported.
+
+	  Each side spins briefly when its ring is empty (or full), and then
+	  sleeps on a futex in the segment.  Producers only wake the other side
+	  if it said it was going to sleep, so a busy connection makes no system
+	  calls at all.
+ */
+
+/** The control block of one ring.  The fields each side writes are on separate cache lines. */
+struct shm_ring {
+  volatile uint64_t head;           // bytes published; written by the producer.
+  volatile int32_t  head_seq;       // futex; bumped whenever head moves.
+  volatile int32_t  head_waiting;   // the consumer is sleeping on head_seq.
+  char pad0[48];
+  volatile uint64_t tail;           // bytes released; written by the consumer.
+  volatile int32_t  tail_seq;       // futex; bumped whenever tail moves.
+  volatile int32_t  tail_waiting;   // the producer is sleeping on tail_seq.
+  char pad1[48];
+};
+
+/** A process-local handle on one ring. */
+struct shm_ring_view {
+  shm_ring * ctl;
+  byte * data;
+  uint64_t size;
+};
+
+static const char SHM_NAME_PREFIX[] = "/blsm-client-";
+static const uint64_t SHM_RECORD_WRAP = 1;        // skip to the start of the ring.
+static const uint64_t SHM_RECORD_ON_SOCKET = 2;   // the body follows on the socket.
+static const size_t SHM_RECORD_HEADER = 16;
+static const uint64_t SHM_MIN_RING_BYTES = 4096;
+static const uint64_t SHM_MAX_RING_BYTES = 1024 * 1024 * 1024;
+static const uint64_t SHM_DEFAULT_RING_BYTES = 1024 * 1024;
+// How long a side spins before it sleeps, and how often a sleeper checks that its peer is alive.
+static const int SHM_SPIN_COUNT = 4096;
+static const long SHM_LIVENESS_CHECK_NS = 100 * 1000 * 1000;
+
+static inline size_t shm_segment_size(uint64_t ring_bytes) {
+  return 2 * sizeof(shm_ring) + 2 * ring_bytes;
+}
+static inline bool shm_ring_size_ok(uint64_t ring_bytes) {
+  return ring_bytes >= SHM_MIN_RING_BYTES && ring_bytes <= SHM_MAX_RING_BYTES
+      && !(ring_bytes & (ring_bytes - 1));
+}
+/** @param seg is the start of the segment, which has shm_segment_size() bytes. */
+static inline void shm_ring_views(byte * seg, uint64_t ring_bytes, shm_ring_view * requests, shm_ring_view * responses) {
+  requests->ctl  = (shm_ring*) seg;
+  responses->ctl = (shm_ring*)(seg + sizeof(shm_ring));
+  requests->data  = seg + 2 * sizeof(shm_ring);
+  responses->data = requests->data + ring_bytes;
+  requests->size = responses->size = ring_bytes;
+}
+static inline size_t shm_record_length(size_t body) {
+  return (SHM_RECORD_HEADER + body + 7) & ~(size_t)7;
+}
+/** @return the largest body that fits in the ring; bigger ones go on the socket. */
+static inline size_t shm_max_body(const shm_ring_view * r) {
+  return r->size / 2 - SHM_RECORD_HEADER;
+}
+
+/** @return false if the other end of the socket has gone away. */
+static inline bool shm_peer_alive(int sockd) {
+  char c;
+  ssize_t n = recv(sockd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  return n > 0 || (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR));
+}
+
+/**
+    Wait until *cond_word differs from val.  Spins first, then sleeps on
+    *seq, after setting *waiting so the other side knows to wake us.
+
+    @return zero, or LOGSTORE_CONN_CLOSED_ERROR if the peer went away.
+ */
+static inline int shm_wait(volatile uint64_t * cond_word, uint64_t val, volatile int32_t * seq, volatile int32_t * waiting, int sockd) {
+  // On a single core, spinning only delays the peer we're waiting for.
+  static const int spins = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SHM_SPIN_COUNT : 0;
+  for(int i = 0; i < spins; i++) {
+    if(*cond_word != val) { return 0; }
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__("pause");
+#endif
+  }
+  while(true) {
+    int32_t s = *seq;
+    *waiting = 1;
+    __sync_synchronize();
+    if(*cond_word != val) { break; }
+    struct timespec ts;
+    ts.tv_sec = 0;
+    ts.tv_nsec = SHM_LIVENESS_CHECK_NS;
+    if(syscall(SYS_futex, seq, FUTEX_WAIT, s, &ts, NULL, 0) == -1 && errno == ETIMEDOUT
+       && !shm_peer_alive(sockd)) {
+      *waiting = 0;
+      return LOGSTORE_CONN_CLOSED_ERROR;
+    }
+    if(*cond_word != val) { break; }
+  }
+  *waiting = 0;
+  return 0;
+}
+static inline void shm_wake(volatile int32_t * seq, volatile int32_t * waiting) {
+  __sync_fetch_and_add(seq, 1);
+  __sync_synchronize();
+  if(*waiting) {
+    syscall(SYS_futex, seq, FUTEX_WAKE, 1, NULL, NULL, 0);
+  }
+}
+
+/**
+    Reserve room for a record, waiting for the consumer if the ring is full.
+    body must be at most shm_max_body().
+
+    @return where to write the body, or NULL (and *err is set) if the peer went away.
+ */
+static inline byte * shm_ring_reserve(shm_ring_view * r, size_t body, int sockd, int * err) {
+  size_t len = shm_record_length(body);
+  uint64_t head = r->ctl->head;
+  uint64_t pos = head & (r->size - 1);
+  // Records never wrap, so a record that doesn't fit at the end starts over at the beginning.
+  uint64_t skip = r->size - pos < len ? r->size - pos : 0;
+  uint64_t tail;
+  while(head + skip + len - (tail = r->ctl->tail) > r->size) {
+    if(( *err = shm_wait(&r->ctl->tail, tail, &r->ctl->tail_seq, &r->ctl->tail_waiting, sockd) )) { return NULL; }
+  }
+  if(skip) {
+    // The consumer skips the rest of the ring if it has no room for a header.
+    if(skip >= SHM_RECORD_HEADER) {
+      uint64_t hdr[2] = { 0, SHM_RECORD_WRAP };
+      memcpy(r->data + pos, hdr, sizeof(hdr));
+    }
+    pos = 0;
+  }
+  return r->data + pos + SHM_RECORD_HEADER;
+}
+/** Publish the record written after shm_ring_reserve(). */
+static inline void shm_ring_publish(shm_ring_view * r, size_t body, uint64_t flags) {
+  size_t len = shm_record_length(body);
+  uint64_t head = r->ctl->head;
+  uint64_t pos = head & (r->size - 1);
+  if(r->size - pos < len) {
+    head += r->size - pos;
+    pos = 0;
+  }
+  uint64_t hdr[2] = { body, flags };
+  memcpy(r->data + pos, hdr, sizeof(hdr));
+  __sync_synchronize();
+  r->ctl->head = head + len;
+  shm_wake(&r->ctl->head_seq, &r->ctl->head_waiting);
+}
+/**
+    Wait for the next record.  The peer can write to the ring at any time,
+    so the body must be copied out before it is parsed.
+
+    @return its body, or NULL (and *err is set) if the peer went away, or
+    wrote a record that does not fit in the ring (LOGSTORE_PROTOCOL_ERROR).
+ */
+static inline byte * shm_ring_peek(shm_ring_view * r, size_t * body, uint64_t * flags, int sockd, int * err) {
+  while(true) {
+    uint64_t tail = r->ctl->tail;
+    if(r->ctl->head == tail) {
+      if(( *err = shm_wait(&r->ctl->head, tail, &r->ctl->head_seq, &r->ctl->head_waiting, sockd) )) { return NULL; }
+    }
+    __sync_synchronize();
+    uint64_t avail = r->ctl->head - tail;
+    uint64_t pos = tail & (r->size - 1);
+    uint64_t hdr[2] = { 0, SHM_RECORD_WRAP };
+    if(r->size - pos >= SHM_RECORD_HEADER) {
+      memcpy(hdr, r->data + pos, sizeof(hdr));
+    }
+    if(hdr[1] & SHM_RECORD_WRAP) {
+      // Nobody is waiting for this space yet, so there's no need to wake the producer.
+      r->ctl->tail = tail + r->size - pos;
+      continue;
+    }
+    // Records are no bigger than shm_max_body(), never wrap, and are
+    // published whole; anything else is garbage.
+    if(avail > r->size || hdr[0] > shm_max_body(r)
+       || pos + shm_record_length(hdr[0]) > r->size || shm_record_length(hdr[0]) > avail) {
+      *err = LOGSTORE_PROTOCOL_ERROR;
+      return NULL;
+    }
+    *body = hdr[0];
+    *flags = hdr[1];
+    return r->data + pos + SHM_RECORD_HEADER;
+  }
+}
+/** Hand the space used by the record returned by shm_ring_peek() back to the producer. */
+static inline void shm_ring_release(shm_ring_view * r, size_t body) {
+  __sync_synchronize();
+  r->ctl->tail += shm_record_length(body);
+  shm_wake(&r->ctl->tail_seq, &r->ctl->tail_waiting);
+}
+
+/**
+    Send a record, putting the body on the socket if it doesn't fit in the ring.
+ */
+static inline int shm_ring_send(shm_ring_view * r, const byte * buf, size_t len, int sockd) {
+  int err = 0;
+  bool on_socket = len > shm_max_body(r);
+  byte * dst = shm_ring_reserve(r, on_socket ? 0 : len, sockd, &err);
+  if(err) { return err; }
+  if(!on_socket) { memcpy(dst, buf, len); }
+  shm_ring_publish(r, on_socket ? 0 : len, on_socket ? SHM_RECORD_ON_SOCKET : 0);
+  if(on_socket) {
+    // The peer learns the length from the socket, since the record itself is empty.
+    uint64_t n = len;
+    err = writetosocket(sockd, &n, sizeof(n));
+    if(!err) { err = writetosocket(sockd, buf, len); }
+  }
+  return err;
+}
+
+#endif /* SHMRING_H_ */
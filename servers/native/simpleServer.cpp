@@ -24,67 +24,221 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
+#include <poll.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
-#include <sys/select.h>
 #include <errno.h>
 
 #include <unistd.h>
 #include <fcntl.h>
 
-typedef struct {
- simpleServer * obj;
- int self;
-} worker_arg;
+/** Requests that are longer than this are read on the blocking pool. */
+static const size_t PEEK_BYTES = 64 * 1024;
 
-void * worker_wrap(void * arg) {
-  ((worker_arg*)arg)->obj->worker(((worker_arg*)arg)->self);
-  free(arg);
+/** A request read from a connection, on its way through the executor. */
+struct simpleServer::request {
+  simpleServer * obj;
+  int fd;
+  network_op_t opcode;
+  dataTuple * tuple;
+  dataTuple * tuple2;
+  uint64_t count;
+};
+
+void * simpleServer::poller_wrap(void * arg) {
+  ((simpleServer*)arg)->poller();
   return 0;
 }
 
-void * simpleServer::worker(int self) {
-  int mybufsize =128*1024;
-  char * bigbuffer = (char*)malloc(mybufsize);
-  pthread_mutex_lock(&thread_mut[self]);
-  while(true) {
-    while(thread_fd[self] == -1) {
-      if(!ltable->accepting_new_requests) {
-		free(bigbuffer);
-        pthread_mutex_unlock(&thread_mut[self]);
-        return 0;
-      }
-      pthread_cond_wait(&thread_cond[self], &thread_mut[self]);
+void simpleServer::poller() {
+  static const int MAX_EVENTS = 256;
+  struct epoll_event ev[MAX_EVENTS];
+  while(ltable->accepting_new_requests) {
+    // Time out once in a while to notice shutdown.
+    int n = epoll_wait(epoll_fd, ev, MAX_EVENTS, 1000);
+    if(n == -1 && errno != EINTR) {
+      perror("epoll_wait failed");
+      abort();
+    }
+    for(int i = 0; i < n; i++) {
+      // The set is one-shot, so this connection stays quiet until the request is done.
+      request * r = (request*)malloc(sizeof(request));
+      r->obj = this;
+      r->fd = ev[i].data.fd;
+      r->opcode = OP_DONE;
+      r->tuple = r->tuple2 = 0;
+      r->count = (uint64_t)-1;
+      executor->submit(read_request, r);
     }
-    pthread_mutex_unlock(&thread_mut[self]);
-    FILE * f = fdopen(thread_fd[self], "a+");
-    setbuffer(f, bigbuffer, mybufsize);
-    while(!requestDispatch<FILE*>::dispatch_request(f, ltable)) { }
-    fclose(f);
-    pthread_mutex_lock(&thread_mut[self]);
-    thread_fd[self] = -1;
   }
 }
 
-simpleServer::simpleServer(bLSM * ltable, int max_threads, int port):
+/**
+ * Read a request from a connection, or from a buffer that holds all of one.
+ *
+ * @return zero, or an error, in which case the connection will be closed.
+ */
+template<class HANDLE>
+static int read_from_connection(HANDLE fd, network_op_t * opcode, dataTuple ** tuple, dataTuple ** tuple2, uint64_t * count) {
+  *opcode = readopfromsocket(fd, LOGSTORE_CLIENT_REQUEST);
+  if(*opcode == LOGSTORE_CONN_CLOSED_ERROR) {
+    *opcode = OP_DONE;
+    printf("Broken client closed connection uncleanly\n");
+  }
+  int err = *opcode == OP_DONE || opiserror(*opcode); //close the conn on failure
+  if(!err) { *tuple  = readtuplefromsocket(fd, &err); }
+  if(!err) { *tuple2 = readtuplefromsocket(fd, &err); }
+  if(!err && opreadscount(*opcode)) { *count = readcountfromsocket(fd, &err); }
+  return err;
+}
+
+/** @return true if op reads from or writes to the connection for as long as it runs. */
+static bool optakesconnection(network_op_t op) {
+  return opclosesconnection(op) || op == OP_BULK_INSERT || op == OP_SCAN_STREAM;
+}
+
+/**
+ * Send a response that was written to an open_memstream(), with one write,
+ * and free it.
+ *
+ * @param err is the error the response was written with.
+ */
+static int send_response(int fd, FILE * mf, char * buf, size_t * len, int err) {
+  fclose(mf);
+  if(*len) {
+    int werr = writetosocket(fd, buf, *len);
+    if(!err) { err = werr; }
+  }
+  free(buf);
+  return err;
+}
+
+void simpleServer::read_request(void * arg) {
+  request * r = (request*)arg;
+  simpleServer * obj = r->obj;
+  // Workers must not block, so only read the request here if all of it has
+  // already arrived.  Otherwise, wait for the rest on the blocking pool.
+  byte buf[PEEK_BYTES];
+  ssize_t n = recv(r->fd, buf, sizeof(buf), MSG_PEEK | MSG_DONTWAIT);
+  if(n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+    obj->finish_request(r, 0);  // nothing to read after all; re-arm.
+    return;
+  }
+  size_t len = n > 0 ? requestlength(buf, n) : 0;
+  if(n > 0 && !len) {
+    obj->executor->submit_blocking(read_request_blocking, r);
+    return;
+  }
+  int err;
+  if(len) {
+    // Take the request off the socket with one read, and parse the copy we
+    // already have.
+    if(recv(r->fd, buf, len, MSG_DONTWAIT) != (ssize_t)len) {
+      obj->finish_request(r, LOGSTORE_SOCKET_ERROR);
+      return;
+    }
+    FILE * body = fmemopen(buf, len, "r");
+    err = read_from_connection(body, &r->opcode, &r->tuple, &r->tuple2, &r->count);
+    fclose(body);
+  } else {
+    // On EOF or error, the reads fail right away.
+    err = read_from_connection(r->fd, &r->opcode, &r->tuple, &r->tuple2, &r->count);
+  }
+  if(!err) {
+    char * resp = NULL;
+    size_t resp_len = 0;
+    FILE * mf = open_memstream(&resp, &resp_len);
+    bool handled = requestDispatch<FILE*>::dispatch_nonblocking(r->opcode, r->tuple, r->tuple2, r->count, obj->ltable, mf, &err);
+    if(!handled) {
+      fclose(mf);
+      free(resp);
+      obj->executor->submit_blocking(run_blocking, r);
+      return;
+    }
+    err = send_response(r->fd, mf, resp, &resp_len, err);
+  }
+  obj->finish_request(r, err);
+}
+
+void simpleServer::read_request_blocking(void * arg) {
+  request * r = (request*)arg;
+  int err = read_from_connection(r->fd, &r->opcode, &r->tuple, &r->tuple2, &r->count);
+  if(err) {
+    r->obj->finish_request(r, err);
+  } else {
+    run_blocking(r);
+  }
+}
+
+void simpleServer::run_blocking(void * arg) {
+  request * r = (request*)arg;
+  int err;
+  if(optakesconnection(r->opcode)) {
+    err = requestDispatch<int>::dispatch_request(r->opcode, r->tuple, r->tuple2, r->count, r->obj->ltable, r->fd);
+  } else {
+    // Buffer the response, and send it with one write.
+    char * resp = NULL;
+    size_t resp_len = 0;
+    FILE * mf = open_memstream(&resp, &resp_len);
+    err = requestDispatch<FILE*>::dispatch_request(r->opcode, r->tuple, r->tuple2, r->count, r->obj->ltable, mf);
+    err = send_response(r->fd, mf, resp, &resp_len, err);
+  }
+  r->obj->finish_request(r, err);
+}
+
+void simpleServer::finish_request(request * r, int err) {
+  if(r->tuple)  dataTuple::freetuple(r->tuple);
+  if(r->tuple2) dataTuple::freetuple(r->tuple2);
+  if(err) {
+    if(!opclosesconnection(r->opcode)) {
+      perror("network error. conn closed");
+    }
+    //closing the socket removes it from the epoll set.
+    close(r->fd);
+  } else {
+    //re-arm the connection for its next request.  If the client already sent
+    //one, this reports it immediately.
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.fd = r->fd;
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_MOD, r->fd, &ev) == -1) {
+      perror("Couldn't re-arm connection; closing it");
+      close(r->fd);
+    }
+  }
+  free(r);
+}
+
+simpleServer::simpleServer(bLSM * ltable, int max_threads, int port, int workers, const char * unix_path):
   ltable(ltable),
   port(port),
+  unix_path(unix_path ? strdup(unix_path) : 0),
   max_threads(max_threads),
-  thread_fd((int*)malloc(sizeof(*thread_fd)*max_threads)),
-  thread_cond((pthread_cond_t*)malloc(sizeof(*thread_cond)*max_threads)),
-  thread_mut((pthread_mutex_t*)malloc(sizeof(*thread_mut)*max_threads)),
-  thread((pthread_t*)malloc(sizeof(*thread)*max_threads)) {
-  for(int i = 0; i < max_threads; i++) {
-    thread_fd[i] = -2;
-    pthread_cond_init(&thread_cond[i], 0);
-    pthread_mutex_init(&thread_mut[i], 0);
+  epoll_fd(-1),
+  poller_started(false),
+  executor(new requestExecutor(workers, max_threads)) {
+  // Pipelined connections share the workers, rather than starting their own.
+  requestDispatch<int>::set_executor(executor);
+}
+
+/** Hand a new connection to the poller. */
+void simpleServer::add_connection(int newsockfd) {
+  struct epoll_event ev;
+  ev.events = EPOLLIN | EPOLLONESHOT;
+  ev.data.fd = newsockfd;
+  if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, newsockfd, &ev) == -1) {
+    perror("ERROR adding connection to epoll set");
+    close(newsockfd);
   }
 }
 
 bool simpleServer::acceptLoop() {
 
   int sockfd;
+  int unixfd = -1;
   struct sockaddr_in serv_addr;
   struct sockaddr_in cli_addr;
   int newsockfd;
@@ -107,11 +261,65 @@ bool simpleServer::acceptLoop() {
     perror("ERROR on listen");
     return false;
   }
+
+  if(unix_path) {
+    // Co-located clients skip the TCP stack, and may move to shared memory (OP_SHM_ATTACH).
+    struct sockaddr_un unix_addr;
+    if(strlen(unix_path) >= sizeof(unix_addr.sun_path)) {
+      fprintf(stderr, "Unix socket path %s is too long\n", unix_path);
+      return false;
+    }
+    unixfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(unixfd == -1) {
+      perror("ERROR opening unix socket");
+      return false;
+    }
+    bzero((char *) &unix_addr, sizeof(unix_addr));
+    unix_addr.sun_family = AF_UNIX;
+    strcpy(unix_addr.sun_path, unix_path);
+    unlink(unix_path);  // left behind by an old server.
+    if(bind(unixfd, (struct sockaddr *) &unix_addr, sizeof(unix_addr)) == -1) {
+      perror("ERROR on binding unix socket");
+      return false;
+    }
+    if(listen(unixfd,SOMAXCONN)==-1) {
+      perror("ERROR on listen");
+      return false;
+    }
+  }
   printf("LSM Server listening....\n");
 
+  epoll_fd = epoll_create(1024); // the size is only a hint
+  if(epoll_fd == -1) {
+    perror("Couldn't create epoll set");
+    return false;
+  }
+  pthread_create(&poller_thread, 0, poller_wrap, this);
+  poller_started = true;
+
 //  *(sdata->server_socket) = sockfd;
 
+  struct pollfd listeners[2];
+  listeners[0].fd = sockfd;
+  listeners[1].fd = unixfd;
+  listeners[0].events = listeners[1].events = POLLIN;
+
   while(ltable->accepting_new_requests) {
+    int n = poll(listeners, unixfd == -1 ? 1 : 2, -1);
+    if(n == -1) {
+      if(errno != EINTR) { perror("ERROR on poll"); }
+      continue;
+    }
+    if(unixfd != -1 && (listeners[1].revents & POLLIN)) {
+      newsockfd = accept(unixfd, 0, 0);
+      if(newsockfd == -1) {
+        perror("ERROR on accept");
+      } else {
+        add_connection(newsockfd);
+      }
+    }
+    if(!(listeners[0].revents & POLLIN)) { continue; }
+
     socklen_t clilen = sizeof(cli_addr);
 
     newsockfd = accept(sockfd, (struct sockaddr *) &cli_addr, &clilen);
@@ -132,50 +340,24 @@ bool simpleServer::acceptLoop() {
       //      char clientip[20];
       //      inet_ntop(AF_INET, (void*) &(cli_addr.sin_addr), clientip, 20);
       //      printf("Connection from %s\n", clientip);
-      int i;
-      for(i = 0; i < max_threads; i++) { //TODO round robin or something? (currently, we don't care if connect() is slow...)
-        pthread_mutex_lock(&thread_mut[i]);
-        if(thread_fd[i] == -2) {  // lazily spawn new threads
-          thread_fd[i] = -1;
-          worker_arg * arg = (worker_arg*)malloc(sizeof(worker_arg));
-          arg->obj = this;
-          arg->self = i;
-          pthread_create(&thread[i], 0, worker_wrap, (void*)arg);
-
-        }
-        if(thread_fd[i] == -1) {
-          thread_fd[i] = newsockfd;
-          DEBUG("connect %d\n", i);
-          pthread_cond_signal(&thread_cond[i]);
-          pthread_mutex_unlock(&thread_mut[i]);
-          break;
-        } else {
-          pthread_mutex_unlock(&thread_mut[i]);
-        }
-      }
-      if(i == max_threads) {
-        printf("all threads are busy.  rejecting connection\n");
-        close(newsockfd);
-      }
+      add_connection(newsockfd);
     }
   }
+  if(unixfd != -1) {
+    close(unixfd);
+    unlink(unix_path);
+  }
   return true;
 }
 simpleServer::~simpleServer() {
-  for(int i = 0; i < max_threads; i++) {
-    pthread_cond_signal(&thread_cond[i]);
-    pthread_mutex_lock(&thread_mut[i]);
-    if(thread_fd[i] != -2) {
-      pthread_mutex_unlock(&thread_mut[i]);
-      pthread_join(thread[i],0);
-    } else {
-      pthread_mutex_unlock(&thread_mut[i]);
-    }
-    pthread_mutex_destroy(&thread_mut[i]);
-    pthread_cond_destroy(&thread_cond[i]);
+  if(poller_started) {
+    pthread_join(poller_thread, 0);
+  }
+  // Lets in-flight requests finish; they may still re-arm their connections.
+  delete executor;
+  requestDispatch<int>::set_executor(NULL);
+  if(epoll_fd != -1) {
+    close(epoll_fd);
   }
-  free(thread);
-  free(thread_mut);
-  free(thread_cond);
-  free(thread_fd);
+  free(unix_path);
 }
@@ -22,24 +22,59 @@
 #ifndef SIMPLESERVER_H_
 #define SIMPLESERVER_H_
 #include "blsm.h"
+#include "requestExecutor.h"
 
+/**
+ * Serves requestDispatch over TCP, with a thread count that does not depend
+ * on the number of connections.
+ *
+ * Idle connections wait in a one-shot epoll set.  A poller thread hands each
+ * readable connection to a requestExecutor worker.  If the whole request
+ * has arrived, the worker takes it off the socket with one read, and serves
+ * it directly if it can do so without blocking (e.g. a find that hits the
+ * row cache or C0); otherwise, the blocking pool waits for the rest of the
+ * request.  Responses are buffered, and sent with one write.  Everything
+ * else, including requests that take over the connection (bulk inserts,
+ * pipelines, streaming scans), runs on the executor's blocking pool, so
+ * slow requests cannot starve fast ones.
+ * Pipelined connections submit their requests to the same executor, so
+ * each one costs a single reader thread.  (Readers hold blocking threads,
+ * so max_threads must leave room for the requests they submit.)
+ * Once a request completes, its connection is re-armed.
+ */
 class simpleServer {
 public:
-  void* worker(int /*handle*/);
   static const int DEFAULT_PORT = 32432;
   static const int DEFAULT_THREADS = 1000;
 
-  simpleServer(bLSM * ltable, int max_threads = DEFAULT_THREADS, int port = DEFAULT_PORT);
+  /**
+   * @param max_threads caps the number of requests that may block at once.
+   * @param workers is the number of non-blocking workers; zero means one per core.
+   * @param unix_path is the path of a Unix socket to listen on as well, or NULL.
+   */
+  simpleServer(bLSM * ltable, int max_threads = DEFAULT_THREADS, int port = DEFAULT_PORT, int workers = 0,
+               const char * unix_path = NULL);
   bool acceptLoop();
   ~simpleServer();
 private:
+  struct request;
+
+  static void * poller_wrap(void * arg);
+  void poller();
+  static void read_request(void * arg);
+  static void read_request_blocking(void * arg);
+  static void run_blocking(void * arg);
+  void finish_request(request * r, int err);
+  void add_connection(int newsockfd);
+
   bLSM* ltable;
   int port;
+  char * unix_path;
   int max_threads;
-  int * thread_fd;
-  pthread_cond_t * thread_cond;
-  pthread_mutex_t * thread_mut;
-  pthread_t * thread;
+  int epoll_fd;
+  bool poller_started;
+  pthread_t poller_thread;
+  requestExecutor * executor;
 };
 
 #endif /* SIMPLESERVER_H_ */
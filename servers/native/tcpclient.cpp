@@ -22,6 +22,10 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <netinet/tcp.h>
 #include <netdb.h>
 #include <assert.h>
@@ -33,6 +37,7 @@
 #include "tcpclient.h"
 #include "datatuple.h"
 #include "network.h"
+#include "shmRing.h"
 extern "C" {
 	#define DEBUG(...) /* */
 }
@@ -42,19 +47,55 @@ struct logstore_handle_t {
 	int portnum;
 	int timeout;
 	struct sockaddr_in serveraddr;
+	bool local;                   // connect to localaddr instead of serveraddr.
+	struct sockaddr_un localaddr;
 	struct hostent* server;
 	int server_socket;
   FILE * server_fsocket;
+  bool pipelined;
+  bool framed;
+  byte * frame;         // framed requests that have not been sent yet.
+  size_t frame_len;
+  size_t frame_size;
+  byte * resp;          // the last frame of responses, and how much of it has been returned.
+  size_t resp_len;
+  size_t resp_off;
+  size_t resp_size;
+  byte * shm_seg;       // non-NULL once the connection uses shared memory rings.
+  size_t shm_seg_len;
+  shm_ring_view shm_requests;
+  shm_ring_view shm_responses;
+  FILE * shm_stream;    // the response being read, if any, and its length in the ring.
+  size_t shm_stream_len;
 };
 
-logstore_handle_t * logstore_client_open(const char *host, int portnum, int timeout) {
+// Requests are sent once this much is buffered, or the caller waits for a response.
+static const size_t FRAMED_SEND_BYTES = 64 * 1024;
+
+static logstore_handle_t * alloc_handle(const char *host, int portnum, int timeout) {
 	logstore_handle_t *ret = (logstore_handle_t*) malloc(sizeof(*ret));
 	ret->host = strdup(host);
 	ret->portnum = portnum;
 	if(ret->portnum == 0) { ret->portnum = 32432; }
 	ret->timeout = timeout;
+	ret->local = false;
         ret->server_socket = -1;
 	ret->server_fsocket = NULL;
+	ret->pipelined = false;
+	ret->framed = false;
+	ret->frame = NULL;
+	ret->frame_len = ret->frame_size = 0;
+	ret->resp = NULL;
+	ret->resp_len = ret->resp_off = ret->resp_size = 0;
+	ret->shm_seg = NULL;
+	ret->shm_seg_len = 0;
+	ret->shm_stream = NULL;
+	ret->shm_stream_len = 0;
+	return ret;
+}
+
+logstore_handle_t * logstore_client_open(const char *host, int portnum, int timeout) {
+	logstore_handle_t *ret = alloc_handle(host, portnum, timeout);
 
     ret->server = gethostbyname(ret->host);
     if (ret->server == NULL) {
@@ -74,20 +115,118 @@ logstore_handle_t * logstore_client_open(const char *host, int portnum, int time
     return ret;
 }
 
+logstore_handle_t * logstore_client_open_local(const char *path, int timeout) {
+	logstore_handle_t *ret = alloc_handle(path, 0, timeout);
+	if(strlen(path) >= sizeof(ret->localaddr.sun_path)) {
+		fprintf(stderr,"ERROR, unix socket path %s is too long\n", path);
+		free(ret->host); free(ret); return 0;
+	}
+	ret->local = true;
+	bzero((char *) &ret->localaddr, sizeof(ret->localaddr));
+	ret->localaddr.sun_family = AF_UNIX;
+	strcpy(ret->localaddr.sun_path, path);
+	return ret;
+}
+
+/** Release the shared memory response that is being read, if any. */
+static void shm_finish_response(logstore_handle_t *l) {
+  if(l->shm_stream) {
+    fclose(l->shm_stream);
+    l->shm_stream = NULL;
+    shm_ring_release(&l->shm_responses, l->shm_stream_len);
+  }
+}
+
+static void shm_detach(logstore_handle_t *l) {
+  if(l->shm_seg) {
+    if(l->shm_stream) {
+      fclose(l->shm_stream);
+      l->shm_stream = NULL;
+    }
+    munmap(l->shm_seg, l->shm_seg_len);
+    l->shm_seg = NULL;
+  }
+}
+
 static inline void close_conn(logstore_handle_t *l) {
   perror("read/write err.. conn closed.\n");
   fclose(l->server_fsocket); //close the connection
   l->server_fsocket = NULL;
   l->server_socket = -1;
+  l->pipelined = false;
+  l->framed = false;
+  l->frame_len = 0;
+  l->resp_len = l->resp_off = 0;
+  shm_detach(l);
+}
+
+static uint8_t shm_op(logstore_handle_t *l,
+                uint8_t opcode, dataTuple * tuple, dataTuple * tuple2, uint64_t count) {
+  shm_finish_response(l);
+  // These need to talk over the connection itself.
+  if(opcode == OP_BULK_INSERT || opcode == OP_PIPELINE || opcode == OP_FRAMED
+     || opcode == OP_SCAN_STREAM || opcode == OP_SHM_ATTACH) {
+    return LOGSTORE_UNIMPLEMENTED_ERROR;
+  }
+
+  // Build the request directly in the ring, unless it is too big for it.
+  int err = 0;
+  size_t n = framedrequestlength(tuple, tuple2);
+  if(n > shm_max_body(&l->shm_requests)) {
+    if(n > l->frame_size) {
+      l->frame_size = n;
+      l->frame = (byte*) realloc(l->frame, l->frame_size);
+    }
+    writeframedrequest(l->frame, 0, opcode, tuple, tuple2, count);
+    err = shm_ring_send(&l->shm_requests, l->frame, n, l->server_socket);
+  } else {
+    byte * dst = shm_ring_reserve(&l->shm_requests, n, l->server_socket, &err);
+    if(!err) {
+      writeframedrequest(dst, 0, opcode, tuple, tuple2, count);
+      shm_ring_publish(&l->shm_requests, n, 0);
+    }
+  }
+
+  size_t len = 0;
+  uint64_t flags = 0;
+  byte * body = NULL;
+  if(!err) { body = shm_ring_peek(&l->shm_responses, &len, &flags, l->server_socket, &err); }
+  l->shm_stream_len = len;
+  if(!err && (flags & SHM_RECORD_ON_SOCKET)) {
+    uint64_t big;
+    err = readfromsocket(l->server_socket, &big, sizeof(big));
+    if(!err && big > l->resp_size) {
+      l->resp_size = big;
+      l->resp = (byte*) realloc(l->resp, l->resp_size);
+    }
+    if(!err) { err = readfromsocket(l->server_socket, l->resp, big); }
+    body = l->resp;
+    len = big;
+  }
+  if(!err && !len) { err = LOGSTORE_PROTOCOL_ERROR; }
+  if(err) {
+    close_conn(l);
+    return LOGSTORE_CONN_CLOSED_ERROR;
+  }
+
+  // Tuples are read straight out of the ring; it is released once the caller has them all.
+  l->shm_stream = fmemopen(body, len, "r");
+  network_op_t rcode = readopfromsocket(l->shm_stream, LOGSTORE_SERVER_RESPONSE);
+  if(rcode != LOGSTORE_RESPONSE_SENDING_TUPLES) {
+    shm_finish_response(l);
+  }
+  return rcode;
 }
 
 uint8_t
 logstore_client_op_returns_many(logstore_handle_t *l,
 				uint8_t opcode,  dataTuple * tuple, dataTuple * tuple2, uint64_t count) {
 
+    if(l->shm_seg) { return shm_op(l, opcode, tuple, tuple2, count); }
+
     if(l->server_socket < 0)
     {
-      l->server_socket = socket(AF_INET, SOCK_STREAM, 0);
+      l->server_socket = socket(l->local ? AF_UNIX : AF_INET, SOCK_STREAM, 0);
       l->server_fsocket = fdopen(l->server_socket, "a+");
         if (l->server_socket < 0)
         {
@@ -96,6 +235,7 @@ logstore_client_op_returns_many(logstore_handle_t *l,
         }
 
 #ifdef LOGSTORE_NODELAY
+        if(!l->local) {
         int flag = 1;
         int result = setsockopt(l->server_socket,            /* socket affected */
                                 IPPROTO_TCP,     /* set option at TCP level */
@@ -108,9 +248,13 @@ logstore_client_op_returns_many(logstore_handle_t *l,
             perror("ERROR on setting socket option TCP_NODELAY.\n");
             return LOGSTORE_CONN_CLOSED_ERROR;
         }
+        }
 #endif
         /* connect: create a connection with the server */
-        if (connect(l->server_socket, (sockaddr*) &(l->serveraddr), sizeof(l->serveraddr)) < 0)
+        int result = l->local
+            ? connect(l->server_socket, (sockaddr*) &(l->localaddr), sizeof(l->localaddr))
+            : connect(l->server_socket, (sockaddr*) &(l->serveraddr), sizeof(l->serveraddr));
+        if (result < 0)
         {
             perror("ERROR connecting\n");
             return LOGSTORE_CONN_CLOSED_ERROR;
@@ -165,6 +309,13 @@ logstore_client_send_tuple(logstore_handle_t *l, dataTuple *t) {
 
 dataTuple *
 logstore_client_next_tuple(logstore_handle_t *l) {
+	if(l->shm_seg) {
+		if(!l->shm_stream) { return NULL; }
+		int err = 0;
+		dataTuple * ret = readtuplefromsocket(l->shm_stream, &err);
+		if(!ret) { shm_finish_response(l); }
+		return ret;
+	}
 	assert(l->server_fsocket != 0); // otherwise, then the client forgot to check a return value...
 	int err = 0;
 	dataTuple * ret = readtuplefromsocket(l->server_fsocket, &err);
@@ -209,14 +360,245 @@ logstore_client_op(logstore_handle_t *l,
     return ret;
 }
 
+uint8_t logstore_client_shm_start(logstore_handle_t *l, uint64_t ring_bytes) {
+  if(!l->local) { return LOGSTORE_UNIMPLEMENTED_ERROR; }
+  if(!shm_ring_size_ok(ring_bytes)) { return LOGSTORE_PROTOCOL_ERROR; }
+  static int seq = 0;
+  char name[64];
+  snprintf(name, sizeof(name), "%s%d-%d", SHM_NAME_PREFIX, (int)getpid(), __sync_fetch_and_add(&seq, 1));
+
+  size_t seg_len = shm_segment_size(ring_bytes);
+  byte * seg = (byte*)MAP_FAILED;
+  int shmfd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if(shmfd == -1) {
+    perror("ERROR creating shared memory segment");
+    return LOGSTORE_SOCKET_ERROR;
+  }
+  // The new segment is zero filled, which is what empty rings look like.
+  if(!ftruncate(shmfd, seg_len)) {
+    seg = (byte*)mmap(0, seg_len, PROT_READ | PROT_WRITE, MAP_SHARED, shmfd, 0);
+  }
+  close(shmfd);
+  if(seg == MAP_FAILED) {
+    perror("ERROR mapping shared memory segment");
+    shm_unlink(name);
+    return LOGSTORE_SOCKET_ERROR;
+  }
+
+  dataTuple * key = dataTuple::create(name, strlen(name) + 1);
+  network_op_t rcode = logstore_client_op_returns_many(l, OP_SHM_ATTACH, key, NULL, ring_bytes);
+  dataTuple::freetuple(key);
+  // Both sides have it mapped (or never will), so the name is no longer needed.
+  shm_unlink(name);
+
+  if(rcode == LOGSTORE_RESPONSE_SUCCESS) {
+    l->shm_seg = seg;
+    l->shm_seg_len = seg_len;
+    shm_ring_views(seg, ring_bytes, &l->shm_requests, &l->shm_responses);
+  } else {
+    munmap(seg, seg_len);
+  }
+  return rcode;
+}
+
+uint8_t logstore_client_pipeline_start(logstore_handle_t *l, bool framed) {
+  network_op_t rcode = logstore_client_op_returns_many(l, framed ? OP_FRAMED : OP_PIPELINE);
+  if(rcode == LOGSTORE_RESPONSE_SUCCESS) {
+    l->pipelined = true;
+    l->framed = framed;
+  } else if(!opiserror(rcode)) {
+    // An old server that doesn't know about OP_PIPELINE closes the connection instead.
+    close_conn(l);
+    rcode = LOGSTORE_PROTOCOL_ERROR;
+  }
+  return rcode;
+}
+
+/** Send the request frame that has been built up so far, if any. */
+static int send_frame(logstore_handle_t *l) {
+  if(!l->frame_len) { return 0; }
+  uint64_t len = l->frame_len;
+  int err = 0;
+  if( !err) { err = writetosocket(l->server_fsocket, &len, sizeof(len));          }
+  if( !err) { err = writetosocket(l->server_fsocket, l->frame, l->frame_len);     }
+  l->frame_len = 0;
+  return err;
+}
+
+/** Append a request to the frame, sending the frame first if it is full. */
+static int add_to_frame(logstore_handle_t *l, uint64_t reqid,
+                uint8_t opcode, dataTuple * tuple, dataTuple * tuple2, uint64_t count) {
+  size_t n = framedrequestlength(tuple, tuple2);
+  if(l->frame_len && l->frame_len + n > FRAMED_SEND_BYTES) {
+    int err = send_frame(l);
+    if(err) { return err; }
+  }
+  if(l->frame_len + n > FRAMED_MAX_LENGTH) { return LOGSTORE_PROTOCOL_ERROR; }
+  if(l->frame_len + n > l->frame_size) {
+    l->frame_size = 2 * (l->frame_len + n);
+    l->frame = (byte*) realloc(l->frame, l->frame_size);
+  }
+  writeframedrequest(l->frame + l->frame_len, reqid, opcode, tuple, tuple2, count);
+  l->frame_len += n;
+  return 0;
+}
+
+uint8_t logstore_client_pipeline_send(logstore_handle_t *l, uint64_t reqid,
+                uint8_t opcode, dataTuple * tuple, dataTuple * tuple2, uint64_t count) {
+  if(!l->pipelined) { return LOGSTORE_CONN_CLOSED_ERROR; }
+
+  int err = 0;
+  if(l->framed) {
+    err = add_to_frame(l, reqid, opcode, tuple, tuple2, count);
+  } else {
+    if( !err) { err = writetosocket(l->server_fsocket, &reqid, sizeof(reqid));    }
+    if( !err) { err = writetosocket(l->server_fsocket, &opcode, sizeof(opcode));  }
+    if( !err) { err = writetupletosocket(l->server_fsocket, tuple);               }
+    if( !err) { err = writetupletosocket(l->server_fsocket, tuple2);              }
+    if( (!err) && opreadscount(opcode) ) {
+                err = writecounttosocket(l->server_fsocket, count);               }
+  }
+  if(err) {
+    close_conn(l);
+    return LOGSTORE_CONN_CLOSED_ERROR;
+  }
+  return LOGSTORE_RESPONSE_SUCCESS;
+}
+
+uint8_t logstore_client_pipeline_recv(logstore_handle_t *l, uint64_t *reqid,
+                dataTuple *** tuples, size_t * tuple_count) {
+  *tuples = NULL;
+  *tuple_count = 0;
+  if(!l->pipelined) { return LOGSTORE_CONN_CLOSED_ERROR; }
+
+  // push out any requests that are still buffered.
+  int err = l->framed ? send_frame(l) : 0;
+  MYFFLUSH(l->server_fsocket);
+
+  uint64_t len;
+  byte * buf = NULL;
+  if(l->framed) {
+    if(l->resp_off == l->resp_len) {
+      // Read the next frame of responses.
+      uint64_t frame_len;
+      if( !err) { err = readfromsocket(l->server_fsocket, &frame_len, sizeof(frame_len)); }
+      if( !err && frame_len > l->resp_size) {
+        l->resp_size = frame_len;
+        l->resp = (byte*) realloc(l->resp, l->resp_size);
+      }
+      if( !err) { err = readfromsocket(l->server_fsocket, l->resp, frame_len); }
+      l->resp_off = 0;
+      l->resp_len = err ? 0 : frame_len;
+    }
+    if( !err && l->resp_len - l->resp_off < 2 * sizeof(uint64_t)) { err = LOGSTORE_PROTOCOL_ERROR; }
+    if( !err) {
+      memcpy(reqid, l->resp + l->resp_off, sizeof(*reqid));
+      memcpy(&len, l->resp + l->resp_off + sizeof(*reqid), sizeof(len));
+      l->resp_off += 2 * sizeof(uint64_t);
+      if(len > l->resp_len - l->resp_off) { err = LOGSTORE_PROTOCOL_ERROR; }
+    }
+    if(err) {
+      close_conn(l);
+      return LOGSTORE_CONN_CLOSED_ERROR;
+    }
+    buf = l->resp + l->resp_off;
+    l->resp_off += len;
+    return readresponsefrombuffer(buf, len, tuples, tuple_count);
+  }
+
+  if( !err) { err = readfromsocket(l->server_fsocket, reqid, sizeof(*reqid)); }
+  if( !err) { err = readfromsocket(l->server_fsocket, &len, sizeof(len));     }
+  if( !err) {
+    buf = (byte*) malloc(len);
+    err = readfromsocket(l->server_fsocket, buf, len);
+  }
+  if(err) {
+    free(buf);
+    close_conn(l);
+    return LOGSTORE_CONN_CLOSED_ERROR;
+  }
+
+  // The body is an ordinary response.  If it is truncated, the stream itself is still in sync.
+  network_op_t rcode = readresponsefrombuffer(buf, len, tuples, tuple_count);
+  free(buf);
+  return rcode;
+}
+
+uint8_t logstore_client_scan_start(logstore_handle_t *l, dataTuple * start, dataTuple * end, uint64_t batch) {
+  return logstore_client_op_returns_many(l, OP_SCAN_STREAM, start, end, batch);
+}
+
+uint8_t logstore_client_scan_batch(logstore_handle_t *l, dataTuple *** tuples, size_t * tuple_count, dataTuple ** token) {
+  assert(l->server_fsocket != 0);
+  *tuples = NULL;
+  *tuple_count = 0;
+  *token = NULL;
+  int err = 0;
+  uint64_t n = readcountfromsocket(l->server_fsocket, &err);
+  if(!err && n) {
+    *tuples = (dataTuple**) malloc(n * sizeof(**tuples));
+  }
+  for(uint64_t i = 0; !err && i < n; i++) {
+    dataTuple * t = readtuplefromsocket(l->server_fsocket, &err);
+    if(!t && !err) { err = LOGSTORE_PROTOCOL_ERROR; }  // the batch ended early.
+    if(t) { (*tuples)[(*tuple_count)++] = t; }
+  }
+  if(!err) { *token = readtuplefromsocket(l->server_fsocket, &err); }
+  if(err) {
+    for(size_t i = 0; i < *tuple_count; i++) {
+      dataTuple::freetuple((*tuples)[i]);
+    }
+    free(*tuples);
+    *tuples = NULL;
+    *tuple_count = 0;
+    if(*token) { dataTuple::freetuple(*token); *token = NULL; }
+    close_conn(l);
+    return LOGSTORE_CONN_CLOSED_ERROR;
+  }
+  return LOGSTORE_RESPONSE_SUCCESS;
+}
+
+uint8_t logstore_client_scan_credit(logstore_handle_t *l, uint64_t credit) {
+  assert(l->server_fsocket != 0);
+  int err = writecounttosocket(l->server_fsocket, credit);
+  if(!err) { err = MYFFLUSH(l->server_fsocket); }
+  if(err) {
+    close_conn(l);
+    return LOGSTORE_CONN_CLOSED_ERROR;
+  }
+  return LOGSTORE_RESPONSE_SUCCESS;
+}
+
 int logstore_client_close(logstore_handle_t* l) {
     if(l->server_fsocket)
     {
-        writetosocket(l->server_fsocket, (char*) &OP_DONE, sizeof(uint8_t));
+        if(l->shm_seg) {
+            shm_finish_response(l);
+            int err = 0;
+            size_t n = framedrequestlength(NULL, NULL);
+            byte * dst = shm_ring_reserve(&l->shm_requests, n, l->server_socket, &err);
+            if(!err) {
+                writeframedrequest(dst, 0, OP_DONE, NULL, NULL, 0);
+                shm_ring_publish(&l->shm_requests, n, 0);
+            }
+            shm_detach(l);
+        } else if(l->framed) {
+            if(!add_to_frame(l, 0, OP_DONE, NULL, NULL, 0)) {
+                send_frame(l);
+            }
+        } else {
+            if(l->pipelined) {
+                uint64_t reqid = 0;
+                writetosocket(l->server_fsocket, &reqid, sizeof(reqid));
+            }
+            writetosocket(l->server_fsocket, (char*) &OP_DONE, sizeof(uint8_t));
+        }
 
         fclose(l->server_fsocket);
         DEBUG("socket closed %d\n.", l->server_fsocket);
     }
+    free(l->frame);
+    free(l->resp);
     free(l->host);
     free(l);
     return 0;
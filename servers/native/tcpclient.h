@@ -27,6 +27,8 @@
 typedef struct logstore_handle_t logstore_handle_t;
 
 logstore_handle_t * logstore_client_open(const char *host, int portnum, int timeout);
+/** Connect to a server on this host through its Unix socket (newserver --unix-socket). */
+logstore_handle_t * logstore_client_open_local(const char *path, int timeout);
 
 dataTuple * logstore_client_op(logstore_handle_t* l,
 					uint8_t opcode,
@@ -40,6 +42,80 @@ uint8_t logstore_client_op_returns_many(logstore_handle_t *l,
 
 dataTuple * logstore_client_next_tuple(logstore_handle_t *l);
 uint8_t logstore_client_send_tuple(logstore_handle_t *l, dataTuple *tuple = NULL);
+
+/**
+ * Move a connection opened with logstore_client_open_local() to a pair of
+ * shared memory rings (OP_SHM_ATTACH; see shmRing.h).  Afterwards,
+ * logstore_client_op, logstore_client_op_returns_many and
+ * logstore_client_next_tuple work as before, but requests and responses
+ * don't go through the kernel unless one side has to wait.  Bulk inserts,
+ * pipelining and streaming scans are not available on the connection.
+ *
+ * @param ring_bytes is the size of each ring, a power of two.
+ * @return LOGSTORE_RESPONSE_SUCCESS, or an error code.
+ */
+uint8_t logstore_client_shm_start(logstore_handle_t *l, uint64_t ring_bytes = 1024 * 1024);
+
+/**
+ * Switch the connection to pipelined mode (see network.h).  Afterwards, only
+ * the logstore_client_pipeline_* calls and logstore_client_close may be used.
+ *
+ * @param framed batches requests and responses into frames (OP_FRAMED),
+ *        which costs far fewer system calls per request.
+ * @return LOGSTORE_RESPONSE_SUCCESS, or an error code.
+ */
+uint8_t logstore_client_pipeline_start(logstore_handle_t *l, bool framed = false);
+
+/**
+ * Queue a request without waiting for its response.  Requests are buffered
+ * until the next call to logstore_client_pipeline_recv().  Callers should
+ * bound the number of outstanding requests, and drain responses as they go;
+ * the server stops reading once too many requests are queued.
+ *
+ * @param reqid is echoed back with the response; it is up to the caller to
+ *        keep ids unique among outstanding requests.
+ */
+uint8_t logstore_client_pipeline_send(logstore_handle_t *l, uint64_t reqid,
+					uint8_t opcode,
+					dataTuple * tuple = NULL, dataTuple * tuple2 = NULL,
+					uint64_t count = (uint64_t)-1);
+
+/**
+ * Wait for the next response, in whatever order the server completes them.
+ *
+ * @param reqid is set to the id of the request being answered.
+ * @param tuples is set to a malloc()ed array of the returned tuples (or NULL
+ *        if there are none).  The caller frees the tuples and the array.
+ * @param tuple_count is set to the length of tuples.
+ * @return the response code for the request, or a connection error.
+ */
+uint8_t logstore_client_pipeline_recv(logstore_handle_t *l, uint64_t *reqid,
+					dataTuple *** tuples, size_t * tuple_count);
+
+/**
+ * Start a streaming scan (OP_SCAN_STREAM; see network.h) of [start, end).
+ * Either bound may be NULL.  Follow up with logstore_client_scan_batch(),
+ * and logstore_client_scan_credit() after each batch that has a token.
+ *
+ * @param batch is the size of the first batch.
+ * @return LOGSTORE_RESPONSE_SENDING_TUPLES, or an error code.
+ */
+uint8_t logstore_client_scan_start(logstore_handle_t *l, dataTuple * start, dataTuple * end, uint64_t batch);
+
+/**
+ * Read the next batch of a streaming scan.
+ *
+ * @param tuples is set to a malloc()ed array of tuples, or NULL if the batch is empty.
+ * @param tuple_count is set to the length of tuples.
+ * @param token is set to the continuation token (the first key the scan
+ *        may return next), or NULL if the scan is complete.
+ * @return LOGSTORE_RESPONSE_SUCCESS, or an error code.
+ */
+uint8_t logstore_client_scan_batch(logstore_handle_t *l, dataTuple *** tuples, size_t * tuple_count, dataTuple ** token);
+
+/** Ask for the next batch of a streaming scan, or cancel it, if credit is zero. */
+uint8_t logstore_client_scan_credit(logstore_handle_t *l, uint64_t credit);
+
 int logstore_client_close(logstore_handle_t* l);
 
 
@@ -43,10 +43,14 @@ int main(int argc, char * argv[]) {
   logstore_handle_t * from = util_open_conn(2, from_arg);
   logstore_handle_t * to   = util_open_conn(2, to_arg);
 
-  uint8_t ret = logstore_client_op_returns_many(from, OP_SCAN, 0, 0, -2);
+  // Stream the scan in batches, so that a slow to_host doesn't hold up merges on from_host.
+  const uint64_t batch_size = 1000;
+  uint8_t ret = logstore_client_scan_start(from, NULL, NULL, batch_size);
   if(ret != LOGSTORE_RESPONSE_SENDING_TUPLES) {
     perror("Open database scan failed"); return 3;
   }
+  // The scan returns tuples in key order, so if to_host is empty it can
+  // bulk load them straight into c2.
   ret = logstore_client_op_returns_many(to, OP_BULK_INSERT);
   if(ret != LOGSTORE_RESPONSE_RECEIVING_TUPLES) {
     perror("Open bulk insert failed"); return 3;
@@ -62,22 +66,41 @@ int main(int argc, char * argv[]) {
   struct timeval load_start_time;
   gettimeofday(&load_start_time, 0);
 
-  while((tup = logstore_client_next_tuple(from))) {
-    ret = logstore_client_send_tuple(to, tup);
-    num_tuples ++;
-    size_copied += tup->byte_length();
-    dataTuple::freetuple(tup);
+  dataTuple ** batch;
+  size_t batch_count;
+  dataTuple * token;
+  bool more = true;
+  while(more) {
+    ret = logstore_client_scan_batch(from, &batch, &batch_count, &token);
     if(ret != LOGSTORE_RESPONSE_SUCCESS) {
-      perror("Send tuple failed"); return 3;
+      perror("Scan failed"); return 3;
     }
-    if(last_dot != size_copied / bytes_per_dot) {
-      printf("."); fflush(stdout);
-      last_dot = size_copied / bytes_per_dot;
-      if(last_dot % dots_per_line == 0) {
-        struct timeval line_stop_time;
-        gettimeofday(&line_stop_time,0);
-        double seconds = tv_to_double(line_stop_time) - tv_to_double(load_start_time);
-        printf("%6lldMB %6.1f s %6.2f mb/s %6.2f tuples/s\n", size_copied / 1024*1024, seconds, (double)size_copied/(1024.0 * 1024.0 * seconds), (double)num_tuples/seconds);
+    for(size_t i = 0; i < batch_count; i++) {
+      tup = batch[i];
+      ret = logstore_client_send_tuple(to, tup);
+      num_tuples ++;
+      size_copied += tup->byte_length();
+      dataTuple::freetuple(tup);
+      if(ret != LOGSTORE_RESPONSE_SUCCESS) {
+        perror("Send tuple failed"); return 3;
+      }
+      if(last_dot != size_copied / bytes_per_dot) {
+        printf("."); fflush(stdout);
+        last_dot = size_copied / bytes_per_dot;
+        if(last_dot % dots_per_line == 0) {
+          struct timeval line_stop_time;
+          gettimeofday(&line_stop_time,0);
+          double seconds = tv_to_double(line_stop_time) - tv_to_double(load_start_time);
+          printf("%6lldMB %6.1f s %6.2f mb/s %6.2f tuples/s\n", size_copied / 1024*1024, seconds, (double)size_copied/(1024.0 * 1024.0 * seconds), (double)num_tuples/seconds);
+        }
+      }
+    }
+    free(batch);
+    more = (token != NULL);
+    if(more) {
+      dataTuple::freetuple(token);
+      if(logstore_client_scan_credit(from, batch_size) != LOGSTORE_RESPONSE_SUCCESS) {
+        perror("Scan failed"); return 3;
       }
     }
   }
@@ -0,0 +1,85 @@
+/*
+ * merge_telemetry.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../tcpclient.h"
+#include "../network.h"
+#include "../datatuple.h"
+#include "mergeTelemetry.h"
+
+void usage(char * argv[]) {
+	fprintf(stderr, "usage %s [--metrics] [host [port]]\n", argv[0]);
+}
+#include "util_main.h"
+int main(int argc, char * argv[]) {
+	bool metrics = false;
+	char * prog = argv[0];
+	if(argc > 1 && !strcmp(argv[1], "--metrics")) {
+		metrics = true;
+		argc--;
+		argv++;
+		argv[0] = prog;
+	}
+	logstore_handle_t * l = util_open_conn(argc, argv);
+
+	// Metrics are scraped periodically, so only the snapshot is of interest.
+	uint64_t after_seq = metrics ? ~0ull - 1 : 0;
+	uint8_t rcode = logstore_client_op_returns_many(l, OP_STAT_MERGE_TELEMETRY, NULL, NULL, after_seq);
+
+	if(rcode != LOGSTORE_RESPONSE_SENDING_TUPLES) {
+		perror("Merge telemetry failed."); return 3;
+	}
+
+	dataTuple * tup;
+	while((tup = logstore_client_next_tuple(l))) {
+		const char * kind = (const char*)tup->rawkey();
+		if(!strcmp(kind, "snapshot")) {
+			mergeSnapshot s;
+			assert(tup->datalen() == sizeof(s));
+			memcpy(&s, tup->data(), sizeof(s));
+			if(metrics) {
+				s.print_metrics(stdout);
+			} else {
+				printf("R %.2f c1_c2_delta %.4f mean_c0_run_length %lldMB max_c0_size %lldMB\n", s.r, s.c1_c2_delta,
+				       (long long)s.mean_c0_run_length >> 20, (long long)s.max_c0_size >> 20);
+				printf("%-5s %-6s %8s %8s %10s %10s %10s %8s %10s %10s %8s\n", "level", "state", "in%", "out%",
+				       "curMB", "targetMB", "outMB", "merges", "datapages", "MB/s", "active%");
+				for(int i = 0; i < 3; i++) {
+					mergeLevelSnapshot * m = &s.level[i];
+					printf("%-5d %-6s %8.1f %8.1f %10lld %10lld %10lld %8lld %10lld %10.1f %8.1f\n", m->merge_level,
+					       m->active ? "RUN" : "---", 100.0 * m->in_progress, 100.0 * m->out_progress,
+					       (long long)m->current_size >> 20, (long long)m->target_size >> 20, (long long)m->bytes_out >> 20,
+					       (long long)m->merge_count, (long long)m->datapages_out, m->bps / (1024.0 * 1024.0),
+					       m->lifetime_elapsed > 0 ? 100.0 * m->lifetime_active / m->lifetime_elapsed : 0.0);
+				}
+				printf("\n%-10s %-20s %-5s %-8s %14s %12s %8s\n", "seq", "time", "level", "event", "duration(ms)", "MB", "count");
+			}
+		} else if(!metrics && !strcmp(kind, "event")) {
+			mergeEvent e;
+			assert(tup->datalen() == sizeof(e));
+			memcpy(&e, tup->data(), sizeof(e));
+			printf("%-10llu %10llu.%09llu %-5d %-8s %14.3f %12.1f %8llu\n", (unsigned long long)e.seq,
+			       (unsigned long long)(e.timestamp_ns / 1000000000ull), (unsigned long long)(e.timestamp_ns % 1000000000ull),
+			       e.merge_level, mergeEvent::type_name(e.type), e.duration_ns / 1000000.0, e.bytes / (1024.0 * 1024.0),
+			       (unsigned long long)e.count);
+		}
+		dataTuple::freetuple(tup);
+	}
+
+	logstore_client_close(l);
+	return 0;
+}
@@ -0,0 +1,74 @@
+/*
+ * perf_report.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../tcpclient.h"
+#include "../network.h"
+#include "../datatuple.h"
+#include "latencyStats.h"
+#include "readStats.h"
+#include "rowCache.h"
+
+void usage(char * argv[]) {
+	fprintf(stderr, "usage %s [host [port]]\n", argv[0]);
+}
+#include "util_main.h"
+int main(int argc, char * argv[]) {
+	logstore_handle_t * l = util_open_conn(argc, argv);
+
+	uint8_t rcode = logstore_client_op_returns_many(l, OP_STAT_PERF_REPORT);
+
+	if(rcode != LOGSTORE_RESPONSE_SENDING_TUPLES) {
+		perror("Perf report failed."); return 3;
+	}
+
+	printf("%-14s %12s %10s %10s %10s %10s %10s %12s\n", "op", "count", "mean(us)", "p50(us)", "p99(us)", "p99.9(us)", "max(us)", "ops/sec");
+	dataTuple * tup;
+	while((tup = logstore_client_next_tuple(l))) {
+		latencyStats::summary_t s;
+		assert(tup->datalen() == sizeof(s));
+		memcpy(&s, tup->data(), sizeof(s));
+		printf("%-14s %12llu %10.1f %10.1f %10.1f %10.1f %10.1f %12.1f\n", (const char*)tup->rawkey(),
+		       (unsigned long long)s.count, s.mean / 1000.0, s.p50 / 1000.0, s.p99 / 1000.0,
+		       s.p999 / 1000.0, s.max / 1000.0, s.throughput);
+		dataTuple::freetuple(tup);
+	}
+
+	rcode = logstore_client_op_returns_many(l, OP_STAT_READ_AMPLIFICATION);
+	if(rcode != LOGSTORE_RESPONSE_SENDING_TUPLES) {
+		perror("Read amplification report failed."); return 3;
+	}
+	printf("\n");
+	while((tup = logstore_client_next_tuple(l))) {
+		if(!strcmp((const char*)tup->rawkey(), "row_cache")) {
+			rowCache::stats_t s;
+			assert(tup->datalen() == sizeof(s));
+			memcpy(&s, tup->data(), sizeof(s));
+			rowCache::pretty_print(stdout, &s);
+			printf("\n");
+		} else {
+			readStats::summary_t s;
+			assert(tup->datalen() == sizeof(s));
+			memcpy(&s, tup->data(), sizeof(s));
+			readStats::pretty_print(stdout, &s);
+		}
+		dataTuple::freetuple(tup);
+	}
+
+	logstore_client_close(l);
+	return 0;
+}
@@ -0,0 +1,133 @@
+/*
+ * check_bulkload.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "bLSM.h"
+#include "bulkLoader.h"
+#include "mergeScheduler.h"
+#include <assert.h>
+#include <stdio.h>
+
+#include <stasis/transactional.h>
+#undef begin
+#undef end
+
+#include "check_util.h"
+
+// If dup_val is set, keys[0] is loaded a second time, with that value, after the others.
+static void load(bLSM * ltable, std::vector<std::string> &keys, const char * val, bool expect_c2, const char * dup_val = NULL) {
+    bulkLoader loader(ltable);
+    for(size_t i = 0; i < keys.size(); i++) {
+        dataTuple * t = dataTuple::create(keys[i].c_str(), keys[i].length()+1, val, strlen(val)+1);
+        loader.insertTuple(t);
+        dataTuple::freetuple(t);
+    }
+    if(dup_val) {
+        dataTuple * t = dataTuple::create(keys[0].c_str(), keys[0].length()+1, dup_val, strlen(dup_val)+1);
+        loader.insertTuple(t);
+        dataTuple::freetuple(t);
+    }
+    bool c2;
+    assert(!loader.finish(&c2));
+    assert(c2 == expect_c2);
+}
+
+static void probe(bLSM * ltable, std::vector<std::string> &keys, const char * val, size_t first = 0) {
+    for(size_t i = first; i < keys.size(); i++) {
+        dataTuple * t = ltable->findTuple(-1, (dataTuple::key_t)keys[i].c_str(), keys[i].length()+1);
+        assert(t);
+        assert(!strcmp((char*)t->data(), val));
+        dataTuple::freetuple(t);
+    }
+}
+
+static size_t scan(bLSM * ltable) {
+    size_t count = 0;
+    bLSM::iterator * it = new bLSM::iterator(ltable);
+    dataTuple * last = NULL;
+    dataTuple * t;
+    while((t = it->getnext())) {
+        if(last) {
+            assert(dataTuple::compare_obj(last, t) < 0);
+            dataTuple::freetuple(last);
+        }
+        last = t;
+        count++;
+    }
+    if(last) dataTuple::freetuple(last);
+    delete it;
+    return count;
+}
+
+void insertProbeIter(size_t NUM_ENTRIES)
+{
+    unlink("storefile.txt");
+    unlink("logfile.txt");
+    system("rm -rf stasis_log/");
+
+    bLSM::init_stasis();
+    int xid = Tbegin();
+
+    // Small c0, so that the unsorted load below spills several sorted runs.
+    bLSM * ltable = new bLSM(0, 1024 * 1024, 1000, 10000, 5);
+    mergeScheduler mscheduler(ltable);
+    ltable->allocTable(xid);
+    Tcommit(xid);
+    mscheduler.start();
+
+    std::vector<std::string> key_arr;
+    preprandstr(NUM_ENTRIES, key_arr, 50, true);
+    std::sort(key_arr.begin(), key_arr.end(), &mycmp);
+    removeduplicates(key_arr);
+    NUM_ENTRIES = key_arr.size();
+
+    std::vector<std::string> first_half(key_arr.begin(), key_arr.begin() + NUM_ENTRIES / 2);
+    std::vector<std::string> second_half(key_arr.begin() + NUM_ENTRIES / 2, key_arr.end());
+
+    printf("Stage 1: Sorted bulk load of %llu keys into an empty table\n", (unsigned long long)first_half.size());
+    assert(bulkLoader::table_is_empty(ltable));
+    load(ltable, first_half, "first", true);
+    probe(ltable, first_half, "first");
+    assert(scan(ltable) == first_half.size());
+
+    printf("Stage 2: Unsorted bulk load of %llu keys into a non-empty table\n", (unsigned long long)second_half.size());
+    scramble(&second_half);
+    // A duplicate in the input; the last copy should win.
+    load(ltable, second_half, "second", false, "second, again");
+    probe(ltable, first_half, "first");
+    probe(ltable, second_half, "second", 1);
+    std::vector<std::string> dup(second_half.begin(), second_half.begin() + 1);
+    probe(ltable, dup, "second, again");
+    assert(scan(ltable) == NUM_ENTRIES);
+
+    mscheduler.shutdown();
+    delete ltable;
+    bLSM::deinit_stasis();
+
+    printf("\npass\n");
+}
+
+/** @test
+ */
+int main()
+{
+    insertProbeIter(50000);
+    return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * check_componentfile.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <errno.h>
+#include "bLSM.h"
+#include "bulkLoader.h"
+#include "componentFile.h"
+#include "mergeScheduler.h"
+#include <assert.h>
+#include <stdio.h>
+
+#include <stasis/transactional.h>
+#undef begin
+#undef end
+
+#include "check_util.h"
+
+static void write_file(const char * path, std::vector<std::string> &keys, size_t block_size) {
+    componentFileWriter * w = componentFileWriter::open(path, block_size);
+    assert(w);
+    for(size_t i = 0; i < keys.size(); i++) {
+        dataTuple * t = dataTuple::create(keys[i].c_str(), keys[i].length()+1, keys[i].c_str(), keys[i].length()+1);
+        assert(!w->append(t));
+        dataTuple::freetuple(t);
+    }
+    // Out of order appends are rejected, and don't poison the writer.
+    dataTuple * t = dataTuple::create(keys[0].c_str(), keys[0].length()+1);
+    assert(w->append(t) == EINVAL);
+    dataTuple::freetuple(t);
+    assert(w->get_tuple_count() == keys.size());
+    assert(!w->close());
+    delete w;
+}
+
+static void corrupt(const char * path, long offset) {
+    FILE * f = fopen(path, "r+");
+    assert(f);
+    fseek(f, offset, SEEK_SET);
+    int c = fgetc(f);
+    fseek(f, offset, SEEK_SET);
+    fputc(c ^ 0xff, f);
+    fclose(f);
+}
+
+void insertProbeIter(size_t NUM_ENTRIES)
+{
+    unlink("storefile.txt");
+    unlink("logfile.txt");
+    system("rm -rf stasis_log/");
+
+    std::vector<std::string> key_arr;
+    preprandstr(NUM_ENTRIES, key_arr, 50, true);
+    std::sort(key_arr.begin(), key_arr.end(), &mycmp);
+    removeduplicates(key_arr);
+    NUM_ENTRIES = key_arr.size();
+
+    printf("Stage 1: Write and reread a component file of %llu keys\n", (unsigned long long)NUM_ENTRIES);
+    write_file("component.blsm", key_arr, 64 * 1024);
+    {
+        componentFileReader * r = componentFileReader::open("component.blsm");
+        assert(r);
+        assert(r->get_tuple_count() == NUM_ENTRIES);
+        dataTuple * t;
+        size_t i = 0;
+        while((t = r->next_callerFrees())) {
+            assert(!strcmp((char*)t->strippedkey(), key_arr[i].c_str()));
+            assert(!strcmp((char*)t->data(), key_arr[i].c_str()));
+            dataTuple::freetuple(t);
+            i++;
+        }
+        assert(!r->error());
+        assert(i == NUM_ENTRIES);
+        delete r;
+    }
+
+    bLSM::init_stasis();
+    int xid = Tbegin();
+    bLSM * ltable = new bLSM(0, 1024 * 1024, 1000, 10000, 5);
+    mergeScheduler mscheduler(ltable);
+    ltable->allocTable(xid);
+    Tcommit(xid);
+    mscheduler.start();
+
+    printf("Stage 2: Reject damaged files\n");
+    assert(bulkLoader::ingest(ltable, "no-such-file.blsm") == ENOENT);
+    write_file("damaged.blsm", key_arr, 64 * 1024);
+    corrupt("damaged.blsm", 3);     // magic
+    assert(bulkLoader::ingest(ltable, "damaged.blsm") == EINVAL);
+    write_file("damaged.blsm", key_arr, 64 * 1024);
+    corrupt("damaged.blsm", componentFile::HEADER_SIZE + 100 * 1024); // payload of the second block
+    assert(bulkLoader::ingest(ltable, "damaged.blsm") == EIO);
+    unlink("damaged.blsm");
+    assert(bulkLoader::table_is_empty(ltable));
+
+    printf("Stage 3: Ingest into an empty table\n");
+    bool c2 = false;
+    assert(!bulkLoader::ingest(ltable, "component.blsm", &c2));
+    assert(c2);
+    unlink("component.blsm");
+    for(size_t i = 0; i < NUM_ENTRIES; i++) {
+        dataTuple * t = ltable->findTuple(-1, (dataTuple::key_t)key_arr[i].c_str(), key_arr[i].length()+1);
+        assert(t);
+        assert(!strcmp((char*)t->data(), key_arr[i].c_str()));
+        dataTuple::freetuple(t);
+    }
+
+    mscheduler.shutdown();
+    delete ltable;
+    bLSM::deinit_stasis();
+
+    printf("\npass\n");
+}
+
+/** @test
+ */
+int main()
+{
+    insertProbeIter(50000);
+    return 0;
+}
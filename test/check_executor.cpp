@@ -0,0 +1,257 @@
+/*
+ * check_executor.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <vector>
+#include <assert.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../servers/native/requestExecutor.h"
+
+// Waits that should be over in microseconds give up after this long, so a
+// broken executor fails the check instead of hanging it.
+static const int TIMEOUT_SECONDS = 30;
+
+/** State shared by the tasks of one stage. */
+struct stage {
+    requestExecutor * executor;
+    pthread_mutex_t mut;
+    pthread_cond_t cond;
+    int started;
+    int finished;
+    int running;
+    int max_running;
+    std::vector<int> order;
+    std::vector<pthread_t> threads;
+
+    stage() : executor(NULL), started(0), finished(0), running(0), max_running(0) {
+        pthread_mutex_init(&mut, 0);
+        pthread_cond_init(&cond, 0);
+    }
+    ~stage() {
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&mut);
+    }
+    /** Wait (holding mut) until *counter reaches n.  @return false on timeout. */
+    bool wait_for(int * counter, int n) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += TIMEOUT_SECONDS;
+        while(*counter < n) {
+            if(pthread_cond_timedwait(&cond, &mut, &deadline)) { return *counter >= n; }
+        }
+        return true;
+    }
+};
+
+struct task_arg {
+    stage * s;
+    int i;
+};
+
+static task_arg * make_arg(stage * s, int i) {
+    task_arg * a = new task_arg;
+    a->s = s;
+    a->i = i;
+    return a;
+}
+
+// Record which thread ran the task, and in what order.
+static void record_task(void * arg) {
+    task_arg * a = (task_arg*)arg;
+    stage * s = a->s;
+    pthread_mutex_lock(&s->mut);
+    s->order.push_back(a->i);
+    s->threads.push_back(pthread_self());
+    s->finished++;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->mut);
+    delete a;
+}
+
+static const int STEAL_TASKS = 100;
+
+// Queue tasks on this worker's own deque, then hold on to the worker until
+// they are done, so the others have to steal them.
+static void spawn_and_wait(void * arg) {
+    task_arg * a = (task_arg*)arg;
+    stage * s = a->s;
+    for(int i = 0; i < STEAL_TASKS; i++) {
+        s->executor->submit(record_task, make_arg(s, i));
+    }
+    pthread_mutex_lock(&s->mut);
+    assert(s->wait_for(&s->finished, STEAL_TASKS));
+    for(size_t i = 0; i < s->threads.size(); i++) {
+        assert(!pthread_equal(s->threads[i], pthread_self()));
+    }
+    s->started = 1;  // tells the main thread we're done.
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->mut);
+    delete a;
+}
+
+void checkSteal()
+{
+    stage s;
+    s.executor = new requestExecutor(4);
+    assert(s.executor->worker_count() == 4);
+    s.executor->submit(spawn_and_wait, make_arg(&s, -1));
+    pthread_mutex_lock(&s.mut);
+    assert(s.wait_for(&s.started, 1));
+    pthread_mutex_unlock(&s.mut);
+    delete s.executor;
+    assert(s.finished == STEAL_TASKS);
+    printf("Stage 1: idle workers stole all %d tasks from a busy one\n", STEAL_TASKS);
+}
+
+static const int LIFO_TASKS = 10;
+
+// With a single worker, there is no one to steal, so a worker's own tasks run newest first.
+static void spawn_lifo(void * arg) {
+    task_arg * a = (task_arg*)arg;
+    for(int i = 0; i < LIFO_TASKS; i++) {
+        a->s->executor->submit(record_task, make_arg(a->s, i));
+    }
+    delete a;
+}
+
+void checkOwnTasksNewestFirst()
+{
+    stage s;
+    s.executor = new requestExecutor(1);
+    s.executor->submit(spawn_lifo, make_arg(&s, -1));
+    pthread_mutex_lock(&s.mut);
+    assert(s.wait_for(&s.finished, LIFO_TASKS));
+    for(int i = 0; i < LIFO_TASKS; i++) {
+        assert(s.order[i] == LIFO_TASKS - 1 - i);
+    }
+    pthread_mutex_unlock(&s.mut);
+    delete s.executor;
+    printf("Stage 2: a worker ran its own tasks newest first\n");
+}
+
+static const int SHUTDOWN_TASKS = 200;
+
+static void slow_task(void * arg) {
+    usleep(1000);
+    record_task(arg);
+}
+// Hands its work to the blocking pool, like a request that turns out to need the disk.
+static void hand_off(void * arg) {
+    task_arg * a = (task_arg*)arg;
+    a->s->executor->submit_blocking(slow_task, arg);
+}
+
+void checkShutdown()
+{
+    stage s;
+    s.executor = new requestExecutor(2);
+    for(int i = 0; i < SHUTDOWN_TASKS; i++) {
+        if(i % 2) {
+            s.executor->submit(slow_task, make_arg(&s, i));
+        } else {
+            s.executor->submit(hand_off, make_arg(&s, i));
+        }
+    }
+    // The destructor runs everything that is queued, including the blocking
+    // tasks that the workers queue on their way out.
+    delete s.executor;
+    assert(s.finished == SHUTDOWN_TASKS);
+    printf("Stage 3: shutdown ran all %d queued tasks\n", SHUTDOWN_TASKS);
+}
+
+static const int BLOCKING_TASKS = 32;
+
+// Each task waits for all of the others to start, so this only finishes if
+// they all run at once.
+static void rendezvous(void * arg) {
+    task_arg * a = (task_arg*)arg;
+    stage * s = a->s;
+    pthread_mutex_lock(&s->mut);
+    s->started++;
+    s->running++;
+    if(s->running > s->max_running) { s->max_running = s->running; }
+    pthread_cond_broadcast(&s->cond);
+    s->wait_for(&s->started, a->i);
+    s->running--;
+    s->finished++;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->mut);
+    delete a;
+}
+
+// Keeps its thread busy for a while.
+static void occupy(void * arg) {
+    task_arg * a = (task_arg*)arg;
+    stage * s = a->s;
+    pthread_mutex_lock(&s->mut);
+    s->running++;
+    if(s->running > s->max_running) { s->max_running = s->running; }
+    pthread_mutex_unlock(&s->mut);
+    usleep(10000);
+    pthread_mutex_lock(&s->mut);
+    s->running--;
+    s->finished++;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->mut);
+    delete a;
+}
+
+void checkBlockingPool()
+{
+    // The pool grows until every blocking task has a thread of its own.
+    stage s;
+    s.executor = new requestExecutor(1);
+    for(int i = 0; i < BLOCKING_TASKS; i++) {
+        s.executor->submit_blocking(rendezvous, make_arg(&s, BLOCKING_TASKS));
+    }
+    pthread_mutex_lock(&s.mut);
+    assert(s.wait_for(&s.finished, BLOCKING_TASKS));
+    assert(s.max_running == BLOCKING_TASKS);
+    pthread_mutex_unlock(&s.mut);
+    delete s.executor;
+    printf("Stage 4: the blocking pool grew to %d threads\n", BLOCKING_TASKS);
+
+    // ...but no further than max_blocking_threads; the other tasks wait their turn.
+    const int cap = 2;
+    stage s2;
+    s2.executor = new requestExecutor(1, cap);
+    for(int i = 0; i < 3 * cap; i++) {
+        s2.executor->submit_blocking(occupy, make_arg(&s2, i));
+    }
+    pthread_mutex_lock(&s2.mut);
+    assert(s2.wait_for(&s2.finished, 3 * cap));
+    assert(s2.max_running <= cap);
+    pthread_mutex_unlock(&s2.mut);
+    delete s2.executor;
+    printf("Stage 5: the blocking pool stopped at %d threads\n", cap);
+}
+
+/** @test
+ */
+int main()
+{
+    checkSteal();
+    checkOwnTasksNewestFirst();
+    checkShutdown();
+    checkBlockingPool();
+    printf("\npass\n");
+    return 0;
+}
@@ -0,0 +1,185 @@
+/*
+ * check_framing.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <string>
+#include <vector>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "dataTuple.h"
+#include "../servers/native/network.h"
+
+// malloc()ed buffers are 8-byte aligned, as from_frame() requires.
+static byte * frame_of(const dataTuple * t) {
+    byte * buf = (byte*) malloc(t->framed_length());
+    t->to_frame(buf);
+    return buf;
+}
+
+// The lengths to cut a record of len bytes down to: every short prefix, and
+// the ones that are just a little too short.
+static std::vector<size_t> truncations(size_t len) {
+    std::vector<size_t> ret;
+    for(size_t avail = 0; avail < len; avail++) {
+        if(avail < 64 || avail + 16 >= len || avail == len / 2) { ret.push_back(avail); }
+    }
+    return ret;
+}
+
+static std::vector<dataTuple*> make_tuples() {
+    std::vector<dataTuple*> tuples;
+    // Every padding length, for keys and for values.
+    for(int i = 1; i <= 9; i++) {
+        std::string key(i, 'k');
+        std::string val(i, 'v');
+        tuples.push_back(dataTuple::create(key.c_str(), key.size(), val.c_str(), val.size()));
+    }
+    tuples.push_back(dataTuple::create("tombstone", 10));
+    tuples.push_back(dataTuple::create("empty value", 12, "", 0));
+    std::string big(100000, 'b');
+    tuples.push_back(dataTuple::create("big", 4, big.c_str(), big.size()));
+    return tuples;
+}
+
+void checkTupleRoundTrip()
+{
+    std::vector<dataTuple*> tuples = make_tuples();
+    for(size_t i = 0; i < tuples.size(); i++) {
+        dataTuple * t = tuples[i];
+        size_t len = t->framed_length();
+        assert(len % 8 == 0);
+
+        byte * buf = frame_of(t);
+        size_t used = 0;
+        dataTuple * f = dataTuple::from_frame(buf, len, &used);
+        assert(f && used == len);
+        assert(f->isDelete() == t->isDelete());
+        assert(!dataTuple::compare_obj(f, t));
+        assert(f->datalen() == t->datalen());
+        assert(!memcmp(f->data(), t->data(), t->datalen()));
+        free(buf);
+
+        // Truncated frames are rejected.
+        buf = frame_of(t);
+        std::vector<size_t> cuts = truncations(len);
+        for(size_t j = 0; j < cuts.size(); j++) {
+            assert(!dataTuple::from_frame(buf, cuts[j], &used));
+        }
+        free(buf);
+
+        // So is a frame whose key length runs past the buffer.  The key
+        // length takes the place of the data pointer, the tuple's last field.
+        buf = frame_of(t);
+        uintptr_t bogus = len;
+        memcpy(buf + sizeof(dataTuple) - sizeof(bogus), &bogus, sizeof(bogus));
+        assert(!dataTuple::from_frame(buf, len, &used));
+        free(buf);
+    }
+    printf("Tuple frames round trip, and truncated ones are rejected\n");
+    for(size_t i = 0; i < tuples.size(); i++) {
+        dataTuple::freetuple(tuples[i]);
+    }
+}
+
+void checkRequestRoundTrip()
+{
+    std::vector<dataTuple*> tuples = make_tuples();
+    for(size_t i = 0; i < tuples.size(); i++) {
+        dataTuple * t = tuples[i];
+        dataTuple * t2 = tuples[(i + 1) % tuples.size()];
+        // A request with no tuples, one, and two.
+        for(int ntuples = 0; ntuples <= 2; ntuples++) {
+            dataTuple * a = ntuples >= 1 ? t : NULL;
+            dataTuple * b = ntuples >= 2 ? t2 : NULL;
+            uint64_t id = 0x0123456789abcdefULL + i;
+            uint64_t count = 1000 + i;
+            size_t len = framedrequestlength(a, b);
+            byte * buf = (byte*) malloc(len);
+
+            writeframedrequest(buf, id, OP_SCAN, a, b, count);
+            uint64_t rid, rcount;
+            network_op_t opcode;
+            dataTuple * ra, * rb;
+            size_t used;
+            assert(!readframedrequest(buf, len, &rid, &opcode, &ra, &rb, &rcount, &used));
+            assert(rid == id && rcount == count && opcode == OP_SCAN && used == len);
+            assert((ra != NULL) == (a != NULL) && (rb != NULL) == (b != NULL));
+            if(a) { assert(!dataTuple::compare_obj(ra, a) && ra->datalen() == a->datalen()); }
+            if(b) { assert(!dataTuple::compare_obj(rb, b) && rb->datalen() == b->datalen()); }
+
+            // Truncated records are protocol errors.  Parsing a tuple in
+            // place overwrites its frame, so write a fresh copy each time.
+            std::vector<size_t> cuts = truncations(len);
+            for(size_t j = 0; j < cuts.size(); j++) {
+                writeframedrequest(buf, id, OP_SCAN, a, b, count);
+                assert(readframedrequest(buf, cuts[j], &rid, &opcode, &ra, &rb, &rcount, &used)
+                       == LOGSTORE_PROTOCOL_ERROR);
+            }
+            free(buf);
+        }
+    }
+    printf("Request records round trip, and truncated ones are rejected\n");
+    for(size_t i = 0; i < tuples.size(); i++) {
+        dataTuple::freetuple(tuples[i]);
+    }
+}
+
+void checkRequestLength()
+{
+    std::vector<dataTuple*> tuples = make_tuples();
+    for(size_t i = 0; i < tuples.size(); i++) {
+        dataTuple * t = tuples[i];
+        // OP_SCAN takes a count; OP_FIND does not.
+        network_op_t ops[] = { OP_FIND, OP_SCAN };
+        for(int j = 0; j < 2; j++) {
+            char * buf = NULL;
+            size_t len = 0;
+            FILE * mf = open_memstream(&buf, &len);
+            assert(!writeoptosocket(mf, ops[j]));
+            assert(!writetupletosocket(mf, t));
+            assert(!writetupletosocket(mf, (j ? t : NULL)));
+            if(opreadscount(ops[j])) { assert(!writecounttosocket(mf, 10)); }
+            fclose(mf);
+
+            assert(requestlength((byte*)buf, len) == len);
+            std::vector<size_t> cuts = truncations(len);
+            for(size_t k = 0; k < cuts.size(); k++) {
+                assert(requestlength((byte*)buf, cuts[k]) == 0);
+            }
+            free(buf);
+        }
+    }
+    byte junk = LOGSTORE_RESPONSE_SUCCESS;
+    assert(requestlength(&junk, 1) == 1);
+    printf("Request lengths are only reported for whole requests\n");
+    for(size_t i = 0; i < tuples.size(); i++) {
+        dataTuple::freetuple(tuples[i]);
+    }
+}
+
+/** @test
+ */
+int main()
+{
+    checkTupleRoundTrip();
+    checkRequestRoundTrip();
+    checkRequestLength();
+    printf("\npass\n");
+    return 0;
+}
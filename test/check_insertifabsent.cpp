@@ -0,0 +1,119 @@
+/*
+ * check_insertifabsent.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "bLSM.h"
+#include <assert.h>
+#include <stdio.h>
+
+#include "check_util.h"
+#include "check_table.h"
+
+static const int NUM_THREADS = 8;
+
+struct worker_arg {
+    bLSM * ltable;
+    std::vector<std::string> * key_arr;
+    int thread;
+    size_t inserted;
+};
+
+// Every thread tries to insert every key, each with its own value.
+static void * worker(void * argp) {
+    worker_arg * arg = (worker_arg*)argp;
+    std::vector<std::string> &key_arr = *arg->key_arr;
+    arg->inserted = 0;
+    for(size_t i = 0; i < key_arr.size(); i++) {
+        dataTuple * t = dataTuple::create(key_arr[i].c_str(), key_arr[i].length()+1, &arg->thread, sizeof(arg->thread));
+        if(arg->ltable->insertTupleIfAbsent(t)) { arg->inserted++; }
+        dataTuple::freetuple(t);
+    }
+    return 0;
+}
+
+void insertProbeIter(size_t NUM_ENTRIES)
+{
+    checkTable table;
+    bLSM * ltable = table.ltable;
+    table.start();
+
+    std::vector<std::string> key_arr;
+    preprandstr(NUM_ENTRIES, key_arr, 50, true);
+    std::sort(key_arr.begin(), key_arr.end(), &mycmp);
+    removeduplicates(key_arr);
+    NUM_ENTRIES = key_arr.size();
+
+    printf("Stage 1: %d threads race to insert the same %llu keys\n", NUM_THREADS, (unsigned long long)NUM_ENTRIES);
+    {
+        pthread_t threads[NUM_THREADS];
+        worker_arg args[NUM_THREADS];
+        for(int i = 0; i < NUM_THREADS; i++) {
+            args[i].ltable = ltable;
+            args[i].key_arr = &key_arr;
+            args[i].thread = i;
+            pthread_create(&threads[i], 0, worker, &args[i]);
+        }
+        size_t total = 0;
+        for(int i = 0; i < NUM_THREADS; i++) {
+            pthread_join(threads[i], 0);
+            total += args[i].inserted;
+        }
+        // Exactly one insert per key won.
+        assert(total == NUM_ENTRIES);
+    }
+
+    printf("Stage 2: Keys on disk are not inserted again\n");
+    table.flush();
+    for(size_t i = 0; i < NUM_ENTRIES; i++) {
+        dataTuple * t = dataTuple::create(key_arr[i].c_str(), key_arr[i].length()+1, "x", 2);
+        assert(!ltable->insertTupleIfAbsent(t));
+        dataTuple::freetuple(t);
+    }
+
+    printf("Stage 3: Deleted keys can be inserted\n");
+    for(size_t i = 0; i < NUM_ENTRIES; i += 2) {
+        dataTuple * t = dataTuple::create(key_arr[i].c_str(), key_arr[i].length()+1);
+        ltable->insertTuple(t);
+        dataTuple::freetuple(t);
+    }
+    table.flush();
+    for(size_t i = 0; i < NUM_ENTRIES; i++) {
+        dataTuple * t = dataTuple::create(key_arr[i].c_str(), key_arr[i].length()+1, "y", 2);
+        assert(ltable->insertTupleIfAbsent(t) == !(i % 2));
+        dataTuple::freetuple(t);
+    }
+    for(size_t i = 0; i < NUM_ENTRIES; i++) {
+        dataTuple * t = ltable->findTuple_first(-1, (dataTuple::key_t)key_arr[i].c_str(), key_arr[i].length()+1);
+        assert(t);
+        if(!(i % 2)) { assert(t->datalen() == 2 && !strcmp((char*)t->data(), "y")); }
+        else         { assert(t->datalen() == sizeof(int)); }
+        dataTuple::freetuple(t);
+    }
+
+    printf("\npass\n");
+}
+
+/** @test
+ */
+int main()
+{
+    insertProbeIter(20000);
+    return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * check_insertmany.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "bLSM.h"
+#include <assert.h>
+#include <stdio.h>
+
+#include "check_util.h"
+#include "check_table.h"
+
+static const int BATCH = 100;
+
+// Probe keys [0, n) in batches of BATCH, and check the answers against expected.
+static void check_probe(bLSM * ltable, std::vector<std::string> &key_arr, std::vector<bool> &expected) {
+    dataTuple * keys[BATCH];
+    bool exists[BATCH];
+    for(size_t i = 0; i < key_arr.size(); i += BATCH) {
+        int n = std::min((size_t)BATCH, key_arr.size() - i);
+        // Probe in reverse order; probeTuples sorts internally.
+        for(int j = 0; j < n; j++) {
+            keys[j] = dataTuple::create(key_arr[i+n-1-j].c_str(), key_arr[i+n-1-j].length()+1);
+        }
+        ltable->probeTuples(keys, n, exists);
+        for(int j = 0; j < n; j++) {
+            assert(exists[j] == expected[i+n-1-j]);
+            dataTuple::freetuple(keys[j]);
+        }
+    }
+}
+
+static const int NUM_THREADS = 4;
+
+struct worker_arg {
+    bLSM * ltable;
+    std::vector<std::vector<dataTuple*> > * batches;
+    std::vector<int> * wins;    // per batch
+    pthread_mutex_t * mut;
+};
+
+// Every thread tries to insert every batch.
+static void * worker(void * argp) {
+    worker_arg * arg = (worker_arg*)argp;
+    for(size_t i = 0; i < arg->batches->size(); i++) {
+        std::vector<dataTuple*> &batch = (*arg->batches)[i];
+        if(arg->ltable->insertManyTuplesIfAbsent(&batch[0], batch.size())) {
+            pthread_mutex_lock(arg->mut);
+            (*arg->wins)[i]++;
+            pthread_mutex_unlock(arg->mut);
+        }
+    }
+    return 0;
+}
+
+void insertProbeIter(size_t NUM_ENTRIES)
+{
+    checkTable table(1);
+    bLSM * ltable = table.ltable;
+    table.start();
+
+    std::vector<std::string> key_arr;
+    preprandstr(NUM_ENTRIES, key_arr, 50, true);
+    std::sort(key_arr.begin(), key_arr.end(), &mycmp);
+    removeduplicates(key_arr);
+    NUM_ENTRIES = key_arr.size();
+    std::vector<bool> expected(NUM_ENTRIES, false);
+
+    printf("Stage 1: Inserting every third key in batches of %d\n", BATCH);
+    {
+        std::vector<dataTuple*> batch;
+        for(size_t i = 0; i < NUM_ENTRIES; i += 3) {
+            batch.push_back(dataTuple::create(key_arr[i].c_str(), key_arr[i].length()+1, "v", 2));
+            expected[i] = true;
+            if(batch.size() == BATCH || i + 3 >= NUM_ENTRIES) {
+                ltable->insertManyTuples(&batch[0], batch.size());
+                for(size_t j = 0; j < batch.size(); j++) { dataTuple::freetuple(batch[j]); }
+                batch.clear();
+            }
+        }
+    }
+    check_probe(ltable, key_arr, expected);
+
+    printf("Stage 2: Probing after a flush\n");
+    table.flush();
+    check_probe(ltable, key_arr, expected);
+
+    printf("Stage 3: Deleted keys don't exist\n");
+    for(size_t i = 0; i < NUM_ENTRIES; i += 9) {
+        dataTuple * t = dataTuple::create(key_arr[i].c_str(), key_arr[i].length()+1);
+        ltable->insertTuple(t);
+        dataTuple::freetuple(t);
+        expected[i] = false;
+    }
+    check_probe(ltable, key_arr, expected);
+    table.flush();
+    check_probe(ltable, key_arr, expected);
+
+    printf("Stage 4: Batched inserts are visible to lookups\n");
+    for(size_t i = 0; i < NUM_ENTRIES; i++) {
+        dataTuple * t = ltable->findTuple(-1, (dataTuple::key_t)key_arr[i].c_str(), key_arr[i].length()+1);
+        assert((t && !t->isDelete()) == expected[i]);
+        if(t) { dataTuple::freetuple(t); }
+    }
+
+    printf("Stage 5: %d threads race to insert the same batches if they are absent\n", NUM_THREADS);
+    {
+        // Batches of absent keys; the last one also has a key that exists, so nobody can insert it.
+        std::vector<std::vector<dataTuple*> > batches(1);
+        std::vector<size_t> batch_of(NUM_ENTRIES, (size_t)-1);
+        for(size_t i = 0; i < NUM_ENTRIES; i++) {
+            if(expected[i]) { continue; }
+            if(batches.back().size() == BATCH) { batches.push_back(std::vector<dataTuple*>()); }
+            batches.back().push_back(dataTuple::create(key_arr[i].c_str(), key_arr[i].length()+1, "w", 2));
+            batch_of[i] = batches.size() - 1;
+        }
+        size_t present = std::find(expected.begin(), expected.end(), true) - expected.begin();
+        assert(present < NUM_ENTRIES);
+        batches.back().push_back(dataTuple::create(key_arr[present].c_str(), key_arr[present].length()+1, "w", 2));
+
+        std::vector<int> wins(batches.size(), 0);
+        pthread_mutex_t mut;
+        pthread_mutex_init(&mut, 0);
+        pthread_t threads[NUM_THREADS];
+        worker_arg arg = { ltable, &batches, &wins, &mut };
+        for(int i = 0; i < NUM_THREADS; i++) {
+            pthread_create(&threads[i], 0, worker, &arg);
+        }
+        for(int i = 0; i < NUM_THREADS; i++) {
+            pthread_join(threads[i], 0);
+        }
+        pthread_mutex_destroy(&mut);
+        for(size_t i = 0; i < batches.size(); i++) {
+            // Exactly one insert per batch won, except for the last batch.
+            assert(wins[i] == (i + 1 < batches.size() ? 1 : 0));
+            for(size_t j = 0; j < batches[i].size(); j++) { dataTuple::freetuple(batches[i][j]); }
+        }
+        for(size_t i = 0; i < NUM_ENTRIES; i++) {
+            dataTuple * t = ltable->findTuple(-1, (dataTuple::key_t)key_arr[i].c_str(), key_arr[i].length()+1);
+            if(expected[i]) {
+                assert(t && !strcmp((char*)t->data(), "v"));
+            } else if(batch_of[i] + 1 < batches.size()) {
+                assert(t && !strcmp((char*)t->data(), "w"));
+            } else {
+                // The batch with the present key was refused as a whole.
+                assert(!t || t->isDelete());
+            }
+            if(t) { dataTuple::freetuple(t); }
+        }
+    }
+
+    printf("\npass\n");
+}
+
+/** @test
+ */
+int main()
+{
+    insertProbeIter(50000);
+    return 0;
+}
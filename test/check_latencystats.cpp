@@ -0,0 +1,118 @@
+/*
+ * check_latencystats.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "latencyStats.h"
+#include <assert.h>
+#include <stdio.h>
+#include <pthread.h>
+
+void checkBuckets()
+{
+    // Every value falls in a bucket whose upper bound is within 1/SUB_BUCKETS of it.
+    for(uint64_t v = 0; v < 100000; v++) {
+        int b = latencyHistogram::bucket(v);
+        assert(b >= 0 && b < latencyHistogram::BUCKETS);
+        uint64_t hi = latencyHistogram::bucket_max(b);
+        assert(hi >= v);
+        assert(hi - v <= v / latencyHistogram::SUB_BUCKETS);
+        if(b) { assert(latencyHistogram::bucket_max(b-1) < v); }
+    }
+    assert(latencyHistogram::bucket(~0ull) == latencyHistogram::BUCKETS - 1);
+    assert(latencyHistogram::bucket_max(latencyHistogram::BUCKETS - 1) == ~0ull);
+}
+
+void checkPercentiles()
+{
+    latencyHistogram h;
+    assert(h.percentile(50) == 0);
+    for(uint64_t i = 1; i <= 10000; i++) {
+        h.record(i * 1000);
+    }
+    assert(h.count() == 10000);
+    assert(h.max() == 10000 * 1000);
+    uint64_t p50 = h.percentile(50);
+    uint64_t p99 = h.percentile(99);
+    uint64_t p999 = h.percentile(99.9);
+    assert(p50 >= 5000 * 1000 && p50 <= 5000 * 1000 * 17 / 16);
+    assert(p99 >= 9900 * 1000 && p99 <= 9900 * 1000 * 17 / 16);
+    assert(p999 >= 9990 * 1000 && p999 <= 10000 * 1000);
+    assert(h.percentile(100) == h.max());
+
+    latencyHistogram h2;
+    h2.record(50ull * 1000 * 1000 * 1000);
+    h2.merge(&h);
+    assert(h2.count() == 10001);
+    assert(h2.max() == 50ull * 1000 * 1000 * 1000);
+    assert(h2.percentile(50) == p50);
+}
+
+static latencyStats * stats;
+static const int RECORDS_PER_THREAD = 100000;
+
+void * worker(void * arg)
+{
+    for(int i = 0; i < RECORDS_PER_THREAD; i++) {
+        stats->record(latencyStats::FIND, 1000 + i % 1000);
+        if(!(i % 10)) { stats->record(latencyStats::INSERT, 2000); }
+    }
+    return 0;
+}
+
+void checkThreads()
+{
+    stats = new latencyStats();
+    static const int NUM_THREADS = 8;
+    pthread_t threads[NUM_THREADS];
+    for(int i = 0; i < NUM_THREADS; i++) {
+        pthread_create(&threads[i], 0, worker, 0);
+    }
+    // Readers can merge while the threads are still recording.
+    latencyHistogram h[latencyStats::NUM_OPS];
+    stats->merge(h);
+    assert(h[latencyStats::FIND].count() <= (uint64_t)NUM_THREADS * RECORDS_PER_THREAD);
+    for(int i = 0; i < NUM_THREADS; i++) {
+        pthread_join(threads[i], 0);
+    }
+    // The threads have exited, so their histograms have been retired.
+    stats->merge(h);
+    assert(h[latencyStats::FIND].count() == (uint64_t)NUM_THREADS * RECORDS_PER_THREAD);
+    assert(h[latencyStats::INSERT].count() == (uint64_t)NUM_THREADS * RECORDS_PER_THREAD / 10);
+    assert(h[latencyStats::SCAN].count() == 0);
+    assert(h[latencyStats::FIND].max() == 1999);
+
+    stats->record(latencyStats::BACKPRESSURE, 1000000);
+    latencyStats::summary_t s[latencyStats::NUM_OPS];
+    stats->summarize(s);
+    assert(s[latencyStats::BACKPRESSURE].count == 1);
+    assert(s[latencyStats::BACKPRESSURE].max == 1000000);
+    assert(s[latencyStats::INSERT].p99 >= 2000 && s[latencyStats::INSERT].p99 <= 2000 * 17 / 16);
+    assert(s[latencyStats::FIND].throughput > 0);
+    stats->pretty_print(stdout);
+    delete stats;
+}
+
+/** @test
+ */
+int main()
+{
+    checkBuckets();
+    checkPercentiles();
+    checkThreads();
+    printf("\npass\n");
+    return 0;
+}
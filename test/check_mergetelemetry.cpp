@@ -0,0 +1,168 @@
+/*
+ * check_mergetelemetry.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "mergeTelemetry.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+void checkEventLog()
+{
+    mergeEventLog log(16);
+    mergeEvent out[32];
+    assert(log.last_seq() == 0);
+    assert(log.read(0, out, 32) == 0);
+
+    for(int i = 0; i < 10; i++) {
+        log.record(i % 3, mergeEvent::SLEEP, i * 1000, i);
+    }
+    assert(log.last_seq() == 10);
+    size_t n = log.read(0, out, 32);
+    assert(n == 10);
+    for(size_t i = 0; i < n; i++) {
+        assert(out[i].seq == i + 1);
+        assert(out[i].merge_level == (int)(i % 3));
+        assert(out[i].type == mergeEvent::SLEEP);
+        assert(out[i].duration_ns == i * 1000);
+        assert(out[i].bytes == (int64_t)i);
+        if(i) { assert(out[i].timestamp_ns >= out[i-1].timestamp_ns); }
+    }
+    // Poll from the last event seen.
+    assert(log.read(7, out, 32) == 3);
+    assert(out[0].seq == 8);
+    assert(log.read(10, out, 32) == 0);
+    assert(log.read(0, out, 4) == 4 && out[3].seq == 4);
+
+    // Old events are overwritten once the ring is full.
+    for(int i = 10; i < 40; i++) {
+        log.record(1, mergeEvent::FINISH, 0, 0);
+    }
+    assert(log.last_seq() == 40);
+    n = log.read(0, out, 32);
+    assert(n == 16);
+    assert(out[0].seq == 25 && out[15].seq == 40);
+    assert(log.read(30, out, 32) == 10 && out[0].seq == 31);
+}
+
+void checkSleepCoalescing()
+{
+    mergeEventLog log(16);
+    mergeEvent out[16];
+
+    // A run of sleeps at one level takes up a single event.
+    for(int i = 1; i <= 100; i++) {
+        log.record(1, mergeEvent::SLEEP, 1000, i);
+    }
+    assert(log.last_seq() == 1);
+    assert(log.read(0, out, 16) == 1);
+    assert(out[0].type == mergeEvent::SLEEP && out[0].merge_level == 1);
+    assert(out[0].count == 100 && out[0].duration_ns == 100 * 1000 && out[0].bytes == 100);
+
+    // Once a reader has seen it, it is left alone, so pollers never miss a sleep.
+    log.record(1, mergeEvent::SLEEP, 1000, 0);
+    assert(log.read(1, out, 16) == 1 && out[0].seq == 2 && out[0].count == 1);
+    log.record(1, mergeEvent::SLEEP, 1000, 0);
+    assert(log.read(1, out, 16) == 2 && out[1].seq == 3);
+
+    // Sleeps at another level, and other events, end the run.
+    log.record(0, mergeEvent::SLEEP, 1000, 0);
+    log.record(1, mergeEvent::SLEEP, 1000, 0);
+    log.record(1, mergeEvent::START, 0, 0);
+    log.record(1, mergeEvent::SLEEP, 1000, 0);
+    log.record(1, mergeEvent::SLEEP, 1000, 0);
+    assert(log.read(3, out, 16) == 4);
+    assert(out[0].merge_level == 0 && out[1].merge_level == 1 && out[2].type == mergeEvent::START);
+    assert(out[3].type == mergeEvent::SLEEP && out[3].count == 2);
+    for(int i = 0; i < 3; i++) { assert(out[i].count == 1); }
+}
+
+static mergeEventLog * shared_log;
+static const int EVENTS_PER_THREAD = 10000;
+
+void * worker(void * arg)
+{
+    for(int i = 0; i < EVENTS_PER_THREAD; i++) {
+        shared_log->record((int)(intptr_t)arg, mergeEvent::START, 0, 0);
+    }
+    return 0;
+}
+
+void checkConcurrentRecord()
+{
+    static const int NUM_THREADS = 4;
+    shared_log = new mergeEventLog();
+    pthread_t threads[NUM_THREADS];
+    for(int i = 0; i < NUM_THREADS; i++) {
+        pthread_create(&threads[i], 0, worker, (void*)(intptr_t)i);
+    }
+    for(int i = 0; i < NUM_THREADS; i++) {
+        pthread_join(threads[i], 0);
+    }
+    assert(shared_log->last_seq() == (uint64_t)NUM_THREADS * EVENTS_PER_THREAD);
+    mergeEvent * out = new mergeEvent[mergeEventLog::DEFAULT_CAPACITY];
+    size_t n = shared_log->read(0, out, mergeEventLog::DEFAULT_CAPACITY);
+    assert(n == mergeEventLog::DEFAULT_CAPACITY);
+    for(size_t i = 1; i < n; i++) {
+        assert(out[i].seq == out[i-1].seq + 1);
+    }
+    delete[] out;
+    delete shared_log;
+}
+
+void checkMetrics()
+{
+    mergeSnapshot s;
+    memset(&s, 0, sizeof(s));
+    s.version = mergeSnapshot::VERSION;
+    s.components = mergeSnapshot::HAVE_C0 | mergeSnapshot::HAVE_C2;
+    s.r = 3.5;
+    for(int i = 0; i < 3; i++) {
+        s.level[i].merge_level = i;
+        s.level[i].target_size = 1000 * (i + 1);
+        s.level[i].lifetime_bytes_out_with_overhead = 5000 * i;
+    }
+    char * buf;
+    size_t len;
+    FILE * f = open_memstream(&buf, &len);
+    s.print_metrics(f);
+    fclose(f);
+    assert(strstr(buf, "blsm_merge_r 3.5"));
+    assert(strstr(buf, "blsm_tree_component_present{component=\"c0\"} 1\n"));
+    assert(strstr(buf, "blsm_tree_component_present{component=\"c1\"} 0\n"));
+    assert(strstr(buf, "blsm_tree_component_present{component=\"c2\"} 1\n"));
+    assert(strstr(buf, "blsm_merge_target_size_bytes{level=\"2\"} 3000\n"));
+    assert(strstr(buf, "blsm_merge_written_bytes_total{level=\"2\"} 10000\n"));
+    free(buf);
+
+    assert(!strcmp(mergeEvent::type_name(mergeEvent::HANDOFF), "handoff"));
+    assert(!strcmp(mergeEvent::type_name(mergeEvent::NUM_TYPES), "unknown"));
+}
+
+/** @test
+ */
+int main()
+{
+    checkEventLog();
+    checkSleepCoalescing();
+    checkConcurrentRecord();
+    checkMetrics();
+    printf("\npass\n");
+    return 0;
+}
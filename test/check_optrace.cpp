@@ -0,0 +1,150 @@
+/*
+ * check_optrace.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "opTrace.h"
+#include "latencyStats.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <vector>
+
+static opTrace * trace;
+// Enough records to fill several of each thread's buffers.
+static const int OPS_PER_THREAD = 20000;
+static const int NUM_THREADS = 4;
+
+static dataTuple * make_tuple(int thread, int i, bool tombstone) {
+    char key[32];
+    char val[64];
+    int keylen = snprintf(key, sizeof(key), "key-%d-%08d", thread, i) + 1;
+    int vallen = snprintf(val, sizeof(val), "value %d", i) + 1;
+    return tombstone ? dataTuple::create(key, keylen) : dataTuple::create(key, keylen, val, vallen);
+}
+
+// Each thread inserts (or deletes) a key, then looks it up.
+void * worker(void * arg)
+{
+    int thread = (int)(intptr_t)arg;
+    for(int i = 0; i < OPS_PER_THREAD; i++) {
+        dataTuple * t = make_tuple(thread, i, !(i % 10));
+        uint64_t start = latencyStats::now();
+        trace->record_op(opTrace::INSERT, start, true, t);
+        trace->record_op(opTrace::FIND, start, !t->isDelete(), t);
+        dataTuple::freetuple(t);
+    }
+    return 0;
+}
+
+void checkRoundTrip()
+{
+    trace = opTrace::open("optrace.bin");
+    assert(trace);
+    pthread_t threads[NUM_THREADS];
+    for(int i = 0; i < NUM_THREADS; i++) {
+        pthread_create(&threads[i], 0, worker, (void*)(intptr_t)i);
+    }
+    for(int i = 0; i < NUM_THREADS; i++) {
+        pthread_join(threads[i], 0);
+    }
+    // A scan with a start tuple bigger than a buffer, from this (still
+    // running) thread, so the trace has to collect a partial buffer at shutdown.
+    std::string big(opTrace::BUFFER_SIZE, 'v');
+    dataTuple * lo = dataTuple::create("aaa", 4, big.c_str(), big.size());
+    dataTuple * hi = dataTuple::create("zzz", 4);
+    trace->record_op(opTrace::SCAN, latencyStats::now(), true, lo, hi, 100);
+    assert(trace->get_dropped() == 0);
+    delete trace;
+
+    opTraceReader * r = opTraceReader::open("optrace.bin");
+    assert(r);
+    std::vector<uint64_t> next_seq(NUM_THREADS + 1, 0);
+    std::vector<uint32_t> thread_of_worker(NUM_THREADS, (uint32_t)-1);
+    int scans = 0;
+    uint64_t records = 0;
+    opTrace::record rec;
+    dataTuple * t, * t2;
+    while(r->next(&rec, &t, &t2)) {
+        records++;
+        assert(rec.thread <= NUM_THREADS);
+        // Within a thread, records come out in the order they were recorded.
+        assert(rec.seq == next_seq[rec.thread]++);
+        if(rec.op == opTrace::SCAN) {
+            scans++;
+            assert(rec.tuples == 2 && rec.count == 100);
+            assert(!dataTuple::compare_obj(t, lo) && !dataTuple::compare_obj(t2, hi));
+            assert(t->datalen() == big.size() && t2->isDelete());
+        } else {
+            assert(rec.tuples == 1 && t && !t2);
+            int thread, i;
+            assert(sscanf((const char*)t->rawkey(), "key-%d-%d", &thread, &i) == 2);
+            assert(thread_of_worker[thread] == (uint32_t)-1 || thread_of_worker[thread] == rec.thread);
+            thread_of_worker[thread] = rec.thread;
+            assert(i == (int)(rec.seq / 2));
+            assert(rec.op == ((rec.seq % 2) ? opTrace::FIND : opTrace::INSERT));
+            assert(t->isDelete() == !(i % 10));
+            if(rec.op == opTrace::FIND) {
+                assert(rec.result == !t->isDelete());
+            } else {
+                dataTuple * expected = make_tuple(thread, i, !(i % 10));
+                assert(t->datalen() == expected->datalen());
+                assert(!memcmp(t->data(), expected->data(), t->datalen()));
+                dataTuple::freetuple(expected);
+            }
+        }
+        dataTuple::freetuple(t);
+        if(t2) { dataTuple::freetuple(t2); }
+    }
+    assert(r->error() == 0);
+    assert(scans == 1);
+    assert(records == 2 * (uint64_t)NUM_THREADS * OPS_PER_THREAD + 1);
+    delete r;
+    dataTuple::freetuple(lo);
+    dataTuple::freetuple(hi);
+
+    // A file that ends in the middle of a record reads back up to that record.
+    FILE * f = fopen("optrace.bin", "r+");
+    assert(f);
+    fseek(f, 0, SEEK_END);
+    assert(!ftruncate(fileno(f), ftell(f) - 1));
+    fclose(f);
+    r = opTraceReader::open("optrace.bin");
+    assert(r);
+    records = 0;
+    while(r->next(&rec, &t, &t2)) {
+        records++;
+        dataTuple::freetuple(t);
+        if(t2) { dataTuple::freetuple(t2); }
+    }
+    assert(r->error() == EIO);
+    assert(records == 2 * (uint64_t)NUM_THREADS * OPS_PER_THREAD);
+    delete r;
+
+    assert(!opTraceReader::open("no-such-trace.bin"));
+    unlink("optrace.bin");
+}
+
+/** @test
+ */
+int main()
+{
+    checkRoundTrip();
+    printf("\npass\n");
+    return 0;
+}
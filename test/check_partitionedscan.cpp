@@ -0,0 +1,117 @@
+/*
+ * check_partitionedscan.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "bLSM.h"
+#include "partitionedScan.h"
+#include <assert.h>
+#include <stdio.h>
+
+#include "check_util.h"
+#include "check_table.h"
+
+#define NUM_PARTITIONS 8
+
+struct scan_state {
+    pthread_mutex_t mut;
+    size_t count[NUM_PARTITIONS];
+    dataTuple * last[NUM_PARTITIONS];
+    partitionedScan * scan;
+};
+
+static int count_tuple(void * arg, int partition, dataTuple * t) {
+    scan_state * s = (scan_state*)arg;
+    // Tuples arrive in order, and stay within their partition.
+    if(s->last[partition]) {
+        assert(dataTuple::compare_obj(s->last[partition], t) < 0);
+        dataTuple::freetuple(s->last[partition]);
+    } else if(s->scan->get_start_key(partition)) {
+        assert(dataTuple::compare_obj(s->scan->get_start_key(partition), t) <= 0);
+    }
+    if(s->scan->get_end_key(partition)) {
+        assert(dataTuple::compare_obj(t, s->scan->get_end_key(partition)) < 0);
+    }
+    s->last[partition] = t->create_copy();
+    s->count[partition]++;
+    return 0;
+}
+
+void insertProbeIter(size_t NUM_ENTRIES)
+{
+    checkTable table;
+    bLSM * ltable = table.ltable;
+    table.start();
+
+    std::vector<std::string> key_arr;
+    preprandstr(NUM_ENTRIES, key_arr, 50, true);
+    std::sort(key_arr.begin(), key_arr.end(), &mycmp);
+    removeduplicates(key_arr);
+    NUM_ENTRIES = key_arr.size();
+
+    printf("Stage 1: Writing %llu keys\n", (unsigned long long)NUM_ENTRIES);
+    // Write the first half, and push it to disk, so that the second half is
+    // split between disk and C0.
+    for(size_t i = 0; i < NUM_ENTRIES; i++) {
+        if(i == NUM_ENTRIES / 2) { table.flush(); }
+        dataTuple * t = dataTuple::create(key_arr[i].c_str(), key_arr[i].length()+1, key_arr[i].c_str(), key_arr[i].length()+1);
+        ltable->insertTuple(t);
+        dataTuple::freetuple(t);
+    }
+
+    printf("Stage 2: Partitioned scan\n");
+    scan_state s;
+    memset(&s, 0, sizeof(s));
+    s.scan = new partitionedScan(ltable, NUM_PARTITIONS);
+    assert(s.scan->get_partition_count() > 1);
+    assert(s.scan->get_partition_count() <= NUM_PARTITIONS);
+    assert(!s.scan->run(count_tuple, &s));
+
+    size_t total = 0;
+    for(int i = 0; i < s.scan->get_partition_count(); i++) {
+        printf("partition %d: %llu tuples\n", i, (unsigned long long)s.count[i]);
+        // Both halves of the data were sampled, so no partition should be empty.
+        assert(s.count[i]);
+        total += s.count[i];
+        if(s.last[i]) { dataTuple::freetuple(s.last[i]); }
+    }
+    assert(total == NUM_ENTRIES);
+    delete s.scan;
+
+    printf("Stage 3: Single partition\n");
+    partitionedScan * one = new partitionedScan(ltable, 1);
+    assert(one->get_partition_count() == 1);
+    partitionedScan::iterator * it = one->open_iterator(0);
+    dataTuple * t;
+    total = 0;
+    while((t = it->getnext())) { total++; dataTuple::freetuple(t); }
+    delete it;
+    delete one;
+    assert(total == NUM_ENTRIES);
+
+    printf("\npass\n");
+}
+
+/** @test
+ */
+int main()
+{
+    insertProbeIter(100000);
+    return 0;
+}
@@ -0,0 +1,174 @@
+/*
+ * check_pipeline.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <map>
+#include <string>
+#include "bLSM.h"
+#include <assert.h>
+#include <stdio.h>
+
+#include "check_table.h"
+#include "check_server.h"
+
+static const int NUM_KEYS = 500;
+
+static dataTuple * make_key(int i) {
+    char key[32];
+    return dataTuple::create(key, snprintf(key, sizeof(key), "key-%06d", i) + 1);
+}
+static std::string make_value(int i) {
+    char val[32];
+    snprintf(val, sizeof(val), "value %d", i);
+    return val;
+}
+// Ids that don't follow the order in which the requests are sent.
+static uint64_t make_id(int phase, int i) {
+    return ((uint64_t)phase << 48) | ((uint64_t)(NUM_KEYS - i) << 16) | (uint64_t)i;
+}
+
+static void send_request(int sockd, uint64_t id, network_op_t op, dataTuple * t, uint64_t count = 0) {
+    assert(!writetosocket(sockd, &id, sizeof(id)));
+    assert(!writetosocket(sockd, &op, sizeof(op)));
+    assert(!writetupletosocket(sockd, t));
+    assert(!writetupletosocket(sockd, NULL));
+    if(opreadscount(op)) { assert(!writecounttosocket(sockd, count)); }
+}
+static network_op_t recv_response(int sockd, uint64_t * id, dataTuple *** tuples, size_t * tuple_count) {
+    uint64_t len;
+    assert(!readfromsocket(sockd, id, sizeof(*id)));
+    assert(!readfromsocket(sockd, &len, sizeof(len)));
+    byte * buf = (byte*) malloc(len);
+    assert(!readfromsocket(sockd, buf, len));
+    network_op_t rcode = readresponsefrombuffer(buf, len, tuples, tuple_count);
+    free(buf);
+    return rcode;
+}
+static void free_tuples(dataTuple ** tuples, size_t tuple_count) {
+    for(size_t i = 0; i < tuple_count; i++) {
+        dataTuple::freetuple(tuples[i]);
+    }
+    free(tuples);
+}
+
+void checkPipeline()
+{
+    checkTable table;
+    bLSM * ltable = table.ltable;
+    table.start();
+    checkServer server(ltable);
+    int sockd = server.client;
+
+    assert(!writeoptosocket(sockd, OP_PIPELINE));
+    assert(!writetupletosocket(sockd, NULL));
+    assert(!writetupletosocket(sockd, NULL));
+    assert(readopfromsocket(sockd, LOGSTORE_SERVER_RESPONSE) == LOGSTORE_RESPONSE_SUCCESS);
+
+    // Stage 1: insert the even keys.  The workers answer in whatever order
+    // they finish, so match the responses up by id.
+    std::map<uint64_t, int> outstanding;
+    for(int i = 0; i < NUM_KEYS; i += 2) {
+        dataTuple * k = make_key(i);
+        std::string v = make_value(i);
+        dataTuple * t = dataTuple::create(k->rawkey(), k->rawkeylen(), v.c_str(), v.size() + 1);
+        send_request(sockd, make_id(1, i), OP_INSERT, t);
+        outstanding[make_id(1, i)] = i;
+        dataTuple::freetuple(t);
+        dataTuple::freetuple(k);
+    }
+    while(!outstanding.empty()) {
+        uint64_t id;
+        dataTuple ** tuples;
+        size_t tuple_count;
+        assert(recv_response(sockd, &id, &tuples, &tuple_count) == LOGSTORE_RESPONSE_SUCCESS);
+        assert(outstanding.erase(id) == 1);  // each request is answered once.
+        assert(!tuples);
+    }
+    printf("Stage 1: pipelined inserts answered\n");
+
+    // Stage 2: look up every key, and throw in some requests that get
+    // other kinds of responses.
+    for(int i = 0; i < NUM_KEYS; i++) {
+        dataTuple * k = make_key(i);
+        send_request(sockd, make_id(2, i), OP_FIND, k);
+        outstanding[make_id(2, i)] = i;
+        dataTuple::freetuple(k);
+    }
+    const uint64_t scan_id = make_id(3, 0);
+    const uint64_t bulk_id = make_id(3, 1);
+    dataTuple * first = make_key(0);
+    send_request(sockd, scan_id, OP_SCAN, first, 10);
+    send_request(sockd, bulk_id, OP_BULK_INSERT, NULL);
+    dataTuple::freetuple(first);
+
+    bool got_scan = false, got_bulk = false;
+    while(!outstanding.empty() || !got_scan || !got_bulk) {
+        uint64_t id;
+        dataTuple ** tuples;
+        size_t tuple_count;
+        network_op_t rcode = recv_response(sockd, &id, &tuples, &tuple_count);
+        if(id == scan_id) {
+            assert(!got_scan);
+            got_scan = true;
+            assert(rcode == LOGSTORE_RESPONSE_SENDING_TUPLES);
+            assert(tuple_count == 10);
+            for(size_t j = 0; j < tuple_count; j++) {
+                dataTuple * k = make_key(2 * j);
+                assert(!dataTuple::compare_obj(tuples[j], k));
+                dataTuple::freetuple(k);
+            }
+        } else if(id == bulk_id) {
+            // Bulk inserts would take over the connection, so they are refused.
+            assert(!got_bulk);
+            got_bulk = true;
+            assert(rcode == LOGSTORE_UNIMPLEMENTED_ERROR);
+        } else {
+            std::map<uint64_t, int>::iterator it = outstanding.find(id);
+            assert(it != outstanding.end());
+            int i = it->second;
+            outstanding.erase(it);
+            assert(rcode == LOGSTORE_RESPONSE_SENDING_TUPLES);
+            assert(tuple_count == 1);
+            dataTuple * k = make_key(i);
+            assert(!dataTuple::compare_obj(tuples[0], k));
+            dataTuple::freetuple(k);
+            if(i % 2) {
+                assert(tuples[0]->isDelete());
+            } else {
+                assert(!tuples[0]->isDelete());
+                assert(make_value(i) == (const char*)tuples[0]->data());
+            }
+        }
+        free_tuples(tuples, tuple_count);
+    }
+    printf("Stage 2: pipelined lookups matched their ids\n");
+
+    // Stage 3: OP_DONE ends the connection once everything has been answered.
+    send_request(sockd, 0, OP_DONE, NULL);
+    uint64_t id;
+    assert(readfromsocket(sockd, &id, sizeof(id)) == EOF);
+    printf("Stage 3: OP_DONE closed the connection\n");
+}
+
+/** @test
+ */
+int main()
+{
+    checkPipeline();
+    printf("\npass\n");
+    return 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * check_prefixscan.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "bLSM.h"
+#include <assert.h>
+#include <stdio.h>
+
+#include "check_util.h"
+#include "check_table.h"
+
+static const int NUM_PREFIXES = 10;
+
+// Keys are a four byte prefix ("p000", "p002", ...) followed by a random string.
+static std::string make_prefix(int p) {
+    char buf[5];
+    snprintf(buf, sizeof(buf), "p%03d", p);
+    return std::string(buf);
+}
+
+// Scan prefix p, and check that we see exactly the keys in key_arr that start with it.
+static void check_prefix(bLSM * ltable, std::vector<std::string> &key_arr, int p) {
+    std::string prefix = make_prefix(p);
+    bLSM::iterator * it = new bLSM::iterator(ltable, NULL, (const byte*)prefix.c_str(), prefix.length());
+    std::vector<std::string>::iterator expected = std::lower_bound(key_arr.begin(), key_arr.end(), prefix);
+    dataTuple * t;
+    while((t = it->getnext())) {
+        assert(expected != key_arr.end());
+        assert(!strcmp((char*)t->strippedkey(), expected->c_str()));
+        dataTuple::freetuple(t);
+        ++expected;
+    }
+    assert(expected == key_arr.end() || expected->compare(0, prefix.length(), prefix));
+    delete it;
+}
+
+void insertProbeIter(size_t NUM_ENTRIES)
+{
+    checkTable table;
+    bLSM * ltable = table.ltable;
+    ltable->set_prefix_extractor(new prefixExtractor(4));
+    table.start();
+
+    std::vector<std::string> suffixes;
+    preprandstr(NUM_ENTRIES, suffixes, 50, true);
+
+    // Only even prefixes get keys, so the odd ones must come back empty.
+    std::vector<std::string> key_arr;
+    for(size_t i = 0; i < suffixes.size(); i++) {
+        key_arr.push_back(make_prefix(2 * (i % (NUM_PREFIXES / 2))) + suffixes[i]);
+    }
+    std::sort(key_arr.begin(), key_arr.end(), &mycmp);
+    removeduplicates(key_arr);
+    NUM_ENTRIES = key_arr.size();
+
+    printf("Stage 1: Writing %llu keys\n", (unsigned long long)NUM_ENTRIES);
+    for(size_t i = 0; i < NUM_ENTRIES; i++) {
+        dataTuple * t = dataTuple::create(key_arr[i].c_str(), key_arr[i].length()+1, "v", 2);
+        ltable->insertTuple(t);
+        dataTuple::freetuple(t);
+    }
+
+    printf("Stage 2: Prefix scans of C0\n");
+    for(int p = 0; p < NUM_PREFIXES; p++) {
+        check_prefix(ltable, key_arr, p);
+    }
+
+    printf("Stage 3: Prefix scans of the disk trees\n");
+    table.flush();
+    for(int p = 0; p < NUM_PREFIXES; p++) {
+        check_prefix(ltable, key_arr, p);
+    }
+
+    printf("Stage 4: Prefix bloom filters\n");
+    {
+        rwlc_readlock(ltable->header_mut);
+        diskTreeComponent * c1 = ltable->get_tree_c1();
+        assert(c1);
+        for(int p = 0; p < NUM_PREFIXES; p++) {
+            std::string prefix = make_prefix(p);
+            bool present = c1->may_contain_prefix((const byte*)prefix.c_str(), prefix.length());
+            // Bloom filters don't have false negatives; with this few prefixes, a false positive means a bug.
+            assert(present == !(p % 2));
+        }
+        // Anything that isn't a complete prefix can't be ruled out.
+        assert(c1->may_contain_prefix((const byte*)"p0", 2));
+        rwlc_unlock(ltable->header_mut);
+    }
+
+    printf("Stage 5: Prefix scans starting mid-prefix, and bounded scans\n");
+    {
+        size_t mid = NUM_ENTRIES / 2;
+        std::string prefix = key_arr[mid].substr(0, 4);
+        dataTuple * key = dataTuple::create(key_arr[mid].c_str(), key_arr[mid].length()+1);
+        bLSM::iterator * it = new bLSM::iterator(ltable, key, (const byte*)prefix.c_str(), prefix.length());
+        size_t i = mid;
+        dataTuple * t;
+        while((t = it->getnext())) {
+            assert(!strcmp((char*)t->strippedkey(), key_arr[i].c_str()));
+            dataTuple::freetuple(t);
+            i++;
+        }
+        assert(i == NUM_ENTRIES || key_arr[i].compare(0, 4, prefix));
+        delete it;
+
+        size_t hi = mid + NUM_ENTRIES / 10;
+        dataTuple * upper = dataTuple::create(key_arr[hi].c_str(), key_arr[hi].length()+1);
+        it = new bLSM::iterator(ltable, key, upper);
+        i = mid;
+        while((t = it->getnext())) {
+            assert(!strcmp((char*)t->strippedkey(), key_arr[i].c_str()));
+            dataTuple::freetuple(t);
+            i++;
+        }
+        assert(i == hi);
+        delete it;
+        dataTuple::freetuple(upper);
+        dataTuple::freetuple(key);
+    }
+
+    printf("\npass\n");
+}
+
+/** @test
+ */
+int main()
+{
+    insertProbeIter(50000);
+    return 0;
+}
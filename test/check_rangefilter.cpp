@@ -0,0 +1,125 @@
+/*
+ * check_rangefilter.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "bLSM.h"
+#include "rangeFilter.h"
+#include <assert.h>
+#include <stdio.h>
+
+#include "check_util.h"
+#include "check_table.h"
+
+// Compare the filter against the truth for random ranges; it must never rule out a range that has a key in it.
+static void checkFilter(std::vector<std::string> &key_arr, size_t max_bytes) {
+    rangeFilter f(max_bytes);
+    for(size_t i = 0; i < key_arr.size(); i++) {
+        f.insert((const byte*)key_arr[i].c_str(), key_arr[i].length()+1);
+    }
+    f.done();
+    assert(f.memory_usage() <= max_bytes || f.get_trunc_len() == 1);
+
+    std::vector<std::string> probes;
+    preprandstr(2000, probes, 50, true);
+    size_t empty = 0, false_positives = 0;
+    for(size_t i = 0; i + 1 < probes.size(); i += 2) {
+        std::string lo = probes[i], hi = probes[i+1];
+        if(hi < lo) { std::swap(lo, hi); }
+        std::vector<std::string>::iterator it = std::lower_bound(key_arr.begin(), key_arr.end(), lo);
+        bool truth = it != key_arr.end() && *it < hi;
+        bool ans = f.may_contain((const byte*)lo.c_str(), lo.length()+1, (const byte*)hi.c_str(), hi.length()+1);
+        assert(ans || !truth);
+        if(!truth) { empty++; if(ans) { false_positives++; } }
+    }
+    printf("%lld byte budget: %lld prefixes of %lld bytes; %lld of %lld empty ranges passed\n",
+           (long long)max_bytes, (long long)f.get_entry_count(), (long long)f.get_trunc_len(),
+           (long long)false_positives, (long long)empty);
+
+    // Ranges entirely outside of the keys are always ruled out.
+    std::string before = key_arr.front().substr(0, 1);
+    assert(!f.may_contain(NULL, 0, (const byte*)before.c_str(), before.length()));
+    std::string after = key_arr.back() + "~";
+    assert(!f.may_contain((const byte*)after.c_str(), after.length()+1, NULL, 0));
+    assert(f.may_contain(NULL, 0, NULL, 0));
+}
+
+void insertProbeIter(size_t NUM_ENTRIES)
+{
+    std::vector<std::string> key_arr;
+    preprandstr(NUM_ENTRIES, key_arr, 50, true);
+    std::sort(key_arr.begin(), key_arr.end(), &mycmp);
+    removeduplicates(key_arr);
+    NUM_ENTRIES = key_arr.size();
+
+    printf("Stage 1: Filters on their own\n");
+    checkFilter(key_arr, 1024);
+    checkFilter(key_arr, 64 * 1024);
+    checkFilter(key_arr, 16 * 1024 * 1024);
+
+    printf("Stage 2: Bounded scans over components with range filters\n");
+    checkTable table;
+    bLSM * ltable = table.ltable;
+    ltable->range_filters = true;
+    table.start();
+
+    // The first half of the keys go to disk; the second half stay in C0.
+    for(size_t i = 0; i < NUM_ENTRIES; i++) {
+        if(i == NUM_ENTRIES / 2) { table.flush(); }
+        dataTuple * t = dataTuple::create(key_arr[i].c_str(), key_arr[i].length()+1, "v", 2);
+        ltable->insertTuple(t);
+        dataTuple::freetuple(t);
+    }
+    {
+        rwlc_readlock(ltable->header_mut);
+        diskTreeComponent * c1 = ltable->get_tree_c1();
+        assert(c1 && c1->range_filter);
+        dataTuple * lo = dataTuple::create(key_arr[NUM_ENTRIES / 2].c_str(), key_arr[NUM_ENTRIES / 2].length()+1);
+        assert(!c1->may_contain_range(lo, NULL));
+        dataTuple::freetuple(lo);
+        rwlc_unlock(ltable->header_mut);
+    }
+    for(size_t i = 0; i < NUM_ENTRIES; i += NUM_ENTRIES / 13) {
+        size_t hi = std::min(NUM_ENTRIES - 1, i + NUM_ENTRIES / 7);
+        dataTuple * lo_key = dataTuple::create(key_arr[i].c_str(), key_arr[i].length()+1);
+        dataTuple * hi_key = dataTuple::create(key_arr[hi].c_str(), key_arr[hi].length()+1);
+        bLSM::iterator * it = new bLSM::iterator(ltable, lo_key, hi_key);
+        size_t j = i;
+        dataTuple * t;
+        while((t = it->getnext())) {
+            assert(!strcmp((char*)t->strippedkey(), key_arr[j].c_str()));
+            dataTuple::freetuple(t);
+            j++;
+        }
+        assert(j == hi);
+        delete it;
+        dataTuple::freetuple(lo_key);
+        dataTuple::freetuple(hi_key);
+    }
+
+    printf("\npass\n");
+}
+
+/** @test
+ */
+int main()
+{
+    insertProbeIter(50000);
+    return 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * check_readstats.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "readStats.h"
+#include <assert.h>
+#include <stdio.h>
+#include <pthread.h>
+
+static readStats * stats;
+static const int LOOKUPS_PER_THREAD = 10000;
+
+// A lookup that misses C0, is rejected by C1's bloom filter, and finds the key in C2.
+void * worker(void * arg)
+{
+    for(int i = 0; i < LOOKUPS_PER_THREAD; i++) {
+        readStats::lookup_t l;
+        l.c[readStats::C0].probes++;
+        l.c[readStats::C1].probes++;
+        l.c[readStats::C1].bloom_negatives++;
+        l.c[readStats::C2].probes++;
+        l.c[readStats::C2].datapages_read++;
+        l.c[readStats::C2].tuples_decoded += 3;
+        l.c[readStats::C2].hits++;
+        stats->record(&l);
+        if(!(i % 4)) { stats->record_row_cache_hit(); }
+    }
+    return 0;
+}
+
+void checkThreads()
+{
+    static const int NUM_THREADS = 4;
+    stats = new readStats();
+    pthread_t threads[NUM_THREADS];
+    for(int i = 0; i < NUM_THREADS; i++) {
+        pthread_create(&threads[i], 0, worker, 0);
+    }
+    for(int i = 0; i < NUM_THREADS; i++) {
+        pthread_join(threads[i], 0);
+    }
+    // One lookup that passes C1's bloom filter for nothing, on this (still running) thread.
+    readStats::lookup_t l;
+    l.c[readStats::C0].probes++;
+    l.c[readStats::C1].probes++;
+    l.c[readStats::C1].datapages_read++;
+    l.c[readStats::C1].tuples_decoded += 10;
+    l.c[readStats::C1].bloom_false_positives++;
+    l.c[readStats::C2].probes++;
+    l.c[readStats::C2].bloom_negatives++;
+    stats->record(&l);
+
+    readStats::summary_t s;
+    stats->summarize(&s);
+    uint64_t n = (uint64_t)NUM_THREADS * LOOKUPS_PER_THREAD;
+    assert(s.lookups == n + 1);
+    assert(s.row_cache_hits == n / 4);
+    assert(s.c[readStats::C0].probes == n + 1);
+    assert(s.c[readStats::C0].hits == 0);
+    assert(s.c[readStats::C0_MERGEABLE].probes == 0);
+    assert(s.c[readStats::C1].bloom_negatives == n);
+    assert(s.c[readStats::C1].bloom_false_positives == 1);
+    assert(s.c[readStats::C1].tuples_decoded == 10);
+    assert(s.c[readStats::C2].hits == n);
+    assert(s.c[readStats::C2].datapages_read == n);
+    assert(s.c[readStats::C2].tuples_decoded == 3 * n);
+    assert(s.c[readStats::C2].bloom_negatives == 1);
+    assert(s.components_per_lookup[3] == n + 1);
+    assert(s.components_per_lookup[2] == 0);
+    assert(s.datapages_per_lookup[1] == n + 1);
+    assert(s.datapages_per_lookup[0] == 0);
+
+    readStats::pretty_print(stdout, &s);
+    delete stats;
+}
+
+/** @test
+ */
+int main()
+{
+    checkThreads();
+    printf("\npass\n");
+    return 0;
+}
@@ -0,0 +1,111 @@
+/*
+ * check_reversescan.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "bLSM.h"
+#include <assert.h>
+#include <stdio.h>
+
+#include "check_util.h"
+#include "check_table.h"
+
+// Scan backwards from key (or the end of the table), and check that we see key_arr[last], key_arr[last-1], ..., key_arr[0].
+static void check_reverse(bLSM * ltable, std::vector<std::string> &key_arr, dataTuple * key, ssize_t last) {
+    bLSM::iterator * it = new bLSM::iterator(ltable, key, bLSM::iterator::REVERSE);
+    dataTuple * t;
+    ssize_t i = last;
+    while((t = it->getnext())) {
+        assert(i >= 0);
+        assert(!strcmp((char*)t->strippedkey(), key_arr[i].c_str()));
+        dataTuple::freetuple(t);
+        i--;
+    }
+    assert(i == -1);
+    delete it;
+}
+
+void insertProbeIter(size_t NUM_ENTRIES)
+{
+    checkTable table;
+    bLSM * ltable = table.ltable;
+    table.start();
+
+    std::vector<std::string> key_arr;
+    preprandstr(NUM_ENTRIES, key_arr, 50, true);
+    std::sort(key_arr.begin(), key_arr.end(), &mycmp);
+    removeduplicates(key_arr);
+    NUM_ENTRIES = key_arr.size();
+
+    // Insert every other key, push them to disk, then insert the rest, so
+    // that the reverse merge has to interleave C0 and the disk trees.
+    printf("Stage 1: Writing %llu keys\n", (unsigned long long)NUM_ENTRIES);
+    for(int pass = 0; pass < 2; pass++) {
+        for(size_t i = pass; i < NUM_ENTRIES; i += 2) {
+            dataTuple * t = dataTuple::create(key_arr[i].c_str(), key_arr[i].length()+1, "v", 2);
+            ltable->insertTuple(t);
+            dataTuple::freetuple(t);
+        }
+        if(!pass) { table.flush(); }
+    }
+    // Delete the last key; the reverse scan should skip the tombstone.
+    {
+        dataTuple * t = dataTuple::create(key_arr.back().c_str(), key_arr.back().length()+1);
+        ltable->insertTuple(t);
+        dataTuple::freetuple(t);
+        key_arr.pop_back();
+        NUM_ENTRIES--;
+    }
+
+    printf("Stage 2: Reverse scan of the whole table\n");
+    check_reverse(ltable, key_arr, NULL, NUM_ENTRIES - 1);
+
+    printf("Stage 3: Reverse scans from keys in the table\n");
+    for(size_t i = 0; i < NUM_ENTRIES; i += NUM_ENTRIES / 7) {
+        dataTuple * key = dataTuple::create(key_arr[i].c_str(), key_arr[i].length()+1);
+        check_reverse(ltable, key_arr, key, i);
+        dataTuple::freetuple(key);
+    }
+
+    printf("Stage 4: Reverse scans from keys between table entries\n");
+    {
+        // "" sorts before everything in the table; a key with a trailing byte sorts just after key_arr[i].
+        dataTuple * key = dataTuple::create("", 1);
+        check_reverse(ltable, key_arr, key, -1);
+        dataTuple::freetuple(key);
+        std::string k = key_arr[NUM_ENTRIES / 2] + "!";
+        key = dataTuple::create(k.c_str(), k.length()+1);
+        check_reverse(ltable, key_arr, key, NUM_ENTRIES / 2);
+        dataTuple::freetuple(key);
+    }
+
+    printf("Stage 5: Reverse scan after another flush\n");
+    table.flush();
+    check_reverse(ltable, key_arr, NULL, NUM_ENTRIES - 1);
+
+    printf("\npass\n");
+}
+
+/** @test
+ */
+int main()
+{
+    insertProbeIter(50000);
+    return 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * check_rowcache.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "bLSM.h"
+#include "rowCache.h"
+#include "mergeScheduler.h"
+#include <assert.h>
+#include <stdio.h>
+
+#include <stasis/transactional.h>
+#undef begin
+#undef end
+
+#include "check_util.h"
+
+void checkCache()
+{
+    rowCache cache(1024 * 1024);
+    const char * k = "key";
+    dataTuple * ret;
+    uint64_t version, version2;
+
+    // miss, fill, hit.
+    assert(!cache.lookup((const byte*)k, strlen(k)+1, &ret, &version));
+    dataTuple * t = dataTuple::create(k, strlen(k)+1, "val", 4);
+    cache.fill((const byte*)k, strlen(k)+1, t, version);
+    assert(cache.lookup((const byte*)k, strlen(k)+1, &ret, &version));
+    assert(ret && ret->datalen() == 4 && !memcmp(ret->data(), "val", 4));
+    dataTuple::freetuple(ret);
+
+    // invalidation drops the entry.
+    cache.invalidate((const byte*)k, strlen(k)+1);
+    assert(!cache.lookup((const byte*)k, strlen(k)+1, &ret, &version));
+
+    // a fill that raced with a write is ignored.
+    assert(!cache.lookup((const byte*)k, strlen(k)+1, &ret, &version2));
+    cache.invalidate((const byte*)k, strlen(k)+1);
+    cache.fill((const byte*)k, strlen(k)+1, t, version2);
+    assert(!cache.lookup((const byte*)k, strlen(k)+1, &ret, &version));
+
+    // negative entries.
+    cache.fill((const byte*)k, strlen(k)+1, NULL, version);
+    assert(cache.lookup((const byte*)k, strlen(k)+1, &ret, &version));
+    assert(ret == NULL);
+
+    dataTuple::freetuple(t);
+
+    rowCache::stats_t s;
+    cache.get_stats(&s);
+    assert(s.hits == 2);
+    assert(s.misses == 4);
+    assert(s.entries == 1);
+
+    char * buf;
+    size_t len;
+    FILE * f = open_memstream(&buf, &len);
+    cache.print_metrics(f);
+    fclose(f);
+    assert(strstr(buf, "blsm_row_cache_hits_total 2\n"));
+    assert(strstr(buf, "blsm_row_cache_misses_total 4\n"));
+    assert(strstr(buf, "blsm_row_cache_entries 1\n"));
+    free(buf);
+}
+
+void insertProbe(size_t NUM_ENTRIES)
+{
+    unlink("storefile.txt");
+    unlink("logfile.txt");
+    system("rm -rf stasis_log/");
+
+    bLSM::init_stasis();
+    int xid = Tbegin();
+
+    bLSM * ltable = new bLSM(0, 10 * 1024 * 1024, 1000, 10000, 5, 10 * 1024 * 1024);
+    mergeScheduler mscheduler(ltable);
+    ltable->allocTable(xid);
+    Tcommit(xid);
+    mscheduler.start();
+
+    std::vector<std::string> key_arr;
+    preprandstr(NUM_ENTRIES, key_arr, 50, true);
+    std::sort(key_arr.begin(), key_arr.end(), &mycmp);
+    removeduplicates(key_arr);
+    NUM_ENTRIES = key_arr.size();
+
+    // Probe every key before it exists so that the cache holds negative entries.
+    for(size_t i = 0; i < NUM_ENTRIES; i++) {
+        assert(!ltable->findTuple(-1, (dataTuple::key_t)key_arr[i].c_str(), key_arr[i].length()+1));
+    }
+    for(size_t i = 0; i < NUM_ENTRIES; i++) {
+        dataTuple * t = dataTuple::create(key_arr[i].c_str(), key_arr[i].length()+1, key_arr[i].c_str(), key_arr[i].length()+1);
+        ltable->insertTuple(t);
+        dataTuple::freetuple(t);
+    }
+    // Repeatedly read and overwrite a few keys; every read must see the latest write.
+    for(int round = 0; round < 10; round++) {
+        for(size_t i = 0; i < NUM_ENTRIES; i += 10) {
+            const std::string & k = key_arr[i];
+            dataTuple * t;
+            for(int j = 0; j < 2; j++) { // the second read should be a cache hit
+                t = ltable->findTuple(-1, (dataTuple::key_t)k.c_str(), k.length()+1);
+                assert(t);
+                assert(round == 0 || (t->datalen() == sizeof(round) && *(int*)t->data() == round - 1));
+                dataTuple::freetuple(t);
+            }
+            t = dataTuple::create(k.c_str(), k.length()+1, &round, sizeof(round));
+            ltable->insertTuple(t);
+            dataTuple::freetuple(t);
+        }
+    }
+    // Deletes must be visible too.
+    for(size_t i = 0; i < NUM_ENTRIES; i += 10) {
+        dataTuple * t = dataTuple::create(key_arr[i].c_str(), key_arr[i].length()+1);
+        ltable->insertTuple(t);
+        dataTuple::freetuple(t);
+        assert(!ltable->findTuple_first(-1, (dataTuple::key_t)key_arr[i].c_str(), key_arr[i].length()+1));
+    }
+
+    rowCache::stats_t s;
+    ltable->get_row_cache()->get_stats(&s);
+    printf("row cache: %lld hits %lld misses %lld invalidations\n", (long long)s.hits, (long long)s.misses, (long long)s.invalidations);
+    assert(s.hits > 0);
+
+    mscheduler.shutdown();
+    delete ltable;
+    bLSM::deinit_stasis();
+
+    printf("\npass\n");
+}
+
+/** @test
+ */
+int main()
+{
+    checkCache();
+    insertProbe(25000);
+    return 0;
+}
@@ -0,0 +1,281 @@
+/*
+ * check_scanfilter.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <string>
+#include <vector>
+#include <assert.h>
+#include <stdio.h>
+
+#include "dataTuple.h"
+#include "../servers/native/scanFilter.h"
+
+// Values are a four byte tag, then a little-endian int16_t and a uint32_t.
+static dataTuple * make_tuple(const char * key, const char * tag, int16_t a, uint32_t b) {
+    byte val[10];
+    memcpy(val, tag, 4);
+    for(int i = 0; i < 2; i++) { val[4 + i] = ((uint16_t)a >> (8 * i)) & 0xff; }
+    for(int i = 0; i < 4; i++) { val[6 + i] = (b >> (8 * i)) & 0xff; }
+    return dataTuple::create(key, strlen(key) + 1, val, sizeof(val));
+}
+
+/** Send f through scan_filter_request() and scan_filter_parse(), like a request would. */
+static dataTuple * round_trip(const scan_filter * f, scan_filter * parsed) {
+    dataTuple * req = scan_filter_request(f, NULL);
+    assert(scan_filter_parse(req->data(), req->datalen(), parsed));
+    return req;
+}
+
+void checkParse()
+{
+    scan_filter f;
+    scan_filter_init(&f);
+    f.h.value_cmp = SCAN_CMP_EQ;
+    f.h.prefix_len = 4;
+    f.prefix = (const byte*)"user";
+    f.h.cmp_offset = 0;
+    f.h.cmp_len = 4;
+    f.operand = (const byte*)"gold";
+
+    scan_filter p;
+    dataTuple * req = round_trip(&f, &p);
+    assert(!memcmp(&p.h, &f.h, sizeof(f.h)));
+    assert(!memcmp(p.prefix, "user", 4) && !memcmp(p.operand, "gold", 4));
+
+    // Truncated and overlong descriptors are rejected.
+    assert(!scan_filter_parse(req->data(), req->datalen() - 1, &p));
+    std::string longer((const char*)req->data(), req->datalen());
+    longer += 'x';
+    assert(!scan_filter_parse((const byte*)longer.data(), longer.size(), &p));
+    assert(!scan_filter_parse(req->data(), sizeof(scan_filter_header) - 1, &p));
+    dataTuple::freetuple(req);
+
+    // So are fields that are out of range.
+    scan_filter bad = f;
+    bad.h.version = SCAN_FILTER_VERSION + 1;
+    req = scan_filter_request(&bad, NULL);
+    assert(!scan_filter_parse(req->data(), req->datalen(), &p));
+    dataTuple::freetuple(req);
+    bad = f;
+    bad.h.value_cmp = SCAN_CMP_GE + 1;
+    req = scan_filter_request(&bad, NULL);
+    assert(!scan_filter_parse(req->data(), req->datalen(), &p));
+    dataTuple::freetuple(req);
+    bad = f;
+    bad.h.projection = SCAN_PROJECT_VALUE_RANGE + 1;
+    req = scan_filter_request(&bad, NULL);
+    assert(!scan_filter_parse(req->data(), req->datalen(), &p));
+    dataTuple::freetuple(req);
+    bad = f;
+    bad.h.agg_width = 3;
+    req = scan_filter_request(&bad, NULL);
+    assert(!scan_filter_parse(req->data(), req->datalen(), &p));
+    dataTuple::freetuple(req);
+
+    // The request's key is the scan's first key.
+    dataTuple * start = dataTuple::create("user42", 7);
+    req = scan_filter_request(&f, start);
+    assert(!dataTuple::compare_obj(req, start));
+    assert(scan_filter_parse(req->data(), req->datalen(), &p));
+    dataTuple::freetuple(req);
+    dataTuple::freetuple(start);
+    printf("Descriptors round trip, and malformed ones are rejected\n");
+}
+
+void checkPredicates()
+{
+    dataTuple * gold   = make_tuple("user1", "gold", 0, 0);
+    dataTuple * iron   = make_tuple("user2", "iron", 0, 0);
+    dataTuple * silver = make_tuple("user3", "slvr", 0, 0);
+    dataTuple * other  = make_tuple("item1", "gold", 0, 0);
+    dataTuple * shorty = dataTuple::create("user4", 6, "go", 2);
+
+    scan_filter f;
+    scan_filter_init(&f);
+    f.h.prefix_len = 4;
+    f.prefix = (const byte*)"user";
+
+    // A prefix alone.
+    scan_filter p;
+    dataTuple * req = round_trip(&f, &p);
+    assert(scan_filter_matches(&p, gold) && scan_filter_matches(&p, shorty));
+    assert(!scan_filter_matches(&p, other));
+    dataTuple::freetuple(req);
+
+    // Each comparison, against "iron".  Values that are too short never match.
+    f.h.cmp_len = 4;
+    f.operand = (const byte*)"iron";
+    struct { uint8_t cmp; bool gold, iron, silver; } cases[] = {
+        { SCAN_CMP_EQ, false, true,  false },
+        { SCAN_CMP_NE, true,  false, true  },
+        { SCAN_CMP_LT, true,  false, false },
+        { SCAN_CMP_LE, true,  true,  false },
+        { SCAN_CMP_GT, false, false, true  },
+        { SCAN_CMP_GE, false, true,  true  },
+    };
+    for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        f.h.value_cmp = cases[i].cmp;
+        req = round_trip(&f, &p);
+        assert(scan_filter_matches(&p, gold)   == cases[i].gold);
+        assert(scan_filter_matches(&p, iron)   == cases[i].iron);
+        assert(scan_filter_matches(&p, silver) == cases[i].silver);
+        assert(!scan_filter_matches(&p, shorty));
+        assert(!scan_filter_matches(&p, other));
+        dataTuple::freetuple(req);
+    }
+
+    // A field at an offset: the uint32_t's low byte.
+    dataTuple * seven = make_tuple("user5", "gold", 0, 7);
+    byte seven_byte = 7;
+    f.h.value_cmp = SCAN_CMP_EQ;
+    f.h.cmp_offset = 6;
+    f.h.cmp_len = 1;
+    f.operand = &seven_byte;
+    req = round_trip(&f, &p);
+    assert(scan_filter_matches(&p, seven) && !scan_filter_matches(&p, gold));
+    dataTuple::freetuple(req);
+    printf("Prefixes and value comparisons match as expected\n");
+
+    dataTuple::freetuple(seven);
+    dataTuple::freetuple(gold);
+    dataTuple::freetuple(iron);
+    dataTuple::freetuple(silver);
+    dataTuple::freetuple(other);
+    dataTuple::freetuple(shorty);
+}
+
+void checkProjection()
+{
+    dataTuple * t = make_tuple("user1", "gold", 5, 6);
+    scan_filter f;
+    scan_filter_init(&f);
+
+    // Whole tuples are sent as they are.
+    assert(!scan_filter_project(&f, t));
+
+    f.h.projection = SCAN_PROJECT_KEY;
+    dataTuple * k = scan_filter_project(&f, t);
+    assert(!dataTuple::compare_obj(k, t) && k->datalen() == 0 && !k->isDelete());
+    dataTuple::freetuple(k);
+
+    // Value ranges are clipped to the value.
+    f.h.projection = SCAN_PROJECT_VALUE_RANGE;
+    struct { uint32_t off, len; size_t expect_off, expect_len; } cases[] = {
+        { 0,  4,  0,  4 },   // the tag
+        { 6,  4,  6,  4 },   // the uint32_t
+        { 8,  10, 8,  2 },   // runs past the end
+        { 10, 4,  10, 0 },   // starts at the end
+        { 50, 4,  10, 0 },   // starts past the end
+    };
+    for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        f.h.project_offset = cases[i].off;
+        f.h.project_len = cases[i].len;
+        dataTuple * r = scan_filter_project(&f, t);
+        assert(!dataTuple::compare_obj(r, t));
+        assert(r->datalen() == cases[i].expect_len);
+        assert(!memcmp(r->data(), t->data() + cases[i].expect_off, cases[i].expect_len));
+        dataTuple::freetuple(r);
+    }
+    dataTuple::freetuple(t);
+    printf("Projections return the requested parts of each tuple\n");
+}
+
+void checkAggregates()
+{
+    std::vector<dataTuple*> tuples;
+    const int16_t as[] = { 5, -3, 1000, -32768, 32767 };
+    const uint32_t bs[] = { 1, 4000000000u, 7, 0, 12 };
+    const int n = sizeof(as) / sizeof(as[0]);
+    for(int i = 0; i < n; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "user%d", i);
+        tuples.push_back(make_tuple(key, "gold", as[i], bs[i]));
+    }
+    // Too short to hold either field.
+    tuples.push_back(dataTuple::create("user9", 6, "gold", 4));
+
+    scan_filter f;
+    scan_filter_init(&f);
+    f.h.aggregate = SCAN_AGGREGATE;
+
+    // The int16_t, signed: sign extended, with signed min and max.
+    f.h.agg_offset = 4;
+    f.h.agg_width = 2;
+    f.h.agg_signed = 1;
+    scan_filter p;
+    dataTuple * req = round_trip(&f, &p);
+    scan_aggregate a;
+    scan_aggregate_init(&a);
+    for(size_t i = 0; i < tuples.size(); i++) { scan_aggregate_add(&p, &a, tuples[i]); }
+    assert(a.rows == (uint64_t)n + 1 && a.values == (uint64_t)n);
+    assert((int64_t)a.sum == 5 - 3 + 1000 - 32768 + 32767);
+    assert((int64_t)a.min == -32768 && (int64_t)a.max == 32767);
+    dataTuple::freetuple(req);
+
+    // The same bytes, unsigned.
+    f.h.agg_signed = 0;
+    req = round_trip(&f, &p);
+    scan_aggregate_init(&a);
+    for(size_t i = 0; i < tuples.size(); i++) { scan_aggregate_add(&p, &a, tuples[i]); }
+    assert(a.values == (uint64_t)n);
+    assert(a.sum == 5u + 65533u + 1000u + 32768u + 32767u);
+    assert(a.min == 5 && a.max == 65533);
+    dataTuple::freetuple(req);
+
+    // The uint32_t, whose sum doesn't fit in 32 bits.
+    f.h.agg_offset = 6;
+    f.h.agg_width = 4;
+    req = round_trip(&f, &p);
+    scan_aggregate_init(&a);
+    for(size_t i = 0; i < tuples.size(); i++) { scan_aggregate_add(&p, &a, tuples[i]); }
+    assert(a.sum == 1ull + 4000000000ull + 7 + 0 + 12);
+    assert(a.min == 0 && a.max == 4000000000ull);
+    dataTuple::freetuple(req);
+
+    // Single bytes, and an eight byte field that no tuple is long enough for.
+    f.h.agg_offset = 0;
+    f.h.agg_width = 1;
+    req = round_trip(&f, &p);
+    scan_aggregate_init(&a);
+    for(size_t i = 0; i < tuples.size(); i++) { scan_aggregate_add(&p, &a, tuples[i]); }
+    assert(a.values == (uint64_t)n + 1 && a.sum == 'g' * ((uint64_t)n + 1));
+    dataTuple::freetuple(req);
+    f.h.agg_offset = 4;
+    f.h.agg_width = 8;
+    req = round_trip(&f, &p);
+    scan_aggregate_init(&a);
+    for(size_t i = 0; i < tuples.size(); i++) { scan_aggregate_add(&p, &a, tuples[i]); }
+    assert(a.rows == (uint64_t)n + 1 && a.values == 0 && a.sum == 0);
+    dataTuple::freetuple(req);
+    printf("Aggregates count, sum and bound each field width\n");
+
+    for(size_t i = 0; i < tuples.size(); i++) {
+        dataTuple::freetuple(tuples[i]);
+    }
+}
+
+/** @test
+ */
+int main()
+{
+    checkParse();
+    checkPredicates();
+    checkProjection();
+    checkAggregates();
+    printf("\npass\n");
+    return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * check_scanstream.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <string>
+#include <vector>
+#include "bLSM.h"
+#include <assert.h>
+#include <stdio.h>
+
+#include "check_table.h"
+#include "check_server.h"
+
+static const int NUM_KEYS = 2500;
+static const int NUM_BIG = 8;
+static const size_t BIG_VALUE = 300 * 1024;
+
+static dataTuple * make_key(const char * prefix, int i) {
+    char key[32];
+    return dataTuple::create(key, snprintf(key, sizeof(key), "%s%06d", prefix, i) + 1);
+}
+static dataTuple * make_bound(const char * bound) {
+    return dataTuple::create(bound, strlen(bound) + 1);
+}
+
+static void start_scan(int sockd, dataTuple * start, dataTuple * end, uint64_t credit) {
+    assert(!writeoptosocket(sockd, OP_SCAN_STREAM));
+    assert(!writetupletosocket(sockd, start));
+    assert(!writetupletosocket(sockd, end));
+    assert(!writecounttosocket(sockd, credit));
+    assert(readopfromsocket(sockd, LOGSTORE_SERVER_RESPONSE) == LOGSTORE_RESPONSE_SENDING_TUPLES);
+}
+/**
+ * Read a batch into tuples.
+ *
+ * @return the continuation token, or NULL if the scan is complete.
+ */
+static dataTuple * read_batch(int sockd, std::vector<dataTuple*> * tuples) {
+    int err;
+    uint64_t n = readcountfromsocket(sockd, &err);
+    assert(!err);
+    for(uint64_t i = 0; i < n; i++) {
+        dataTuple * t = readtuplefromsocket(sockd, &err);
+        assert(t && !err);
+        tuples->push_back(t);
+    }
+    dataTuple * token = readtuplefromsocket(sockd, &err);
+    assert(!err);
+    return token;
+}
+static void free_tuples(std::vector<dataTuple*> * tuples) {
+    for(size_t i = 0; i < tuples->size(); i++) {
+        dataTuple::freetuple((*tuples)[i]);
+    }
+    tuples->clear();
+}
+
+void checkScanStream()
+{
+    checkTable table;
+    bLSM * ltable = table.ltable;
+    table.start();
+
+    // Half of the keys on disk, and half in C0, so the scans merge components.
+    for(int i = 0; i < NUM_KEYS; i++) {
+        if(i == NUM_KEYS / 2) { table.flush(); }
+        dataTuple * k = make_key("key-", i);
+        dataTuple * t = dataTuple::create(k->rawkey(), k->rawkeylen(), &i, sizeof(i));
+        ltable->insertTuple(t);
+        dataTuple::freetuple(t);
+        dataTuple::freetuple(k);
+    }
+    std::string big(BIG_VALUE, 'b');
+    for(int i = 0; i < NUM_BIG; i++) {
+        dataTuple * k = make_key("big-", i);
+        dataTuple * t = dataTuple::create(k->rawkey(), k->rawkeylen(), big.c_str(), big.size());
+        ltable->insertTuple(t);
+        dataTuple::freetuple(t);
+        dataTuple::freetuple(k);
+    }
+
+    checkServer server(ltable);
+    int sockd = server.client;
+    dataTuple * lo = make_bound("key-");
+    dataTuple * hi = make_bound("key.");
+
+    // Stage 1: a scan with a different credit for every batch.  Batches
+    // never exceed their credit, and (with small tuples) are never cut short.
+    const uint64_t credits[] = { 100, 1, 7, 50, 500, 333 };
+    const size_t num_credits = sizeof(credits) / sizeof(credits[0]);
+    std::vector<dataTuple*> batch;
+    int next = 0;
+    uint64_t credit = credits[0];
+    start_scan(sockd, lo, hi, credit);
+    for(size_t b = 1; ; b++) {
+        dataTuple * token = read_batch(sockd, &batch);
+        assert(batch.size() <= credit);
+        for(size_t j = 0; j < batch.size(); j++) {
+            assert(*(int*)batch[j]->data() == next);
+            next++;
+        }
+        if(!token) { break; }
+        assert(batch.size() == credit);
+        // The token sorts after everything we've seen, and no later than the next key.
+        if(!batch.empty()) { assert(dataTuple::compare_obj(batch.back(), token) < 0); }
+        if(next < NUM_KEYS) {
+            dataTuple * k = make_key("key-", next);
+            assert(dataTuple::compare_obj(token, k) <= 0);
+            dataTuple::freetuple(k);
+        }
+        dataTuple::freetuple(token);
+        free_tuples(&batch);
+        credit = credits[b % num_credits];
+        assert(!writecounttosocket(sockd, credit));
+    }
+    free_tuples(&batch);
+    assert(next == NUM_KEYS);
+    printf("Stage 1: credit-controlled batches returned every key in order\n");
+
+    // Stage 2: an initial credit of zero sends an empty batch, whose token
+    // is the first key.  Then cancel the scan partway through, and resume
+    // it from the token on a new request.
+    start_scan(sockd, lo, hi, 0);
+    dataTuple * token = read_batch(sockd, &batch);
+    assert(token && batch.empty());
+    assert(dataTuple::compare_obj(token, lo) <= 0);
+    dataTuple::freetuple(token);
+    assert(!writecounttosocket(sockd, 10));
+    token = read_batch(sockd, &batch);
+    assert(token && batch.size() == 10);
+    assert(*(int*)batch[9]->data() == 9);
+    free_tuples(&batch);
+    assert(!writecounttosocket(sockd, 0));
+
+    // The connection is ready for another request right away.
+    start_scan(sockd, token, hi, NUM_KEYS);
+    dataTuple::freetuple(token);
+    token = read_batch(sockd, &batch);
+    assert(!token);
+    assert(batch.size() == (size_t)(NUM_KEYS - 10));
+    assert(*(int*)batch[0]->data() == 10);
+    free_tuples(&batch);
+    printf("Stage 2: cancelled scan resumed from its token\n");
+
+    // Stage 3: batches of big tuples are cut short, whatever the credit.
+    dataTuple * big_lo = make_bound("big-");
+    dataTuple * big_hi = make_bound("big.");
+    start_scan(sockd, big_lo, big_hi, 100);
+    int seen = 0;
+    while(true) {
+        token = read_batch(sockd, &batch);
+        assert(batch.size() < (size_t)NUM_BIG);
+        assert(batch.size() * BIG_VALUE <= requestDispatch<int>::SCAN_BATCH_BYTES + BIG_VALUE);
+        seen += batch.size();
+        free_tuples(&batch);
+        if(!token) { break; }
+        dataTuple::freetuple(token);
+        assert(!writecounttosocket(sockd, 100));
+    }
+    assert(seen == NUM_BIG);
+    printf("Stage 3: batches were cut short at %lld bytes\n", (long long)requestDispatch<int>::SCAN_BATCH_BYTES);
+
+    dataTuple::freetuple(big_lo);
+    dataTuple::freetuple(big_hi);
+    dataTuple::freetuple(lo);
+    dataTuple::freetuple(hi);
+}
+
+/** @test
+ */
+int main()
+{
+    checkScanStream();
+    printf("\npass\n");
+    return 0;
+}
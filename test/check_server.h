@@ -0,0 +1,65 @@
+/*
+ * check_server.h
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef CHECK_SERVER_H_
+#define CHECK_SERVER_H_
+
+#include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "bLSM.h"
+#include "../servers/native/network.h"
+#include "../servers/native/requestDispatch.h"
+
+/**
+ * One native protocol connection to a bLSM instance, served by
+ * requestDispatch on a thread of its own, over a socketpair.  Checks talk
+ * to the server through client; the destructor closes it, and waits for
+ * the server to notice.
+ */
+class checkServer {
+public:
+    checkServer(bLSM * ltable) : ltable_(ltable) {
+        int sv[2];
+        assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+        client = sv[0];
+        server_ = sv[1];
+        pthread_create(&thread_, 0, serve, this);
+    }
+    ~checkServer() {
+        close(client);
+        pthread_join(thread_, 0);
+    }
+
+    int client;
+
+private:
+    static void * serve(void * arg) {
+        checkServer * s = (checkServer*)arg;
+        while(!requestDispatch<int>::dispatch_request(s->server_, s->ltable_)) { }
+        close(s->server_);
+        return 0;
+    }
+
+    bLSM * ltable_;
+    int server_;
+    pthread_t thread_;
+};
+
+#endif /* CHECK_SERVER_H_ */
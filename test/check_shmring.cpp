@@ -0,0 +1,98 @@
+/*
+ * check_shmring.cpp
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../servers/native/shmRing.h"
+
+static const uint64_t RING_BYTES = SHM_MIN_RING_BYTES;
+
+// Nothing here waits for the other side, so the rings' socket is never used.
+static const int NO_SOCKET = -1;
+
+static void send_record(shm_ring_view * r, size_t len, byte fill) {
+    int err = 0;
+    byte * dst = shm_ring_reserve(r, len, NO_SOCKET, &err);
+    assert(dst && !err);
+    memset(dst, fill, len);
+    shm_ring_publish(r, len, 0);
+}
+/** Overwrite the length in the header of the next record to be read. */
+static void corrupt_length(shm_ring_view * r, uint64_t len) {
+    memcpy(r->data + (r->ctl->tail & (r->size - 1)), &len, sizeof(len));
+}
+
+void checkRing()
+{
+    byte * seg = (byte*) calloc(1, shm_segment_size(RING_BYTES));
+    shm_ring_view requests, responses;
+    shm_ring_views(seg, RING_BYTES, &requests, &responses);
+
+    // Records of every size go around the ring several times, and come
+    // back intact.
+    size_t max = shm_max_body(&requests);
+    for(size_t i = 0; i < 50; i++) {
+        size_t len = (i * 97) % (max + 1);
+        send_record(&requests, len, (byte)i);
+        size_t body;
+        uint64_t flags;
+        int err = 0;
+        byte * rec = shm_ring_peek(&requests, &body, &flags, NO_SOCKET, &err);
+        assert(rec && !err && body == len && !flags);
+        for(size_t j = 0; j < len; j++) { assert(rec[j] == (byte)i); }
+        shm_ring_release(&requests, body);
+    }
+    printf("Records went around the ring intact\n");
+
+    // A length that runs past the end of the ring, or past the part of it
+    // that was published, is rejected.
+    uint64_t bad[] = { max + 1, RING_BYTES, (uint64_t)-1, 64 };
+    for(size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        send_record(&requests, 8, 'x');
+        corrupt_length(&requests, bad[i]);
+        size_t body;
+        uint64_t flags;
+        int err = 0;
+        assert(!shm_ring_peek(&requests, &body, &flags, NO_SOCKET, &err));
+        assert(err == LOGSTORE_PROTOCOL_ERROR);
+        // Throw away the bad record.
+        requests.ctl->tail = requests.ctl->head;
+    }
+    // So is a head that claims more than a ring's worth of records.
+    send_record(&requests, 8, 'x');
+    requests.ctl->head += RING_BYTES;
+    size_t body;
+    uint64_t flags;
+    int err = 0;
+    assert(!shm_ring_peek(&requests, &body, &flags, NO_SOCKET, &err));
+    assert(err == LOGSTORE_PROTOCOL_ERROR);
+    printf("Records that don't fit in the ring were rejected\n");
+
+    free(seg);
+}
+
+/** @test
+ */
+int main()
+{
+    checkRing();
+    printf("\npass\n");
+    return 0;
+}
@@ -0,0 +1,72 @@
+/*
+ * check_table.h
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef CHECK_TABLE_H_
+#define CHECK_TABLE_H_
+
+#include <stdlib.h>
+#include <unistd.h>
+#include "bLSM.h"
+#include "mergeScheduler.h"
+
+#include <stasis/transactional.h>
+#undef begin
+#undef end
+
+/**
+ * A bLSM instance with a 10MB C0, in a new store in the current directory.
+ *
+ * Configure ltable (prefix extractor, range filters, ...), then call
+ * start() to allocate the table and start the merge threads.  The
+ * destructor stops them and shuts stasis down.
+ */
+class checkTable {
+public:
+    checkTable(int log_mode = 0) : mscheduler(NULL) {
+        unlink("storefile.txt");
+        unlink("logfile.txt");
+        system("rm -rf stasis_log/");
+
+        bLSM::init_stasis();
+        ltable = new bLSM(log_mode, 10 * 1024 * 1024, 1000, 10000, 5);
+    }
+    ~checkTable() {
+        if(mscheduler) {
+            mscheduler->shutdown();
+            delete mscheduler;
+        }
+        delete ltable;
+        bLSM::deinit_stasis();
+    }
+    void start() {
+        int xid = Tbegin();
+        mscheduler = new mergeScheduler(ltable);
+        ltable->allocTable(xid);
+        Tcommit(xid);
+        mscheduler->start();
+    }
+    /** Merge everything in C0 into C1, and wait until it is there. */
+    void flush() {
+        ltable->flushTableAndWait();
+    }
+
+    bLSM * ltable;
+    mergeScheduler * mscheduler;
+};
+
+#endif /* CHECK_TABLE_H_ */
@@ -33,6 +33,7 @@
 #include <sys/types.h>
 
 #include "../servers/native/tcpclient.h"
+#include "../servers/native/asyncclient.h"
 #include "../servers/native/network.h"
 
 #include "check_util.h"
@@ -46,6 +47,10 @@
 static const char * svrname = "localhost";
 static int svrport = 32432;
 
+static void put_done(void * arg, network_op_t rcode, dataTuple ** tuples, size_t tuple_count) {
+    assert(rcode == LOGSTORE_RESPONSE_SUCCESS);
+}
+
 void insertProbeIter(size_t NUM_ENTRIES)
 {
     srand(1000);
@@ -131,9 +136,9 @@ void insertProbeIter(size_t NUM_ENTRIES)
     std::vector<int> del_list;
     gettimeofday(&start_tv,0);
 
-    // open a bulk insert stream
-    network_op_t  ret = logstore_client_op_returns_many(l, OP_BULK_INSERT);
-    assert(ret == LOGSTORE_RESPONSE_RECEIVING_TUPLES);
+    // The async client batches concurrent puts into bulk insert streams.
+    asyncClient * async = new asyncClient(svrname, svrport);
+    assert(async->ok());
 
     for(size_t i = 0; i < NUM_ENTRIES; i++)
     {
@@ -153,8 +158,7 @@ void insertProbeIter(size_t NUM_ENTRIES)
         gettimeofday(&ti_st,0);
 
         //send the data
-        ret = logstore_client_send_tuple(l, newtuple);
-        assert(ret == LOGSTORE_RESPONSE_SUCCESS);
+        async->put(newtuple, put_done);
 
         gettimeofday(&ti_end,0);
         insert_time += tv_to_double(ti_end) - tv_to_double(ti_st);
@@ -165,8 +169,7 @@ void insertProbeIter(size_t NUM_ENTRIES)
             printf("%llu / %llu inserted.\n", (unsigned long long)i, (unsigned long long)NUM_ENTRIES);
 
     }
-    ret = logstore_client_send_tuple(l, NULL); // NULL -> end of stream.
-    assert(ret == LOGSTORE_RESPONSE_SUCCESS);
+    delete async; // waits for the outstanding puts.
     gettimeofday(&stop_tv,0);
     printf("insert time: %6.1f\n", insert_time);
     printf("insert time: %6.1f\n", (tv_to_double(stop_tv) - tv_to_double(start_tv)));
@@ -207,7 +210,7 @@ void insertProbeIter(size_t NUM_ENTRIES)
 
     printf("Stage 3: Initiating scan\n");
 
-    ret = logstore_client_op_returns_many(l, OP_SCAN, NULL, NULL, 0); // start = NULL stop = NULL limit = NONE
+    network_op_t ret = logstore_client_op_returns_many(l, OP_SCAN, NULL, NULL, 0); // start = NULL stop = NULL limit = NONE
     assert(ret == LOGSTORE_RESPONSE_SENDING_TUPLES);
     dataTuple * tup;
     size_t i = 0;
@@ -0,0 +1,114 @@
+/*
+ * threadSlots.h
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef THREADSLOTS_H_
+#define THREADSLOTS_H_
+
+#include <pthread.h>
+#include <vector>
+
+/**
+ * One T per thread, created on the thread's first call to get(), for
+ * statistics that each thread updates without taking a lock, and that
+ * readers walk (under lock()) on demand.
+ *
+ * When a thread exits, the retire callback is called with the lock held, so
+ * that the owner can fold the slot into its totals; then the slot is
+ * deleted.  The owner may use the same lock to protect those totals.
+ * Slots of threads that are still running when the threadSlots is destroyed
+ * are deleted without being retired.
+ */
+template<class T>
+class threadSlots {
+public:
+  /** Called with the lock held. */
+  typedef void (*slot_fn)(void * arg, T * slot);
+
+  /**
+   * @param registered If non-NULL, called when a thread's slot is created,
+   * before the thread uses it.
+   */
+  threadSlots(void * arg, slot_fn retire, slot_fn registered = NULL) :
+    arg_(arg), retire_(retire), registered_(registered) {
+    pthread_key_create(&key_, thread_exit);
+    pthread_mutex_init(&mut_, 0);
+  }
+  ~threadSlots() {
+    // Threads that are still running won't call thread_exit once the key is gone.
+    pthread_key_delete(key_);
+    for(size_t i = 0; i < slots_.size(); i++) {
+      delete slots_[i];
+    }
+    pthread_mutex_destroy(&mut_);
+  }
+
+  T * get() {
+    node * n = (node*)pthread_getspecific(key_);
+    return n ? &n->slot : register_thread();
+  }
+
+  void lock() { pthread_mutex_lock(&mut_); }
+  void unlock() { pthread_mutex_unlock(&mut_); }
+  /** For pthread_cond_wait() and friends. */
+  pthread_mutex_t * mutex() { return &mut_; }
+
+  /** The slots of the threads that are running.  The caller holds the lock. */
+  size_t size() const { return slots_.size(); }
+  T * operator[](size_t i) { return &slots_[i]->slot; }
+
+private:
+  struct node {
+    threadSlots * owner;
+    T slot;
+  };
+
+  T * register_thread() {
+    node * n = new node;
+    n->owner = this;
+    lock();
+    if(registered_) { registered_(arg_, &n->slot); }
+    slots_.push_back(n);
+    unlock();
+    pthread_setspecific(key_, n);
+    return &n->slot;
+  }
+  static void thread_exit(void * arg) {
+    node * n = (node*)arg;
+    threadSlots * s = n->owner;
+    s->lock();
+    s->retire_(s->arg_, &n->slot);
+    for(size_t i = 0; i < s->slots_.size(); i++) {
+      if(s->slots_[i] == n) {
+        s->slots_[i] = s->slots_.back();
+        s->slots_.pop_back();
+        break;
+      }
+    }
+    s->unlock();
+    delete n;
+  }
+
+  void * arg_;
+  slot_fn retire_;
+  slot_fn registered_;
+  pthread_key_t key_;
+  pthread_mutex_t mut_;
+  std::vector<node*> slots_;
+};
+
+#endif /* THREADSLOTS_H_ */
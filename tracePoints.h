@@ -0,0 +1,65 @@
+/*
+ * tracePoints.h
+ *
+ * Copyright 2012 Yahoo! Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef TRACEPOINTS_H_
+#define TRACEPOINTS_H_
+
+/*
+  Static (USDT) tracepoints for perf, bpftrace and SystemTap, e.g.:
+
+    bpftrace -e 'usdt:./newserver:blsm:backpressure_done { @[arg0] = hist(arg1); }'
+
+  When the build finds <sys/sdt.h>, each tracepoint compiles to a single nop
+  plus a note in the ELF file that tracers use to find it.  Otherwise, they
+  compile to nothing.  Arguments are evaluated either way, so keep them cheap.
+
+  The provider is "blsm".  Probes, and their arguments:
+
+    insert_start         (key, keylen)
+    insert_done          (key, keylen)
+    insert_many_start    (tuple_count)
+    insert_many_done     (tuple_count)
+    log_force_start      ()
+    log_force_done       ()
+    find_start           (key, keylen)
+    find_component       (readStats::component_t, hit, datapages_read)
+    find_done            (found)
+    datapage_load        (pageid)
+    backpressure_start   (merge_level)
+    backpressure_done    (merge_level, nanoseconds)
+    merge_start          (merge_level)
+    merge_handoff        (merge_level, bytes)
+    merge_done           (merge_level, bytes written)
+    dispatch_start       (opcode)
+    dispatch_done        (opcode, error)
+ */
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define BLSM_TRACE0(name)                DTRACE_PROBE(blsm, name)
+#define BLSM_TRACE1(name, a)             DTRACE_PROBE1(blsm, name, a)
+#define BLSM_TRACE2(name, a, b)          DTRACE_PROBE2(blsm, name, a, b)
+#define BLSM_TRACE3(name, a, b, c)       DTRACE_PROBE3(blsm, name, a, b, c)
+#else
+#define BLSM_TRACE0(name)                do { } while(0)
+#define BLSM_TRACE1(name, a)             do { (void)(a); } while(0)
+#define BLSM_TRACE2(name, a, b)          do { (void)(a); (void)(b); } while(0)
+#define BLSM_TRACE3(name, a, b, c)       do { (void)(a); (void)(b); (void)(c); } while(0)
+#endif
+
+#endif /* TRACEPOINTS_H_ */